@@ -0,0 +1,295 @@
+#include "ClientSocket.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+namespace cli_test {
+
+    ClientSocket::~ClientSocket() {
+        close();
+    }
+
+    bool ClientSocket::resolve(const std::string& host, uint16_t port, sockaddr_in& out) {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result) {
+            return false;
+        }
+        out = *reinterpret_cast<sockaddr_in*>(result->ai_addr);
+        out.sin_port = htons(port);
+        freeaddrinfo(result);
+        return true;
+    }
+
+    bool ClientSocket::connect(const sockaddr_in& addr, bool blocking) {
+        close();
+        fd_ = ::socket(AF_INET, SOCK_STREAM | (blocking ? 0 : SOCK_NONBLOCK) | SOCK_CLOEXEC, 0);
+        if (fd_ < 0) {
+            return false;
+        }
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (::connect(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0) {
+            return true;
+        }
+        if (!blocking && errno == EINPROGRESS) {
+            return true;
+        }
+        close();
+        return false;
+    }
+
+    bool ClientSocket::finishConnect() {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        return getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0;
+    }
+
+    void ClientSocket::close() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        out_.clear();
+        outOffset_ = 0;
+        in_.clear();
+        inOffset_ = 0;
+        handshakeDone_ = false;
+        handshakeFailed_ = false;
+        fragments_.clear();
+    }
+
+    bool ClientSocket::httpRequest(const std::string& method, const std::string& path, const std::string& body,
+                                   const std::string& token, const std::string& host, HttpResponse& out) {
+        std::string request;
+        request.reserve(256 + body.size());
+        request.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+        request.append("Host: ").append(host).append("\r\n");
+        request.append("Connection: keep-alive\r\n");
+        if (!token.empty()) {
+            request.append("Authorization: Bearer ").append(token).append("\r\n");
+        }
+        if (!body.empty()) {
+            request.append("Content-Type: application/json\r\n");
+        }
+        request.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n\r\n");
+        request.append(body);
+
+        size_t sent = 0;
+        while (sent < request.size()) {
+            auto n = ::send(fd_, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        return readHttpResponse(out);
+    }
+
+    bool ClientSocket::readHttpResponse(HttpResponse& out) {
+        char buf[16384];
+        size_t headerEnd;
+        while ((headerEnd = in_.find("\r\n\r\n")) == std::string::npos) {
+            auto n = ::recv(fd_, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            in_.append(buf, static_cast<size_t>(n));
+        }
+
+        std::string_view headers(in_.data(), headerEnd);
+        auto space = headers.find(' ');
+        if (space == std::string_view::npos) {
+            return false;
+        }
+        out.status = std::atoi(in_.c_str() + space + 1);
+
+        size_t contentLength = 0;
+        bool closeAfter = false;
+        size_t lineStart = headers.find("\r\n");
+        while (lineStart != std::string_view::npos && lineStart < headers.size()) {
+            lineStart += 2;
+            auto lineEnd = headers.find("\r\n", lineStart);
+            auto line = headers.substr(lineStart, lineEnd == std::string_view::npos ? std::string_view::npos
+                                                                                     : lineEnd - lineStart);
+            if (line.size() > 15 && strncasecmp(line.data(), "content-length:", 15) == 0) {
+                contentLength = std::strtoull(std::string(line.substr(15)).c_str(), nullptr, 10);
+            } else if (line.size() > 11 && strncasecmp(line.data(), "connection:", 11) == 0 &&
+                       line.find("close") != std::string_view::npos) {
+                closeAfter = true;
+            }
+            lineStart = lineEnd;
+        }
+
+        size_t total = headerEnd + 4 + contentLength;
+        while (in_.size() < total) {
+            auto n = ::recv(fd_, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            in_.append(buf, static_cast<size_t>(n));
+        }
+        out.body.assign(in_, headerEnd + 4, contentLength);
+        in_.erase(0, total);
+
+        if (closeAfter) {
+            close();
+        }
+        return true;
+    }
+
+    void ClientSocket::queueHandshake(const std::string& host, const std::string& path) {
+        out_.append("GET ").append(path).append(" HTTP/1.1\r\n");
+        out_.append("Host: ").append(host).append("\r\n");
+        out_.append("Upgrade: websocket\r\nConnection: Upgrade\r\n");
+        // 固定的 key 即可，服务端回的 Sec-WebSocket-Accept 这里不校验
+        out_.append("Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+    }
+
+    void ClientSocket::queueFrame(FrameType type, std::string_view payload) {
+        out_.push_back(static_cast<char>(0x80 | static_cast<uint8_t>(type)));
+        if (payload.size() < 126) {
+            out_.push_back(static_cast<char>(0x80 | payload.size()));
+        } else if (payload.size() <= 0xFFFF) {
+            out_.push_back(static_cast<char>(0x80 | 126));
+            out_.push_back(static_cast<char>(payload.size() >> 8));
+            out_.push_back(static_cast<char>(payload.size() & 0xFF));
+        } else {
+            out_.push_back(static_cast<char>(0x80 | 127));
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                out_.push_back(static_cast<char>((static_cast<uint64_t>(payload.size()) >> shift) & 0xFF));
+            }
+        }
+
+        // xorshift 生成掩码，压测客户端不需要密码学随机数
+        maskSeed_ ^= maskSeed_ << 13;
+        maskSeed_ ^= maskSeed_ >> 17;
+        maskSeed_ ^= maskSeed_ << 5;
+        char mask[4];
+        std::memcpy(mask, &maskSeed_, 4);
+        out_.append(mask, 4);
+
+        size_t start = out_.size();
+        out_.append(payload.data(), payload.size());
+        for (size_t i = 0; i < payload.size(); ++i) {
+            out_[start + i] ^= mask[i & 3];
+        }
+    }
+
+    ClientSocket::IoResult ClientSocket::flush() {
+        while (outOffset_ < out_.size()) {
+            auto n = ::send(fd_, out_.data() + outOffset_, out_.size() - outOffset_, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK ? IoResult::WouldBlock : IoResult::Error;
+            }
+            outOffset_ += static_cast<size_t>(n);
+        }
+        out_.clear();
+        outOffset_ = 0;
+        return IoResult::Ok;
+    }
+
+    ClientSocket::IoResult ClientSocket::readAvailable() {
+        char buf[65536];
+        while (true) {
+            auto n = ::recv(fd_, buf, sizeof(buf), 0);
+            if (n > 0) {
+                in_.append(buf, static_cast<size_t>(n));
+                continue;
+            }
+            if (n == 0) {
+                return IoResult::Closed;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? IoResult::Ok : IoResult::Error;
+        }
+    }
+
+    bool ClientSocket::parseHandshake() {
+        auto end = in_.find("\r\n\r\n", inOffset_);
+        if (end == std::string::npos) {
+            return false;
+        }
+        // HTTP/1.1 101 Switching Protocols
+        if (in_.compare(inOffset_, 12, "HTTP/1.1 101") != 0) {
+            handshakeFailed_ = true;
+            return false;
+        }
+        inOffset_ = end + 4;
+        handshakeDone_ = true;
+        return true;
+    }
+
+    int ClientSocket::nextFrame(FrameType& type, bool& fin, std::string_view& payload) {
+        size_t available = in_.size() - inOffset_;
+        if (available < 2) {
+            return 0;
+        }
+        auto* p = reinterpret_cast<const uint8_t*>(in_.data() + inOffset_);
+        fin = (p[0] & 0x80) != 0;
+        type = static_cast<FrameType>(p[0] & 0x0F);
+        bool masked = (p[1] & 0x80) != 0;
+        uint64_t length = p[1] & 0x7F;
+        size_t header = 2;
+        if (length == 126) {
+            if (available < 4) {
+                return 0;
+            }
+            length = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+            header = 4;
+        } else if (length == 127) {
+            if (available < 10) {
+                return 0;
+            }
+            length = 0;
+            for (int i = 0; i < 8; ++i) {
+                length = (length << 8) | p[2 + i];
+            }
+            header = 10;
+        }
+        // 服务端发给客户端的帧不应带掩码
+        if (masked) {
+            return -1;
+        }
+        if (available - header < length) {
+            return 0;
+        }
+        payload = std::string_view(in_.data() + inOffset_ + header, static_cast<size_t>(length));
+        inOffset_ += header + static_cast<size_t>(length);
+        return 1;
+    }
+
+    void ClientSocket::compactInput() {
+        if (inOffset_ == in_.size()) {
+            in_.clear();
+            inOffset_ = 0;
+        } else if (inOffset_ > 65536) {
+            in_.erase(0, inOffset_);
+            inOffset_ = 0;
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace cli_test
+{
+    struct HttpResponse
+    {
+        int status = 0;
+        std::string body;
+    };
+
+    // 一条到 im_server 的 TCP 连接，带最小化的 HTTP/1.1 与 WebSocket 客户端实现。
+    //   - 阻塞模式：注册 / 登录等 HTTP 请求，keep-alive 复用同一条连接
+    //   - 非阻塞模式：WebSocket，由调用方的 epoll 循环驱动 flush() / readAvailable() / drainFrames()
+    // 不支持 TLS、chunked 响应和 WebSocket 扩展，服务端 Drogon 默认配置下都用不到。
+    class ClientSocket
+    {
+    public:
+        enum class IoResult
+        {
+            Ok,
+            WouldBlock,
+            Closed,
+            Error
+        };
+
+        enum class FrameType : uint8_t
+        {
+            Text = 0x1,
+            Binary = 0x2,
+            Close = 0x8,
+            Ping = 0x9,
+            Pong = 0xA
+        };
+
+        ClientSocket() = default;
+        ~ClientSocket();
+        ClientSocket(const ClientSocket &) = delete;
+        ClientSocket &operator=(const ClientSocket &) = delete;
+
+        static bool resolve(const std::string &host, uint16_t port, sockaddr_in &out);
+
+        // 非阻塞 connect，返回 false 表示立即失败；连接是否建立由 EPOLLOUT + finishConnect() 判断
+        bool connect(const sockaddr_in &addr, bool blocking);
+        bool finishConnect();
+        void close();
+        int fd() const { return fd_; }
+
+        // 阻塞模式：发送一个 HTTP 请求并读取完整响应，token 非空时带 Authorization 头
+        bool httpRequest(const std::string &method, const std::string &path, const std::string &body,
+                         const std::string &token, const std::string &host, HttpResponse &out);
+
+        // 以下为非阻塞 WebSocket 接口
+        void queueHandshake(const std::string &host, const std::string &path);
+        // 客户端帧必须带掩码
+        void queueFrame(FrameType type, std::string_view payload);
+        IoResult flush();
+        bool wantWrite() const { return outOffset_ < out_.size(); }
+        IoResult readAvailable();
+
+        bool handshakeDone() const { return handshakeDone_; }
+
+        // 解析已读到的数据：握手完成后对每个完整的文本 / 二进制消息调用 onMessage(type, payload)，
+        // ping 自动回 pong，收到 close 返回 false
+        template <typename F>
+        bool drainFrames(F &&onMessage)
+        {
+            if (!handshakeDone_ && !parseHandshake())
+                return !handshakeFailed_;
+
+            while (true)
+            {
+                FrameType type;
+                bool fin;
+                std::string_view payload;
+                auto parsed = nextFrame(type, fin, payload);
+                if (parsed == 0)
+                    break;
+                if (parsed < 0)
+                    return false;
+
+                if (type == FrameType::Close)
+                    return false;
+                if (type == FrameType::Ping)
+                {
+                    std::string copy(payload);
+                    queueFrame(FrameType::Pong, copy);
+                }
+                else if (type == FrameType::Pong)
+                {
+                }
+                else if (static_cast<uint8_t>(type) == 0)
+                {
+                    // 分片消息的后续帧
+                    fragments_.append(payload.data(), payload.size());
+                    if (fin)
+                    {
+                        onMessage(fragmentType_, std::string_view(fragments_));
+                        fragments_.clear();
+                    }
+                }
+                else if (!fin)
+                {
+                    fragmentType_ = type;
+                    fragments_.assign(payload.data(), payload.size());
+                }
+                else
+                {
+                    onMessage(type, payload);
+                }
+            }
+            compactInput();
+            return true;
+        }
+
+    private:
+        bool parseHandshake();
+        // 返回 1 解析出一帧，0 数据不足，-1 协议错误
+        int nextFrame(FrameType &type, bool &fin, std::string_view &payload);
+        void compactInput();
+
+        bool readHttpResponse(HttpResponse &out);
+
+        int fd_ = -1;
+        std::string out_;
+        size_t outOffset_ = 0;
+        std::string in_;
+        size_t inOffset_ = 0;
+        bool handshakeDone_ = false;
+        bool handshakeFailed_ = false;
+        FrameType fragmentType_ = FrameType::Text;
+        std::string fragments_;
+        uint32_t maskSeed_ = 0x9E3779B9u;
+    };
+}
@@ -0,0 +1,1068 @@
+// im_server 端到端压测工具：
+//   1. 通过 /api/auth 注册并登录 N 个用户（已存在的用户直接登录）
+//   2. 多个工作线程各自用 epoll 管理一部分 /ws/chat 连接
+//   3. 按会话图和发送速率定时发消息，消息内容里带发送时刻，接收方据此计算投递延迟
+//   4. 输出建连速率、吞吐和延迟分位数，最后一行 RESULT 为 key=value 格式，方便脚本对比
+//
+// 各项优化对应的压测场景（--churn 断线重连、--senders 群聊扇出、--login-rounds / --auth-only 注册登录）
+// 及命令见 docs/environment_setup.md。
+//
+// 发送节奏是确定的（每个连接固定间隔、按下标错开起点，随机会话图由 --seed 决定），
+// 同一参数多次运行的负载相同。
+
+#include "ClientSocket.h"
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace cli_test;
+
+namespace {
+
+    struct Options {
+        std::string host = "127.0.0.1";
+        uint16_t port = 8080;
+        size_t users = 100;
+        size_t threads = 4;
+        double rate = 1.0;           // 每个连接每秒发送的消息数，0 表示只接收
+        double duration = 30.0;      // 统计窗口（秒）
+        double warmup = 5.0;         // 开始发送到开始统计之间的预热（秒）
+        double drain = 3.0;          // 停止发送后等待在途消息的时间（秒）
+        std::string graph = "pairs"; // pairs | ring | random | room
+        size_t peers = 4;            // random 图中每个用户的会话对象数
+        size_t payload = 64;         // 消息内容字节数（含时间戳前缀）
+        size_t connectConcurrency = 256; // 每个工作线程同时处于握手中的连接数上限
+        size_t senders = 0;          // 只有下标小于它的用户发送，0 表示全部
+        double churn = 0.0;          // 每个连接每隔多少秒断开重连，0 表示不重连
+        size_t loginRounds = 1;      // 登录轮数，第一轮之后的登录命中服务端用户缓存
+        bool authOnly = false;       // 注册、登录后退出，不建立 WebSocket
+        int ackIntervalMs = 50;
+        std::string prefix = "load";
+        std::string password = "loadtest123";
+        uint32_t seed = 1;
+        bool binary = false;
+        bool skipRegister = false;
+    };
+
+    void usage(const char* argv0) {
+        std::printf(
+            "usage: %s [options]\n"
+            "  --host H               server host (127.0.0.1)\n"
+            "  --port P               server port (8080)\n"
+            "  --users N              synthetic users / connections (100)\n"
+            "  --threads T            worker threads (4)\n"
+            "  --rate R               messages per second per connection (1)\n"
+            "  --duration S           measured seconds (30)\n"
+            "  --warmup S             seconds of sending before measuring (5)\n"
+            "  --drain S              seconds to wait for in-flight messages (3)\n"
+            "  --graph G              pairs | ring | random | room (pairs)\n"
+            "  --peers K              peers per user for --graph random (4)\n"
+            "  --payload B            message content bytes (64)\n"
+            "  --connect-concurrency C  handshakes in flight per thread (256)\n"
+            "  --senders K            only the first K users send, 0 = all (0)\n"
+            "  --churn S              reconnect every connection every S seconds while sending (0 = off)\n"
+            "  --login-rounds N       log every user in N times, reporting each round (1)\n"
+            "  --auth-only            stop after register / login, no WebSocket phase\n"
+            "  --ack-interval-ms M    delivery ack interval (50)\n"
+            "  --prefix S             username prefix (load)\n"
+            "  --password S           password for all users (loadtest123)\n"
+            "  --seed N               seed for --graph random (1)\n"
+            "  --binary               use the binary frame protocol (?proto=bin)\n"
+            "  --skip-register        only log in, users must already exist\n",
+            argv0);
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next = [&]() -> const char* {
+                if (i + 1 >= argc) {
+                    std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+                    std::exit(2);
+                }
+                return argv[++i];
+            };
+            if (arg == "--host") options.host = next();
+            else if (arg == "--port") options.port = static_cast<uint16_t>(std::atoi(next()));
+            else if (arg == "--users") options.users = std::strtoull(next(), nullptr, 10);
+            else if (arg == "--threads") options.threads = std::strtoull(next(), nullptr, 10);
+            else if (arg == "--rate") options.rate = std::atof(next());
+            else if (arg == "--duration") options.duration = std::atof(next());
+            else if (arg == "--warmup") options.warmup = std::atof(next());
+            else if (arg == "--drain") options.drain = std::atof(next());
+            else if (arg == "--graph") options.graph = next();
+            else if (arg == "--peers") options.peers = std::strtoull(next(), nullptr, 10);
+            else if (arg == "--payload") options.payload = std::strtoull(next(), nullptr, 10);
+            else if (arg == "--connect-concurrency") options.connectConcurrency = std::strtoull(next(), nullptr, 10);
+            else if (arg == "--senders") options.senders = std::strtoull(next(), nullptr, 10);
+            else if (arg == "--churn") options.churn = std::atof(next());
+            else if (arg == "--login-rounds") options.loginRounds = std::strtoull(next(), nullptr, 10);
+            else if (arg == "--auth-only") options.authOnly = true;
+            else if (arg == "--ack-interval-ms") options.ackIntervalMs = std::atoi(next());
+            else if (arg == "--prefix") options.prefix = next();
+            else if (arg == "--password") options.password = next();
+            else if (arg == "--seed") options.seed = static_cast<uint32_t>(std::strtoul(next(), nullptr, 10));
+            else if (arg == "--binary") options.binary = true;
+            else if (arg == "--skip-register") options.skipRegister = true;
+            else {
+                usage(argv[0]);
+                return false;
+            }
+        }
+        if (options.users < 2 || options.threads == 0 || options.connectConcurrency == 0 || options.loginRounds == 0 ||
+            options.churn < 0 ||
+            (options.graph != "pairs" && options.graph != "ring" && options.graph != "random" &&
+             options.graph != "room")) {
+            usage(argv[0]);
+            return false;
+        }
+        options.threads = std::min(options.threads, options.users);
+        return true;
+    }
+
+    int64_t nowMicros() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 对数-线性直方图（每个 2 的幂区间 16 个子桶，误差约 6%），单位微秒
+    class LatencyHistogram {
+    public:
+        static constexpr unsigned kSubBits = 4;
+        static constexpr unsigned kSubBuckets = 1u << kSubBits;
+        static constexpr size_t kBuckets = (40 - kSubBits + 2) * kSubBuckets;
+
+        void record(int64_t micros) {
+            auto value = static_cast<uint64_t>(std::max<int64_t>(micros, 0));
+            ++buckets_[bucketOf(value)];
+            ++count_;
+            sum_ += value;
+            max_ = std::max(max_, value);
+        }
+
+        void merge(const LatencyHistogram& other) {
+            for (size_t i = 0; i < kBuckets; ++i) {
+                buckets_[i] += other.buckets_[i];
+            }
+            count_ += other.count_;
+            sum_ += other.sum_;
+            max_ = std::max(max_, other.max_);
+        }
+
+        uint64_t count() const { return count_; }
+        uint64_t max() const { return max_; }
+        double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+
+        uint64_t percentile(double q) const {
+            if (count_ == 0) {
+                return 0;
+            }
+            auto rank = static_cast<uint64_t>(q * static_cast<double>(count_ - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < kBuckets; ++i) {
+                seen += buckets_[i];
+                if (seen >= rank) {
+                    return std::min(upperBound(i), max_);
+                }
+            }
+            return max_;
+        }
+
+    private:
+        static size_t bucketOf(uint64_t value) {
+            if (value < kSubBuckets) {
+                return static_cast<size_t>(value);
+            }
+            unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+            if (exponent >= 40) {
+                return kBuckets - 1;
+            }
+            auto sub = static_cast<size_t>((value >> (exponent - kSubBits)) & (kSubBuckets - 1));
+            return (exponent - kSubBits + 1) * kSubBuckets + sub;
+        }
+
+        static uint64_t upperBound(size_t bucket) {
+            if (bucket < kSubBuckets) {
+                return bucket;
+            }
+            unsigned exponent = static_cast<unsigned>(bucket / kSubBuckets) + kSubBits - 1;
+            uint64_t sub = bucket % kSubBuckets;
+            return ((kSubBuckets + sub + 1) << (exponent - kSubBits)) - 1;
+        }
+
+        std::array<uint64_t, kBuckets> buckets_{};
+        uint64_t count_ = 0;
+        uint64_t sum_ = 0;
+        uint64_t max_ = 0;
+    };
+
+    // 从服务端的 JSON 帧里取字符串字段，只处理本工具用到的扁平字段；from 为搜索起点，返回值之后的位置
+    size_t findString(std::string_view json, std::string_view key, std::string_view& value, size_t from = 0) {
+        std::string quoted = "\"" + std::string(key) + "\"";
+        while (true) {
+            auto pos = json.find(quoted, from);
+            if (pos == std::string_view::npos) {
+                return std::string_view::npos;
+            }
+            pos += quoted.size();
+            while (pos < json.size() && (json[pos] == ' ' || json[pos] == ':' || json[pos] == '\t')) {
+                ++pos;
+            }
+            if (pos < json.size() && json[pos] == '"') {
+                auto end = json.find('"', pos + 1);
+                if (end == std::string_view::npos) {
+                    return std::string_view::npos;
+                }
+                value = json.substr(pos + 1, end - pos - 1);
+                return end + 1;
+            }
+            from = pos;
+        }
+    }
+
+    // 布尔字段为 true 时返回 true
+    bool findTrue(std::string_view json, std::string_view key) {
+        std::string quoted = "\"" + std::string(key) + "\"";
+        auto pos = json.find(quoted);
+        if (pos == std::string_view::npos) {
+            return false;
+        }
+        pos += quoted.size();
+        while (pos < json.size() && (json[pos] == ' ' || json[pos] == ':' || json[pos] == '\t')) {
+            ++pos;
+        }
+        return json.substr(pos, 4) == "true";
+    }
+
+    int64_t toInt64(std::string_view value) {
+        int64_t out = 0;
+        for (char c : value) {
+            if (c < '0' || c > '9') {
+                return 0;
+            }
+            out = out * 10 + (c - '0');
+        }
+        return out;
+    }
+
+    // 二进制帧字段读取，格式见服务端 BinaryProtocol.h
+    struct BinaryReader {
+        const uint8_t* p;
+        const uint8_t* end;
+
+        bool varint(uint64_t& out) {
+            out = 0;
+            for (int shift = 0; shift < 64 && p != end; shift += 7) {
+                uint8_t b = *p++;
+                out |= static_cast<uint64_t>(b & 0x7F) << shift;
+                if (!(b & 0x80)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool bytes(std::string_view& out) {
+            uint64_t size;
+            if (!varint(size) || size > static_cast<uint64_t>(end - p)) {
+                return false;
+            }
+            out = std::string_view(reinterpret_cast<const char*>(p), size);
+            p += size;
+            return true;
+        }
+    };
+
+    void appendVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    void appendBytes(std::string& out, std::string_view value) {
+        appendVarint(out, value.size());
+        out.append(value.data(), value.size());
+    }
+
+    struct User {
+        std::string name;
+        int64_t id = 0;
+        std::string token;
+    };
+
+    // 所有线程共享、只读的运行参数
+    struct Plan {
+        Options options;
+        sockaddr_in addr{};
+        std::vector<User> users;
+        std::vector<std::vector<uint32_t>> peers; // 每个用户的会话对象（用户下标）
+        int64_t roomId = 0;
+
+        // 由主线程推进的阶段
+        std::atomic<int> phase{0};
+        std::atomic<int64_t> sendFrom{0};
+        std::atomic<int64_t> measureFrom{0};
+        std::atomic<int64_t> measureUntil{0};
+        std::atomic<size_t> setupDone{0}; // 已建立或已失败的连接数
+    };
+
+    enum Phase { kConnect = 0, kRun = 1, kDrain = 2, kStop = 3 };
+
+    struct WorkerStats {
+        uint64_t connected = 0;
+        uint64_t connectFailures = 0;
+        uint64_t closed = 0;
+        uint64_t evicted = 0;
+        uint64_t sent = 0;          // 统计窗口内发出的消息
+        uint64_t delivered = 0;     // 统计窗口内发出、已被接收方收到的投递
+        uint64_t acked = 0;         // 统计窗口内发出、已收到 message_ack 的消息
+        uint64_t ackFailures = 0;
+        uint64_t syncedMessages = 0;
+        uint64_t sendLag = 0;       // 发送落后计划超过 1 秒、被重新排期的次数
+        uint64_t reconnected = 0;   // --churn 主动断开后重新建立的连接
+        int64_t lastConnectedAt = 0;
+        LatencyHistogram setup;
+        LatencyHistogram delivery;
+        LatencyHistogram ack;
+    };
+
+    struct Connection {
+        enum State { kIdle, kConnecting, kHandshaking, kOpen, kClosed };
+
+        ClientSocket socket;
+        uint32_t userIndex = 0;
+        State state = kIdle;
+        int64_t connectStartedAt = 0;
+        int64_t nextSendAt = 0;
+        int64_t reconnectAt = 0;    // --churn：到点后断开并重新握手
+        bool reconnecting = false;  // 正在重新握手，不计入初始建连
+        size_t peerCursor = 0;
+        int64_t maxSeenId = 0;
+        int64_t ackedId = 0;
+        int64_t lastAckAt = 0;
+        bool ackNow = false;
+    };
+
+    class Worker {
+    public:
+        Worker(Plan& plan, size_t index) : plan_(plan), index_(index) {}
+
+        void start() {
+            thread_ = std::thread([this]() { run(); });
+        }
+
+        void join() { thread_.join(); }
+
+        const WorkerStats& stats() const { return stats_; }
+
+    private:
+        void run() {
+            const auto& options = plan_.options;
+            epoll_ = epoll_create1(EPOLL_CLOEXEC);
+            for (size_t i = index_; i < plan_.users.size(); i += options.threads) {
+                auto conn = std::make_unique<Connection>();
+                conn->userIndex = static_cast<uint32_t>(i);
+                connections_.push_back(std::move(conn));
+            }
+
+            const int64_t interval = options.rate > 0 ? static_cast<int64_t>(1e6 / options.rate) : 0;
+            const int64_t churnInterval = static_cast<int64_t>(options.churn * 1e6);
+            const size_t senders = options.senders > 0 ? options.senders : plan_.users.size();
+            const int64_t ackInterval = static_cast<int64_t>(options.ackIntervalMs) * 1000;
+            std::vector<epoll_event> events(1024);
+            bool scheduled = false;
+
+            while (plan_.phase.load(std::memory_order_acquire) != kStop) {
+                startConnections();
+
+                int64_t now = nowMicros();
+                int phase = plan_.phase.load(std::memory_order_acquire);
+                if (phase == kRun && !scheduled) {
+                    // 按连接在全体中的下标错开起点，避免所有连接同一时刻发送或重连
+                    auto sendFrom = plan_.sendFrom.load(std::memory_order_acquire);
+                    auto users = static_cast<int64_t>(plan_.users.size());
+                    for (auto& conn : connections_) {
+                        conn->nextSendAt = sendFrom + interval * conn->userIndex / users;
+                        conn->reconnectAt = sendFrom + churnInterval * (conn->userIndex + 1) / users;
+                    }
+                    scheduled = true;
+                }
+                if (phase == kRun && churnInterval > 0) {
+                    for (auto& conn : connections_) {
+                        if (conn->state == Connection::kOpen && conn->reconnectAt <= now) {
+                            reconnect(*conn);
+                        }
+                    }
+                }
+                if (phase == kRun && interval > 0) {
+                    for (auto& conn : connections_) {
+                        if (conn->state != Connection::kOpen || conn->userIndex >= senders) {
+                            continue;
+                        }
+                        while (conn->nextSendAt <= now) {
+                            sendMessage(*conn, conn->nextSendAt);
+                            conn->nextSendAt += interval;
+                            if (now - conn->nextSendAt > 1000000) {
+                                ++stats_.sendLag;
+                                conn->nextSendAt = now + interval;
+                            }
+                        }
+                    }
+                }
+
+                for (auto& conn : connections_) {
+                    if (conn->state != Connection::kOpen) {
+                        continue;
+                    }
+                    if (conn->maxSeenId > conn->ackedId && (conn->ackNow || now - conn->lastAckAt >= ackInterval)) {
+                        sendAck(*conn);
+                        conn->lastAckAt = now;
+                    }
+                    if (conn->socket.wantWrite()) {
+                        flush(*conn);
+                    }
+                }
+
+                int n = epoll_wait(epoll_, events.data(), static_cast<int>(events.size()), 1);
+                for (int i = 0; i < n; ++i) {
+                    handleEvent(*static_cast<Connection*>(events[i].data.ptr), events[i].events);
+                }
+            }
+
+            for (auto& conn : connections_) {
+                conn->socket.close();
+            }
+            ::close(epoll_);
+        }
+
+        void startConnections() {
+            while (handshaking_ < plan_.options.connectConcurrency &&
+                   (!reconnects_.empty() || nextToConnect_ < connections_.size())) {
+                Connection* next;
+                if (!reconnects_.empty()) {
+                    next = reconnects_.back();
+                    reconnects_.pop_back();
+                } else {
+                    next = connections_[nextToConnect_++].get();
+                }
+                auto& conn = *next;
+                conn.connectStartedAt = nowMicros();
+                if (!conn.socket.connect(plan_.addr, false)) {
+                    ++stats_.connectFailures;
+                    if (!conn.reconnecting) {
+                        plan_.setupDone.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    conn.state = Connection::kClosed;
+                    continue;
+                }
+                conn.state = Connection::kConnecting;
+                ++handshaking_;
+                epoll_event event{};
+                event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                event.data.ptr = &conn;
+                epoll_ctl(epoll_, EPOLL_CTL_ADD, conn.socket.fd(), &event);
+            }
+        }
+
+        void handleEvent(Connection& conn, uint32_t events) {
+            if (conn.state == Connection::kClosed) {
+                return;
+            }
+            if (conn.state == Connection::kConnecting) {
+                if (!(events & EPOLLOUT) && !(events & (EPOLLERR | EPOLLHUP))) {
+                    return;
+                }
+                if (!conn.socket.finishConnect()) {
+                    fail(conn, true);
+                    return;
+                }
+                const auto& user = plan_.users[conn.userIndex];
+                std::string path = "/ws/chat?token=" + user.token;
+                if (plan_.options.binary) {
+                    path += "&proto=bin";
+                }
+                conn.socket.queueHandshake(plan_.options.host, path);
+                conn.state = Connection::kHandshaking;
+            }
+
+            if (conn.socket.wantWrite()) {
+                flush(conn);
+                if (conn.state == Connection::kClosed) {
+                    return;
+                }
+            }
+
+            if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                auto result = conn.socket.readAvailable();
+                bool open = conn.socket.drainFrames([&](ClientSocket::FrameType, std::string_view payload) {
+                    if (plan_.options.binary) {
+                        onBinary(conn, payload);
+                    } else {
+                        onJson(conn, payload);
+                    }
+                });
+                if (!open || result != ClientSocket::IoResult::Ok) {
+                    fail(conn, conn.state != Connection::kOpen);
+                }
+            }
+        }
+
+        // --churn：关闭 TCP 连接（不发 close 帧，模拟客户端掉线）后排队重新握手
+        void reconnect(Connection& conn) {
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, conn.socket.fd(), nullptr);
+            conn.socket.close();
+            conn.state = Connection::kIdle;
+            conn.reconnecting = true;
+            reconnects_.push_back(&conn);
+        }
+
+        void flush(Connection& conn) {
+            if (conn.socket.flush() == ClientSocket::IoResult::Error) {
+                fail(conn, conn.state != Connection::kOpen);
+            }
+        }
+
+        void fail(Connection& conn, bool duringSetup) {
+            if (conn.state == Connection::kClosed) {
+                return;
+            }
+            if (duringSetup) {
+                ++stats_.connectFailures;
+                --handshaking_;
+                if (!conn.reconnecting) {
+                    plan_.setupDone.fetch_add(1, std::memory_order_relaxed);
+                }
+            } else {
+                ++stats_.closed;
+            }
+            conn.state = Connection::kClosed;
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, conn.socket.fd(), nullptr);
+            conn.socket.close();
+        }
+
+        void onConnected(Connection& conn) {
+            if (conn.state == Connection::kOpen) {
+                return;
+            }
+            conn.state = Connection::kOpen;
+            --handshaking_;
+            auto now = nowMicros();
+            stats_.setup.record(now - conn.connectStartedAt);
+            if (conn.reconnecting) {
+                conn.reconnecting = false;
+                conn.reconnectAt = now + static_cast<int64_t>(plan_.options.churn * 1e6);
+                ++stats_.reconnected;
+                return;
+            }
+            ++stats_.connected;
+            stats_.lastConnectedAt = now;
+            plan_.setupDone.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bool inWindow(int64_t sentAt) const {
+            return sentAt >= plan_.measureFrom.load(std::memory_order_relaxed) &&
+                   sentAt < plan_.measureUntil.load(std::memory_order_relaxed);
+        }
+
+        // 消息内容以 "lt:<发送时刻微秒>:" 开头，其余用 x 填充到 --payload 字节
+        void onDelivered(Connection& conn, int64_t id, std::string_view content) {
+            conn.maxSeenId = std::max(conn.maxSeenId, id);
+            if (content.size() < 4 || content.substr(0, 3) != "lt:") {
+                return;
+            }
+            auto end = content.find(':', 3);
+            int64_t sentAt = toInt64(content.substr(3, end == std::string_view::npos ? std::string_view::npos : end - 3));
+            if (sentAt > 0 && inWindow(sentAt)) {
+                ++stats_.delivered;
+                stats_.delivery.record(nowMicros() - sentAt);
+            }
+        }
+
+        void onAcked(std::string_view clientMsgId, bool success) {
+            int64_t sentAt = toInt64(clientMsgId);
+            if (sentAt <= 0 || !inWindow(sentAt)) {
+                return;
+            }
+            if (success) {
+                ++stats_.acked;
+                stats_.ack.record(nowMicros() - sentAt);
+            } else {
+                ++stats_.ackFailures;
+            }
+        }
+
+        void onJson(Connection& conn, std::string_view frame) {
+            std::string_view type, value;
+            if (findString(frame, "type", type) == std::string_view::npos) {
+                return;
+            }
+            if (type == "connected") {
+                onConnected(conn);
+            } else if (type == "message") {
+                std::string_view id, content;
+                findString(frame, "id", id);
+                findString(frame, "content", content);
+                onDelivered(conn, toInt64(id), content);
+            } else if (type == "message_ack") {
+                findString(frame, "client_msg_id", value);
+                onAcked(value, findTrue(frame, "success"));
+            } else if (type == "sync_batch") {
+                // 重复运行时会收到上次未确认的消息，只前移游标，不计入延迟
+                size_t pos = 0;
+                while ((pos = findString(frame, "id", value, pos)) != std::string_view::npos) {
+                    conn.maxSeenId = std::max(conn.maxSeenId, toInt64(value));
+                    ++stats_.syncedMessages;
+                }
+                conn.ackNow = findTrue(frame, "has_more");
+            } else if (type == "evicted") {
+                ++stats_.evicted;
+            }
+        }
+
+        void onBinary(Connection& conn, std::string_view frame) {
+            if (frame.empty()) {
+                return;
+            }
+            BinaryReader in{reinterpret_cast<const uint8_t*>(frame.data()) + 1,
+                            reinterpret_cast<const uint8_t*>(frame.data() + frame.size())};
+            uint64_t id, from, roomId, count;
+            std::string_view timestamp, content, clientMsgId, messageType;
+            switch (static_cast<uint8_t>(frame[0])) {
+            case 0x80:
+                onConnected(conn);
+                break;
+            case 0x81:
+                if (in.varint(id) && in.varint(from) && in.bytes(timestamp) && in.bytes(content)) {
+                    onDelivered(conn, static_cast<int64_t>(id), content);
+                }
+                break;
+            case 0x84:
+                if (in.varint(id) && in.varint(roomId) && in.varint(from) && in.bytes(timestamp) &&
+                    in.bytes(content)) {
+                    onDelivered(conn, static_cast<int64_t>(id), content);
+                }
+                break;
+            case 0x82:
+                if (in.varint(id) && in.p != in.end) {
+                    bool success = *in.p++ != 0;
+                    if (in.bytes(clientMsgId)) {
+                        onAcked(clientMsgId, success);
+                    }
+                }
+                break;
+            case 0x83:
+                if (in.p != in.end) {
+                    conn.ackNow = *in.p++ != 0;
+                    if (in.varint(count)) {
+                        for (uint64_t i = 0; i < count; ++i) {
+                            if (!(in.varint(id) && in.varint(from) && in.bytes(messageType) &&
+                                  in.bytes(timestamp) && in.bytes(content))) {
+                                break;
+                            }
+                            conn.maxSeenId = std::max(conn.maxSeenId, static_cast<int64_t>(id));
+                            ++stats_.syncedMessages;
+                        }
+                    }
+                }
+                break;
+            case 0x85:
+                ++stats_.evicted;
+                break;
+            default:
+                break;
+            }
+        }
+
+        void sendMessage(Connection& conn, int64_t scheduledAt) {
+            const auto& options = plan_.options;
+            // 用计划发送时刻而不是实际时刻，延迟里包含本工具自身的排队，避免 coordinated omission
+            std::string sentAt = std::to_string(scheduledAt);
+            content_.assign("lt:").append(sentAt).push_back(':');
+            if (content_.size() < options.payload) {
+                content_.append(options.payload - content_.size(), 'x');
+            }
+
+            int64_t target;
+            bool room = plan_.roomId > 0;
+            if (room) {
+                target = plan_.roomId;
+            } else {
+                const auto& peers = plan_.peers[conn.userIndex];
+                target = plan_.users[peers[conn.peerCursor++ % peers.size()]].id;
+            }
+
+            frame_.clear();
+            if (options.binary) {
+                frame_.push_back(static_cast<char>(room ? 0x04 : 0x01));
+                appendVarint(frame_, static_cast<uint64_t>(target));
+                appendBytes(frame_, sentAt);
+                appendBytes(frame_, content_);
+            } else {
+                frame_.append(R"({"type":"message",")").append(room ? "room_id" : "to").append(R"(":")");
+                frame_.append(std::to_string(target)).append(R"(","client_msg_id":")").append(sentAt);
+                frame_.append(R"(","content":")").append(content_).append(R"("})");
+            }
+            conn.socket.queueFrame(options.binary ? ClientSocket::FrameType::Binary : ClientSocket::FrameType::Text,
+                                   frame_);
+            if (inWindow(scheduledAt)) {
+                ++stats_.sent;
+            }
+        }
+
+        void sendAck(Connection& conn) {
+            frame_.clear();
+            if (plan_.options.binary) {
+                frame_.push_back(0x03);
+                appendVarint(frame_, static_cast<uint64_t>(conn.maxSeenId));
+                conn.socket.queueFrame(ClientSocket::FrameType::Binary, frame_);
+            } else {
+                frame_.append(R"({"type":"ack","last_id":")").append(std::to_string(conn.maxSeenId)).append(R"("})");
+                conn.socket.queueFrame(ClientSocket::FrameType::Text, frame_);
+            }
+            conn.ackedId = conn.maxSeenId;
+            conn.ackNow = false;
+        }
+
+        Plan& plan_;
+        size_t index_;
+        std::thread thread_;
+        int epoll_ = -1;
+        std::vector<std::unique_ptr<Connection>> connections_;
+        std::vector<Connection*> reconnects_;
+        size_t nextToConnect_ = 0;
+        size_t handshaking_ = 0;
+        WorkerStats stats_;
+        std::string content_;
+        std::string frame_;
+    };
+
+    // 阻塞 HTTP 请求，连接被服务端关闭时重连重试一次
+    bool request(ClientSocket& socket, const Plan& plan, const std::string& method, const std::string& path,
+                 const std::string& body, const std::string& token, HttpResponse& response) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (socket.fd() < 0 && !socket.connect(plan.addr, true)) {
+                continue;
+            }
+            if (socket.httpRequest(method, path, body, token, plan.options.host, response)) {
+                return true;
+            }
+            socket.close();
+        }
+        return false;
+    }
+
+    // 在 threads 个线程上并行执行 f(socket, i)，i 为用户下标
+    template <typename F>
+    void parallelUsers(const Plan& plan, size_t begin, F&& f) {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < plan.options.threads; ++t) {
+            threads.emplace_back([&, t]() {
+                ClientSocket socket;
+                for (size_t i = begin + t; i < plan.users.size(); i += plan.options.threads) {
+                    f(socket, i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // 多个线程共享的延迟直方图
+    struct SharedHistogram {
+        std::mutex mutex;
+        LatencyHistogram histogram;
+
+        void record(int64_t micros) {
+            std::lock_guard<std::mutex> lock(mutex);
+            histogram.record(micros);
+        }
+    };
+
+    // 注册、登录阶段的结果，--auth-only 时输出 AUTH 行
+    struct AuthStats {
+        double registerPerSecond = 0;
+        uint64_t registerP99 = 0;
+        double firstLoginPerSecond = 0; // 第一轮：服务端用户缓存未命中
+        double loginPerSecond = 0;      // 最后一轮
+        uint64_t loginP50 = 0;
+        uint64_t loginP99 = 0;
+        size_t busy = 0;                // 503：口令哈希线程池排满
+    };
+
+    bool prepareUsers(Plan& plan, AuthStats& auth) {
+        const auto& options = plan.options;
+        plan.users.resize(options.users);
+        for (size_t i = 0; i < options.users; ++i) {
+            plan.users[i].name = options.prefix + "_" + std::to_string(i);
+        }
+
+        std::atomic<size_t> registered{0}, busy{0};
+        auto started = nowMicros();
+        if (!options.skipRegister) {
+            SharedHistogram latency;
+            parallelUsers(plan, 0, [&](ClientSocket& socket, size_t i) {
+                const auto& name = plan.users[i].name;
+                std::string body = R"({"username":")" + name + R"(","password":")" + options.password +
+                                   R"(","email":")" + name + R"(@load.test"})";
+                HttpResponse response;
+                auto sentAt = nowMicros();
+                // 用户已存在时注册失败，直接进入登录
+                if (request(socket, plan, "POST", "/api/auth/register", body, "", response)) {
+                    latency.record(nowMicros() - sentAt);
+                    if (response.status == 201) {
+                        ++registered;
+                    } else if (response.status == 503) {
+                        ++busy;
+                    }
+                }
+            });
+            auto seconds = std::max<int64_t>(1, nowMicros() - started) / 1e6;
+            auth.registerPerSecond = registered.load() / seconds;
+            auth.registerP99 = latency.histogram.percentile(0.99);
+            std::printf("accounts   : %zu new of %zu in %.2f s (%.0f/s), p50 %" PRIu64 " us p99 %" PRIu64
+                        " us, %zu busy\n",
+                        registered.load(), options.users, seconds, auth.registerPerSecond,
+                        latency.histogram.percentile(0.5), auth.registerP99, busy.load());
+        }
+
+        // 第一轮登录从数据库读用户，之后的轮次命中服务端的用户缓存，只做口令校验
+        for (size_t round = 0; round < options.loginRounds; ++round) {
+            std::atomic<size_t> loginFailures{0}, loginBusy{0};
+            SharedHistogram latency;
+            auto roundStarted = nowMicros();
+            parallelUsers(plan, 0, [&](ClientSocket& socket, size_t i) {
+                auto& user = plan.users[i];
+                std::string body = R"({"username":")" + user.name + R"(","password":")" + options.password + R"("})";
+                HttpResponse response;
+                std::string_view token, userId;
+                auto sentAt = nowMicros();
+                bool ok = request(socket, plan, "POST", "/api/auth/login", body, "", response);
+                if (ok) {
+                    latency.record(nowMicros() - sentAt);
+                }
+                if (!ok || response.status != 200 ||
+                    findString(response.body, "token", token) == std::string_view::npos ||
+                    findString(response.body, "user_id", userId) == std::string_view::npos) {
+                    ++(ok && response.status == 503 ? loginBusy : loginFailures);
+                    return;
+                }
+                user.token = std::string(token);
+                user.id = toInt64(userId);
+            });
+            auto seconds = std::max<int64_t>(1, nowMicros() - roundStarted) / 1e6;
+            size_t failed = loginFailures.load() + loginBusy.load();
+            auth.loginPerSecond = (options.users - failed) / seconds;
+            auth.loginP50 = latency.histogram.percentile(0.5);
+            auth.loginP99 = latency.histogram.percentile(0.99);
+            auth.busy += loginBusy.load();
+            if (round == 0) {
+                auth.firstLoginPerSecond = auth.loginPerSecond;
+            }
+            std::printf("login %-5zu: %zu ok in %.2f s (%.0f/s), p50 %" PRIu64 " us p99 %" PRIu64 " us, %zu busy\n",
+                        round + 1, options.users - failed, seconds, auth.loginPerSecond, auth.loginP50,
+                        auth.loginP99, loginBusy.load());
+            // --auth-only 只统计，503 不算失败；要建立 WebSocket 时每个用户都需要 token
+            if (loginFailures.load() > 0 || (loginBusy.load() > 0 && !options.authOnly)) {
+                std::fprintf(stderr, "%zu logins failed, is the server running and are the users registered?\n",
+                             failed);
+                return false;
+            }
+        }
+        auth.busy += busy.load();
+        return true;
+    }
+
+    // 群聊图：第一个用户建一个公开房间，其余用户加入；需在建立 WebSocket 之前完成，连接时服务端加载房间成员关系
+    bool prepareRoom(Plan& plan) {
+        ClientSocket socket;
+        HttpResponse response;
+        std::string body = R"({"name":")" + plan.options.prefix + R"(-room","is_public":true})";
+        std::string_view roomId;
+        if (!request(socket, plan, "POST", "/api/rooms", body, plan.users[0].token, response) ||
+            findString(response.body, "room_id", roomId) == std::string_view::npos) {
+            std::fprintf(stderr, "failed to create room: %d %s\n", response.status, response.body.c_str());
+            return false;
+        }
+        plan.roomId = toInt64(roomId);
+
+        std::atomic<size_t> failures{0};
+        std::string path = "/api/rooms/" + std::to_string(plan.roomId) + "/join";
+        parallelUsers(plan, 1, [&](ClientSocket& userSocket, size_t i) {
+            HttpResponse joined;
+            if (!request(userSocket, plan, "POST", path, "", plan.users[i].token, joined) || joined.status != 200) {
+                ++failures;
+            }
+        });
+        std::printf("room       : %" PRId64 " with %zu members\n", plan.roomId, plan.users.size() - failures.load());
+        return failures.load() == 0;
+    }
+
+    void buildGraph(Plan& plan) {
+        const auto& options = plan.options;
+        size_t n = plan.users.size();
+        plan.peers.assign(n, {});
+        if (options.graph == "room") {
+            return;
+        }
+        std::mt19937 rng(options.seed);
+        for (size_t i = 0; i < n; ++i) {
+            auto& peers = plan.peers[i];
+            if (options.graph == "pairs") {
+                peers.push_back(static_cast<uint32_t>((i ^ 1) < n ? (i ^ 1) : i - 1));
+            } else if (options.graph == "ring") {
+                peers.push_back(static_cast<uint32_t>((i + 1) % n));
+            } else {
+                std::uniform_int_distribution<size_t> pick(0, n - 2);
+                size_t k = std::min(options.peers, n - 1);
+                while (peers.size() < k) {
+                    // 跳过自己：在 [0, n-2] 中取，大于等于 i 的整体后移一位
+                    auto peer = pick(rng);
+                    peer += peer >= i ? 1 : 0;
+                    if (std::find(peers.begin(), peers.end(), peer) == peers.end()) {
+                        peers.push_back(static_cast<uint32_t>(peer));
+                    }
+                }
+            }
+        }
+    }
+
+    void sleepSeconds(double seconds) {
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(seconds * 1e6)));
+    }
+}
+
+int main(int argc, char** argv) {
+    Plan plan;
+    if (!parseOptions(argc, argv, plan.options)) {
+        return 2;
+    }
+    const auto& options = plan.options;
+    if (!ClientSocket::resolve(options.host, options.port, plan.addr)) {
+        std::fprintf(stderr, "cannot resolve %s\n", options.host.c_str());
+        return 1;
+    }
+
+    AuthStats auth;
+    if (!prepareUsers(plan, auth)) {
+        return 1;
+    }
+    if (options.authOnly) {
+        std::printf("AUTH users=%zu threads=%zu register_per_s=%.0f register_p99_us=%" PRIu64
+                    " first_login_per_s=%.0f login_rounds=%zu login_per_s=%.0f login_p50_us=%" PRIu64
+                    " login_p99_us=%" PRIu64 " busy=%zu\n",
+                    options.users, options.threads, auth.registerPerSecond, auth.registerP99,
+                    auth.firstLoginPerSecond, options.loginRounds, auth.loginPerSecond, auth.loginP50,
+                    auth.loginP99, auth.busy);
+        return 0;
+    }
+    if (options.graph == "room" && !prepareRoom(plan)) {
+        return 1;
+    }
+    buildGraph(plan);
+
+    // 建连
+    std::vector<std::unique_ptr<Worker>> workers;
+    auto connectStarted = nowMicros();
+    for (size_t t = 0; t < options.threads; ++t) {
+        workers.push_back(std::make_unique<Worker>(plan, t));
+        workers.back()->start();
+    }
+    // 等所有连接建立或失败，最多 30 秒（用户数很多时按每秒 1000 个放宽）
+    auto connectDeadline = connectStarted + static_cast<int64_t>(std::max(30.0, options.users / 1000.0) * 1e6);
+    while (plan.setupDone.load(std::memory_order_relaxed) < options.users && nowMicros() < connectDeadline) {
+        sleepSeconds(0.01);
+    }
+
+    // 发送与统计
+    auto runStarted = nowMicros();
+    plan.sendFrom.store(runStarted);
+    plan.measureFrom.store(runStarted + static_cast<int64_t>(options.warmup * 1e6));
+    plan.measureUntil.store(runStarted + static_cast<int64_t>((options.warmup + options.duration) * 1e6));
+    plan.phase.store(kRun, std::memory_order_release);
+    sleepSeconds(options.warmup + options.duration);
+    plan.phase.store(kDrain, std::memory_order_release);
+    sleepSeconds(options.drain);
+    plan.phase.store(kStop, std::memory_order_release);
+    for (auto& worker : workers) {
+        worker->join();
+    }
+
+    WorkerStats total;
+    int64_t lastConnectedAt = connectStarted;
+    for (auto& worker : workers) {
+        const auto& s = worker->stats();
+        total.connected += s.connected;
+        total.connectFailures += s.connectFailures;
+        total.closed += s.closed;
+        total.evicted += s.evicted;
+        total.sent += s.sent;
+        total.delivered += s.delivered;
+        total.acked += s.acked;
+        total.ackFailures += s.ackFailures;
+        total.syncedMessages += s.syncedMessages;
+        total.sendLag += s.sendLag;
+        total.reconnected += s.reconnected;
+        total.setup.merge(s.setup);
+        total.delivery.merge(s.delivery);
+        total.ack.merge(s.ack);
+        lastConnectedAt = std::max(lastConnectedAt, s.lastConnectedAt);
+    }
+
+    double connectSeconds = std::max<int64_t>(1, lastConnectedAt - connectStarted) / 1e6;
+    double connectRate = total.connected / connectSeconds;
+    double sendRate = total.sent / options.duration;
+    double deliverRate = total.delivered / options.duration;
+    // 每条消息的预期投递数：单聊 1，群聊为其他成员数
+    double fanout = options.graph == "room" ? static_cast<double>(options.users - 1) : 1.0;
+    double deliveredRatio = total.sent ? total.delivered / (total.sent * fanout) : 0.0;
+
+    std::printf("connections: %" PRIu64 "/%zu open in %.2f s (%.0f/s), %" PRIu64 " failed\n", total.connected,
+                options.users, connectSeconds, connectRate, total.connectFailures);
+    std::printf("setup us   : p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64 "\n", total.setup.percentile(0.5),
+                total.setup.percentile(0.99), total.setup.max());
+    std::printf("sent       : %" PRIu64 " msgs (%.0f/s), graph %s, %s frames\n", total.sent, sendRate,
+                options.graph.c_str(), options.binary ? "binary" : "json");
+    std::printf("delivered  : %" PRIu64 " (%.0f/s, %.1f%% of expected)\n", total.delivered, deliverRate,
+                deliveredRatio * 100);
+    std::printf("delivery us: p50 %" PRIu64 " p90 %" PRIu64 " p99 %" PRIu64 " p99.9 %" PRIu64 " max %" PRIu64 "\n",
+                total.delivery.percentile(0.5), total.delivery.percentile(0.9), total.delivery.percentile(0.99),
+                total.delivery.percentile(0.999), total.delivery.max());
+    std::printf("ack us     : p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64 " (%" PRIu64 " acked, %" PRIu64
+                " failed)\n",
+                total.ack.percentile(0.5), total.ack.percentile(0.99), total.ack.max(), total.acked,
+                total.ackFailures);
+    std::printf("errors     : %" PRIu64 " closed, %" PRIu64 " evicted, %" PRIu64 " send lag, %" PRIu64
+                " synced backlog\n",
+                total.closed, total.evicted, total.sendLag, total.syncedMessages);
+    double reconnectRate = total.reconnected / (options.warmup + options.duration);
+    if (options.churn > 0) {
+        std::printf("churn      : %" PRIu64 " reconnects (%.0f/s), setup p99 %" PRIu64 " us over all handshakes\n",
+                    total.reconnected, reconnectRate, total.setup.percentile(0.99));
+    }
+    std::printf("RESULT users=%zu threads=%zu graph=%s rate=%g senders=%zu churn=%g duration=%g connected=%" PRIu64
+                " connect_per_s=%.0f reconnect_per_s=%.0f sent_per_s=%.0f delivered_per_s=%.0f delivered_ratio=%.4f"
+                " p50_us=%" PRIu64 " p99_us=%" PRIu64 " p999_us=%" PRIu64 " ack_p99_us=%" PRIu64
+                " closed=%" PRIu64 " evicted=%" PRIu64 "\n",
+                options.users, options.threads, options.graph.c_str(), options.rate, options.senders, options.churn,
+                options.duration, total.connected, connectRate, reconnectRate, sendRate, deliverRate, deliveredRatio,
+                total.delivery.percentile(0.5), total.delivery.percentile(0.99), total.delivery.percentile(0.999),
+                total.ack.percentile(0.99), total.closed, total.evicted);
+    return total.connected == options.users ? 0 : 1;
+}
@@ -19,22 +19,69 @@ CREATE TABLE users (
     INDEX idx_is_active (is_active)
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
 
+-- 群聊房间，id 由服务端 IdGenerator 生成
+CREATE TABLE rooms (
+    id BIGINT UNSIGNED PRIMARY KEY,
+    name VARCHAR(100) NOT NULL,
+    owner_id BIGINT UNSIGNED NOT NULL,
+    -- 公开房间任何人都可以加入；非公开房间只能由创建者添加成员
+    is_public BOOLEAN NOT NULL DEFAULT FALSE,
+    created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    FOREIGN KEY (owner_id) REFERENCES users(id) ON DELETE CASCADE
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+-- 旧库升级：ALTER TABLE rooms ADD COLUMN is_public BOOLEAN NOT NULL DEFAULT FALSE AFTER owner_id;
+
+CREATE TABLE room_members (
+    room_id BIGINT UNSIGNED NOT NULL,
+    user_id BIGINT UNSIGNED NOT NULL,
+    joined_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    PRIMARY KEY (room_id, user_id),
+    -- 上线时加载用户所在的房间
+    INDEX idx_user (user_id, room_id),
+    FOREIGN KEY (room_id) REFERENCES rooms(id) ON DELETE CASCADE,
+    FOREIGN KEY (user_id) REFERENCES users(id) ON DELETE CASCADE
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
 -- Create messages table
+-- 消息 id 由服务端 IdGenerator 生成后显式写入，AUTO_INCREMENT 仅用于手工插入的数据
 CREATE TABLE messages (
     id BIGINT UNSIGNED AUTO_INCREMENT PRIMARY KEY,
     sender_id BIGINT UNSIGNED NOT NULL,
-    receiver_id BIGINT UNSIGNED NOT NULL,
+    -- 单聊的接收方；群聊消息为 NULL，改用 room_id
+    receiver_id BIGINT UNSIGNED NULL,
+    room_id BIGINT UNSIGNED NULL,
+    -- 会话 id：单聊为 (较小用户 id << 32) | 较大用户 id，与 makeConversationId 一致；
+    -- 群聊为 (1 << 63) | room_id，与 makeRoomConversationId 一致
+    conversation_id BIGINT UNSIGNED NOT NULL,
     content TEXT,
     message_type ENUM('text', 'image', 'file') DEFAULT 'text',
-    timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+    -- 发送时间，Unix 毫秒（TimeUtil::nowMillis）；下发给客户端时再格式化
+    timestamp BIGINT NOT NULL DEFAULT 0,
     is_read BOOLEAN DEFAULT FALSE,
     file_path VARCHAR(500) NULL,
     INDEX idx_sender (sender_id),
-    INDEX idx_receiver (receiver_id),
+    -- 上线同步：WHERE receiver_id = ? AND id > ? ORDER BY id
+    INDEX idx_receiver (receiver_id, id),
     INDEX idx_timestamp (timestamp),
     INDEX idx_is_read (is_read),
+    -- 按会话做 keyset 分页：WHERE conversation_id = ? AND id < ? ORDER BY id DESC
+    INDEX idx_conversation_id (conversation_id, id),
     FOREIGN KEY (sender_id) REFERENCES users(id) ON DELETE CASCADE,
-    FOREIGN KEY (receiver_id) REFERENCES users(id) ON DELETE CASCADE
+    FOREIGN KEY (receiver_id) REFERENCES users(id) ON DELETE CASCADE,
+    FOREIGN KEY (room_id) REFERENCES rooms(id) ON DELETE CASCADE
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+-- 旧库升级（timestamp 原为 TIMESTAMP 类型，按数据库会话时区换算）：
+--   ALTER TABLE messages ADD COLUMN ts_ms BIGINT NOT NULL DEFAULT 0;
+--   UPDATE messages SET ts_ms = ROUND(UNIX_TIMESTAMP(timestamp) * 1000);
+--   ALTER TABLE messages DROP INDEX idx_timestamp, DROP COLUMN timestamp,
+--       CHANGE ts_ms timestamp BIGINT NOT NULL DEFAULT 0, ADD INDEX idx_timestamp (timestamp);
+
+-- 每个用户已确认送达的最大消息 id，上线同步从这里继续推送
+CREATE TABLE delivery_cursors (
+    user_id BIGINT UNSIGNED PRIMARY KEY,
+    last_delivered_id BIGINT UNSIGNED NOT NULL DEFAULT 0,
+    updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+    FOREIGN KEY (user_id) REFERENCES users(id) ON DELETE CASCADE
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
 
 -- Insert test data
@@ -44,8 +91,5 @@ INSERT INTO users (username, email, password_hash, created_at, updated_at, is_ac
 ('bob', 'bob@example.com', 'hashed_password_bob', NOW(), NOW(), TRUE);
 
 -- Add 1 test message
-INSERT INTO messages (sender_id, receiver_id, content, message_type, timestamp, is_read, file_path) VALUES
-(1, 2, 'Hello Bob! This is a test message from Alice.', 'text', NOW(), FALSE, NULL);
-
--- Create composite index for efficient message retrieval between users
-CREATE INDEX idx_messages_sender_receiver ON messages (sender_id, receiver_id);
\ No newline at end of file
+INSERT INTO messages (sender_id, receiver_id, conversation_id, content, message_type, timestamp, is_read, file_path) VALUES
+(1, 2, (1 << 32) | 2, 'Hello Bob! This is a test message from Alice.', 'text', ROUND(UNIX_TIMESTAMP(NOW(3)) * 1000), FALSE, NULL);
\ No newline at end of file
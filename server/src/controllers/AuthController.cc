@@ -1,6 +1,7 @@
 #include <drogon/HttpController.h>
 #include <drogon/HttpResponse.h>
 #include <json/json.h>
+#include "../services/SessionStore.h"
 #include "../services/UserService.h"
 #include "../utils/JwtUtil.h"
 
@@ -12,12 +13,38 @@ namespace im_server {
         METHOD_LIST_BEGIN
         ADD_METHOD_TO(AuthController::registerUser, "/api/auth/register", Post);
         ADD_METHOD_TO(AuthController::loginUser, "/api/auth/login", Post);
+        ADD_METHOD_TO(AuthController::refreshToken, "/api/auth/refresh", Post);
+        ADD_METHOD_TO(AuthController::logout, "/api/auth/logout", Post);
+        ADD_METHOD_TO(AuthController::deactivate, "/api/auth/deactivate", Post, "im_server::JwtFilter");
         METHOD_LIST_END
 
         void registerUser(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback);
         void loginUser(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback);
+        // {"refresh_token":".."} -> 新的 token 和 refresh_token，旧的 refresh_token 随即作废
+        void refreshToken(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback);
+        // {"refresh_token":".."}，作废该 refresh token；已签发的 access token 到期前仍可使用
+        void logout(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback);
+        // 停用当前登录的账号：之后无法登录和刷新，全部 refresh token 作废
+        void deactivate(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback);
     };
 
+    namespace {
+        // 口令哈希线程池排满：503 + Retry-After，客户端稍后重试
+        void setBusy(const HttpResponsePtr& resp) {
+            resp->setStatusCode(HttpStatusCode::k503ServiceUnavailable);
+            resp->addHeader("Retry-After", "1");
+        }
+
+        // 登录和刷新的响应：短期的 access token 与一次性的 refresh token
+        void setTokens(Json::Value& ret, const std::string& userId, std::string&& refreshToken) {
+            auto& sessions = SessionStore::instance();
+            ret["token"] = JwtUtil::generateToken(userId, sessions.accessTtl());
+            ret["expires_in"] = static_cast<Json::Int64>(sessions.accessTtl().count());
+            ret["refresh_token"] = std::move(refreshToken);
+            ret["user_id"] = userId;
+        }
+    }
+
     void AuthController::registerUser(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
         // Get JSON data from request
         auto json = req->getJsonObject();
@@ -47,27 +74,29 @@ namespace im_server {
             return;
         }
 
-        UserService userService;
-        auto result = userService.registerUser(username, password, email);
-
-        Json::Value ret;
-        if (result.first) {
-            ret["success"] = true;
-            ret["message"] = "Registration successful";
-            ret["user_id"] = result.second;
-        } else {
-            ret["success"] = false;
-            ret["message"] = result.second;
-        }
-
-        auto resp = HttpResponse::newHttpJsonResponse(ret);
-        if (ret["success"].asBool()) {
-            resp->setStatusCode(HttpStatusCode::k201Created);
-        } else {
-            resp->setStatusCode(HttpStatusCode::k400BadRequest);
-        }
-
-        callback(resp);
+        UserService::instance().registerUser(username, password, email,
+            [callback = std::move(callback)](UserService::AuthResult&& result) {
+                Json::Value ret;
+                if (result.status == UserService::AuthStatus::Ok) {
+                    ret["success"] = true;
+                    ret["message"] = "Registration successful";
+                    ret["user_id"] = result.value;
+                } else {
+                    ret["success"] = false;
+                    ret["message"] = result.value;
+                }
+
+                auto resp = HttpResponse::newHttpJsonResponse(ret);
+                if (ret["success"].asBool()) {
+                    resp->setStatusCode(HttpStatusCode::k201Created);
+                } else if (result.status == UserService::AuthStatus::Busy) {
+                    setBusy(resp);
+                } else {
+                    resp->setStatusCode(HttpStatusCode::k400BadRequest);
+                }
+
+                callback(resp);
+            });
     }
 
     void AuthController::loginUser(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
@@ -98,29 +127,121 @@ namespace im_server {
             return;
         }
 
-        UserService userService;
-        auto result = userService.loginUser(username, password);
+        UserService::instance().loginUser(username, password,
+            [callback = std::move(callback)](UserService::AuthResult&& result) {
+                Json::Value ret;
+                if (result.status == UserService::AuthStatus::Ok) {
+                    ret["success"] = true;
+                    ret["message"] = "Login successful";
+                    setTokens(ret, result.value, SessionStore::instance().issue(std::stoll(result.value)));
+                } else {
+                    ret["success"] = false;
+                    ret["message"] = result.value;
+                }
+
+                auto resp = HttpResponse::newHttpJsonResponse(ret);
+                if (ret["success"].asBool()) {
+                    resp->setStatusCode(HttpStatusCode::k200OK);
+                } else if (result.status == UserService::AuthStatus::Busy) {
+                    setBusy(resp);
+                } else {
+                    resp->setStatusCode(HttpStatusCode::k401Unauthorized);
+                }
+
+                callback(resp);
+            });
+    }
 
-        Json::Value ret;
-        if (result.first) {
-            // Generate JWT token
-            std::string token = JwtUtil::generateToken(result.second);
-            ret["success"] = true;
-            ret["message"] = "Login successful";
-            ret["token"] = token;
-            ret["user_id"] = result.second;
-        } else {
+    void AuthController::refreshToken(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+        auto json = req->getJsonObject();
+        std::string refreshToken = json ? (*json)["refresh_token"].asString() : "";
+
+        if (refreshToken.empty()) {
+            Json::Value ret;
             ret["success"] = false;
-            ret["message"] = result.second;
+            ret["message"] = "refresh_token is required";
+            auto resp = HttpResponse::newHttpJsonResponse(ret);
+            resp->setStatusCode(HttpStatusCode::k400BadRequest);
+            callback(resp);
+            return;
         }
 
-        auto resp = HttpResponse::newHttpJsonResponse(ret);
-        if (ret["success"].asBool()) {
-            resp->setStatusCode(HttpStatusCode::k200OK);
-        } else {
+        SessionStore::instance().refresh(refreshToken,
+            [callback = std::move(callback)](SessionStore::RefreshStatus status, int64_t userId,
+                                             std::string&& nextToken) {
+                Json::Value ret;
+                if (status == SessionStore::RefreshStatus::Ok) {
+                    ret["success"] = true;
+                    ret["message"] = "Token refreshed";
+                    setTokens(ret, std::to_string(userId), std::move(nextToken));
+                } else if (status == SessionStore::RefreshStatus::Unavailable) {
+                    ret["success"] = false;
+                    ret["message"] = "Service temporarily unavailable, please retry";
+                } else {
+                    ret["success"] = false;
+                    ret["message"] = "Invalid or expired refresh token";
+                }
+
+                auto resp = HttpResponse::newHttpJsonResponse(ret);
+                if (status == SessionStore::RefreshStatus::Ok) {
+                    resp->setStatusCode(HttpStatusCode::k200OK);
+                } else if (status == SessionStore::RefreshStatus::Unavailable) {
+                    setBusy(resp);
+                } else {
+                    resp->setStatusCode(HttpStatusCode::k401Unauthorized);
+                }
+                callback(resp);
+            });
+    }
+
+    void AuthController::logout(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+        auto json = req->getJsonObject();
+        std::string refreshToken = json ? (*json)["refresh_token"].asString() : "";
+
+        if (refreshToken.empty()) {
+            Json::Value ret;
+            ret["success"] = false;
+            ret["message"] = "refresh_token is required";
+            auto resp = HttpResponse::newHttpJsonResponse(ret);
+            resp->setStatusCode(HttpStatusCode::k400BadRequest);
+            callback(resp);
+            return;
+        }
+
+        SessionStore::instance().revoke(refreshToken);
+
+        Json::Value ret;
+        ret["success"] = true;
+        ret["message"] = "Logged out";
+        callback(HttpResponse::newHttpJsonResponse(ret));
+    }
+
+    void AuthController::deactivate(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+        // JwtFilter 已完成鉴权
+        int64_t userId = 0;
+        try {
+            userId = std::stoll(req->attributes()->get<std::string>("user_id"));
+        } catch (const std::exception&) {
+        }
+        if (userId <= 0) {
+            Json::Value ret;
+            ret["success"] = false;
+            ret["message"] = "Invalid token";
+            auto resp = HttpResponse::newHttpJsonResponse(ret);
             resp->setStatusCode(HttpStatusCode::k401Unauthorized);
+            callback(resp);
+            return;
         }
 
-        callback(resp);
+        UserService::instance().setUserActive(userId, false, [callback = std::move(callback)](bool ok) {
+            Json::Value ret;
+            ret["success"] = ok;
+            ret["message"] = ok ? "Account deactivated" : "Failed to deactivate account";
+            auto resp = HttpResponse::newHttpJsonResponse(ret);
+            if (!ok) {
+                resp->setStatusCode(HttpStatusCode::k500InternalServerError);
+            }
+            callback(resp);
+        });
     }
-}
\ No newline at end of file
+}
@@ -1,14 +1,52 @@
 #include <drogon/WebSocketController.h>
 #include <json/json.h>
+#include "../services/FanoutService.h"
+#include "../services/MessageRouter.h"
 #include "../services/MessageService.h"
+#include "../services/OutboundQueue.h"
+#include "../services/PresenceService.h"
+#include "../services/RoomService.h"
+#include "../services/SessionRegistry.h"
+#include "../services/SyncService.h"
+#include "../utils/BinaryProtocol.h"
+#include "../utils/CommandParser.h"
+#include "../utils/FrameEncoder.h"
+#include "../utils/IdGenerator.h"
 #include "../utils/JwtUtil.h"
-#include <unordered_map>
-#include <mutex>
+#include "../utils/Metrics.h"
 
 using namespace drogon;
 
 namespace im_server
 {
+    namespace
+    {
+        // /ws/chat 热路径上的指标，首次使用时注册
+        struct ChatMetrics
+        {
+            Metrics::Counter &handshakesAccepted;
+            Metrics::Counter &handshakesRejected;
+            Metrics::Histogram &parse;
+            Metrics::Histogram &forward;
+            Metrics::Histogram &persist;
+        };
+
+        ChatMetrics &chatMetrics()
+        {
+            static const std::string handshakes = "im_ws_handshakes_total";
+            static const std::string stages = "im_ws_message_stage_seconds";
+            static ChatMetrics metrics{
+                Metrics::instance().counter(handshakes, "WebSocket handshakes on /ws/chat", R"(result="accepted")"),
+                Metrics::instance().counter(handshakes, "WebSocket handshakes on /ws/chat", R"(result="rejected")"),
+                Metrics::instance().histogram(stages, "Per-stage latency of inbound chat frames", R"(stage="parse")"),
+                Metrics::instance().histogram(stages, "Per-stage latency of inbound chat frames", R"(stage="forward")"),
+                // 从交给写入阶段到回执发出，包含批量落库的等待时间
+                Metrics::instance().histogram(stages, "Per-stage latency of inbound chat frames", R"(stage="persist")"),
+            };
+            return metrics;
+        }
+    }
+
     class ChatController : public drogon::WebSocketController<ChatController>
     {
     public:
@@ -32,39 +70,95 @@ namespace im_server
         void handleConnectionClosed(const WebSocketConnectionPtr &wsConnPtr) override;
 
     private:
-        struct UserSession
+        // handleNewMessage 的实际处理，异常由调用方兜底，单个客户端的坏帧不能让进程退出
+        void dispatch(const WebSocketConnectionPtr &wsConnPtr, std::string &message, const WebSocketMessageType &type);
+
+        // 已确认发送方是成员后落库并扇出群聊消息，在连接的 IO 线程上调用
+        static void sendRoomMessage(const WebSocketConnectionPtr &wsConnPtr, const UserSessionPtr &session,
+                                    int64_t roomId, std::string_view content, std::string_view clientMsgId);
+
+        // 给发送方的 message_ack，按连接协商的线路格式编码
+        static MessageService::BoolCallback makeAckCallback(const WebSocketConnectionPtr &wsConnPtr,
+                                                            WireProtocol protocol, int64_t messageId,
+                                                            std::string_view clientMsgId)
         {
-            std::string userId;
-            std::string username;
-        };
+            std::weak_ptr<WebSocketConnection> weakConn = wsConnPtr;
+            auto enqueuedAt = Metrics::now();
+            return [weakConn, protocol, messageId, clientMsgId = std::string(clientMsgId), enqueuedAt](bool saved) {
+                chatMetrics().persist.observeSince(enqueuedAt);
+                if (!saved)
+                    LOG_ERROR << "Failed to save message";
 
-        // 存储活跃连接
-        static std::unordered_map<WebSocketConnectionPtr, UserSession> connections_;
-        static std::mutex connections_mutex_;
-    };
+                auto conn = weakConn.lock();
+                if (!conn)
+                    return;
+                if (protocol == WireProtocol::Binary)
+                {
+                    auto ack = BinaryProtocol::encodeMessageAck(messageId, clientMsgId, saved);
+                    conn->send(ack.data(), ack.size(), WebSocketMessageType::Binary);
+                }
+                else
+                {
+                    auto ack = FrameEncoder::encodeMessageAck(messageId, clientMsgId, saved);
+                    conn->send(ack.data(), ack.size());
+                }
+            };
+        }
 
-    // 静态成员定义
-    std::unordered_map<WebSocketConnectionPtr, ChatController::UserSession> ChatController::connections_;
-    std::mutex ChatController::connections_mutex_;
+        // 写入队列已满：消息没有被接受，客户端稍后重发
+        static void sendBusy(const WebSocketConnectionPtr &wsConnPtr, WireProtocol protocol,
+                             std::string_view clientMsgId)
+        {
+            if (protocol == WireProtocol::Binary)
+            {
+                auto ack = BinaryProtocol::encodeMessageBusy(clientMsgId);
+                wsConnPtr->send(ack.data(), ack.size(), WebSocketMessageType::Binary);
+            }
+            else
+            {
+                auto ack = FrameEncoder::encodeMessageBusy(clientMsgId);
+                wsConnPtr->send(ack.data(), ack.size());
+            }
+        }
+
+        // 发送方不是房间成员：消息没有被接受，回复失败的 message_ack。
+        // 不经过 makeAckCallback，不记落库耗时、不打落库失败日志
+        static void sendRejected(const WebSocketConnectionPtr &wsConnPtr, WireProtocol protocol,
+                                 std::string_view clientMsgId)
+        {
+            if (protocol == WireProtocol::Binary)
+            {
+                auto ack = BinaryProtocol::encodeMessageAck(0, clientMsgId, false);
+                wsConnPtr->send(ack.data(), ack.size(), WebSocketMessageType::Binary);
+            }
+            else
+            {
+                auto ack = FrameEncoder::encodeMessageAck(0, clientMsgId, false);
+                wsConnPtr->send(ack.data(), ack.size());
+            }
+        }
+
+        // ?proto=bin 或 Sec-WebSocket-Protocol 中带 im.bin.v1 时下行使用二进制帧
+        static WireProtocol negotiateProtocol(const HttpRequestPtr &req)
+        {
+            if (req->getParameter("proto") == "bin" ||
+                req->getHeader("Sec-WebSocket-Protocol").find(BinaryProtocol::kSubprotocol) != std::string::npos)
+                return WireProtocol::Binary;
+            return WireProtocol::Json;
+        }
+    };
 
     // 实现：处理新连接
     void ChatController::handleNewConnection(const HttpRequestPtr &req,
                                              const WebSocketConnectionPtr &wsConnPtr)
     {
         // 1. 获取 Token
-        std::string token = req->getParameter("token");
-        if (token.empty())
-        {
-            auto authHeader = req->getHeader("Authorization");
-            if (authHeader.substr(0, 7) == "Bearer ")
-            {
-                token = authHeader.substr(7);
-            }
-        }
+        std::string token = JwtUtil::extractToken(req);
 
         if (token.empty())
         {
             LOG_WARN << "Missing token";
+            chatMetrics().handshakesRejected.inc();
             wsConnPtr->forceClose();
             return;
         }
@@ -74,23 +168,52 @@ namespace im_server
         if (userId.empty())
         {
             LOG_WARN << "Invalid token";
+            chatMetrics().handshakesRejected.inc();
             wsConnPtr->forceClose();
             return;
         }
 
-        // 3. 记录连接
+        // 3. 记录连接（会话挂在连接上，同时按 user id 登记到注册表）
+        auto session = std::make_shared<UserSession>();
+        try
         {
-            std::lock_guard<std::mutex> lock(connections_mutex_);
-            connections_[wsConnPtr] = {userId, ""};
+            session->userId = std::stoll(userId);
         }
+        catch (const std::exception &)
+        {
+            LOG_WARN << "Invalid user id in token: " << userId;
+            chatMetrics().handshakesRejected.inc();
+            wsConnPtr->forceClose();
+            return;
+        }
+        session->userIdStr = userId;
+        session->protocol = negotiateProtocol(req);
+        session->outbound.ackWindow = req->getParameter("ack") == "1";
+        session->loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+        if (SessionRegistry::instance().add(wsConnPtr, session))
+            MessageRouter::instance().onUserOnline(session->userId);
+        PresenceService::instance().connect(session->userId);
+        FanoutService::instance().attach(wsConnPtr, session);
 
+        chatMetrics().handshakesAccepted.inc();
         LOG_INFO << "New WebSocket connection from user: " << userId;
 
         // 4. 发送欢迎消息
-        Json::Value response;
-        response["type"] = "connected";
-        response["message"] = "WebSocket connection established";
-        wsConnPtr->send(Json::writeString(Json::StreamWriterBuilder(), response));
+        if (session->protocol == WireProtocol::Binary)
+        {
+            auto frame = BinaryProtocol::encodeConnected();
+            wsConnPtr->send(frame.data(), frame.size(), WebSocketMessageType::Binary);
+        }
+        else
+        {
+            Json::Value response;
+            response["type"] = "connected";
+            response["message"] = "WebSocket connection established";
+            wsConnPtr->send(Json::writeString(Json::StreamWriterBuilder(), response));
+        }
+
+        // 5. 推送离线期间收到的消息
+        SyncService::instance().startSync(wsConnPtr, session->userId);
     }
 
     // 实现：处理消息
@@ -98,114 +221,189 @@ namespace im_server
                                           std::string &&message,
                                           const WebSocketMessageType &type)
     {
-        if (type != WebSocketMessageType::Text)
-            return;
-
         try
         {
-            Json::Value json;
-            Json::CharReaderBuilder builder;
-            std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
-            std::string errors;
+            dispatch(wsConnPtr, message, type);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR << "Error handling chat frame: " << e.what();
+        }
+        catch (...)
+        {
+            LOG_ERROR << "Unknown error handling chat frame";
+        }
+    }
 
-            // 解析 JSON
-            bool parsingSuccessful = reader->parse(
-                message.c_str(),
-                message.c_str() + message.size(),
-                &json,
-                &errors);
+    void ChatController::dispatch(const WebSocketConnectionPtr &wsConnPtr,
+                                  std::string &message,
+                                  const WebSocketMessageType &type)
+    {
+        // 获取当前用户信息
+        auto userSession = SessionRegistry::sessionOf(wsConnPtr);
+        if (!userSession)
+            return;
+        // 任何上行帧（包括 ping/pong）都视为客户端仍在读取，清空未开启 ack 的连接的下行窗口
+        OutboundQueue::instance().onClientFrame(wsConnPtr, *userSession);
 
-            if (!parsingSuccessful)
-            {
-                LOG_ERROR << "Failed to parse JSON: " << errors;
+        // 按需解析：只取出用到的字段，字符串指向 message 自身的缓冲区。
+        // 上行帧按帧类型解码，与连接协商的下行格式无关
+        auto &metrics = chatMetrics();
+        auto parseStart = Metrics::now();
+        ChatCommand command;
+        CommandParser::Status status;
+        if (type == WebSocketMessageType::Text)
+            status = CommandParser::parse(message, command);
+        else if (type == WebSocketMessageType::Binary)
+            status = BinaryProtocol::decode(message, command);
+        else
+            return;
+        metrics.parse.observeSince(parseStart);
+
+        if (status == CommandParser::Status::Malformed)
+        {
+            LOG_ERROR << "Failed to parse command";
+            return;
+        }
+        if (status == CommandParser::Status::UnknownType)
+            return;
+
+        switch (command.type)
+        {
+        case CommandType::Message:
+        {
+            int64_t receiverId = command.to;
+            int64_t roomId = command.roomId;
+            if (command.content.empty() || (receiverId <= 0 && roomId <= 0))
                 return;
-            }
 
-            // 获取当前用户信息
-            UserSession userSession;
+            // 群聊只允许成员发言；session->rooms 只在本连接的 IO 线程上维护，这里读取无需加锁。
+            // 它在连接建立后异步加载，不在其中（尚未加载完、或在其他节点刚加入）时查询一次成员关系
+            if (roomId > 0)
             {
-                std::lock_guard<std::mutex> lock(connections_mutex_);
-                auto it = connections_.find(wsConnPtr);
-                if (it == connections_.end())
-                    return;
-                userSession = it->second;
+                if (userSession->rooms.count(roomId) > 0)
+                {
+                    sendRoomMessage(wsConnPtr, userSession, roomId, command.content, command.clientMsgId);
+                    break;
+                }
+                std::weak_ptr<WebSocketConnection> weakConn = wsConnPtr;
+                RoomService::instance().isMember(roomId, userSession->userId,
+                    [weakConn, userSession, roomId, content = std::string(command.content),
+                     clientMsgId = std::string(command.clientMsgId)](bool member) {
+                        userSession->loop->queueInLoop([weakConn, userSession, roomId, member, content,
+                                                        clientMsgId]() {
+                            auto conn = weakConn.lock();
+                            if (!conn)
+                                return;
+                            if (!member)
+                            {
+                                sendRejected(conn, userSession->protocol, clientMsgId);
+                                return;
+                            }
+                            sendRoomMessage(conn, userSession, roomId, content, clientMsgId);
+                        });
+                    });
+                break;
             }
 
-            std::string msgType = json["type"].asString();
+            int64_t senderId = userSession->userId;
 
-            if (msgType == "message")
-            {
-                std::string toUserIdStr = json["to"].asString();
-                std::string content = json["content"].asString();
+            // 在落库之前分配消息 id，转发、回执、已读回执都使用它
+            int64_t messageId = IdGenerator::nextId();
+            int64_t timestamp = TimeUtil::nowMillis();
+            auto ackCallback = makeAckCallback(wsConnPtr, userSession->protocol, messageId, command.clientMsgId);
 
-                if (toUserIdStr.empty() || content.empty())
-                    return;
+            // 先交给批量写入阶段，按 durability 配置在入队或落库后给发送方回执；
+            // 队列已满时回复 busy，不转发，避免接收方收到一条不会落库的消息
+            if (!MessageService::instance().saveMessage(messageId, senderId, receiverId,
+                                                        std::string(command.content), MessageType::Text, timestamp,
+                                                        std::move(ackCallback)))
+            {
+                sendBusy(wsConnPtr, userSession->protocol, command.clientMsgId);
+                return;
+            }
 
-                MessageService messageService;
+            // 转发消息：不等落库，先投递本节点的连接，再按在线目录转发到接收方所在的其他节点
+            auto forwardStart = Metrics::now();
+            MessageRouter::instance().routeDirect(receiverId, messageId, senderId, command.content, timestamp);
+            metrics.forward.observeSince(forwardStart);
+            break;
+        }
+        case CommandType::ReadReceipt:
+        {
+            if (command.from <= 0)
+                return;
 
-                try
-                {
-                    // ID 类型转换
-                    int64_t senderId = std::stoll(userSession.userId);
-                    int64_t receiverId = std::stoll(toUserIdStr);
-
-                    // 保存消息
-                    bool saved = messageService.saveMessage(senderId, receiverId, content, "text");
-                    if (!saved)
-                    {
-                        LOG_ERROR << "Failed to save message";
-                        return;
-                    }
-
-                    // 转发消息
-                    {
-                        std::lock_guard<std::mutex> lock(connections_mutex_);
-                        for (const auto &conn : connections_)
-                        {
-                            if (conn.second.userId == toUserIdStr)
-                            {
-                                Json::Value messageResponse;
-                                messageResponse["type"] = "message";
-                                messageResponse["from"] = userSession.userId;
-                                messageResponse["content"] = content;
-                                messageResponse["timestamp"] = TimeUtil::getCurrentTimestamp();
-                                conn.first->send(Json::writeString(Json::StreamWriterBuilder(), messageResponse));
-                            }
-                        }
-                    }
-                }
-                catch (const std::exception &e)
-                {
-                    LOG_ERROR << "Message processing error: " << e.what();
-                }
-            }
-            else if (msgType == "read_receipt")
+            // up_to_id：一次把该会话中这条及之前的消息全部标记为已读
+            if (command.upToId > 0)
             {
-                std::string messageId = json["message_id"].asString();
-                MessageService messageService;
-                try
-                {
-                    int64_t userId = std::stoll(userSession.userId);
-                    messageService.updateMessageAsRead(messageId, userId);
-                }
-                catch (...)
-                {
-                }
+                MessageService::instance().markConversationRead(userSession->userId, command.from, command.upToId,
+                                                                [](bool) {});
+                return;
             }
+
+            if (command.messageId <= 0)
+                return;
+            MessageService::instance().updateMessageAsRead(command.messageId, userSession->userId,
+                                                           command.from, [](bool) {});
+            break;
         }
-        catch (const std::exception &e)
+        case CommandType::Ack:
         {
-            LOG_ERROR << "WebSocket error: " << e.what();
+            // 客户端确认已收到 last_id 及之前的消息（同步批次和实时消息共用）
+            if (command.lastId <= 0)
+                return;
+            OutboundQueue::instance().onAck(wsConnPtr, *userSession, command.lastId);
+            SyncService::instance().onAck(wsConnPtr, userSession->userId, command.lastId);
+            break;
         }
+        case CommandType::PresenceSubscribe:
+            PresenceService::instance().subscribe(userSession->userId, std::move(command.users));
+            break;
+        case CommandType::Typing:
+            if (command.to > 0)
+                PresenceService::instance().typing(userSession->userId, command.to);
+            break;
+        case CommandType::Unknown:
+            break;
+        }
+    }
+
+    // 实现：群聊消息落库并扇出
+    void ChatController::sendRoomMessage(const WebSocketConnectionPtr &wsConnPtr, const UserSessionPtr &session,
+                                         int64_t roomId, std::string_view content, std::string_view clientMsgId)
+    {
+        int64_t senderId = session->userId;
+        int64_t messageId = IdGenerator::nextId();
+        int64_t timestamp = TimeUtil::nowMillis();
+        auto ackCallback = makeAckCallback(wsConnPtr, session->protocol, messageId, clientMsgId);
+
+        if (!MessageService::instance().saveRoomMessage(messageId, senderId, roomId, std::string(content),
+                                                        MessageType::Text, timestamp, std::move(ackCallback)))
+        {
+            sendBusy(wsConnPtr, session->protocol, clientMsgId);
+            return;
+        }
+
+        // 群聊：本节点编码一次后交给各 IO 线程扇出，同时广播给其他节点
+        auto forwardStart = Metrics::now();
+        MessageRouter::instance().routeRoom(roomId, messageId, senderId, content, timestamp, wsConnPtr.get());
+        chatMetrics().forward.observeSince(forwardStart);
     }
 
     // 实现：连接关闭
     void ChatController::handleConnectionClosed(const WebSocketConnectionPtr &wsConnPtr)
     {
+        SyncService::instance().onDisconnect(wsConnPtr);
+        FanoutService::instance().detach(wsConnPtr);
+        auto session = SessionRegistry::sessionOf(wsConnPtr);
+        if (session)
         {
-            std::lock_guard<std::mutex> lock(connections_mutex_);
-            connections_.erase(wsConnPtr);
+            OutboundQueue::instance().release(*session);
+            PresenceService::instance().disconnect(session->userId);
         }
+        if (SessionRegistry::instance().remove(wsConnPtr) && session)
+            MessageRouter::instance().onUserOffline(session->userId);
         LOG_INFO << "WebSocket connection closed";
     }
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <vector>
 #include <algorithm>
 #include <filesystem>
+#include "../utils/Metrics.h"
 
 using namespace drogon;
 
@@ -106,6 +107,9 @@ namespace im_server {
             return;
         }
 
+        static auto& uploadBytes = Metrics::instance().counter("im_upload_bytes_total", "Bytes of successfully stored uploads");
+        uploadBytes.inc(file.getFileSize());
+
         Json::Value ret;
         ret["success"] = true;
         ret["message"] = "File uploaded successfully";
@@ -0,0 +1,95 @@
+#include <drogon/HttpController.h>
+#include <drogon/HttpResponse.h>
+#include <json/json.h>
+#include "../services/MessageService.h"
+#include "../services/RoomService.h"
+#include "../utils/FrameEncoder.h"
+
+using namespace drogon;
+
+namespace im_server {
+    class MessageController : public drogon::HttpController<MessageController> {
+    public:
+        METHOD_LIST_BEGIN
+        ADD_METHOD_TO(MessageController::getMessages, "/api/messages", Get, "im_server::JwtFilter");
+        METHOD_LIST_END
+
+        void getMessages(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback);
+
+    private:
+        static constexpr int kDefaultLimit = 50;
+        static constexpr int kMaxLimit = 200;
+    };
+
+    namespace {
+        HttpResponsePtr errorResponse(const std::string& message, HttpStatusCode code) {
+            Json::Value ret;
+            ret["success"] = false;
+            ret["message"] = message;
+            auto resp = HttpResponse::newHttpJsonResponse(ret);
+            resp->setStatusCode(code);
+            return resp;
+        }
+
+        int64_t parseIdParameter(const HttpRequestPtr& req, const std::string& name) {
+            const auto& value = req->getParameter(name);
+            return value.empty() ? 0 : std::stoll(value);
+        }
+    }
+
+    void MessageController::getMessages(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+        // JwtFilter 已完成鉴权
+        const auto& userIdStr = req->attributes()->get<std::string>("user_id");
+
+        int64_t userId, peerId, roomId, beforeId, afterId;
+        int limit = kDefaultLimit;
+        try {
+            userId = std::stoll(userIdStr);
+            peerId = parseIdParameter(req, "peer_id");
+            roomId = parseIdParameter(req, "room_id");
+            beforeId = parseIdParameter(req, "before_id");
+            afterId = parseIdParameter(req, "after_id");
+            const auto& limitStr = req->getParameter("limit");
+            if (!limitStr.empty()) {
+                limit = std::stoi(limitStr);
+            }
+        } catch (const std::exception& e) {
+            callback(errorResponse("Invalid query parameters", HttpStatusCode::k400BadRequest));
+            return;
+        }
+
+        if ((peerId > 0) == (roomId > 0)) {
+            callback(errorResponse("Exactly one of peer_id and room_id is required", HttpStatusCode::k400BadRequest));
+            return;
+        }
+        if (beforeId > 0 && afterId > 0) {
+            callback(errorResponse("before_id and after_id are mutually exclusive", HttpStatusCode::k400BadRequest));
+            return;
+        }
+        limit = std::max(1, std::min(limit, kMaxLimit));
+
+        auto cb = std::make_shared<std::function<void(const HttpResponsePtr&)>>(std::move(callback));
+        auto respond = [cb, limit](std::vector<Message>&& messages) {
+            // 结果集直接拼成响应 JSON，不经过 Json::Value
+            auto resp = HttpResponse::newHttpResponse();
+            resp->setContentTypeCode(CT_APPLICATION_JSON);
+            resp->setBody(FrameEncoder::encodeHistory(messages, static_cast<int>(messages.size()) == limit));
+            (*cb)(resp);
+        };
+
+        if (peerId > 0) {
+            MessageService::instance().getMessages(userId, peerId, beforeId, afterId, limit, std::move(respond));
+            return;
+        }
+
+        // 群聊历史只对成员开放
+        RoomService::instance().isMember(roomId, userId,
+            [cb, respond = std::move(respond), roomId, beforeId, afterId, limit](bool member) mutable {
+                if (!member) {
+                    (*cb)(errorResponse("Not a member of this room", HttpStatusCode::k403Forbidden));
+                    return;
+                }
+                MessageService::instance().getRoomMessages(roomId, beforeId, afterId, limit, std::move(respond));
+            });
+    }
+}
@@ -0,0 +1,143 @@
+#include <drogon/HttpController.h>
+#include <drogon/HttpResponse.h>
+#include "../services/FanoutService.h"
+#include "../services/MessageArchive.h"
+#include "../services/MessageArchiver.h"
+#include "../services/MessageCache.h"
+#include "../services/MessagePersister.h"
+#include "../services/MessageRouter.h"
+#include "../services/OutboundQueue.h"
+#include "../services/PasswordHasher.h"
+#include "../services/PresenceService.h"
+#include "../services/SessionRegistry.h"
+#include "../services/SessionStore.h"
+#include "../services/UserCache.h"
+#include "../utils/Metrics.h"
+
+using namespace drogon;
+
+namespace im_server {
+    // Prometheus 抓取端点。热路径指标由各模块直接写 Metrics，
+    // 各 Service 已有的 stats() 在这里注册为读取时回调，不改动它们的计数方式。
+    // 端点不做鉴权，部署时只应暴露给内网的抓取方。
+    class MetricsController : public drogon::HttpController<MetricsController> {
+    public:
+        METHOD_LIST_BEGIN
+        ADD_METHOD_TO(MetricsController::scrape, "/metrics", Get);
+        METHOD_LIST_END
+
+        MetricsController();
+
+        void scrape(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback);
+    };
+
+    namespace {
+        template <typename Service, typename Field>
+        void exportStat(const char* name, const char* help, Metrics::Type type, Field Service::Stats::*field) {
+            Metrics::instance().callback(name, help, type, [field]() {
+                return static_cast<double>(Service::instance().stats().*field);
+            });
+        }
+    }
+
+    MetricsController::MetricsController() {
+        using Type = Metrics::Type;
+
+        Metrics::instance().callback("im_ws_active_connections", "Open /ws/chat connections on this node", Type::Gauge,
+                                     []() { return static_cast<double>(SessionRegistry::instance().connectionCount()); });
+
+        exportStat<OutboundQueue>("im_outbound_unacked_bytes", "Bytes sent but not yet acked, all connections",
+                                  Type::Gauge, &OutboundQueue::Stats::unackedBytes);
+        exportStat<OutboundQueue>("im_outbound_peak_connection_bytes", "Largest unacked window seen on one connection",
+                                  Type::Gauge, &OutboundQueue::Stats::peakConnectionBytes);
+        exportStat<OutboundQueue>("im_outbound_slow_consumers", "Connections above the high watermark",
+                                  Type::Gauge, &OutboundQueue::Stats::slowConsumers);
+        exportStat<OutboundQueue>("im_outbound_evictions_total", "Connections closed for exceeding max_bytes",
+                                  Type::Counter, &OutboundQueue::Stats::evictions);
+        exportStat<OutboundQueue>("im_outbound_coalesced_events_total", "Coalescible events replaced while behind",
+                                  Type::Counter, &OutboundQueue::Stats::coalescedEvents);
+        exportStat<OutboundQueue>("im_outbound_dropped_events_total", "Frames dropped for full or evicted connections",
+                                  Type::Counter, &OutboundQueue::Stats::droppedEvents);
+
+        exportStat<MessagePersister>("im_persister_queue_depth", "Messages waiting to be written",
+                                     Type::Gauge, &MessagePersister::Stats::queueDepth);
+        exportStat<MessagePersister>("im_persister_flushes_total", "Batch INSERTs issued",
+                                     Type::Counter, &MessagePersister::Stats::flushes);
+        exportStat<MessagePersister>("im_persister_flushed_rows_total", "Rows written successfully",
+                                     Type::Counter, &MessagePersister::Stats::flushedRows);
+        exportStat<MessagePersister>("im_persister_failed_rows_total", "Rows whose batch failed after all retries",
+                                     Type::Counter, &MessagePersister::Stats::failedRows);
+        exportStat<MessagePersister>("im_persister_retries_total", "Batch INSERTs retried after a failure",
+                                     Type::Counter, &MessagePersister::Stats::retries);
+        exportStat<MessagePersister>("im_persister_rejected_total", "Messages rejected because the queue was full",
+                                     Type::Counter, &MessagePersister::Stats::rejected);
+
+        exportStat<MessageCache>("im_message_cache_hits_total", "History pages answered from cache",
+                                 Type::Counter, &MessageCache::Stats::hits);
+        exportStat<MessageCache>("im_message_cache_misses_total", "History pages that went to the database",
+                                 Type::Counter, &MessageCache::Stats::misses);
+        exportStat<MessageCache>("im_message_cache_bytes", "Bytes held by the message cache",
+                                 Type::Gauge, &MessageCache::Stats::bytes);
+
+        exportStat<FanoutService>("im_fanout_published_total", "Room messages published to IO loops",
+                                  Type::Counter, &FanoutService::Stats::published);
+        exportStat<FanoutService>("im_fanout_deliveries_total", "Room frames sent to connections",
+                                  Type::Counter, &FanoutService::Stats::deliveries);
+
+        exportStat<MessageRouter>("im_router_batches_published_total", "Cluster batches published to the bus",
+                                  Type::Counter, &MessageRouter::Stats::batchesPublished);
+        exportStat<MessageRouter>("im_router_deliveries_received_total", "Deliveries received from other nodes",
+                                  Type::Counter, &MessageRouter::Stats::deliveriesReceived);
+
+        exportStat<PresenceService>("im_presence_online_users", "Users with a connection on this node",
+                                    Type::Gauge, &PresenceService::Stats::onlineUsers);
+        exportStat<PresenceService>("im_presence_events_total", "Presence events sent to subscribers",
+                                    Type::Counter, &PresenceService::Stats::presenceEvents);
+
+        exportStat<PasswordHasher>("im_password_hash_queue_depth", "Password hash/verify tasks waiting for a worker",
+                                   Type::Gauge, &PasswordHasher::Stats::queueDepth);
+        exportStat<PasswordHasher>("im_password_hash_total", "Password hash/verify tasks completed",
+                                   Type::Counter, &PasswordHasher::Stats::hashed);
+        exportStat<PasswordHasher>("im_password_hash_rejected_total", "Auth requests shed because the hash queue was full",
+                                   Type::Counter, &PasswordHasher::Stats::rejected);
+        exportStat<PasswordHasher>("im_password_rehash_total", "Passwords rehashed on login with current parameters",
+                                   Type::Counter, &PasswordHasher::Stats::rehashed);
+
+        exportStat<MessageArchive>("im_archive_blocks", "Compressed blocks in the message archive",
+                                   Type::Gauge, &MessageArchive::Stats::blocks);
+        exportStat<MessageArchive>("im_archive_bytes", "Compressed bytes in the message archive",
+                                   Type::Gauge, &MessageArchive::Stats::bytes);
+        exportStat<MessageArchive>("im_archive_cold_reads_total", "Archive blocks decompressed for reads",
+                                   Type::Counter, &MessageArchive::Stats::coldReads);
+        exportStat<MessageArchiver>("im_archive_moved_rows_total", "Rows moved from the messages table to the archive",
+                                    Type::Counter, &MessageArchiver::Stats::movedRows);
+        exportStat<MessageArchiver>("im_archive_failed_runs_total", "Archive runs that stopped on an error",
+                                    Type::Counter, &MessageArchiver::Stats::failedRuns);
+
+        exportStat<UserCache>("im_user_cache_entries", "Users held by the login cache",
+                              Type::Gauge, &UserCache::Stats::entries);
+        exportStat<UserCache>("im_user_cache_hits_total", "Logins answered from the user cache",
+                              Type::Counter, &UserCache::Stats::hits);
+        exportStat<UserCache>("im_user_cache_misses_total", "Logins that queried the users table",
+                              Type::Counter, &UserCache::Stats::misses);
+        exportStat<UserCache>("im_user_cache_invalidations_total", "User cache invalidations",
+                              Type::Counter, &UserCache::Stats::invalidations);
+        exportStat<SessionStore>("im_sessions", "Refresh-token sessions held in memory on this node",
+                                 Type::Gauge, &SessionStore::Stats::sessions);
+        exportStat<SessionStore>("im_sessions_issued_total", "Refresh tokens issued",
+                                 Type::Counter, &SessionStore::Stats::issued);
+        exportStat<SessionStore>("im_session_refresh_local_hits_total", "Refreshes found in this node's memory",
+                                 Type::Counter, &SessionStore::Stats::localHits);
+        exportStat<SessionStore>("im_session_refresh_remote_hits_total", "Refreshes found only in redis",
+                                 Type::Counter, &SessionStore::Stats::remoteHits);
+        exportStat<SessionStore>("im_session_refresh_misses_total", "Refreshes with an invalid, expired or reused token",
+                                 Type::Counter, &SessionStore::Stats::misses);
+    }
+
+    void MetricsController::scrape(const HttpRequestPtr&, std::function<void(const HttpResponsePtr&)>&& callback) {
+        auto resp = HttpResponse::newHttpResponse();
+        resp->setContentTypeString("text/plain; version=0.0.4");
+        resp->setBody(Metrics::instance().render());
+        callback(resp);
+    }
+}
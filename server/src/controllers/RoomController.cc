@@ -0,0 +1,149 @@
+#include <drogon/HttpController.h>
+#include <drogon/HttpResponse.h>
+#include <json/json.h>
+#include "../services/RoomService.h"
+
+using namespace drogon;
+
+namespace im_server {
+    class RoomController : public drogon::HttpController<RoomController> {
+    public:
+        METHOD_LIST_BEGIN
+        ADD_METHOD_TO(RoomController::createRoom, "/api/rooms", Post, "im_server::JwtFilter");
+        ADD_METHOD_TO(RoomController::joinRoom, "/api/rooms/{1}/join", Post, "im_server::JwtFilter");
+        ADD_METHOD_TO(RoomController::addMember, "/api/rooms/{1}/members", Post, "im_server::JwtFilter");
+        ADD_METHOD_TO(RoomController::leaveRoom, "/api/rooms/{1}/leave", Post, "im_server::JwtFilter");
+        METHOD_LIST_END
+
+        void createRoom(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback);
+        void joinRoom(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback,
+                      const std::string& roomId);
+        void addMember(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback,
+                       const std::string& roomId);
+        void leaveRoom(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback,
+                       const std::string& roomId);
+
+    private:
+        static constexpr size_t kMaxNameLength = 100;
+    };
+
+    namespace {
+        HttpResponsePtr jsonResponse(bool success, const std::string& message,
+                                     HttpStatusCode code = HttpStatusCode::k200OK) {
+            Json::Value ret;
+            ret["success"] = success;
+            ret["message"] = message;
+            auto resp = HttpResponse::newHttpJsonResponse(ret);
+            resp->setStatusCode(code);
+            return resp;
+        }
+
+        // JwtFilter 已完成鉴权；路径中的 room id 非法时返回 false
+        bool parseIds(const HttpRequestPtr& req, const std::string& roomIdStr, int64_t& userId, int64_t& roomId) {
+            try {
+                userId = std::stoll(req->attributes()->get<std::string>("user_id"));
+                roomId = std::stoll(roomIdStr);
+            } catch (const std::exception&) {
+                return false;
+            }
+            return roomId > 0;
+        }
+
+        HttpResponsePtr statusResponse(RoomService::Status status, const std::string& okMessage,
+                                       const std::string& notFoundMessage) {
+            switch (status) {
+            case RoomService::Status::Ok:
+                return jsonResponse(true, okMessage);
+            case RoomService::Status::NotFound:
+                return jsonResponse(false, notFoundMessage, HttpStatusCode::k404NotFound);
+            case RoomService::Status::Forbidden:
+                return jsonResponse(false, "Not allowed", HttpStatusCode::k403Forbidden);
+            default:
+                return jsonResponse(false, "Internal error", HttpStatusCode::k500InternalServerError);
+            }
+        }
+    }
+
+    void RoomController::createRoom(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+        auto json = req->getJsonObject();
+        std::string name = json && (*json)["name"].isString() ? (*json)["name"].asString() : "";
+        bool isPublic = json && (*json)["is_public"].isBool() && (*json)["is_public"].asBool();
+        if (name.empty() || name.size() > kMaxNameLength) {
+            callback(jsonResponse(false, "Room name is required (max 100 characters)", HttpStatusCode::k400BadRequest));
+            return;
+        }
+
+        int64_t ownerId;
+        try {
+            ownerId = std::stoll(req->attributes()->get<std::string>("user_id"));
+        } catch (const std::exception&) {
+            callback(jsonResponse(false, "Unauthorized", HttpStatusCode::k401Unauthorized));
+            return;
+        }
+
+        RoomService::instance().createRoom(ownerId, name, isPublic,
+            [callback = std::move(callback)](int64_t roomId) {
+                if (roomId == 0) {
+                    callback(jsonResponse(false, "Failed to create room", HttpStatusCode::k500InternalServerError));
+                    return;
+                }
+                Json::Value ret;
+                ret["success"] = true;
+                ret["room_id"] = std::to_string(roomId);
+                callback(HttpResponse::newHttpJsonResponse(ret));
+            });
+    }
+
+    void RoomController::joinRoom(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback,
+                                  const std::string& roomId) {
+        int64_t userId, id;
+        if (!parseIds(req, roomId, userId, id)) {
+            callback(jsonResponse(false, "Invalid room id", HttpStatusCode::k400BadRequest));
+            return;
+        }
+
+        RoomService::instance().joinRoom(id, userId,
+            [callback = std::move(callback)](RoomService::Status status) {
+                callback(statusResponse(status, "Joined room", "Room not found"));
+            });
+    }
+
+    void RoomController::addMember(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback,
+                                   const std::string& roomId) {
+        int64_t requesterId, id;
+        if (!parseIds(req, roomId, requesterId, id)) {
+            callback(jsonResponse(false, "Invalid room id", HttpStatusCode::k400BadRequest));
+            return;
+        }
+        auto json = req->getJsonObject();
+        int64_t userId = 0;
+        try {
+            userId = json && (*json)["user_id"].isString() ? std::stoll((*json)["user_id"].asString()) : 0;
+        } catch (const std::exception&) {
+        }
+        if (userId <= 0) {
+            callback(jsonResponse(false, "user_id is required", HttpStatusCode::k400BadRequest));
+            return;
+        }
+
+        RoomService::instance().addMember(id, requesterId, userId,
+            [callback = std::move(callback)](RoomService::Status status) {
+                callback(statusResponse(status, "Member added", "Room or user not found"));
+            });
+    }
+
+    void RoomController::leaveRoom(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback,
+                                   const std::string& roomId) {
+        int64_t userId, id;
+        if (!parseIds(req, roomId, userId, id)) {
+            callback(jsonResponse(false, "Invalid room id", HttpStatusCode::k400BadRequest));
+            return;
+        }
+
+        RoomService::instance().leaveRoom(id, userId,
+            [callback = std::move(callback)](bool ok) {
+                callback(ok ? jsonResponse(true, "Left room")
+                            : jsonResponse(false, "Not a member of this room", HttpStatusCode::k404NotFound));
+            });
+    }
+}
@@ -0,0 +1,28 @@
+#include "JwtFilter.h"
+#include "../utils/JwtUtil.h"
+#include <json/json.h>
+
+using namespace drogon;
+
+namespace im_server {
+
+    void JwtFilter::doFilter(const HttpRequestPtr& req,
+                             FilterCallback&& fcb,
+                             FilterChainCallback&& fccb) {
+        std::string token = JwtUtil::extractToken(req);
+        std::string userId = token.empty() ? "" : JwtUtil::verifyToken(token);
+
+        if (userId.empty()) {
+            Json::Value ret;
+            ret["success"] = false;
+            ret["message"] = "Unauthorized";
+            auto resp = HttpResponse::newHttpJsonResponse(ret);
+            resp->setStatusCode(HttpStatusCode::k401Unauthorized);
+            fcb(resp);
+            return;
+        }
+
+        req->attributes()->insert("user_id", userId);
+        fccb();
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <drogon/HttpFilter.h>
+
+using namespace drogon;
+
+namespace im_server
+{
+    // 校验 Bearer token（或 ?token= 参数），通过后把用户 id 放进请求属性 "user_id"，
+    // 失败直接返回 401。路由上以 "im_server::JwtFilter" 引用。
+    class JwtFilter : public drogon::HttpFilter<JwtFilter>
+    {
+    public:
+        void doFilter(const HttpRequestPtr &req,
+                      FilterCallback &&fcb,
+                      FilterChainCallback &&fccb) override;
+    };
+}
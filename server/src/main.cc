@@ -1,5 +1,20 @@
 #include <drogon/drogon.h>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include "services/FanoutService.h"
+#include "services/MessageArchiver.h"
+#include "services/MessageCache.h"
+#include "services/MessagePersister.h"
+#include "services/MessageRouter.h"
+#include "services/OutboundQueue.h"
+#include "services/PasswordHasher.h"
+#include "services/PresenceService.h"
+#include "services/SessionStore.h"
+#include "services/Storage.h"
+#include "services/SyncService.h"
+#include "services/UserCache.h"
+#include "utils/IdGenerator.h"
 
 using namespace drogon;
 
@@ -8,6 +23,63 @@ int main() {
     
     // Load configuration file
     app().loadConfigFile("config.json");
+
+    // 多实例部署时每个实例的 node_id 必须不同，保证消息 id 全局唯一
+    im_server::IdGenerator::setNodeId(app().getCustomConfig().get("node_id", 0).asInt64());
+
+    // 在处理请求前选定存储后端；embedded 后端在这里回放日志重建索引
+    im_server::Storage::instance();
+
+    // 多节点时其他节点写入的消息不经过本节点缓存，条目只信任 cluster_max_age_ms
+    const auto &cacheConfig = app().getCustomConfig()["message_cache"];
+    bool clustered = app().getCustomConfig()["cluster"].get("bus", "loopback").asString() == "redis";
+    im_server::MessageCache::instance().configure(
+        cacheConfig.get("max_bytes", 64 * 1024 * 1024).asUInt64(),
+        cacheConfig.get("per_conversation", 200).asUInt64(),
+        std::chrono::milliseconds(clustered ? cacheConfig.get("cluster_max_age_ms", 1000).asInt64() : 0));
+    im_server::MessagePersister::instance().setCommitHook([](const std::vector<im_server::Message> &rows) {
+        auto &cache = im_server::MessageCache::instance();
+        for (const auto &row : rows) {
+            cache.append(row);
+        }
+    });
+
+    const auto &outboundConfig = app().getCustomConfig()["outbound"];
+    im_server::OutboundQueue::instance().configure(
+        outboundConfig.get("low_watermark_bytes", 256 * 1024).asUInt64(),
+        outboundConfig.get("high_watermark_bytes", 1024 * 1024).asUInt64(),
+        outboundConfig.get("max_bytes", 4 * 1024 * 1024).asUInt64());
+
+    const auto &userCacheConfig = app().getCustomConfig()["auth"]["user_cache"];
+    im_server::UserCache::instance().configure(
+        userCacheConfig.get("max_entries", 100000).asUInt64(),
+        std::chrono::seconds(userCacheConfig.get("ttl_sec", 300).asInt64()));
+
+    // IO 线程就绪后启动消息批量写入阶段、群聊扇出、跨节点路由、在线状态和上线同步
+    app().registerBeginningAdvice([]() {
+        im_server::MessagePersister::instance().start();
+        im_server::FanoutService::instance().start();
+        im_server::MessageRouter::instance().start();
+        im_server::PresenceService::instance().start();
+        im_server::SyncService::instance().start();
+        im_server::MessageArchiver::instance().start();
+        im_server::PasswordHasher::instance().start();
+        im_server::SessionStore::instance().start();
+    });
+
+    // 停机前先把写入队列里的消息落库；再次收到信号时直接退出
+    auto shutdown = []() {
+        static std::atomic<bool> draining{false};
+        if (draining.exchange(true)) {
+            app().quit();
+            return;
+        }
+        im_server::MessagePersister::instance().drain([]() {
+            app().quit();
+        });
+    };
+    app().setTermSignalHandler(shutdown);
+    app().setIntSignalHandler(shutdown);
     
     // Start the server
     app().run();
@@ -1,28 +1,72 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <drogon/orm/DbClient.h>
 
 using namespace drogon::orm;
 
 namespace im_server {
+    // 单聊会话 id：两个用户 id 中较小者放高 32 位、较大者放低 32 位，
+    // 与发送方向无关，同一对用户的消息落在同一个 (conversation_id, id) 索引区间
+    inline uint64_t makeConversationId(int64_t userA, int64_t userB) {
+        auto lo = static_cast<uint64_t>(std::min(userA, userB));
+        auto hi = static_cast<uint64_t>(std::max(userA, userB));
+        return (lo << 32) | (hi & 0xFFFFFFFFULL);
+    }
+
+    // 群聊会话 id：最高位置 1，与单聊会话 id（用户 id 均小于 2^31）不会重叠
+    inline uint64_t makeRoomConversationId(int64_t roomId) {
+        return (1ULL << 63) | static_cast<uint64_t>(roomId);
+    }
+
+    // 与 messages.message_type 的 ENUM('text', 'image', 'file') 一一对应
+    enum class MessageType : uint8_t {
+        Text = 0,
+        Image = 1,
+        File = 2
+    };
+
+    inline std::string_view messageTypeName(MessageType type) {
+        static constexpr std::string_view kNames[] = {"text", "image", "file"};
+        auto index = static_cast<size_t>(type);
+        return index < sizeof(kNames) / sizeof(kNames[0]) ? kNames[index] : kNames[0];
+    }
+
+    // 未知的类型按 text 处理
+    inline MessageType parseMessageType(std::string_view name) {
+        if (name == "image") {
+            return MessageType::Image;
+        }
+        if (name == "file") {
+            return MessageType::File;
+        }
+        return MessageType::Text;
+    }
+
+    // 整数字段在前、两个单字节字段在最后，64 位下 sizeof(Message) 为 80；
+    // 只有 content 可能占用堆内存
     struct Message {
         int64_t id;
         int64_t sender_id;
         int64_t receiver_id;
+        int64_t room_id = 0; // 群聊消息所属房间，单聊为 0（此时 receiver_id 有效）
+        int64_t timestamp; // Unix 毫秒，下发时再由 TimeUtil 格式化
         std::string content;
-        std::string message_type; // text, image, file, etc.
-        std::string timestamp;
+        MessageType message_type;
         bool is_read;
-        std::string file_path; // For file messages
 
-        Message() : id(0), sender_id(0), receiver_id(0), is_read(false) {}
+        Message() : id(0), sender_id(0), receiver_id(0), timestamp(0), message_type(MessageType::Text), is_read(false) {}
+
+        Message(int64_t id, int64_t sender_id, int64_t receiver_id, std::string content,
+                MessageType message_type, int64_t timestamp, bool is_read = false)
+            : id(id), sender_id(sender_id), receiver_id(receiver_id), timestamp(timestamp),
+              content(std::move(content)), message_type(message_type), is_read(is_read) {}
 
-        Message(int64_t id, int64_t sender_id, int64_t receiver_id, const std::string& content,
-                const std::string& message_type, const std::string& timestamp, 
-                bool is_read = false, const std::string& file_path = "")
-            : id(id), sender_id(sender_id), receiver_id(receiver_id), content(content),
-              message_type(message_type), timestamp(timestamp), is_read(is_read), 
-              file_path(file_path) {}
+        uint64_t conversationId() const {
+            return room_id != 0 ? makeRoomConversationId(room_id) : makeConversationId(sender_id, receiver_id);
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,275 @@
+#include "AppendLog.h"
+#include <trantor/utils/Logger.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace im_server {
+
+    namespace {
+        // CRC32（IEEE 多项式），只用于识别写了一半的尾部记录
+        const std::array<uint32_t, 256>& crcTable() {
+            static const auto table = []() {
+                std::array<uint32_t, 256> t{};
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; ++k) {
+                        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    }
+                    t[i] = c;
+                }
+                return t;
+            }();
+            return table;
+        }
+
+        uint32_t crc32(uint32_t crc, const void* data, size_t size) {
+            const auto& table = crcTable();
+            auto* p = static_cast<const uint8_t*>(data);
+            crc = ~crc;
+            for (size_t i = 0; i < size; ++i) {
+                crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        uint32_t recordCrc(uint8_t type, std::string_view payload) {
+            return crc32(crc32(0, &type, 1), payload.data(), payload.size());
+        }
+
+        void storeU32(char* out, uint32_t value) {
+            for (int i = 0; i < 4; ++i) {
+                out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+            }
+        }
+
+        uint32_t loadU32(const char* in) {
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) {
+                value |= static_cast<uint32_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+            }
+            return value;
+        }
+
+        constexpr size_t kPageBytes = 4096;
+    }
+
+    AppendLog::AppendLog(std::string dir, size_t segmentBytes)
+        : dir_(std::move(dir)), segmentBytes_(std::max<size_t>(segmentBytes, 1 << 20)) {}
+
+    AppendLog::~AppendLog() {
+        for (auto& segment : segments_) {
+            if (segment.data) {
+                msync(segment.data, segment.writeOffset, MS_SYNC);
+                munmap(segment.data, segment.size);
+            }
+            if (segment.fd >= 0) {
+                ::close(segment.fd);
+            }
+        }
+    }
+
+    std::string AppendLog::segmentPath(uint32_t sequence) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%08u.seg", sequence);
+        return dir_ + name;
+    }
+
+    bool AppendLog::open(const ReplayHandler& replay) {
+        if (::mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOG_ERROR << "Cannot create log directory " << dir_ << ": " << std::strerror(errno);
+            return false;
+        }
+
+        std::vector<uint32_t> sequences;
+        if (DIR* dir = ::opendir(dir_.c_str())) {
+            while (auto* entry = ::readdir(dir)) {
+                unsigned sequence;
+                char suffix[8];
+                if (std::sscanf(entry->d_name, "%8u.%3s", &sequence, suffix) == 2 && std::strcmp(suffix, "seg") == 0) {
+                    sequences.push_back(sequence);
+                }
+            }
+            ::closedir(dir);
+        }
+        std::sort(sequences.begin(), sequences.end());
+
+        for (auto sequence : sequences) {
+            Segment segment;
+            segment.sequence = sequence;
+            if (!mapSegment(segment, false)) {
+                return false;
+            }
+            segments_.push_back(segment);
+            recover(segments_.back(), static_cast<uint32_t>(segments_.size() - 1), replay);
+        }
+
+        if (segments_.empty()) {
+            return rollSegment();
+        }
+        return true;
+    }
+
+    bool AppendLog::mapSegment(Segment& segment, bool create) {
+        auto path = segmentPath(segment.sequence);
+        segment.fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+        if (segment.fd < 0) {
+            LOG_ERROR << "Cannot open log segment " << path << ": " << std::strerror(errno);
+            return false;
+        }
+        // 失败时关闭 fd；新建的段同时删除，下次滚动时还能用同一个序号重新创建
+        auto fail = [&segment, &path, create]() {
+            ::close(segment.fd);
+            segment.fd = -1;
+            if (create) {
+                ::unlink(path.c_str());
+            }
+            return false;
+        };
+
+        struct stat st {};
+        if (::fstat(segment.fd, &st) != 0) {
+            LOG_ERROR << "Cannot stat log segment " << path << ": " << std::strerror(errno);
+            return fail();
+        }
+        segment.size = static_cast<size_t>(st.st_size);
+        // 新段，或上次创建后还没来得及扩展就崩溃的段
+        if (segment.size < kHeaderBytes) {
+            segment.size = segmentBytes_;
+        }
+        // 预先分配磁盘块而不是 ftruncate 出稀疏文件：磁盘满时在这里失败，
+        // 而不是之后写映射区域时收到 SIGBUS。已分配的区域（包括旧版本留下的稀疏段）重复调用只补齐空洞
+        int error = ::posix_fallocate(segment.fd, 0, static_cast<off_t>(segment.size));
+        if (error != 0) {
+            LOG_ERROR << "Cannot allocate log segment " << path << ": " << std::strerror(error);
+            return fail();
+        }
+
+        void* data = ::mmap(nullptr, segment.size, PROT_READ | PROT_WRITE, MAP_SHARED, segment.fd, 0);
+        if (data == MAP_FAILED) {
+            LOG_ERROR << "Cannot map log segment " << path << ": " << std::strerror(errno);
+            return fail();
+        }
+        segment.data = static_cast<char*>(data);
+        return true;
+    }
+
+    void AppendLog::recover(Segment& segment, uint32_t index, const ReplayHandler& replay) {
+        size_t offset = 0;
+        while (offset + kHeaderBytes <= segment.size) {
+            const char* header = segment.data + offset;
+            uint32_t length = loadU32(header);
+            uint32_t crc = loadU32(header + 4);
+            auto type = static_cast<uint8_t>(header[8]);
+            if (length == 0 && crc == 0 && type == 0) {
+                break;
+            }
+            if (type == 0 || length > segment.size - offset - kHeaderBytes) {
+                break;
+            }
+            std::string_view payload(header + kHeaderBytes, length);
+            if (recordCrc(type, payload) != crc) {
+                break;
+            }
+            replay(type, payload, (static_cast<uint64_t>(index) << 32) | offset);
+            offset += kHeaderBytes + length;
+        }
+
+        // 找到第一个全 0 的页，其后不可能有写过的数据；中间的残留清零，防止以后被误认为有效记录
+        size_t dirtyEnd = std::min((offset + kPageBytes) / kPageBytes * kPageBytes, segment.size);
+        size_t probe = dirtyEnd;
+        while (probe < segment.size) {
+            size_t end = std::min(probe + kPageBytes, segment.size);
+            if (std::all_of(segment.data + probe, segment.data + end, [](char c) { return c == 0; })) {
+                break;
+            }
+            dirtyEnd = end;
+            probe = end;
+        }
+        bool torn = std::any_of(segment.data + offset, segment.data + dirtyEnd, [](char c) { return c != 0; });
+        if (torn) {
+            LOG_WARN << "Truncating log segment " << segmentPath(segment.sequence) << " at offset " << offset
+                     << ", discarding " << (dirtyEnd - offset) << " bytes";
+            std::memset(segment.data + offset, 0, dirtyEnd - offset);
+            msync(segment.data, dirtyEnd, MS_SYNC);
+            truncatedBytes_ += dirtyEnd - offset;
+        }
+
+        segment.writeOffset = offset;
+        segment.syncedOffset = offset;
+    }
+
+    bool AppendLog::rollSegment() {
+        if (!segments_.empty()) {
+            auto& last = segments_.back();
+            msync(last.data, last.writeOffset, MS_ASYNC);
+        }
+        Segment segment;
+        segment.sequence = segments_.empty() ? 1 : segments_.back().sequence + 1;
+        if (!mapSegment(segment, true)) {
+            return false;
+        }
+        segments_.push_back(segment);
+        return true;
+    }
+
+    bool AppendLog::append(uint8_t type, std::string_view payload, Location* location) {
+        size_t recordBytes = kHeaderBytes + payload.size();
+        if (type == 0 || recordBytes > segmentBytes_) {
+            return false;
+        }
+        if (segments_.back().writeOffset + recordBytes > segments_.back().size && !rollSegment()) {
+            return false;
+        }
+
+        auto& segment = segments_.back();
+        char* out = segment.data + segment.writeOffset;
+        // 记录可能跨页，崩溃时只有部分页被写回的情况由恢复时的 CRC 校验识别
+        std::memcpy(out + kHeaderBytes, payload.data(), payload.size());
+        out[8] = static_cast<char>(type);
+        storeU32(out + 4, recordCrc(type, payload));
+        storeU32(out, static_cast<uint32_t>(payload.size()));
+
+        if (location) {
+            *location = (static_cast<uint64_t>(segments_.size() - 1) << 32) | segment.writeOffset;
+        }
+        segment.writeOffset += recordBytes;
+        return true;
+    }
+
+    void AppendLog::sync() {
+        for (auto& segment : segments_) {
+            if (segment.syncedOffset == segment.writeOffset) {
+                continue;
+            }
+            // msync 要求起始地址按页对齐
+            size_t begin = segment.syncedOffset / kPageBytes * kPageBytes;
+            msync(segment.data + begin, segment.writeOffset - begin, MS_SYNC);
+            segment.syncedOffset = segment.writeOffset;
+        }
+    }
+
+    std::string_view AppendLog::read(Location location, uint8_t* type) const {
+        const auto& segment = segments_[location >> 32];
+        const char* header = segment.data + (location & 0xFFFFFFFFu);
+        if (type) {
+            *type = static_cast<uint8_t>(header[8]);
+        }
+        return std::string_view(header + kHeaderBytes, loadU32(header));
+    }
+
+    uint64_t AppendLog::bytesWritten() const {
+        uint64_t total = 0;
+        for (const auto& segment : segments_) {
+            total += segment.writeOffset;
+        }
+        return total;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace im_server
+{
+    // 段式追加日志。目录下按序号命名的定长段文件（00000001.seg、00000002.seg ...），
+    // 每个段创建时用 posix_fallocate 预分配到固定大小并整体 mmap，追加写就是一次 memcpy，读取直接返回映射内的视图。
+    // 磁盘空间不足时滚动新段失败，append 返回 false，不会在写映射区域时收到 SIGBUS。
+    //
+    // 记录格式（小端）：[u32 payload 长度][u32 CRC32(type + payload)][u8 type][payload]
+    // 段内未写过的区域全为 0，遇到全 0 的记录头即为段尾。
+    // 崩溃恢复：open() 从头扫描所有段，遇到校验失败的记录（写了一半）就把该段截断到这里并清零其后的区域。
+    //
+    // 非线程安全，由调用方保证同一时刻只有一个线程访问（EmbeddedStorage 只在自己的工作线程上使用）。
+    class AppendLog
+    {
+    public:
+        // (段序号 << 32) | 段内偏移，供索引保存
+        using Location = uint64_t;
+        using ReplayHandler = std::function<void(uint8_t type, std::string_view payload, Location location)>;
+
+        static constexpr size_t kHeaderBytes = 9;
+
+        AppendLog(std::string dir, size_t segmentBytes);
+        ~AppendLog();
+        AppendLog(const AppendLog &) = delete;
+        AppendLog &operator=(const AppendLog &) = delete;
+
+        // 打开（必要时创建）目录并按写入顺序回放所有有效记录，失败返回 false
+        bool open(const ReplayHandler &replay);
+
+        // 追加一条记录，当前段放不下时滚动到新段；type 不能为 0，记录大于段大小时返回 false
+        bool append(uint8_t type, std::string_view payload, Location *location = nullptr);
+        // 把上次 sync 之后写入的区域同步刷到磁盘（msync MS_SYNC）。
+        // 不调用时数据留在页缓存里，进程崩溃不会丢，只有机器掉电才会丢
+        void sync();
+
+        // location 必须来自 append / 回放
+        std::string_view read(Location location, uint8_t *type = nullptr) const;
+
+        size_t segmentCount() const { return segments_.size(); }
+        uint64_t bytesWritten() const;
+        // 回放时被截断的字节数（崩溃时写了一半的尾部）
+        uint64_t truncatedBytes() const { return truncatedBytes_; }
+
+    private:
+        struct Segment
+        {
+            uint32_t sequence = 0;
+            int fd = -1;
+            char *data = nullptr;
+            size_t size = 0;
+            size_t writeOffset = 0;
+            size_t syncedOffset = 0;
+        };
+
+        bool mapSegment(Segment &segment, bool create);
+        bool rollSegment();
+        std::string segmentPath(uint32_t sequence) const;
+        void recover(Segment &segment, uint32_t index, const ReplayHandler &replay);
+
+        std::string dir_;
+        size_t segmentBytes_;
+        std::vector<Segment> segments_;
+        uint64_t truncatedBytes_ = 0;
+    };
+}
@@ -0,0 +1,617 @@
+#include "EmbeddedStorage.h"
+#include <trantor/utils/Logger.h>
+#include <algorithm>
+#include <cstdlib>
+
+namespace im_server {
+
+    namespace {
+        // 记录 payload 的编码：整数固定 8 字节小端，字符串为 u32 长度 + 字节
+        class RecordWriter {
+        public:
+            RecordWriter& i64(int64_t value) {
+                auto v = static_cast<uint64_t>(value);
+                for (int i = 0; i < 8; ++i) {
+                    buffer_.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+                }
+                return *this;
+            }
+
+            RecordWriter& str(std::string_view value) {
+                auto size = static_cast<uint32_t>(value.size());
+                for (int i = 0; i < 4; ++i) {
+                    buffer_.push_back(static_cast<char>((size >> (8 * i)) & 0xFF));
+                }
+                buffer_.append(value);
+                return *this;
+            }
+
+            const std::string& data() const { return buffer_; }
+
+        private:
+            std::string buffer_;
+        };
+
+        class RecordReader {
+        public:
+            explicit RecordReader(std::string_view data) : data_(data) {}
+
+            int64_t i64() {
+                if (data_.size() < 8) {
+                    ok_ = false;
+                    return 0;
+                }
+                uint64_t v = 0;
+                for (int i = 0; i < 8; ++i) {
+                    v |= static_cast<uint64_t>(static_cast<uint8_t>(data_[i])) << (8 * i);
+                }
+                data_.remove_prefix(8);
+                return static_cast<int64_t>(v);
+            }
+
+            std::string_view str() {
+                if (data_.size() < 4) {
+                    ok_ = false;
+                    return {};
+                }
+                uint32_t size = 0;
+                for (int i = 0; i < 4; ++i) {
+                    size |= static_cast<uint32_t>(static_cast<uint8_t>(data_[i])) << (8 * i);
+                }
+                data_.remove_prefix(4);
+                if (data_.size() < size) {
+                    ok_ = false;
+                    return {};
+                }
+                auto value = data_.substr(0, size);
+                data_.remove_prefix(size);
+                return value;
+            }
+
+            bool ok() const { return ok_; }
+            // 旧版本写入的记录可能没有后来追加的字段
+            bool done() const { return data_.empty(); }
+
+        private:
+            std::string_view data_;
+            bool ok_ = true;
+        };
+
+        // 大多数情况下 id 递增，直接追加；批次之间乱序时插到正确位置
+        template <typename Ref>
+        void insertSorted(std::vector<Ref>& refs, const Ref& ref) {
+            if (refs.empty() || refs.back().id < ref.id) {
+                refs.push_back(ref);
+                return;
+            }
+            auto it = std::upper_bound(refs.begin(), refs.end(), ref.id,
+                                       [](int64_t id, const Ref& r) { return id < r.id; });
+            refs.insert(it, ref);
+        }
+
+        template <typename Ref>
+        typename std::vector<Ref>::const_iterator firstAfter(const std::vector<Ref>& refs, int64_t id) {
+            return std::upper_bound(refs.begin(), refs.end(), id,
+                                    [](int64_t value, const Ref& r) { return value < r.id; });
+        }
+    }
+
+    EmbeddedStorage::EmbeddedStorage(const Options& options)
+        : options_(options), log_(options.dataDir, options.segmentBytes), thread_("EmbeddedStorage") {
+        size_t records = 0;
+        bool opened = log_.open([this, &records](uint8_t type, std::string_view payload, AppendLog::Location location) {
+            apply(type, payload, location);
+            ++records;
+        });
+        if (!opened) {
+            LOG_FATAL << "Cannot open embedded storage at " << options_.dataDir;
+            std::exit(1);
+        }
+        LOG_INFO << "Embedded storage recovered " << records << " records (" << messagesById_.size() << " messages, "
+                 << users_.size() << " users) from " << log_.segmentCount() << " segments, "
+                 << log_.truncatedBytes() << " bytes truncated";
+        thread_.run();
+    }
+
+    void EmbeddedStorage::post(std::function<void()>&& task) {
+        thread_.getLoop()->queueInLoop(std::move(task));
+    }
+
+    bool EmbeddedStorage::write(RecordType type, const std::string& payload) {
+        AppendLog::Location location;
+        if (!log_.append(type, payload, &location)) {
+            LOG_ERROR << "Error appending record type " << static_cast<int>(type) << " to embedded storage";
+            return false;
+        }
+        apply(type, payload, location);
+        return true;
+    }
+
+    void EmbeddedStorage::commit() {
+        if (options_.fsync) {
+            log_.sync();
+        }
+    }
+
+    void EmbeddedStorage::apply(uint8_t type, std::string_view payload, AppendLog::Location location) {
+        RecordReader reader(payload);
+        switch (type) {
+        case kMessage: {
+            int64_t id = reader.i64();
+            int64_t senderId = reader.i64();
+            int64_t receiverId = reader.i64();
+            int64_t roomId = reader.i64();
+            if (!reader.ok() || !messagesById_.emplace(id, location).second) {
+                return;
+            }
+            MessageRef ref{id, location};
+            if (roomId != 0) {
+                insertSorted(conversations_[makeRoomConversationId(roomId)], ref);
+            } else {
+                insertSorted(conversations_[makeConversationId(senderId, receiverId)], ref);
+                insertSorted(inboxes_[receiverId], ref);
+            }
+            break;
+        }
+        case kMarkRead:
+            readIds_.insert(reader.i64());
+            break;
+        case kMarkConversationRead: {
+            auto conversationId = static_cast<uint64_t>(reader.i64());
+            int64_t receiverId = reader.i64();
+            int64_t upToId = reader.i64();
+            auto& watermark = readUpTo_[{conversationId, receiverId}];
+            watermark = std::max(watermark, upToId);
+            break;
+        }
+        case kUser: {
+            User user;
+            user.id = reader.i64();
+            user.username = std::string(reader.str());
+            user.email = std::string(reader.str());
+            user.password_hash = std::string(reader.str());
+            user.created_at = std::string(reader.str());
+            user.updated_at = user.created_at;
+            if (!reader.ok()) {
+                return;
+            }
+            nextUserId_ = std::max(nextUserId_, user.id + 1);
+            usersByName_[user.username] = user.id;
+            usersByEmail_[user.email] = user.id;
+            users_[user.id] = std::move(user);
+            break;
+        }
+        case kRoom: {
+            int64_t roomId = reader.i64();
+            int64_t ownerId = reader.i64();
+            auto name = reader.str();
+            bool isPublic = !reader.done() && reader.i64() != 0;
+            if (!reader.ok()) {
+                return;
+            }
+            auto& room = rooms_[roomId];
+            room.name = std::string(name);
+            room.ownerId = ownerId;
+            room.isPublic = isPublic;
+            // 创建者同时成为成员，与 MySQL 后端的两条 INSERT 对应
+            if (room.members.insert(ownerId).second) {
+                userRooms_[ownerId].push_back(roomId);
+            }
+            break;
+        }
+        case kRoomJoin: {
+            int64_t roomId = reader.i64();
+            int64_t userId = reader.i64();
+            auto it = rooms_.find(roomId);
+            if (it != rooms_.end() && it->second.members.insert(userId).second) {
+                userRooms_[userId].push_back(roomId);
+            }
+            break;
+        }
+        case kRoomLeave: {
+            int64_t roomId = reader.i64();
+            int64_t userId = reader.i64();
+            auto it = rooms_.find(roomId);
+            if (it != rooms_.end() && it->second.members.erase(userId) > 0) {
+                auto& rooms = userRooms_[userId];
+                rooms.erase(std::remove(rooms.begin(), rooms.end(), roomId), rooms.end());
+            }
+            break;
+        }
+        case kCursor: {
+            int64_t userId = reader.i64();
+            int64_t lastId = reader.i64();
+            auto& cursor = cursors_[userId];
+            cursor = std::max(cursor, lastId);
+            break;
+        }
+        case kPasswordHash: {
+            int64_t userId = reader.i64();
+            auto hash = reader.str();
+            auto it = users_.find(userId);
+            if (reader.ok() && it != users_.end()) {
+                it->second.password_hash = std::string(hash);
+            }
+            break;
+        }
+        case kUserActive: {
+            int64_t userId = reader.i64();
+            bool active = reader.i64() != 0;
+            auto it = users_.find(userId);
+            if (reader.ok() && it != users_.end()) {
+                it->second.is_active = active;
+            }
+            break;
+        }
+        default:
+            LOG_WARN << "Skipping unknown record type " << static_cast<int>(type) << " in embedded storage";
+            break;
+        }
+    }
+
+    Message EmbeddedStorage::load(AppendLog::Location location) const {
+        RecordReader reader(log_.read(location));
+        Message message;
+        message.id = reader.i64();
+        message.sender_id = reader.i64();
+        message.receiver_id = reader.i64();
+        message.room_id = reader.i64();
+        message.timestamp = reader.i64();
+        message.message_type = parseMessageType(reader.str());
+        message.content = std::string(reader.str());
+        message.is_read = isRead(message);
+        return message;
+    }
+
+    std::vector<Message> EmbeddedStorage::loadRange(std::vector<MessageRef>::const_iterator first,
+                                                    std::vector<MessageRef>::const_iterator last) const {
+        std::vector<Message> messages;
+        messages.reserve(static_cast<size_t>(last - first));
+        for (; first != last; ++first) {
+            messages.push_back(load(first->location));
+        }
+        return messages;
+    }
+
+    bool EmbeddedStorage::isRead(const Message& message) const {
+        // 群聊消息没有单一接收方，与 MySQL 后端一样始终为未读
+        if (message.room_id != 0) {
+            return false;
+        }
+        auto it = readUpTo_.find({message.conversationId(), message.receiver_id});
+        if (it != readUpTo_.end() && message.id <= it->second) {
+            return true;
+        }
+        return readIds_.count(message.id) > 0;
+    }
+
+    void EmbeddedStorage::insertMessages(const std::vector<Message>& rows, BoolCallback&& callback) {
+        post([this, rows, callback = std::move(callback)]() {
+            // 先检查整批都放得进一个段，保证除了磁盘错误外整批要么全部写入要么全部拒绝
+            std::vector<std::string> payloads;
+            payloads.reserve(rows.size());
+            for (const auto& message : rows) {
+                // 重试的批次里上次已经写入的消息
+                if (messagesById_.count(message.id) > 0) {
+                    continue;
+                }
+                RecordWriter writer;
+                writer.i64(message.id).i64(message.sender_id).i64(message.room_id != 0 ? 0 : message.receiver_id)
+                      .i64(message.room_id).i64(message.timestamp).str(messageTypeName(message.message_type)).str(message.content);
+                if (writer.data().size() + AppendLog::kHeaderBytes > options_.segmentBytes) {
+                    LOG_ERROR << "Message " << message.id << " is larger than a log segment";
+                    callback(false);
+                    return;
+                }
+                payloads.push_back(writer.data());
+            }
+
+            bool ok = true;
+            for (const auto& payload : payloads) {
+                ok = write(kMessage, payload) && ok;
+            }
+            commit();
+            callback(ok);
+        });
+    }
+
+    void EmbeddedStorage::getConversationMessages(uint64_t conversationId, int64_t beforeId, int64_t afterId,
+                                                  int limit, MessagesCallback&& callback) {
+        post([this, conversationId, beforeId, afterId, limit, callback = std::move(callback)]() {
+            auto it = conversations_.find(conversationId);
+            if (it == conversations_.end() || limit <= 0) {
+                callback({});
+                return;
+            }
+            const auto& refs = it->second;
+            auto count = static_cast<size_t>(limit);
+            if (afterId > 0) {
+                auto first = firstAfter(refs, afterId);
+                auto last = first + static_cast<ptrdiff_t>(std::min<size_t>(count, refs.end() - first));
+                callback(loadRange(first, last));
+                return;
+            }
+            auto last = beforeId > 0 ? std::lower_bound(refs.begin(), refs.end(), beforeId,
+                                                        [](const MessageRef& r, int64_t id) { return r.id < id; })
+                                     : refs.end();
+            auto first = last - static_cast<ptrdiff_t>(std::min<size_t>(count, last - refs.begin()));
+            callback(loadRange(first, last));
+        });
+    }
+
+    void EmbeddedStorage::getMessagesForReceiver(int64_t receiverId, int64_t afterId, int limit,
+                                                 MessagesCallback&& callback) {
+        post([this, receiverId, afterId, limit, callback = std::move(callback)]() {
+            auto it = inboxes_.find(receiverId);
+            if (it == inboxes_.end() || limit <= 0) {
+                callback({});
+                return;
+            }
+            auto first = firstAfter(it->second, afterId);
+            auto last = first + static_cast<ptrdiff_t>(std::min<size_t>(limit, it->second.end() - first));
+            callback(loadRange(first, last));
+        });
+    }
+
+    void EmbeddedStorage::getUnreadMessages(int64_t receiverId, MessagesCallback&& callback) {
+        post([this, receiverId, callback = std::move(callback)]() {
+            std::vector<Message> messages;
+            auto it = inboxes_.find(receiverId);
+            if (it != inboxes_.end()) {
+                for (const auto& ref : it->second) {
+                    auto message = load(ref.location);
+                    if (!message.is_read) {
+                        messages.push_back(std::move(message));
+                    }
+                }
+            }
+            callback(std::move(messages));
+        });
+    }
+
+    void EmbeddedStorage::getMessageById(int64_t messageId, MessageCallback&& callback) {
+        post([this, messageId, callback = std::move(callback)]() {
+            auto it = messagesById_.find(messageId);
+            callback(it != messagesById_.end() ? load(it->second) : Message());
+        });
+    }
+
+    void EmbeddedStorage::markRead(int64_t messageId, int64_t receiverId, BoolCallback&& callback) {
+        post([this, messageId, receiverId, callback = std::move(callback)]() {
+            auto it = messagesById_.find(messageId);
+            if (it == messagesById_.end()) {
+                callback(false);
+                return;
+            }
+            auto message = load(it->second);
+            if (message.room_id != 0 || message.receiver_id != receiverId) {
+                callback(false);
+                return;
+            }
+            if (message.is_read) {
+                callback(true);
+                return;
+            }
+            RecordWriter writer;
+            writer.i64(messageId);
+            bool ok = write(kMarkRead, writer.data());
+            commit();
+            callback(ok);
+        });
+    }
+
+    void EmbeddedStorage::markConversationRead(uint64_t conversationId, int64_t receiverId, int64_t upToId,
+                                               BoolCallback&& callback) {
+        post([this, conversationId, receiverId, upToId, callback = std::move(callback)]() {
+            auto it = readUpTo_.find({conversationId, receiverId});
+            if (it != readUpTo_.end() && it->second >= upToId) {
+                callback(true);
+                return;
+            }
+            RecordWriter writer;
+            writer.i64(static_cast<int64_t>(conversationId)).i64(receiverId).i64(upToId);
+            bool ok = write(kMarkConversationRead, writer.data());
+            commit();
+            callback(ok);
+        });
+    }
+
+    void EmbeddedStorage::createUser(const std::string& username, const std::string& email,
+                                     const std::string& passwordHash, const std::string& createdAt,
+                                     CreateUserCallback&& callback) {
+        post([this, username, email, passwordHash, createdAt, callback = std::move(callback)]() {
+            if (usersByName_.count(username)) {
+                callback(Status::UsernameTaken, 0);
+                return;
+            }
+            if (usersByEmail_.count(email)) {
+                callback(Status::EmailTaken, 0);
+                return;
+            }
+            int64_t userId = nextUserId_;
+            RecordWriter writer;
+            writer.i64(userId).str(username).str(email).str(passwordHash).str(createdAt);
+            bool ok = write(kUser, writer.data());
+            commit();
+            callback(ok ? Status::Ok : Status::Error, ok ? userId : 0);
+        });
+    }
+
+    void EmbeddedStorage::findUserByName(const std::string& username, UserCallback&& callback) {
+        post([this, username, callback = std::move(callback)]() {
+            auto it = usersByName_.find(username);
+            if (it == usersByName_.end() || !users_.at(it->second).is_active) {
+                callback(Status::NotFound, User());
+                return;
+            }
+            User user = users_.at(it->second);
+            callback(Status::Ok, std::move(user));
+        });
+    }
+
+    void EmbeddedStorage::findUserById(int64_t userId, UserCallback&& callback) {
+        post([this, userId, callback = std::move(callback)]() {
+            auto it = users_.find(userId);
+            if (it == users_.end() || !it->second.is_active) {
+                callback(Status::NotFound, User());
+                return;
+            }
+            User user = it->second;
+            user.password_hash.clear();
+            callback(Status::Ok, std::move(user));
+        });
+    }
+
+    void EmbeddedStorage::updatePasswordHash(int64_t userId, const std::string& passwordHash,
+                                             BoolCallback&& callback) {
+        post([this, userId, passwordHash, callback = std::move(callback)]() {
+            if (!users_.count(userId)) {
+                callback(false);
+                return;
+            }
+            RecordWriter writer;
+            writer.i64(userId).str(passwordHash);
+            bool ok = write(kPasswordHash, writer.data());
+            commit();
+            callback(ok);
+        });
+    }
+
+    void EmbeddedStorage::setUserActive(int64_t userId, bool active, BoolCallback&& callback) {
+        post([this, userId, active, callback = std::move(callback)]() {
+            if (!users_.count(userId)) {
+                callback(false);
+                return;
+            }
+            RecordWriter writer;
+            writer.i64(userId).i64(active ? 1 : 0);
+            bool ok = write(kUserActive, writer.data());
+            commit();
+            callback(ok);
+        });
+    }
+
+    void EmbeddedStorage::createRoom(int64_t roomId, const std::string& name, int64_t ownerId, bool isPublic,
+                                     BoolCallback&& callback) {
+        post([this, roomId, name, ownerId, isPublic, callback = std::move(callback)]() {
+            if (rooms_.count(roomId)) {
+                callback(false);
+                return;
+            }
+            RecordWriter writer;
+            writer.i64(roomId).i64(ownerId).str(name).i64(isPublic ? 1 : 0);
+            bool ok = write(kRoom, writer.data());
+            commit();
+            callback(ok);
+        });
+    }
+
+    void EmbeddedStorage::getRoom(int64_t roomId, RoomCallback&& callback) {
+        post([this, roomId, callback = std::move(callback)]() {
+            auto it = rooms_.find(roomId);
+            if (it == rooms_.end()) {
+                callback(Status::NotFound, RoomInfo());
+                return;
+            }
+            RoomInfo room;
+            room.ownerId = it->second.ownerId;
+            room.isPublic = it->second.isPublic;
+            callback(Status::Ok, std::move(room));
+        });
+    }
+
+    void EmbeddedStorage::joinRoom(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        post([this, roomId, userId, callback = std::move(callback)]() {
+            auto it = rooms_.find(roomId);
+            if (it == rooms_.end()) {
+                callback(false);
+                return;
+            }
+            if (it->second.members.count(userId)) {
+                callback(true);
+                return;
+            }
+            RecordWriter writer;
+            writer.i64(roomId).i64(userId);
+            bool ok = write(kRoomJoin, writer.data());
+            commit();
+            callback(ok);
+        });
+    }
+
+    void EmbeddedStorage::leaveRoom(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        post([this, roomId, userId, callback = std::move(callback)]() {
+            auto it = rooms_.find(roomId);
+            if (it == rooms_.end() || !it->second.members.count(userId)) {
+                callback(false);
+                return;
+            }
+            RecordWriter writer;
+            writer.i64(roomId).i64(userId);
+            bool ok = write(kRoomLeave, writer.data());
+            commit();
+            callback(ok);
+        });
+    }
+
+    void EmbeddedStorage::isMember(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        post([this, roomId, userId, callback = std::move(callback)]() {
+            auto it = rooms_.find(roomId);
+            callback(it != rooms_.end() && it->second.members.count(userId) > 0);
+        });
+    }
+
+    void EmbeddedStorage::getUserRooms(int64_t userId, IdsCallback&& callback) {
+        post([this, userId, callback = std::move(callback)]() {
+            auto it = userRooms_.find(userId);
+            callback(it != userRooms_.end() ? std::vector<int64_t>(it->second) : std::vector<int64_t>());
+        });
+    }
+
+    void EmbeddedStorage::filterContacts(int64_t userId, std::vector<int64_t>&& candidates, IdsCallback&& callback) {
+        post([this, userId, candidates = std::move(candidates), callback = std::move(callback)]() {
+            std::vector<int64_t> contacts;
+            auto owned = userRooms_.find(userId);
+            for (auto id : candidates) {
+                bool shared = conversations_.count(makeConversationId(userId, id)) > 0;
+                if (!shared && owned != userRooms_.end()) {
+                    for (auto roomId : owned->second) {
+                        auto room = rooms_.find(roomId);
+                        if (room != rooms_.end() && room->second.members.count(id) > 0) {
+                            shared = true;
+                            break;
+                        }
+                    }
+                }
+                if (shared) {
+                    contacts.push_back(id);
+                }
+            }
+            callback(std::move(contacts));
+        });
+    }
+
+    void EmbeddedStorage::loadCursor(int64_t userId, CursorCallback&& callback) {
+        post([this, userId, callback = std::move(callback)]() {
+            auto it = cursors_.find(userId);
+            callback(true, it != cursors_.end() ? it->second : 0);
+        });
+    }
+
+    void EmbeddedStorage::saveCursors(std::vector<std::pair<int64_t, int64_t>>&& cursors, BoolCallback&& callback) {
+        post([this, cursors = std::move(cursors), callback = std::move(callback)]() {
+            bool ok = true;
+            for (const auto& cursor : cursors) {
+                auto it = cursors_.find(cursor.first);
+                if (it != cursors_.end() && it->second >= cursor.second) {
+                    continue;
+                }
+                RecordWriter writer;
+                writer.i64(cursor.first).i64(cursor.second);
+                ok = write(kCursor, writer.data()) && ok;
+            }
+            commit();
+            callback(ok);
+        });
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "AppendLog.h"
+#include "Storage.h"
+#include <trantor/net/EventLoopThread.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace im_server
+{
+    // 不依赖 MySQL 的嵌入式存储引擎，用于单机 / 边缘部署和无数据库的压测。
+    //   - 所有写入（消息、已读标记、用户、房间成员、同步游标）都作为一条记录追加到 AppendLog
+    //   - 内存索引：会话 -> 按 id 排序的 (id, 日志位置)、接收方 -> 单聊收件箱、id -> 日志位置，
+    //     以及用户表、房间成员表和游标表；消息正文只在日志里，读取时按位置从映射区解码
+    //   - 启动时回放整个日志重建内存状态，写了一半的尾部记录被截断（见 AppendLog）
+    //   - 所有操作在引擎自己的一个工作线程上串行执行，内部不加锁；回调也在该线程上执行
+    class EmbeddedStorage : public Storage
+    {
+    public:
+        struct Options
+        {
+            std::string dataDir = "./data";
+            size_t segmentBytes = 64 << 20;
+            bool fsync = false;
+        };
+
+        explicit EmbeddedStorage(const Options &options);
+
+        void insertMessages(const std::vector<Message> &rows, BoolCallback &&callback) override;
+        void getConversationMessages(uint64_t conversationId, int64_t beforeId, int64_t afterId, int limit,
+                                     MessagesCallback &&callback) override;
+        void getMessagesForReceiver(int64_t receiverId, int64_t afterId, int limit,
+                                    MessagesCallback &&callback) override;
+        void getUnreadMessages(int64_t receiverId, MessagesCallback &&callback) override;
+        void getMessageById(int64_t messageId, MessageCallback &&callback) override;
+        void markRead(int64_t messageId, int64_t receiverId, BoolCallback &&callback) override;
+        void markConversationRead(uint64_t conversationId, int64_t receiverId, int64_t upToId,
+                                  BoolCallback &&callback) override;
+
+        void createUser(const std::string &username, const std::string &email, const std::string &passwordHash,
+                        const std::string &createdAt, CreateUserCallback &&callback) override;
+        void findUserByName(const std::string &username, UserCallback &&callback) override;
+        void findUserById(int64_t userId, UserCallback &&callback) override;
+        void updatePasswordHash(int64_t userId, const std::string &passwordHash, BoolCallback &&callback) override;
+        void setUserActive(int64_t userId, bool active, BoolCallback &&callback) override;
+
+        void createRoom(int64_t roomId, const std::string &name, int64_t ownerId, bool isPublic,
+                        BoolCallback &&callback) override;
+        void getRoom(int64_t roomId, RoomCallback &&callback) override;
+        void joinRoom(int64_t roomId, int64_t userId, BoolCallback &&callback) override;
+        void leaveRoom(int64_t roomId, int64_t userId, BoolCallback &&callback) override;
+        void isMember(int64_t roomId, int64_t userId, BoolCallback &&callback) override;
+        void getUserRooms(int64_t userId, IdsCallback &&callback) override;
+        void filterContacts(int64_t userId, std::vector<int64_t> &&candidates, IdsCallback &&callback) override;
+
+        void loadCursor(int64_t userId, CursorCallback &&callback) override;
+        void saveCursors(std::vector<std::pair<int64_t, int64_t>> &&cursors, BoolCallback &&callback) override;
+
+    private:
+        enum RecordType : uint8_t
+        {
+            kMessage = 1,
+            kMarkRead = 2,
+            kMarkConversationRead = 3,
+            kUser = 4,
+            kRoom = 5,
+            kRoomJoin = 6,
+            kRoomLeave = 7,
+            kCursor = 8,
+            kPasswordHash = 9,
+            kUserActive = 10
+        };
+
+        struct MessageRef
+        {
+            int64_t id;
+            AppendLog::Location location;
+        };
+
+        struct Room
+        {
+            std::string name;
+            int64_t ownerId = 0;
+            bool isPublic = false;
+            std::unordered_set<int64_t> members;
+        };
+
+        // 在工作线程上执行
+        void post(std::function<void()> &&task);
+        // 追加一条记录并更新内存索引；实时写入和启动回放走同一个 apply
+        bool write(RecordType type, const std::string &payload);
+        void apply(uint8_t type, std::string_view payload, AppendLog::Location location);
+        // 一组写入结束后按 fsync 配置刷盘
+        void commit();
+
+        Message load(AppendLog::Location location) const;
+        std::vector<Message> loadRange(std::vector<MessageRef>::const_iterator first,
+                                       std::vector<MessageRef>::const_iterator last) const;
+        bool isRead(const Message &message) const;
+
+        Options options_;
+        AppendLog log_;
+
+        std::unordered_map<uint64_t, std::vector<MessageRef>> conversations_;
+        std::unordered_map<int64_t, std::vector<MessageRef>> inboxes_;
+        std::unordered_map<int64_t, AppendLog::Location> messagesById_;
+        // 已读状态：(会话, 接收方) 的批量已读水位，加上水位之上单独标记已读的消息 id
+        std::map<std::pair<uint64_t, int64_t>, int64_t> readUpTo_;
+        std::unordered_set<int64_t> readIds_;
+
+        std::unordered_map<int64_t, User> users_;
+        std::unordered_map<std::string, int64_t> usersByName_;
+        std::unordered_map<std::string, int64_t> usersByEmail_;
+        int64_t nextUserId_ = 1;
+
+        std::unordered_map<int64_t, Room> rooms_;
+        std::unordered_map<int64_t, std::vector<int64_t>> userRooms_;
+        std::unordered_map<int64_t, int64_t> cursors_;
+
+        // 声明在最后、最先析构：先停掉工作线程，再释放索引和日志
+        trantor::EventLoopThread thread_;
+    };
+}
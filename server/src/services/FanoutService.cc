@@ -0,0 +1,248 @@
+#include "FanoutService.h"
+#include "OutboundQueue.h"
+#include "RoomService.h"
+#include "../utils/BinaryProtocol.h"
+#include "../utils/FrameEncoder.h"
+#include <drogon/HttpAppFramework.h>
+
+using namespace drogon;
+
+namespace im_server {
+
+    namespace {
+        void updateMax(std::atomic<uint64_t>& target, uint64_t value) {
+            auto current = target.load(std::memory_order_relaxed);
+            while (value > current &&
+                   !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    FanoutService& FanoutService::instance() {
+        static FanoutService service;
+        return service;
+    }
+
+    void FanoutService::start() {
+        if (started_.load(std::memory_order_acquire)) {
+            return;
+        }
+        for (size_t i = 0; i < app().getThreadNum(); ++i) {
+            auto state = std::make_unique<LoopState>();
+            state->loop = app().getIOLoop(i);
+            states_.push_back(std::move(state));
+        }
+        started_.store(true, std::memory_order_release);
+    }
+
+    void FanoutService::attach(const WebSocketConnectionPtr& conn, const UserSessionPtr& session) {
+        std::weak_ptr<WebSocketConnection> weakConn = conn;
+        RoomService::instance().getUserRooms(session->userId,
+            [this, weakConn, session](std::vector<int64_t>&& rooms) {
+                if (rooms.empty() || !session->loop) {
+                    return;
+                }
+                session->loop->queueInLoop([this, weakConn, session, rooms = std::move(rooms)]() {
+                    auto conn = weakConn.lock();
+                    // 加载期间连接可能已经关闭并 detach
+                    if (!conn || !conn->connected()) {
+                        return;
+                    }
+                    auto* state = stateFor(session->loop);
+                    if (!state) {
+                        return;
+                    }
+                    for (auto roomId : rooms) {
+                        addMember(*state, roomId, conn, session);
+                    }
+                });
+            });
+    }
+
+    void FanoutService::detach(const WebSocketConnectionPtr& conn) {
+        auto session = SessionRegistry::sessionOf(conn);
+        if (!session) {
+            return;
+        }
+        auto* state = stateFor(session->loop);
+        if (state) {
+            for (auto roomId : session->rooms) {
+                auto it = state->rooms.find(roomId);
+                if (it == state->rooms.end()) {
+                    continue;
+                }
+                auto& members = it->second;
+                for (size_t i = 0; i < members.size(); ++i) {
+                    if (members[i].conn == conn) {
+                        members[i] = std::move(members.back());
+                        members.pop_back();
+                        break;
+                    }
+                }
+                if (members.empty()) {
+                    state->rooms.erase(it);
+                }
+            }
+        }
+        session->rooms.clear();
+    }
+
+    void FanoutService::onJoin(int64_t roomId, int64_t userId) {
+        SessionRegistry::instance().forEachConnection(userId, [this, roomId](const WebSocketConnectionPtr& conn) {
+            auto session = SessionRegistry::sessionOf(conn);
+            if (!session || !session->loop) {
+                return;
+            }
+            session->loop->queueInLoop([this, roomId, conn, session]() {
+                if (!conn->connected()) {
+                    return;
+                }
+                if (auto* state = stateFor(session->loop)) {
+                    addMember(*state, roomId, conn, session);
+                }
+            });
+        });
+    }
+
+    void FanoutService::onLeave(int64_t roomId, int64_t userId) {
+        SessionRegistry::instance().forEachConnection(userId, [this, roomId](const WebSocketConnectionPtr& conn) {
+            auto session = SessionRegistry::sessionOf(conn);
+            if (!session || !session->loop) {
+                return;
+            }
+            session->loop->queueInLoop([this, roomId, conn, session]() {
+                if (auto* state = stateFor(session->loop)) {
+                    removeMember(*state, roomId, conn, session);
+                }
+            });
+        });
+    }
+
+    void FanoutService::addMember(LoopState& state, int64_t roomId, const WebSocketConnectionPtr& conn,
+                                  const UserSessionPtr& session) {
+        if (session->rooms.insert(roomId).second) {
+            state.rooms[roomId].push_back(Member{conn, session});
+        }
+    }
+
+    void FanoutService::removeMember(LoopState& state, int64_t roomId, const WebSocketConnectionPtr& conn,
+                                     const UserSessionPtr& session) {
+        if (session->rooms.erase(roomId) == 0) {
+            return;
+        }
+        auto it = state.rooms.find(roomId);
+        if (it == state.rooms.end()) {
+            return;
+        }
+        auto& members = it->second;
+        for (size_t i = 0; i < members.size(); ++i) {
+            if (members[i].conn == conn) {
+                // 成员顺序无关紧要，swap 到末尾再 pop
+                members[i] = std::move(members.back());
+                members.pop_back();
+                break;
+            }
+        }
+        if (members.empty()) {
+            state.rooms.erase(it);
+        }
+    }
+
+    void FanoutService::publish(int64_t roomId, int64_t messageId, int64_t senderId, std::string_view content,
+                                int64_t timestamp, const WebSocketConnection* origin) {
+        if (!started_.load(std::memory_order_acquire)) {
+            LOG_ERROR << "Fanout service not started, dropping room message " << messageId;
+            return;
+        }
+        published_.fetch_add(1, std::memory_order_relaxed);
+
+        // 两种线路格式各编码一次，所有 IO 线程共享
+        Delivery delivery{
+            roomId,
+            messageId,
+            std::make_shared<const std::string>(
+                FrameEncoder::encodeRoomMessage(messageId, roomId, senderId, content, timestamp)),
+            std::make_shared<const std::string>(
+                BinaryProtocol::encodeRoomMessage(messageId, roomId, senderId, content, timestamp)),
+            origin,
+            std::chrono::steady_clock::now()};
+
+        for (auto& state : states_) {
+            bool schedule = false;
+            {
+                std::lock_guard<std::mutex> lock(state->inboxMutex);
+                state->inbox.push_back(delivery);
+                if (!state->scheduled) {
+                    state->scheduled = true;
+                    schedule = true;
+                }
+            }
+            if (schedule) {
+                auto* raw = state.get();
+                raw->loop->queueInLoop([this, raw]() {
+                    drain(*raw);
+                });
+            }
+        }
+    }
+
+    void FanoutService::drain(LoopState& state) {
+        std::vector<Delivery> batch;
+        {
+            std::lock_guard<std::mutex> lock(state.inboxMutex);
+            batch.swap(state.inbox);
+            state.scheduled = false;
+        }
+        batches_.fetch_add(1, std::memory_order_relaxed);
+
+        auto& outbound = OutboundQueue::instance();
+        uint64_t sent = 0;
+        for (const auto& delivery : batch) {
+            auto it = state.rooms.find(delivery.roomId);
+            if (it != state.rooms.end()) {
+                for (const auto& member : it->second) {
+                    if (member.conn.get() == delivery.origin) {
+                        continue;
+                    }
+                    if (member.session->protocol == WireProtocol::Binary) {
+                        outbound.sendReliable(member.conn, *member.session, delivery.messageId, *delivery.binary,
+                                              WebSocketMessageType::Binary);
+                    } else {
+                        outbound.sendReliable(member.conn, *member.session, delivery.messageId, *delivery.json,
+                                              WebSocketMessageType::Text);
+                    }
+                    ++sent;
+                }
+            }
+
+            auto micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - delivery.publishedAt).count());
+            latencySamples_.fetch_add(1, std::memory_order_relaxed);
+            lastLatencyMicros_.store(micros, std::memory_order_relaxed);
+            totalLatencyMicros_.fetch_add(micros, std::memory_order_relaxed);
+            updateMax(maxLatencyMicros_, micros);
+        }
+        deliveries_.fetch_add(sent, std::memory_order_relaxed);
+    }
+
+    FanoutService::LoopState* FanoutService::stateFor(trantor::EventLoop* loop) {
+        for (auto& state : states_) {
+            if (state->loop == loop) {
+                return state.get();
+            }
+        }
+        return nullptr;
+    }
+
+    FanoutService::Stats FanoutService::stats() const {
+        return Stats{
+            published_.load(std::memory_order_relaxed),
+            deliveries_.load(std::memory_order_relaxed),
+            batches_.load(std::memory_order_relaxed),
+            latencySamples_.load(std::memory_order_relaxed),
+            lastLatencyMicros_.load(std::memory_order_relaxed),
+            maxLatencyMicros_.load(std::memory_order_relaxed),
+            totalLatencyMicros_.load(std::memory_order_relaxed),
+        };
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "SessionRegistry.h"
+#include <drogon/WebSocketConnection.h>
+#include <trantor/net/EventLoop.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace im_server
+{
+    // 群聊消息扇出。
+    // 每个 IO 线程维护自己的房间索引：room id -> 本线程上在线成员的连接，只在本线程访问，不加锁。
+    // 一条消息只编码一次（JSON / 二进制各一份，多个线程共享同一份只读帧），
+    // 发送方线程只向每个 IO 线程的收件箱投递一次，工作量 O(IO 线程数)，与房间人数无关；
+    // 逐个成员的发送分摊到各自连接所在的 IO 线程上。
+    // 同一轮事件循环内投递到某个线程的多条消息合并成一次 queueInLoop 批量处理。
+    class FanoutService
+    {
+    public:
+        struct Stats
+        {
+            uint64_t published;          // 累计发布的群聊消息
+            uint64_t deliveries;         // 累计下发的帧数
+            uint64_t batches;            // 各 IO 线程累计处理的收件箱批次
+            uint64_t latencySamples;     // 每条消息在每个 IO 线程处理完计一次
+            uint64_t lastLatencyMicros;  // 从发布到某个 IO 线程发送完毕的耗时
+            uint64_t maxLatencyMicros;
+            uint64_t totalLatencyMicros;
+        };
+
+        static FanoutService &instance();
+
+        // 在 IO 线程启动后调用（main 中通过 registerBeginningAdvice）
+        void start();
+
+        // 以下两个方法在连接所属的 IO 线程上调用
+        // 连接建立后加载用户所在的房间，挂到本线程的房间索引
+        void attach(const drogon::WebSocketConnectionPtr &conn, const UserSessionPtr &session);
+        // 连接关闭时从本线程的房间索引中摘除，需在 SessionRegistry::remove 之前调用
+        void detach(const drogon::WebSocketConnectionPtr &conn);
+
+        // 成员关系变化后调用（任意线程），更新该用户所有在线连接的房间索引
+        void onJoin(int64_t roomId, int64_t userId);
+        void onLeave(int64_t roomId, int64_t userId);
+
+        // 把消息推给房间内所有在线成员，origin 为发送方连接（不回推给它自己）
+        void publish(int64_t roomId, int64_t messageId, int64_t senderId, std::string_view content,
+                     int64_t timestamp, const drogon::WebSocketConnection *origin);
+
+        Stats stats() const;
+
+    private:
+        struct Member
+        {
+            drogon::WebSocketConnectionPtr conn;
+            UserSessionPtr session;
+        };
+
+        struct Delivery
+        {
+            int64_t roomId;
+            int64_t messageId;
+            std::shared_ptr<const std::string> json;
+            std::shared_ptr<const std::string> binary;
+            const drogon::WebSocketConnection *origin;
+            std::chrono::steady_clock::time_point publishedAt;
+        };
+
+        struct LoopState
+        {
+            trantor::EventLoop *loop = nullptr;
+            // 只在 loop 线程访问
+            std::unordered_map<int64_t, std::vector<Member>> rooms;
+
+            // 其他线程投递进来的消息
+            std::mutex inboxMutex;
+            std::vector<Delivery> inbox;
+            bool scheduled = false;
+        };
+
+        FanoutService() = default;
+
+        LoopState *stateFor(trantor::EventLoop *loop);
+        void addMember(LoopState &state, int64_t roomId, const drogon::WebSocketConnectionPtr &conn,
+                       const UserSessionPtr &session);
+        void removeMember(LoopState &state, int64_t roomId, const drogon::WebSocketConnectionPtr &conn,
+                          const UserSessionPtr &session);
+        void drain(LoopState &state);
+
+        std::vector<std::unique_ptr<LoopState>> states_;
+        std::atomic<bool> started_{false};
+
+        std::atomic<uint64_t> published_{0};
+        std::atomic<uint64_t> deliveries_{0};
+        std::atomic<uint64_t> batches_{0};
+        std::atomic<uint64_t> latencySamples_{0};
+        std::atomic<uint64_t> lastLatencyMicros_{0};
+        std::atomic<uint64_t> maxLatencyMicros_{0};
+        std::atomic<uint64_t> totalLatencyMicros_{0};
+    };
+}
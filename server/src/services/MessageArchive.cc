@@ -0,0 +1,625 @@
+#include "MessageArchive.h"
+#include "../utils/IdGenerator.h"
+#include <trantor/utils/Logger.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace im_server {
+
+    namespace {
+        constexpr uint32_t kMagic = 0x52414D49; // "IMAR"
+        constexpr size_t kHeaderBytes = 44;
+        constexpr uint64_t kMaxFileBytes = 256ULL << 20;
+
+        void putU32(std::string& out, uint32_t value) {
+            for (int i = 0; i < 4; ++i) {
+                out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        void putU64(std::string& out, uint64_t value) {
+            for (int i = 0; i < 8; ++i) {
+                out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        uint64_t getLE(const char* in, int bytes) {
+            uint64_t value = 0;
+            for (int i = 0; i < bytes; ++i) {
+                value |= static_cast<uint64_t>(static_cast<uint8_t>(in[i])) << (8 * i);
+            }
+            return value;
+        }
+
+        void putVarint(std::string& out, uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back(static_cast<char>(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        // 有符号差值按 zigzag 编码，绝对值小的负数也只占 1 字节
+        uint64_t zigzag(int64_t value) {
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+
+        int64_t unzigzag(uint64_t value) {
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        void putBytes(std::string& out, std::string_view value) {
+            putVarint(out, value.size());
+            out.append(value);
+        }
+
+        class ColumnReader {
+        public:
+            ColumnReader(const char* data, size_t size) : p_(data), end_(data + size) {}
+
+            uint64_t varint() {
+                uint64_t value = 0;
+                for (int shift = 0; p_ < end_ && shift < 64; shift += 7) {
+                    auto byte = static_cast<uint8_t>(*p_++);
+                    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                    if (!(byte & 0x80)) {
+                        return value;
+                    }
+                }
+                ok_ = false;
+                return 0;
+            }
+
+            std::string bytes() {
+                auto size = varint();
+                if (!ok_ || size > static_cast<uint64_t>(end_ - p_)) {
+                    ok_ = false;
+                    return {};
+                }
+                std::string value(p_, static_cast<size_t>(size));
+                p_ += size;
+                return value;
+            }
+
+            uint8_t byte() {
+                if (p_ >= end_) {
+                    ok_ = false;
+                    return 0;
+                }
+                return static_cast<uint8_t>(*p_++);
+            }
+
+            bool ok() const { return ok_; }
+
+        private:
+            const char* p_;
+            const char* end_;
+            bool ok_ = true;
+        };
+
+        bool readFully(int fd, char* out, size_t size, uint64_t offset) {
+            while (size > 0) {
+                auto n = ::pread(fd, out, size, static_cast<off_t>(offset));
+                if (n <= 0) {
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                out += n;
+                size -= static_cast<size_t>(n);
+                offset += static_cast<uint64_t>(n);
+            }
+            return true;
+        }
+
+        bool writeFully(int fd, const char* data, size_t size, uint64_t offset) {
+            while (size > 0) {
+                auto n = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+                if (n <= 0) {
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                data += n;
+                size -= static_cast<size_t>(n);
+                offset += static_cast<uint64_t>(n);
+            }
+            return true;
+        }
+
+        // 单聊会话 id 拆回两个用户 id
+        int64_t receiverFor(uint64_t conversationId, int64_t senderId) {
+            auto lo = static_cast<int64_t>(conversationId >> 32);
+            auto hi = static_cast<int64_t>(conversationId & 0xFFFFFFFFULL);
+            return senderId == lo ? hi : lo;
+        }
+
+        bool isRoomConversation(uint64_t conversationId) {
+            return (conversationId >> 63) != 0;
+        }
+
+        void dedupSorted(std::vector<Message>& messages) {
+            std::sort(messages.begin(), messages.end(),
+                      [](const Message& a, const Message& b) { return a.id < b.id; });
+            messages.erase(std::unique(messages.begin(), messages.end(),
+                                       [](const Message& a, const Message& b) { return a.id == b.id; }),
+                           messages.end());
+        }
+    }
+
+    MessageArchive& MessageArchive::instance() {
+        static MessageArchive archive;
+        return archive;
+    }
+
+    std::string MessageArchive::filePath(uint32_t sequence) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/archive-%06u.dat", sequence);
+        return dir_ + name;
+    }
+
+    bool MessageArchive::open(const std::string& dir, bool readOnly) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (opened_.load(std::memory_order_acquire)) {
+            return true;
+        }
+        dir_ = dir;
+        readOnly_ = readOnly;
+        if (!readOnly_) {
+            if (::mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+                LOG_ERROR << "Cannot create archive directory " << dir_ << ": " << std::strerror(errno);
+                return false;
+            }
+            // 共享目录上只允许一个写入方，进程退出时锁自动释放
+            auto lockPath = dir_ + "/LOCK";
+            lockFd_ = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (lockFd_ < 0 || ::flock(lockFd_, LOCK_EX | LOCK_NB) != 0) {
+                LOG_ERROR << "Cannot lock " << lockPath << " (is another instance archiving to this directory?): "
+                          << std::strerror(errno);
+                if (lockFd_ >= 0) {
+                    ::close(lockFd_);
+                    lockFd_ = -1;
+                }
+                return false;
+            }
+        } else {
+            struct stat st {};
+            if (::stat(dir_.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                LOG_ERROR << "Archive directory " << dir_ << " is not accessible";
+                return false;
+            }
+        }
+
+        for (uint32_t sequence = 1;; ++sequence) {
+            auto path = filePath(sequence);
+            int fd = ::open(path.c_str(), (readOnly_ ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+            if (fd < 0) {
+                break;
+            }
+            files_.push_back(File{fd, 0});
+            if (!scanFile(static_cast<uint32_t>(files_.size() - 1))) {
+                return false;
+            }
+        }
+        if (files_.empty() && !readOnly_ && !rollFile()) {
+            return false;
+        }
+
+        opened_.store(true, std::memory_order_release);
+        LOG_INFO << "Message archive opened" << (readOnly_ ? " read-only: " : ": ") << files_.size() << " files, "
+                 << blocks_.load() << " blocks";
+        return true;
+    }
+
+    bool MessageArchive::scanFile(uint32_t index) {
+        auto& file = files_[index];
+        struct stat st {};
+        if (::fstat(file.fd, &st) != 0) {
+            LOG_ERROR << "Cannot stat " << filePath(index + 1) << ": " << std::strerror(errno);
+            return false;
+        }
+        auto fileSize = static_cast<uint64_t>(st.st_size);
+
+        std::vector<std::pair<uint64_t, Block>> found;
+        uint64_t offset = scanBlocks(index, 0, fileSize, readOnly_, found);
+        addBlocks(found);
+
+        // 尾部写了一半的块（崩溃时还没 fdatasync，也还没从 MySQL 删除）直接截掉；
+        // 只读时可能是写入方正在写的块，留给下一次 refresh
+        if (offset < fileSize && !readOnly_) {
+            LOG_WARN << "Truncating " << filePath(index + 1) << " from " << fileSize << " to " << offset << " bytes";
+            if (::ftruncate(file.fd, static_cast<off_t>(offset)) != 0) {
+                LOG_ERROR << "Cannot truncate archive file: " << std::strerror(errno);
+                return false;
+            }
+        }
+        file.size = offset;
+        return true;
+    }
+
+    uint64_t MessageArchive::scanBlocks(uint32_t index, uint64_t offset, uint64_t fileSize, bool verify,
+                                        std::vector<std::pair<uint64_t, Block>>& found) const {
+        int fd = files_[index].fd;
+        char header[kHeaderBytes];
+        std::string data;
+        while (offset + kHeaderBytes <= fileSize && readFully(fd, header, kHeaderBytes, offset)) {
+            if (getLE(header, 4) != kMagic) {
+                break;
+            }
+            Block block{};
+            uint64_t conversationId = getLE(header + 4, 8);
+            block.firstId = static_cast<int64_t>(getLE(header + 12, 8));
+            block.lastId = static_cast<int64_t>(getLE(header + 20, 8));
+            block.count = static_cast<uint32_t>(getLE(header + 28, 4));
+            block.rawBytes = static_cast<uint32_t>(getLE(header + 32, 4));
+            block.compressedBytes = static_cast<uint32_t>(getLE(header + 36, 4));
+            block.file = index;
+            block.offset = offset;
+            if (offset + kHeaderBytes + block.compressedBytes > fileSize) {
+                break;
+            }
+            // 其他实例正在追加的文件，长度可见不代表数据已完整可见
+            if (verify) {
+                data.resize(block.compressedBytes);
+                if (!readFully(fd, &data[0], data.size(), offset + kHeaderBytes) ||
+                    getLE(header + 40, 4) != crc32(0, reinterpret_cast<const Bytef*>(data.data()),
+                                                   static_cast<uInt>(data.size()))) {
+                    break;
+                }
+            }
+            found.emplace_back(conversationId, block);
+            offset += kHeaderBytes + block.compressedBytes;
+        }
+        return offset;
+    }
+
+    void MessageArchive::addBlocks(const std::vector<std::pair<uint64_t, Block>>& found) {
+        for (const auto& entry : found) {
+            auto& blocks = index_[entry.first];
+            auto it = std::upper_bound(blocks.begin(), blocks.end(), entry.second.firstId,
+                                       [](int64_t id, const Block& b) { return id < b.firstId; });
+            blocks.insert(it, entry.second);
+            blocks_.fetch_add(1, std::memory_order_relaxed);
+            bytes_.fetch_add(entry.second.compressedBytes, std::memory_order_relaxed);
+        }
+    }
+
+    void MessageArchive::refresh() {
+        if (!readOnly_ || !isOpen()) {
+            return;
+        }
+        // 只读时只有这里修改 files_，读取 files_ 不需要加锁
+        for (;;) {
+            // 先看下一个文件是否已存在：写入方换文件前已把旧文件写完并刷盘，此时再扫旧文件不会漏掉尾部的块
+            auto next = static_cast<uint32_t>(files_.size() + 1);
+            int fd = ::open(filePath(next).c_str(), O_RDONLY | O_CLOEXEC);
+
+            if (!files_.empty()) {
+                auto index = static_cast<uint32_t>(files_.size() - 1);
+                struct stat st {};
+                if (::fstat(files_[index].fd, &st) == 0 && static_cast<uint64_t>(st.st_size) > files_[index].size) {
+                    std::vector<std::pair<uint64_t, Block>> found;
+                    uint64_t offset = scanBlocks(index, files_[index].size, static_cast<uint64_t>(st.st_size),
+                                                 true, found);
+                    std::unique_lock<std::shared_mutex> lock(mutex_);
+                    files_[index].size = offset;
+                    addBlocks(found);
+                }
+            }
+            if (fd < 0) {
+                return;
+            }
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            files_.push_back(File{fd, 0});
+        }
+    }
+
+    bool MessageArchive::rollFile() {
+        // 换文件前把旧文件刷盘，sync() 只需要处理当前文件
+        if (!files_.empty() && ::fdatasync(files_.back().fd) != 0) {
+            LOG_ERROR << "Error syncing archive file: " << std::strerror(errno);
+            return false;
+        }
+        auto path = filePath(static_cast<uint32_t>(files_.size() + 1));
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            LOG_ERROR << "Cannot create archive file " << path << ": " << std::strerror(errno);
+            return false;
+        }
+        files_.push_back(File{fd, 0});
+        return true;
+    }
+
+    bool MessageArchive::append(uint64_t conversationId, std::vector<Message>&& messages) {
+        if (readOnly_) {
+            return false;
+        }
+        dedupSorted(messages);
+        // 块不超过 kBlockMessages 条，一页历史通常落在一个块里
+        for (size_t begin = 0; begin < messages.size(); begin += kBlockMessages) {
+            size_t end = std::min(messages.size(), begin + kBlockMessages);
+            if (!appendBlock(conversationId, messages.data() + begin, end - begin)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool MessageArchive::appendBlock(uint64_t conversationId, const Message* messages, size_t count) {
+        const Message& first = messages[0];
+        const Message& last = messages[count - 1];
+
+        // 按列编码
+        std::string raw;
+        int64_t previous = first.id;
+        for (const Message* message = messages; message != messages + count; ++message) {
+            putVarint(raw, static_cast<uint64_t>(message->id - previous));
+            previous = message->id;
+        }
+        for (const Message* message = messages; message != messages + count; ++message) {
+            putVarint(raw, static_cast<uint64_t>(message->sender_id));
+        }
+        for (const Message* message = messages; message != messages + count; ++message) {
+            // 发送时间与 id 同时生成，相对 id 中的毫秒数通常是 0
+            putVarint(raw, zigzag(message->timestamp - IdGenerator::timestampOf(message->id)));
+        }
+        for (const Message* message = messages; message != messages + count; ++message) {
+            putBytes(raw, messageTypeName(message->message_type));
+        }
+        for (const Message* message = messages; message != messages + count; ++message) {
+            raw.push_back(message->is_read ? 1 : 0);
+        }
+        for (const Message* message = messages; message != messages + count; ++message) {
+            putBytes(raw, message->content);
+        }
+
+        uLongf compressedBytes = compressBound(raw.size());
+        std::string block(kHeaderBytes + compressedBytes, '\0');
+        if (compress2(reinterpret_cast<Bytef*>(&block[kHeaderBytes]), &compressedBytes,
+                      reinterpret_cast<const Bytef*>(raw.data()), raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+            LOG_ERROR << "Error compressing archive block for conversation " << conversationId;
+            return false;
+        }
+        block.resize(kHeaderBytes + compressedBytes);
+
+        std::string header;
+        header.reserve(kHeaderBytes);
+        putU32(header, kMagic);
+        putU64(header, conversationId);
+        putU64(header, static_cast<uint64_t>(first.id));
+        putU64(header, static_cast<uint64_t>(last.id));
+        putU32(header, static_cast<uint32_t>(count));
+        putU32(header, static_cast<uint32_t>(raw.size()));
+        putU32(header, static_cast<uint32_t>(compressedBytes));
+        putU32(header, static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(block.data() + kHeaderBytes),
+                                                   static_cast<uInt>(compressedBytes))));
+        block.replace(0, kHeaderBytes, header);
+
+        // 只有归档任务一个写入方，文件尾部偏移可以在锁外读取
+        File file;
+        uint32_t fileIndex;
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            if (files_.back().size + block.size() > kMaxFileBytes && files_.back().size > 0 && !rollFile()) {
+                return false;
+            }
+            fileIndex = static_cast<uint32_t>(files_.size() - 1);
+            file = files_.back();
+        }
+        if (!writeFully(file.fd, block.data(), block.size(), file.size)) {
+            LOG_ERROR << "Error writing archive block: " << std::strerror(errno);
+            return false;
+        }
+
+        Block entry{first.id, last.id, static_cast<uint32_t>(count), fileIndex,
+                    file.size, static_cast<uint32_t>(raw.size()), static_cast<uint32_t>(compressedBytes)};
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            files_[fileIndex].size += block.size();
+            auto& blocks = index_[conversationId];
+            auto it = std::upper_bound(blocks.begin(), blocks.end(), entry.firstId,
+                                       [](int64_t id, const Block& b) { return id < b.firstId; });
+            blocks.insert(it, entry);
+        }
+        blocks_.fetch_add(1, std::memory_order_relaxed);
+        bytes_.fetch_add(compressedBytes, std::memory_order_relaxed);
+        archivedRows_.fetch_add(count, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool MessageArchive::sync() {
+        if (readOnly_) {
+            return false;
+        }
+        int fd;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            fd = files_.back().fd;
+        }
+        if (::fdatasync(fd) != 0) {
+            LOG_ERROR << "Error syncing archive file: " << std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<Message> MessageArchive::decode(uint64_t conversationId, const Block& block) const {
+        int fd;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            fd = files_[block.file].fd;
+        }
+        coldReads_.fetch_add(1, std::memory_order_relaxed);
+
+        // 块头和数据一起读，一次 pread
+        std::string data(kHeaderBytes + block.compressedBytes, '\0');
+        std::string raw(block.rawBytes, '\0');
+        uLongf rawBytes = block.rawBytes;
+        const char* compressed = data.data() + kHeaderBytes;
+        if (!readFully(fd, &data[0], data.size(), block.offset) ||
+            getLE(data.data() + 40, 4) != crc32(0, reinterpret_cast<const Bytef*>(compressed), block.compressedBytes) ||
+            uncompress(reinterpret_cast<Bytef*>(&raw[0]), &rawBytes,
+                       reinterpret_cast<const Bytef*>(compressed), block.compressedBytes) != Z_OK ||
+            rawBytes != block.rawBytes) {
+            LOG_ERROR << "Corrupt archive block at " << filePath(block.file + 1) << ":" << block.offset;
+            return {};
+        }
+
+        std::vector<Message> messages(block.count);
+        ColumnReader reader(raw.data(), raw.size());
+        int64_t id = block.firstId;
+        for (auto& message : messages) {
+            id += static_cast<int64_t>(reader.varint());
+            message.id = id;
+        }
+        bool room = isRoomConversation(conversationId);
+        for (auto& message : messages) {
+            message.sender_id = static_cast<int64_t>(reader.varint());
+            if (room) {
+                message.room_id = static_cast<int64_t>(conversationId & ~(1ULL << 63));
+            } else {
+                message.receiver_id = receiverFor(conversationId, message.sender_id);
+            }
+        }
+        for (auto& message : messages) {
+            message.timestamp = IdGenerator::timestampOf(message.id) + unzigzag(reader.varint());
+        }
+        for (auto& message : messages) {
+            message.message_type = parseMessageType(reader.bytes());
+        }
+        for (auto& message : messages) {
+            message.is_read = reader.byte() != 0;
+        }
+        for (auto& message : messages) {
+            message.content = reader.bytes();
+        }
+        if (!reader.ok()) {
+            LOG_ERROR << "Corrupt archive block at " << filePath(block.file + 1) << ":" << block.offset;
+            return {};
+        }
+        return messages;
+    }
+
+    std::vector<Message> MessageArchive::readBefore(uint64_t conversationId, int64_t beforeId, int limit) {
+        std::vector<Block> candidates;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto it = index_.find(conversationId);
+            if (it == index_.end()) {
+                return {};
+            }
+            candidates = it->second;
+        }
+
+        // 从最新的块往前读，凑够 limit 条为止
+        std::vector<Message> result;
+        for (auto it = candidates.rbegin(); it != candidates.rend(); ++it) {
+            if (beforeId > 0 && it->firstId >= beforeId) {
+                continue;
+            }
+            // 已凑够一页且这个块整体更旧；块按首条 id 排序，重复归档时末条 id 不一定有序，所以不能提前结束
+            if (static_cast<int>(result.size()) >= limit && it->lastId < result[result.size() - limit].id) {
+                continue;
+            }
+            for (auto& message : decode(conversationId, *it)) {
+                if (beforeId <= 0 || message.id < beforeId) {
+                    result.push_back(std::move(message));
+                }
+            }
+            dedupSorted(result);
+        }
+        if (static_cast<int>(result.size()) > limit) {
+            result.erase(result.begin(), result.end() - limit);
+        }
+        return result;
+    }
+
+    std::vector<Message> MessageArchive::readAfter(uint64_t conversationId, int64_t afterId, int limit) {
+        std::vector<Block> candidates;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto it = index_.find(conversationId);
+            if (it == index_.end()) {
+                return {};
+            }
+            candidates = it->second;
+        }
+
+        std::vector<Message> result;
+        for (const auto& block : candidates) {
+            if (block.lastId <= afterId) {
+                continue;
+            }
+            // 之后的块首条 id 只会更大
+            if (static_cast<int>(result.size()) >= limit && block.firstId > result[limit - 1].id) {
+                break;
+            }
+            for (auto& message : decode(conversationId, block)) {
+                if (message.id > afterId) {
+                    result.push_back(std::move(message));
+                }
+            }
+            dedupSorted(result);
+        }
+        if (static_cast<int>(result.size()) > limit) {
+            result.resize(static_cast<size_t>(limit));
+        }
+        return result;
+    }
+
+    Message MessageArchive::find(int64_t messageId) {
+        // 不同会话的块 id 区间会交叉，区间命中后还要解压确认
+        std::vector<std::pair<uint64_t, Block>> candidates;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            for (const auto& entry : index_) {
+                for (const auto& block : entry.second) {
+                    if (block.firstId <= messageId && messageId <= block.lastId) {
+                        candidates.emplace_back(entry.first, block);
+                    }
+                }
+            }
+        }
+        for (const auto& candidate : candidates) {
+            for (auto& message : decode(candidate.first, candidate.second)) {
+                if (message.id == messageId) {
+                    return std::move(message);
+                }
+            }
+        }
+        return Message();
+    }
+
+    bool MessageArchive::mayHaveBetween(uint64_t conversationId, int64_t newerThan, int64_t beforeId) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = index_.find(conversationId);
+        if (it == index_.end()) {
+            return false;
+        }
+        for (const auto& block : it->second) {
+            if ((beforeId <= 0 || block.firstId < beforeId) && block.lastId > newerThan) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    MessageArchive::Stats MessageArchive::stats() const {
+        return Stats{
+            blocks_.load(std::memory_order_relaxed),
+            bytes_.load(std::memory_order_relaxed),
+            archivedRows_.load(std::memory_order_relaxed),
+            coldReads_.load(std::memory_order_relaxed),
+        };
+    }
+}
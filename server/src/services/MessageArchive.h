@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../models/Message.h"
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace im_server
+{
+    // 冷数据归档：从 messages 表迁出的旧消息按会话打包成压缩块，顺序追加到归档目录下的
+    // archive-000001.dat、archive-000002.dat ...
+    //
+    // 多实例部署时归档目录放在各实例共享的存储上：只有一个实例以写方式打开（目录下 LOCK 文件的排他 flock），
+    // 其余实例只读打开，并定期调用 refresh() 读入写入方新追加的块，只把 CRC 校验通过的完整块加入索引。
+    //
+    // 块格式：44 字节块头 [magic][会话 id][首条 id][末条 id][条数][原始长度][压缩长度][CRC32] + zlib 数据。
+    // 块内按列存放：id 差值、发送方、时间戳（相对 id 中毫秒数的差值）、类型、已读位、正文依次连续，接收方 / 房间由会话 id 推出。
+    // 块索引（会话 -> 按首条 id 排序的块列表）常驻内存，启动时只读块头重建，
+    // 一次分页通常只需要对一个块做一次 pread。
+    //
+    // 同一批消息可能因为迁移中途崩溃被归档两次，读取时按 id 去重。
+    class MessageArchive
+    {
+    public:
+        struct Stats
+        {
+            uint64_t blocks;
+            uint64_t bytes;         // 压缩后的块数据
+            uint64_t archivedRows;  // 本次启动以来写入的行数
+            uint64_t coldReads;     // 读取（解压）的块数
+        };
+
+        static MessageArchive &instance();
+
+        // 打开（必要时创建）归档目录并重建块索引，失败返回 false。
+        // readOnly 时不创建目录和文件、不截断尾部，也不加写锁
+        bool open(const std::string &dir, bool readOnly = false);
+        bool isOpen() const { return opened_.load(std::memory_order_acquire); }
+        bool readOnly() const { return readOnly_; }
+
+        // 只读打开时由定时任务调用：读入上次之后追加的块和新建的文件。只能在一个线程上调用
+        void refresh();
+
+        // 写入一个会话的一批消息（任意顺序），写入后立即可读；
+        // 调用方在删除源数据前必须调用 sync() 确认已落盘
+        bool append(uint64_t conversationId, std::vector<Message> &&messages);
+        bool sync();
+
+        // 与 MessageService::getMessages 相同的分页语义，结果按 id 升序
+        std::vector<Message> readBefore(uint64_t conversationId, int64_t beforeId, int limit);
+        std::vector<Message> readAfter(uint64_t conversationId, int64_t afterId, int limit);
+        // 不存在时返回 id 为 0 的 Message；需要遍历内存中的块索引，只用于低频接口
+        Message find(int64_t messageId);
+
+        // 归档中是否可能有 id 在 (newerThan, beforeId) 之间的消息（beforeId <= 0 表示不限），只查内存索引
+        bool mayHaveBetween(uint64_t conversationId, int64_t newerThan, int64_t beforeId) const;
+
+        Stats stats() const;
+
+    private:
+        struct Block
+        {
+            int64_t firstId;
+            int64_t lastId;
+            uint32_t count;
+            uint32_t file;
+            uint64_t offset;
+            uint32_t rawBytes;
+            uint32_t compressedBytes;
+        };
+
+        struct File
+        {
+            int fd = -1;
+            uint64_t size = 0;
+        };
+
+        static constexpr size_t kBlockMessages = 256;
+
+        MessageArchive() = default;
+
+        bool appendBlock(uint64_t conversationId, const Message *messages, size_t count);
+        bool scanFile(uint32_t index);
+        // 从 offset 开始读块头直到 fileSize，返回最后一个完整块的结尾；verify 时同时校验块数据的 CRC
+        uint64_t scanBlocks(uint32_t index, uint64_t offset, uint64_t fileSize, bool verify,
+                            std::vector<std::pair<uint64_t, Block>> &found) const;
+        // 调用方持有 mutex_ 的写锁
+        void addBlocks(const std::vector<std::pair<uint64_t, Block>> &found);
+        bool rollFile();
+        std::string filePath(uint32_t sequence) const;
+        std::vector<Message> decode(uint64_t conversationId, const Block &block) const;
+
+        std::string dir_;
+        bool readOnly_ = false;
+        int lockFd_ = -1;
+        std::atomic<bool> opened_{false};
+
+        mutable std::shared_mutex mutex_;
+        std::vector<File> files_;
+        std::unordered_map<uint64_t, std::vector<Block>> index_;
+
+        std::atomic<uint64_t> blocks_{0};
+        std::atomic<uint64_t> bytes_{0};
+        std::atomic<uint64_t> archivedRows_{0};
+        mutable std::atomic<uint64_t> coldReads_{0};
+    };
+}
@@ -0,0 +1,218 @@
+#include "MessageArchiver.h"
+#include "MessageArchive.h"
+#include "../utils/DbUtil.h"
+#include "../utils/IdGenerator.h"
+#include <drogon/HttpAppFramework.h>
+#include <chrono>
+#include <unordered_map>
+
+using namespace drogon;
+using namespace drogon::orm;
+
+namespace im_server {
+
+    namespace {
+        // 单条 DELETE ... WHERE id IN (...) 最多携带的 id 数
+        constexpr size_t kIdsPerDelete = 1000;
+    }
+
+    struct MessageArchiver::Run {
+        int64_t cutoffId = 0;
+        int64_t afterId = 0;      // keyset 游标：跳过留在热库里的未读消息
+        size_t batchRows = 0;
+        std::vector<int64_t> archivedIds;
+        uint64_t moved = 0;
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    };
+
+    MessageArchiver& MessageArchiver::instance() {
+        static MessageArchiver archiver;
+        return archiver;
+    }
+
+    void MessageArchiver::start() {
+        const auto& config = app().getCustomConfig()["storage"]["archive"];
+        if (!config.isObject() || !config.get("enabled", false).asBool()) {
+            return;
+        }
+        if (!MessageArchive::instance().isOpen()) {
+            LOG_ERROR << "Message archiver not started: archive is not open (requires the mysql storage backend)";
+            return;
+        }
+
+        maxAgeMillis_ = config.get("max_age_days", 90).asInt64() * 24 * 3600 * 1000;
+        intervalSeconds_ = std::max(1.0, config.get("interval_sec", 3600).asDouble());
+        batchSize_ = std::max<size_t>(1, config.get("batch_size", 5000).asUInt64());
+        refreshInterval_ = std::chrono::milliseconds(std::max<int64_t>(100, config.get("refresh_ms", 1000).asInt64()));
+
+        thread_ = std::make_unique<trantor::EventLoopThread>("MessageArchiver");
+        thread_->run();
+        if (MessageArchive::instance().readOnly()) {
+            thread_->getLoop()->runEvery(refreshInterval_, []() {
+                MessageArchive::instance().refresh();
+            });
+            LOG_INFO << "Message archive follower started: refresh_ms=" << refreshInterval_.count();
+            return;
+        }
+        thread_->getLoop()->runEvery(intervalSeconds_, [this]() {
+            runOnce();
+        });
+        LOG_INFO << "Message archiver started: max_age_days=" << maxAgeMillis_ / (24 * 3600 * 1000)
+                 << " interval_sec=" << intervalSeconds_ << " batch_size=" << batchSize_;
+    }
+
+    void MessageArchiver::runOnce() {
+        if (!thread_ || MessageArchive::instance().readOnly() || running_.exchange(true)) {
+            return;
+        }
+        auto run = std::make_shared<Run>();
+        auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        run->cutoffId = IdGenerator::firstIdAt(now - maxAgeMillis_);
+        selectBatch(run);
+    }
+
+    void MessageArchiver::selectBatch(const RunPtr& run) {
+        // use_fast_client 时 DbClient 只能在 Drogon 的主循环 / IO 线程上取用，SQL 统一从主循环发出，
+        // 归档线程只做压缩和文件读写
+        auto loop = app().getLoop();
+        if (!loop->isInLoopThread()) {
+            loop->queueInLoop([this, run]() {
+                selectBatch(run);
+            });
+            return;
+        }
+
+        // 按主键范围扫描；未读的单聊消息留在热库
+        DbUtil::getClient()->execSqlAsync(
+            "SELECT id, sender_id, receiver_id, room_id, content, message_type, timestamp, is_read FROM messages "
+            "WHERE id > ? AND id < ? AND (is_read = true OR receiver_id IS NULL) ORDER BY id LIMIT ?",
+            [this, run](const Result& result) {
+                std::vector<Message> rows;
+                rows.reserve(result.size());
+                for (const auto& row : result) {
+                    Message message(
+                        row["id"].as<int64_t>(),
+                        row["sender_id"].as<int64_t>(),
+                        row["receiver_id"].isNull() ? 0 : row["receiver_id"].as<int64_t>(),
+                        row["content"].as<std::string>(),
+                        parseMessageType(row["message_type"].as<std::string>()),
+                        row["timestamp"].as<int64_t>(),
+                        row["is_read"].as<bool>());
+                    message.room_id = row["room_id"].isNull() ? 0 : row["room_id"].as<int64_t>();
+                    rows.push_back(std::move(message));
+                }
+                // 压缩和写文件放到归档线程，不占用 DbClient 的线程
+                thread_->getLoop()->queueInLoop([this, run, rows = std::move(rows)]() mutable {
+                    archiveBatch(run, std::move(rows));
+                });
+            },
+            [this, run](const DrogonDbException& e) {
+                LOG_ERROR << "Error selecting messages to archive: " << e.base().what();
+                finish(run, false);
+            },
+            run->afterId, run->cutoffId, static_cast<int64_t>(batchSize_)
+        );
+    }
+
+    void MessageArchiver::archiveBatch(const RunPtr& run, std::vector<Message>&& rows) {
+        run->batchRows = rows.size();
+        if (rows.empty()) {
+            finish(run, true);
+            return;
+        }
+        run->afterId = rows.back().id;
+
+        std::unordered_map<uint64_t, std::vector<Message>> conversations;
+        for (auto& message : rows) {
+            conversations[message.conversationId()].push_back(std::move(message));
+        }
+
+        auto& archive = MessageArchive::instance();
+        run->archivedIds.clear();
+        for (auto& entry : conversations) {
+            std::vector<int64_t> ids;
+            ids.reserve(entry.second.size());
+            for (const auto& message : entry.second) {
+                ids.push_back(message.id);
+            }
+            // 写失败的会话不删除，下一轮重试
+            if (archive.append(entry.first, std::move(entry.second))) {
+                run->archivedIds.insert(run->archivedIds.end(), ids.begin(), ids.end());
+            }
+        }
+
+        // 归档落盘之后才删除热库中的行；删除前崩溃只会产生重复，读取时会去重。
+        // 只读实例每隔 refresh_ms 才读入新块，等它们都看到之后再删
+        if (!archive.sync()) {
+            finish(run, false);
+            return;
+        }
+        thread_->getLoop()->runAfter(refreshInterval_ * 2, [this, run]() {
+            deleteArchived(run, 0);
+        });
+    }
+
+    void MessageArchiver::deleteArchived(const RunPtr& run, size_t offset) {
+        // 与 selectBatch 相同，在主循环上取用 DbClient
+        auto loop = app().getLoop();
+        if (!loop->isInLoopThread()) {
+            loop->queueInLoop([this, run, offset]() {
+                deleteArchived(run, offset);
+            });
+            return;
+        }
+
+        if (offset >= run->archivedIds.size()) {
+            run->moved += run->archivedIds.size();
+            movedRows_.fetch_add(run->archivedIds.size(), std::memory_order_relaxed);
+            if (run->batchRows >= batchSize_) {
+                selectBatch(run);
+            } else {
+                finish(run, true);
+            }
+            return;
+        }
+
+        size_t end = std::min(run->archivedIds.size(), offset + kIdsPerDelete);
+        std::string sql = "DELETE FROM messages WHERE id IN (";
+        for (size_t i = offset; i < end; ++i) {
+            sql += i == offset ? "?" : ",?";
+        }
+        sql += ")";
+
+        auto binder = *DbUtil::getClient() << std::move(sql);
+        for (size_t i = offset; i < end; ++i) {
+            binder << run->archivedIds[i];
+        }
+        binder >> [this, run, end](const Result&) {
+                      deleteArchived(run, end);
+                  }
+               >> [this, run](const DrogonDbException& e) {
+                      LOG_ERROR << "Error deleting archived messages: " << e.base().what();
+                      finish(run, false);
+                  };
+    }
+
+    void MessageArchiver::finish(const RunPtr& run, bool ok) {
+        auto micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - run->started).count());
+        runs_.fetch_add(1, std::memory_order_relaxed);
+        lastRunMicros_.store(micros, std::memory_order_relaxed);
+        if (!ok) {
+            failedRuns_.fetch_add(1, std::memory_order_relaxed);
+        }
+        LOG_INFO << "Message archiver run " << (ok ? "finished" : "failed") << ": moved " << run->moved
+                 << " rows in " << micros / 1000 << " ms";
+        running_.store(false, std::memory_order_release);
+    }
+
+    MessageArchiver::Stats MessageArchiver::stats() const {
+        return Stats{
+            runs_.load(std::memory_order_relaxed),
+            movedRows_.load(std::memory_order_relaxed),
+            failedRuns_.load(std::memory_order_relaxed),
+            lastRunMicros_.load(std::memory_order_relaxed),
+        };
+    }
+}
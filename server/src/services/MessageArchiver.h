@@ -0,0 +1,76 @@
+#pragma once
+
+#include "../models/Message.h"
+#include <trantor/net/EventLoopThread.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace im_server
+{
+    // 冷热分层的迁移任务：定期把 messages 表里早于 max_age_days 的已读单聊消息和群聊消息
+    // 按会话写入 MessageArchive，落盘后再从表中删除，让表和它的二级索引保持在热数据的规模。
+    // 未读消息留在热库，未读查询、已读标记和上线同步都不需要访问归档。
+    //
+    // 只在 MySQL 后端下工作（embedded 后端是追加日志，没有二级索引膨胀的问题）。
+    // 多实例部署时归档目录必须放在所有实例都能访问的共享存储上（如 NFS），否则其他实例读不到已迁出热库的历史消息。
+    // 只有一个实例执行迁移（migrate 为 true，归档目录的写锁保证唯一），其余实例设 migrate 为 false，
+    // 只读打开归档并每隔 refresh_ms 读入新追加的块。迁移时归档落盘后先等待两个 refresh_ms 再删除表中的行，
+    // 让其他实例在行消失之前已经能从归档读到它们。
+    //
+    // 配置（custom_config.storage.archive）：
+    //   "enabled"      : 默认 false
+    //   "dir"          : 归档目录，默认 "./archive"
+    //   "max_age_days" : 超过多少天的消息迁入归档，默认 90
+    //   "interval_sec" : 迁移任务间隔，默认 3600
+    //   "batch_size"   : 每次从表中取出的行数，默认 5000
+    //   "migrate"      : 本实例是否执行迁移，默认 true；为 false 时只读取归档
+    //   "refresh_ms"   : 只读实例检查归档新块的间隔，默认 1000
+    class MessageArchiver
+    {
+    public:
+        struct Stats
+        {
+            uint64_t runs;
+            uint64_t movedRows;   // 已归档并从表中删除
+            uint64_t failedRuns;
+            uint64_t lastRunMicros;
+        };
+
+        static MessageArchiver &instance();
+
+        // 在 IO 线程启动后调用；未开启或归档未能打开时什么也不做，归档只读时只启动刷新定时器
+        void start();
+        // 立即执行一轮迁移（已有一轮在执行时忽略）
+        void runOnce();
+
+        Stats stats() const;
+
+    private:
+        struct Run;
+        using RunPtr = std::shared_ptr<Run>;
+
+        MessageArchiver() = default;
+
+        // selectBatch / deleteArchived 在主循环上执行 SQL，archiveBatch 在归档线程上压缩、写文件
+        void selectBatch(const RunPtr &run);
+        void archiveBatch(const RunPtr &run, std::vector<Message> &&rows);
+        void deleteArchived(const RunPtr &run, size_t offset);
+        void finish(const RunPtr &run, bool ok);
+
+        int64_t maxAgeMillis_ = 90LL * 24 * 3600 * 1000;
+        double intervalSeconds_ = 3600;
+        size_t batchSize_ = 5000;
+        std::chrono::milliseconds refreshInterval_{1000};
+
+        std::unique_ptr<trantor::EventLoopThread> thread_;
+        std::atomic<bool> running_{false};
+
+        std::atomic<uint64_t> runs_{0};
+        std::atomic<uint64_t> movedRows_{0};
+        std::atomic<uint64_t> failedRuns_{0};
+        std::atomic<uint64_t> lastRunMicros_{0};
+    };
+}
@@ -0,0 +1,87 @@
+#include "MessageBus.h"
+#include <drogon/HttpAppFramework.h>
+#include <drogon/nosql/RedisClient.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace drogon;
+
+namespace im_server {
+
+    namespace {
+        // 进程内总线：所有实例共享同一张订阅表，同一进程里的多个节点可以互相投递
+        class LoopbackBus : public MessageBus {
+        public:
+            void publish(const std::string& channel, std::string&& payload) override {
+                std::vector<std::shared_ptr<Handler>> handlers;
+                {
+                    std::lock_guard<std::mutex> lock(registry().mutex);
+                    auto it = registry().channels.find(channel);
+                    if (it == registry().channels.end()) {
+                        return;
+                    }
+                    handlers = it->second;
+                }
+                // 在锁外回调，handler 里可以再次发布
+                for (const auto& handler : handlers) {
+                    (*handler)(payload);
+                }
+            }
+
+            void subscribe(const std::string& channel, Handler&& handler) override {
+                std::lock_guard<std::mutex> lock(registry().mutex);
+                registry().channels[channel].push_back(std::make_shared<Handler>(std::move(handler)));
+            }
+
+        private:
+            struct Registry {
+                std::mutex mutex;
+                std::unordered_map<std::string, std::vector<std::shared_ptr<Handler>>> channels;
+            };
+
+            static Registry& registry() {
+                static Registry instance;
+                return instance;
+            }
+        };
+
+        class RedisBus : public MessageBus {
+        public:
+            explicit RedisBus(nosql::RedisClientPtr client)
+                : client_(std::move(client)), subscriber_(client_->newSubscriber()) {}
+
+            void publish(const std::string& channel, std::string&& payload) override {
+                // %b 按长度传参，payload 中可以包含任意字节
+                client_->execCommandAsync(
+                    [](const nosql::RedisResult&) {},
+                    [channel](const nosql::RedisException& e) {
+                        LOG_ERROR << "Error publishing to " << channel << ": " << e.what();
+                    },
+                    "PUBLISH %s %b", channel.c_str(), payload.data(), payload.size());
+            }
+
+            void subscribe(const std::string& channel, Handler&& handler) override {
+                subscriber_->subscribe(channel,
+                    [handler = std::move(handler)](const std::string&, const std::string& message) {
+                        handler(message);
+                    });
+            }
+
+        private:
+            nosql::RedisClientPtr client_;
+            std::shared_ptr<nosql::RedisSubscriber> subscriber_;
+        };
+    }
+
+    std::shared_ptr<MessageBus> MessageBus::create(const Json::Value& config) {
+        if (config.get("bus", "loopback").asString() == "redis") {
+            auto client = app().getRedisClient(config.get("redis_client", "default").asString());
+            if (client) {
+                return std::make_shared<RedisBus>(std::move(client));
+            }
+            LOG_ERROR << "Redis client not configured, falling back to loopback bus";
+        }
+        return std::make_shared<LoopbackBus>();
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <json/json.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace im_server
+{
+    // 节点间发布 / 订阅总线。payload 是二进制安全的字节串。
+    //
+    // 配置（custom_config.cluster）：
+    //   "bus"          : "loopback"（默认，进程内投递，单机多节点测试用）或 "redis"
+    //   "redis_client" : 使用的 redis_clients 名称，默认 "default"
+    class MessageBus
+    {
+    public:
+        using Handler = std::function<void(const std::string &payload)>;
+
+        virtual ~MessageBus() = default;
+
+        virtual void publish(const std::string &channel, std::string &&payload) = 0;
+        // handler 在总线自己的线程上调用（loopback 为发布方线程），不应阻塞
+        virtual void subscribe(const std::string &channel, Handler &&handler) = 0;
+
+        static std::shared_ptr<MessageBus> create(const Json::Value &config);
+    };
+}
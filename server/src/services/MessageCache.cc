@@ -0,0 +1,296 @@
+#include "MessageCache.h"
+#include <algorithm>
+#include <limits>
+
+namespace im_server {
+
+    namespace {
+        constexpr int64_t kNothingCovered = std::numeric_limits<int64_t>::max();
+
+        bool idLess(const Message& message, int64_t id) {
+            return message.id < id;
+        }
+    }
+
+    MessageCache& MessageCache::instance() {
+        static MessageCache cache;
+        return cache;
+    }
+
+    void MessageCache::configure(size_t maxBytes, size_t perConversation, std::chrono::milliseconds maxAge) {
+        maxBytes_ = maxBytes;
+        perConversation_ = std::max<size_t>(1, perConversation);
+        maxAge_ = std::max(maxAge, std::chrono::milliseconds(0));
+    }
+
+    bool MessageCache::expired(const Entry& entry) const {
+        return maxAge_.count() > 0 && std::chrono::steady_clock::now() - entry.loadedAt > maxAge_;
+    }
+
+    size_t MessageCache::messageBytes(const Message& message) {
+        return sizeof(Message) + message.content.capacity();
+    }
+
+    MessageCache::Entry& MessageCache::touch(Shard& shard, uint64_t conversationId, bool& created) {
+        auto it = shard.entries.find(conversationId);
+        if (it != shard.entries.end()) {
+            created = false;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lruPos);
+            return it->second;
+        }
+
+        created = true;
+        shard.lru.push_front(conversationId);
+        auto& entry = shard.entries[conversationId];
+        entry.floorId = kNothingCovered;
+        entry.lruPos = shard.lru.begin();
+        entry.loadedAt = std::chrono::steady_clock::now();
+        conversations_.fetch_add(1, std::memory_order_relaxed);
+        return entry;
+    }
+
+    void MessageCache::insertSorted(Shard& shard, Entry& entry, const Message& message) {
+        // 早于连续区间的消息不缓存，否则区间里会出现空洞
+        if (entry.floorId != 0 && message.id < entry.floorId) {
+            return;
+        }
+
+        auto& messages = entry.messages;
+        if (messages.empty() || messages.back().id < message.id) {
+            messages.push_back(message);
+        } else {
+            auto pos = std::lower_bound(messages.begin(), messages.end(), message.id, idLess);
+            if (pos != messages.end() && pos->id == message.id) {
+                return;
+            }
+            messages.insert(pos, message);
+        }
+
+        size_t size = messageBytes(message);
+        entry.bytes += size;
+        shard.bytes += size;
+        bytes_.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void MessageCache::trim(Shard& shard, Entry& entry) {
+        size_t removed = 0;
+        while (entry.messages.size() > perConversation_) {
+            removed += messageBytes(entry.messages.front());
+            entry.messages.pop_front();
+        }
+        if (removed > 0) {
+            entry.floorId = entry.messages.front().id;
+            entry.bytes -= removed;
+            shard.bytes -= removed;
+            bytes_.fetch_sub(removed, std::memory_order_relaxed);
+        }
+    }
+
+    void MessageCache::evict(Shard& shard, uint64_t keep) {
+        const size_t shardBudget = maxBytes_ / kShardCount;
+        while (shard.bytes > shardBudget && !shard.lru.empty()) {
+            uint64_t victim = shard.lru.back();
+            if (victim == keep) {
+                break;
+            }
+            erase(shard, shard.entries.find(victim));
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void MessageCache::erase(Shard& shard, std::unordered_map<uint64_t, Entry>::iterator it) {
+        shard.bytes -= it->second.bytes;
+        bytes_.fetch_sub(it->second.bytes, std::memory_order_relaxed);
+        shard.lru.erase(it->second.lruPos);
+        shard.entries.erase(it);
+        conversations_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void MessageCache::invalidate(uint64_t conversationId) {
+        if (!enabled()) {
+            return;
+        }
+        auto& shard = shardFor(conversationId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ++generationOf(shard, conversationId);
+        auto it = shard.entries.find(conversationId);
+        if (it != shard.entries.end()) {
+            erase(shard, it);
+        }
+    }
+
+    void MessageCache::append(const Message& message) {
+        if (!enabled()) {
+            return;
+        }
+
+        uint64_t conversationId = message.conversationId();
+        auto& shard = shardFor(conversationId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ++generationOf(shard, conversationId);
+
+        bool created;
+        auto& entry = touch(shard, conversationId, created);
+        if (created) {
+            entry.floorId = message.id;
+        }
+        insertSorted(shard, entry, message);
+        trim(shard, entry);
+        evict(shard, conversationId);
+    }
+
+    uint64_t MessageCache::generation(uint64_t conversationId) {
+        if (!enabled()) {
+            return 0;
+        }
+        auto& shard = shardFor(conversationId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return generationOf(shard, conversationId);
+    }
+
+    void MessageCache::seedLatest(uint64_t conversationId, const std::vector<Message>& messages, bool complete,
+                                  uint64_t generation) {
+        if (!enabled() || (messages.empty() && !complete)) {
+            return;
+        }
+
+        auto& shard = shardFor(conversationId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // 读库之后提交的消息 M 不在这一页里；如果 M 的 append 因 id 低于当时的 floorId 被丢弃，
+        // 或者 M 只存在于下面要丢弃的过期条目中，按这一页降低 floorId 会在区间里留下空洞
+        if (generationOf(shard, conversationId) != generation) {
+            return;
+        }
+
+        // 过期的条目可能缺少其他节点写入的消息，丢弃后以这一页重建
+        auto stale = shard.entries.find(conversationId);
+        if (stale != shard.entries.end() && expired(stale->second)) {
+            erase(shard, stale);
+        }
+
+        bool created;
+        auto& entry = touch(shard, conversationId, created);
+        entry.loadedAt = std::chrono::steady_clock::now();
+        // 数据库最新一页覆盖 [front, 库中最新]，缓存覆盖 [floorId, +inf)，两者之并仍是连续区间
+        if (complete) {
+            entry.floorId = 0;
+        } else if (entry.floorId != 0) {
+            entry.floorId = std::min(entry.floorId, messages.front().id);
+        }
+        for (const auto& message : messages) {
+            insertSorted(shard, entry, message);
+        }
+        trim(shard, entry);
+        evict(shard, conversationId);
+    }
+
+    std::optional<std::vector<Message>> MessageCache::lookup(uint64_t conversationId, int64_t beforeId,
+                                                             int64_t afterId, int limit) {
+        if (!enabled() || limit <= 0) {
+            return std::nullopt;
+        }
+
+        auto& shard = shardFor(conversationId);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+
+        auto it = shard.entries.find(conversationId);
+        if (it == shard.entries.end()) {
+            lock.unlock();
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        const auto& entry = it->second;
+        if (expired(entry)) {
+            lock.unlock();
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        const auto& messages = entry.messages;
+        const bool complete = entry.floorId == 0;
+        const size_t want = static_cast<size_t>(limit);
+        std::vector<Message> result;
+
+        if (afterId > 0) {
+            // 需要 id > afterId 的全部消息都在缓存中
+            if (complete || afterId >= entry.floorId - 1) {
+                auto first = std::upper_bound(messages.begin(), messages.end(), afterId,
+                                              [](int64_t id, const Message& m) { return id < m.id; });
+                auto count = std::min<size_t>(want, static_cast<size_t>(messages.end() - first));
+                result.assign(first, first + count);
+                shard.lru.splice(shard.lru.begin(), shard.lru, entry.lruPos);
+                lock.unlock();
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return result;
+            }
+        } else {
+            auto last = beforeId > 0
+                            ? std::lower_bound(messages.begin(), messages.end(), beforeId, idLess)
+                            : messages.end();
+            auto available = static_cast<size_t>(last - messages.begin());
+            if (available >= want || complete) {
+                auto count = std::min(want, available);
+                result.assign(last - count, last);
+                shard.lru.splice(shard.lru.begin(), shard.lru, entry.lruPos);
+                lock.unlock();
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return result;
+            }
+        }
+
+        lock.unlock();
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    void MessageCache::markRead(uint64_t conversationId, int64_t messageId, int64_t receiverId) {
+        if (!enabled()) {
+            return;
+        }
+
+        auto& shard = shardFor(conversationId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(conversationId);
+        if (it == shard.entries.end()) {
+            return;
+        }
+
+        auto& messages = it->second.messages;
+        auto pos = std::lower_bound(messages.begin(), messages.end(), messageId, idLess);
+        if (pos != messages.end() && pos->id == messageId && pos->receiver_id == receiverId) {
+            pos->is_read = true;
+        }
+    }
+
+    void MessageCache::markReadUpTo(uint64_t conversationId, int64_t upToId, int64_t receiverId) {
+        if (!enabled()) {
+            return;
+        }
+
+        auto& shard = shardFor(conversationId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(conversationId);
+        if (it == shard.entries.end()) {
+            return;
+        }
+
+        for (auto& message : it->second.messages) {
+            if (message.id > upToId) {
+                break;
+            }
+            if (message.receiver_id == receiverId) {
+                message.is_read = true;
+            }
+        }
+    }
+
+    MessageCache::Stats MessageCache::stats() const {
+        return Stats{
+            hits_.load(std::memory_order_relaxed),
+            misses_.load(std::memory_order_relaxed),
+            evictions_.load(std::memory_order_relaxed),
+            bytes_.load(std::memory_order_relaxed),
+            conversations_.load(std::memory_order_relaxed),
+        };
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "../models/Message.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace im_server
+{
+    // 热点会话缓存：每个会话缓存最近 per_conversation 条消息（按 id 升序），
+    // 所有会话共享一个字节预算，超出时按 LRU 整个会话淘汰。
+    //
+    // 每个会话条目维护 floorId：id >= floorId 的消息全部在缓存里，
+    // floorId == 0 表示整个会话都在缓存里。只有能被这段连续区间完整回答的查询才算命中。
+    // 消息落库成功后才进缓存（MessagePersister 的提交回调），写入失败的消息不会被读到。
+    //
+    // 多节点部署时其他节点写入的消息不经过本节点的缓存：
+    //   - 通过集群总线投递到本节点的消息会使对应会话的条目失效（invalidate）；
+    //   - 本节点没有连接的会话收不到投递，条目自从数据库载入起最多被信任 cluster_max_age_ms，
+    //     之后按未命中处理并重新载入最新一页。
+    //
+    // 配置（custom_config.message_cache）：
+    //   "max_bytes"          : 全局字节预算，默认 64MB，0 关闭缓存
+    //   "per_conversation"   : 每个会话最多缓存的消息条数，默认 200
+    //   "cluster_max_age_ms" : cluster.bus 为 redis 时条目的最长信任时间，默认 1000
+    class MessageCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+            uint64_t bytes;
+            uint64_t conversations;
+        };
+
+        static MessageCache &instance();
+
+        // maxAge 为 0 表示条目一直有效（单节点）
+        void configure(size_t maxBytes, size_t perConversation, std::chrono::milliseconds maxAge);
+        bool enabled() const { return maxBytes_ > 0; }
+
+        // 新消息落库后调用，会话不在缓存中时以这条消息建立条目
+        void append(const Message &message);
+        // 其他节点写入了该会话，丢弃条目
+        void invalidate(uint64_t conversationId);
+
+        // 读库之前取一次，读到的最新一页连同它交给 seedLatest
+        uint64_t generation(uint64_t conversationId);
+        // 从数据库取到的最新一页（升序），合并进缓存；complete 表示会话没有更早的消息。
+        // 读库之后该会话有过 append / invalidate（generation 变化）时这一页可能缺少期间提交的消息，不合并
+        void seedLatest(uint64_t conversationId, const std::vector<Message> &messages, bool complete,
+                        uint64_t generation);
+
+        // 与 MessageService::getMessages 相同的分页语义，缓存无法完整回答时返回 std::nullopt
+        std::optional<std::vector<Message>> lookup(uint64_t conversationId, int64_t beforeId,
+                                                   int64_t afterId, int limit);
+
+        void markRead(uint64_t conversationId, int64_t messageId, int64_t receiverId);
+        // 把发给 receiverId 的、id <= upToId 的缓存消息全部标记为已读
+        void markReadUpTo(uint64_t conversationId, int64_t upToId, int64_t receiverId);
+
+        Stats stats() const;
+
+    private:
+        static constexpr size_t kShardCount = 16;
+        static constexpr size_t kGenerationSlots = 64; // 每个分片的写入计数按会话再分槽，减少无关会话的干扰
+
+        struct Entry
+        {
+            std::deque<Message> messages;
+            int64_t floorId = 0;
+            size_t bytes = 0;
+            std::chrono::steady_clock::time_point loadedAt; // 建立或从数据库载入最新一页的时间
+            std::list<uint64_t>::iterator lruPos;
+        };
+
+        struct alignas(64) Shard
+        {
+            std::mutex mutex;
+            std::unordered_map<uint64_t, Entry> entries;
+            std::list<uint64_t> lru; // 头部最近使用
+            size_t bytes = 0;
+            std::array<uint64_t, kGenerationSlots> generations{}; // 每次 append / invalidate 加一
+        };
+
+        MessageCache() = default;
+
+        static size_t messageBytes(const Message &message);
+        Shard &shardFor(uint64_t conversationId) { return shards_[conversationId % kShardCount]; }
+        static uint64_t &generationOf(Shard &shard, uint64_t conversationId)
+        {
+            return shard.generations[conversationId / kShardCount % kGenerationSlots];
+        }
+        Entry &touch(Shard &shard, uint64_t conversationId, bool &created);
+        void insertSorted(Shard &shard, Entry &entry, const Message &message);
+        void trim(Shard &shard, Entry &entry);
+        void evict(Shard &shard, uint64_t keep);
+        void erase(Shard &shard, std::unordered_map<uint64_t, Entry>::iterator it);
+        bool expired(const Entry &entry) const;
+
+        size_t maxBytes_ = 64 * 1024 * 1024;
+        size_t perConversation_ = 200;
+        std::chrono::milliseconds maxAge_{0};
+        std::array<Shard, kShardCount> shards_;
+
+        std::atomic<uint64_t> hits_{0};
+        std::atomic<uint64_t> misses_{0};
+        std::atomic<uint64_t> evictions_{0};
+        std::atomic<uint64_t> bytes_{0};
+        std::atomic<uint64_t> conversations_{0};
+    };
+}
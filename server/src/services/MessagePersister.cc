@@ -0,0 +1,292 @@
+#include "MessagePersister.h"
+#include "Storage.h"
+#include "../utils/DbUtil.h"
+#include <drogon/HttpAppFramework.h>
+#include <algorithm>
+
+using namespace drogon;
+
+namespace im_server {
+
+    namespace {
+        constexpr std::chrono::milliseconds kDrainPollInterval{50};
+
+        void waitDrained(trantor::EventLoop* loop, const std::atomic<uint64_t>& depth,
+                         std::chrono::steady_clock::time_point deadline,
+                         const std::shared_ptr<std::function<void()>>& done) {
+            auto pending = depth.load(std::memory_order_acquire);
+            if (pending == 0 || std::chrono::steady_clock::now() >= deadline) {
+                if (pending > 0) {
+                    LOG_ERROR << "Shutdown timeout reached with " << pending << " messages not persisted";
+                }
+                (*done)();
+                return;
+            }
+            loop->runAfter(kDrainPollInterval, [loop, &depth, deadline, done]() {
+                waitDrained(loop, depth, deadline, done);
+            });
+        }
+
+        void updateMax(std::atomic<uint64_t>& target, uint64_t value) {
+            auto current = target.load(std::memory_order_relaxed);
+            while (value > current &&
+                   !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    MessagePersister& MessagePersister::instance() {
+        static MessagePersister persister;
+        return persister;
+    }
+
+    void MessagePersister::start() {
+        if (started_.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        const auto& config = app().getCustomConfig()["persistence"];
+        if (config.isObject()) {
+            batchSize_ = std::max<size_t>(1, config.get("batch_size", static_cast<Json::UInt64>(batchSize_)).asUInt64());
+            flushInterval_ = std::chrono::milliseconds(
+                std::max<Json::Int64>(1, config.get("flush_interval_ms", static_cast<Json::Int64>(flushInterval_.count())).asInt64()));
+            if (config.get("durability", "ack_after_commit").asString() == "ack_after_enqueue") {
+                durability_ = Durability::AckAfterEnqueue;
+            }
+            maxQueue_ = std::max<uint64_t>(batchSize_, config.get("max_queue", static_cast<Json::UInt64>(maxQueue_)).asUInt64());
+            maxInflight_ = std::max<size_t>(1, config.get("max_inflight", static_cast<Json::UInt64>(maxInflight_)).asUInt64());
+            maxRetries_ = std::max(0, config.get("max_retries", maxRetries_).asInt());
+            retryBackoff_ = std::chrono::milliseconds(
+                std::max<Json::Int64>(1, config.get("retry_backoff_ms", static_cast<Json::Int64>(retryBackoff_.count())).asInt64()));
+            shutdownTimeout_ = std::chrono::milliseconds(
+                std::max<Json::Int64>(0, config.get("shutdown_timeout_ms", static_cast<Json::Int64>(shutdownTimeout_.count())).asInt64()));
+        }
+
+        for (size_t i = 0; i < app().getThreadNum(); ++i) {
+            auto buffer = std::make_unique<LoopBuffer>();
+            buffer->loop = app().getIOLoop(i);
+
+            auto* raw = buffer.get();
+            raw->loop->runEvery(flushInterval_, [this, raw]() {
+                flush(*raw);
+            });
+            buffers_.push_back(std::move(buffer));
+        }
+
+        started_.store(true, std::memory_order_release);
+        LOG_INFO << "Message persister started: batch_size=" << batchSize_
+                 << " flush_interval_ms=" << flushInterval_.count()
+                 << " durability=" << (durability_ == Durability::AckAfterCommit ? "ack_after_commit" : "ack_after_enqueue")
+                 << " max_queue=" << maxQueue_ << " max_inflight=" << maxInflight_ << " max_retries=" << maxRetries_;
+    }
+
+    bool MessagePersister::enqueue(Message&& row, BoolCallback&& callback) {
+        // 计数不是严格上限，多个 IO 线程同时入队时可能略微超出
+        if (draining_.load(std::memory_order_acquire) ||
+            queueDepth_.load(std::memory_order_relaxed) >= maxQueue_) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        PendingMessage message{std::move(row), std::move(callback)};
+        enqueued_.fetch_add(1, std::memory_order_relaxed);
+        queueDepth_.fetch_add(1, std::memory_order_relaxed);
+
+        if (!started_.load(std::memory_order_acquire)) {
+            // 尚未启动（或未配置 IO 线程）时退化为逐条写入
+            auto batch = std::make_shared<Batch>();
+            batch->loop = app().getLoop();
+            batch->rows.push_back(std::move(message.message));
+            batch->callbacks.push_back(std::move(message.callback));
+            startBatch(batch);
+            return true;
+        }
+
+        if (auto* buffer = currentLoopBuffer()) {
+            enqueueInLoop(*buffer, std::move(message));
+            return true;
+        }
+
+        // 非 IO 线程调用时投递到某个 IO 线程的缓冲区，保证缓冲区只被其所属线程访问
+        auto* buffer = buffers_[static_cast<uint64_t>(message.message.sender_id) % buffers_.size()].get();
+        buffer->loop->queueInLoop([this, buffer, message = std::move(message)]() mutable {
+            enqueueInLoop(*buffer, std::move(message));
+        });
+        return true;
+    }
+
+    void MessagePersister::enqueueInLoop(LoopBuffer& buffer, PendingMessage&& message) {
+        if (durability_ == Durability::AckAfterEnqueue && message.callback) {
+            message.callback(true);
+            message.callback = nullptr;
+        }
+
+        auto id = message.message.id;
+        auto oldest = buffer.oldestId.load(std::memory_order_relaxed);
+        if (oldest == 0 || id < oldest) {
+            buffer.oldestId.store(id, std::memory_order_release);
+        }
+        buffer.messages.push_back(std::move(message));
+        if (buffer.messages.size() >= batchSize_) {
+            flush(buffer);
+        }
+    }
+
+    void MessagePersister::flush(LoopBuffer& buffer) {
+        bool flushed = false;
+        while (!buffer.messages.empty()) {
+            // 写入中的批次达到上限时留在缓冲区，等下一次定时刷盘；退出时不受限制
+            if (inflight_.load(std::memory_order_relaxed) >= maxInflight_ &&
+                !draining_.load(std::memory_order_relaxed)) {
+                break;
+            }
+
+            auto batch = std::make_shared<Batch>();
+            batch->loop = buffer.loop;
+            size_t count = std::min(batchSize_, buffer.messages.size());
+            batch->rows.reserve(count);
+            batch->callbacks.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                auto& pending = buffer.messages.front();
+                batch->rows.push_back(std::move(pending.message));
+                batch->callbacks.push_back(std::move(pending.callback));
+                buffer.messages.pop_front();
+            }
+            startBatch(batch);
+            flushed = true;
+        }
+
+        // 批次已经登记在 inflightIds_ 里，再更新缓冲区的最小 id，oldestPendingId 不会漏掉中间状态
+        if (flushed) {
+            int64_t oldest = 0;
+            for (const auto& pending : buffer.messages) {
+                if (oldest == 0 || pending.message.id < oldest) {
+                    oldest = pending.message.id;
+                }
+            }
+            buffer.oldestId.store(oldest, std::memory_order_release);
+        }
+    }
+
+    void MessagePersister::startBatch(const BatchPtr& batch) {
+        batch->oldestId = std::min_element(batch->rows.begin(), batch->rows.end(),
+                                           [](const Message& a, const Message& b) { return a.id < b.id; })->id;
+        batch->started = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(inflightMutex_);
+            inflightIds_.insert(batch->oldestId);
+        }
+        inflight_.fetch_add(1, std::memory_order_relaxed);
+        writeBatch(batch);
+    }
+
+    void MessagePersister::writeBatch(const BatchPtr& batch) {
+        // 整批原子写入，要么全部落库要么全部失败；失败后在原 IO 线程上按退避时间重写整批
+        Storage::instance().insertMessages(batch->rows, [this, batch](bool ok) {
+            if (ok || batch->attempts >= maxRetries_) {
+                complete(batch, ok);
+                return;
+            }
+            auto delay = retryBackoff_ * (1 << std::min(batch->attempts, 10));
+            ++batch->attempts;
+            retries_.fetch_add(1, std::memory_order_relaxed);
+            LOG_WARN << "Retrying batch of " << batch->rows.size() << " messages in " << delay.count()
+                     << "ms (attempt " << batch->attempts << "/" << maxRetries_ << ")";
+            batch->loop->runAfter(delay, [this, batch]() {
+                writeBatch(batch);
+            });
+        });
+    }
+
+    void MessagePersister::complete(const BatchPtr& batch, bool ok) {
+        static auto& latency = DbUtil::queryLatency("persistBatch");
+        auto micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - batch->started).count());
+        size_t count = batch->rows.size();
+        latency.observe(micros);
+        flushes_.fetch_add(1, std::memory_order_relaxed);
+        lastFlushMicros_.store(micros, std::memory_order_relaxed);
+        totalFlushMicros_.fetch_add(micros, std::memory_order_relaxed);
+        updateMax(maxFlushMicros_, micros);
+        (ok ? flushedRows_ : failedRows_).fetch_add(count, std::memory_order_relaxed);
+        if (!ok) {
+            LOG_ERROR << "Giving up on " << count << " messages after " << batch->attempts << " retries";
+        } else if (commitHook_) {
+            commitHook_(batch->rows);
+        }
+
+        for (const auto& callback : batch->callbacks) {
+            if (callback) {
+                callback(ok);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(inflightMutex_);
+            auto it = inflightIds_.find(batch->oldestId);
+            if (it != inflightIds_.end()) {
+                inflightIds_.erase(it);
+            }
+        }
+        inflight_.fetch_sub(1, std::memory_order_relaxed);
+        queueDepth_.fetch_sub(count, std::memory_order_release);
+    }
+
+    int64_t MessagePersister::oldestPendingId() const {
+        int64_t oldest = 0;
+        {
+            std::lock_guard<std::mutex> lock(inflightMutex_);
+            if (!inflightIds_.empty()) {
+                oldest = *inflightIds_.begin();
+            }
+        }
+        for (const auto& buffer : buffers_) {
+            auto id = buffer->oldestId.load(std::memory_order_acquire);
+            if (id != 0 && (oldest == 0 || id < oldest)) {
+                oldest = id;
+            }
+        }
+        return oldest;
+    }
+
+    void MessagePersister::drain(std::function<void()>&& done) {
+        draining_.store(true, std::memory_order_release);
+        for (auto& buffer : buffers_) {
+            auto* raw = buffer.get();
+            raw->loop->queueInLoop([this, raw]() {
+                flush(*raw);
+            });
+        }
+        LOG_INFO << "Draining message persister: " << queueDepth_.load(std::memory_order_relaxed) << " messages pending";
+
+        auto deadline = std::chrono::steady_clock::now() + shutdownTimeout_;
+        waitDrained(app().getLoop(), queueDepth_, deadline, std::make_shared<std::function<void()>>(std::move(done)));
+    }
+
+    MessagePersister::LoopBuffer* MessagePersister::currentLoopBuffer() {
+        auto* loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+        if (!loop) {
+            return nullptr;
+        }
+        for (auto& buffer : buffers_) {
+            if (buffer->loop == loop) {
+                return buffer.get();
+            }
+        }
+        return nullptr;
+    }
+
+    MessagePersister::Stats MessagePersister::stats() const {
+        return Stats{
+            queueDepth_.load(std::memory_order_relaxed),
+            enqueued_.load(std::memory_order_relaxed),
+            rejected_.load(std::memory_order_relaxed),
+            flushes_.load(std::memory_order_relaxed),
+            flushedRows_.load(std::memory_order_relaxed),
+            retries_.load(std::memory_order_relaxed),
+            failedRows_.load(std::memory_order_relaxed),
+            lastFlushMicros_.load(std::memory_order_relaxed),
+            maxFlushMicros_.load(std::memory_order_relaxed),
+            totalFlushMicros_.load(std::memory_order_relaxed),
+        };
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "../models/Message.h"
+#include <trantor/net/EventLoop.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace im_server
+{
+    // 消息写入的 write-behind 阶段：saveMessage 只把消息放进当前 IO 线程自己的缓冲区，
+    // 凑满 batch_size 条或每隔 flush_interval_ms 就整批交给 Storage 落库（MySQL 后端为一条多行 INSERT）。
+    // 每个缓冲区只在所属 IO 线程上访问，入队不需要加锁。
+    //
+    // 写入失败的批次按指数退避重试，重试 max_retries 次仍失败才回调失败；
+    // 同时进行的批量写入不超过 max_inflight 个，其余留在缓冲区等待。
+    // 尚未落库的消息（含写入中和等待重试的）达到 max_queue 时 enqueue 返回 false，调用方应回复 busy。
+    // 进程收到 SIGTERM / SIGINT 时先调用 drain 把缓冲区全部写完，再退出事件循环。
+    //
+    // 配置（custom_config.persistence）：
+    //   "batch_size"          : 单次批量写入的最大行数，默认 100
+    //   "flush_interval_ms"   : 定时刷盘间隔，默认 10
+    //   "durability"          : "ack_after_commit"（默认，落库成功后回调）
+    //                           或 "ack_after_enqueue"（入队即回调，吞吐更高但宕机会丢未刷盘的消息）
+    //   "max_queue"           : 尚未落库的消息上限，默认 100000
+    //   "max_inflight"        : 同时进行的批量写入上限，默认 8
+    //   "max_retries"         : 单个批次的重试次数，默认 5
+    //   "retry_backoff_ms"    : 首次重试的等待时间，之后每次翻倍，默认 100
+    //   "shutdown_timeout_ms" : 退出时等待写完的最长时间，默认 5000
+    class MessagePersister
+    {
+    public:
+        using BoolCallback = std::function<void(bool)>;
+        // 批次落库成功后、回调发送方之前调用，在 Storage 的回调线程上执行
+        using CommitHook = std::function<void(const std::vector<Message> &)>;
+
+        enum class Durability
+        {
+            AckAfterCommit,
+            AckAfterEnqueue
+        };
+
+        struct Stats
+        {
+            uint64_t queueDepth;      // 尚未落库的消息数
+            uint64_t enqueued;        // 累计入队
+            uint64_t rejected;        // 队列已满被拒绝的消息
+            uint64_t flushes;         // 累计批量写入次数
+            uint64_t flushedRows;     // 累计成功落库行数
+            uint64_t retries;         // 累计重试次数
+            uint64_t failedRows;      // 重试耗尽后放弃的行数
+            uint64_t lastFlushMicros; // 最近一次批量写入耗时
+            uint64_t maxFlushMicros;  // 最大批量写入耗时
+            uint64_t totalFlushMicros;
+        };
+
+        static MessagePersister &instance();
+
+        // 在 start 之前设置
+        void setCommitHook(CommitHook &&hook) { commitHook_ = std::move(hook); }
+
+        // 在 IO 线程启动后调用（main 中通过 registerBeginningAdvice），为每个 IO 线程建缓冲区和刷盘定时器
+        void start();
+
+        // 单聊 room_id 为 0；群聊 receiver_id 为 0。
+        // 返回 false 表示队列已满或正在退出，消息没有被接受，callback 不会被调用
+        bool enqueue(Message &&message, BoolCallback &&callback);
+
+        // 停止接受新消息，写完缓冲区和重试中的批次（或超过 shutdown_timeout_ms）后调用 done
+        void drain(std::function<void()> &&done);
+
+        // 尚未落库（缓冲中、写入中或等待重试）的最小消息 id，没有时为 0。
+        // 上线同步用它把送达游标限制在未落库的消息之前；其他线程刚投递、尚未进入缓冲区的消息不计入
+        int64_t oldestPendingId() const;
+
+        Durability durability() const { return durability_; }
+        Stats stats() const;
+
+    private:
+        struct PendingMessage
+        {
+            Message message;
+            BoolCallback callback;
+        };
+
+        struct LoopBuffer
+        {
+            trantor::EventLoop *loop = nullptr;
+            std::deque<PendingMessage> messages;
+            std::atomic<int64_t> oldestId{0}; // messages 中的最小 id，由所属 IO 线程写入
+        };
+
+        struct Batch
+        {
+            trantor::EventLoop *loop = nullptr; // 重试定时器所在的线程
+            std::vector<Message> rows;
+            std::vector<BoolCallback> callbacks;
+            int attempts = 0;
+            int64_t oldestId = 0;
+            std::chrono::steady_clock::time_point started;
+        };
+        using BatchPtr = std::shared_ptr<Batch>;
+
+        MessagePersister() = default;
+
+        void enqueueInLoop(LoopBuffer &buffer, PendingMessage &&message);
+        void flush(LoopBuffer &buffer);
+        void startBatch(const BatchPtr &batch);
+        void writeBatch(const BatchPtr &batch);
+        void complete(const BatchPtr &batch, bool ok);
+        LoopBuffer *currentLoopBuffer();
+
+        size_t batchSize_ = 100;
+        std::chrono::milliseconds flushInterval_{10};
+        Durability durability_ = Durability::AckAfterCommit;
+        uint64_t maxQueue_ = 100000;
+        size_t maxInflight_ = 8;
+        int maxRetries_ = 5;
+        std::chrono::milliseconds retryBackoff_{100};
+        std::chrono::milliseconds shutdownTimeout_{5000};
+        CommitHook commitHook_;
+        std::vector<std::unique_ptr<LoopBuffer>> buffers_;
+        std::atomic<bool> started_{false};
+        std::atomic<bool> draining_{false};
+        std::atomic<size_t> inflight_{0};
+        // 写入中和等待重试的批次各自的最小 id
+        mutable std::mutex inflightMutex_;
+        std::multiset<int64_t> inflightIds_;
+
+        std::atomic<uint64_t> queueDepth_{0};
+        std::atomic<uint64_t> enqueued_{0};
+        std::atomic<uint64_t> rejected_{0};
+        std::atomic<uint64_t> flushes_{0};
+        std::atomic<uint64_t> flushedRows_{0};
+        std::atomic<uint64_t> retries_{0};
+        std::atomic<uint64_t> failedRows_{0};
+        std::atomic<uint64_t> lastFlushMicros_{0};
+        std::atomic<uint64_t> maxFlushMicros_{0};
+        std::atomic<uint64_t> totalFlushMicros_{0};
+    };
+}
@@ -0,0 +1,301 @@
+#include "MessageRouter.h"
+#include "FanoutService.h"
+#include "MessageCache.h"
+#include "OutboundQueue.h"
+#include "SessionRegistry.h"
+#include "../utils/BinaryProtocol.h"
+#include "../utils/FrameEncoder.h"
+#include "../utils/IdGenerator.h"
+#include <drogon/HttpAppFramework.h>
+#include <vector>
+
+using namespace drogon;
+
+namespace im_server {
+
+    namespace {
+        void updateMax(std::atomic<uint64_t>& target, uint64_t value) {
+            auto current = target.load(std::memory_order_relaxed);
+            while (value > current &&
+                   !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        uint64_t nowMicros() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+        }
+    }
+
+    MessageRouter& MessageRouter::instance() {
+        static MessageRouter router;
+        return router;
+    }
+
+    MessageRouter::MessageRouter() : sink_(defaultSink()) {}
+
+    MessageRouter::LocalSink MessageRouter::defaultSink() {
+        LocalSink sink;
+        sink.direct = [](int64_t receiverId, int64_t messageId, int64_t senderId, std::string_view content,
+                         int64_t timestamp) {
+            // 每种线路格式最多编码一次，同格式的设备共用；经 OutboundQueue 计入接收方的下行窗口
+            std::string_view jsonFrame, binaryFrame;
+            auto& outbound = OutboundQueue::instance();
+            SessionRegistry::instance().forEachConnection(receiverId, [&](const WebSocketConnectionPtr& conn) {
+                auto session = SessionRegistry::sessionOf(conn);
+                if (!session) {
+                    return;
+                }
+                if (session->protocol == WireProtocol::Binary) {
+                    if (binaryFrame.empty()) {
+                        binaryFrame = BinaryProtocol::encodeMessage(messageId, senderId, content, timestamp);
+                    }
+                    outbound.sendReliable(conn, *session, messageId, binaryFrame, WebSocketMessageType::Binary);
+                } else {
+                    if (jsonFrame.empty()) {
+                        jsonFrame = FrameEncoder::encodeMessage(messageId, senderId, content, timestamp);
+                    }
+                    outbound.sendReliable(conn, *session, messageId, jsonFrame, WebSocketMessageType::Text);
+                }
+            });
+        };
+        sink.room = [](int64_t roomId, int64_t messageId, int64_t senderId, std::string_view content,
+                       int64_t timestamp, const WebSocketConnection* origin) {
+            FanoutService::instance().publish(roomId, messageId, senderId, content, timestamp, origin);
+        };
+        sink.membership = [](int64_t roomId, int64_t userId, bool joined) {
+            if (joined) {
+                FanoutService::instance().onJoin(roomId, userId);
+            } else {
+                FanoutService::instance().onLeave(roomId, userId);
+            }
+        };
+        return sink;
+    }
+
+    std::string MessageRouter::channelFor(int64_t nodeId) {
+        return nodeId == kBroadcast ? "im:broadcast" : "im:node:" + std::to_string(nodeId);
+    }
+
+    void MessageRouter::start() {
+        const auto& config = app().getCustomConfig()["cluster"];
+        start(IdGenerator::nodeId(), config, MessageBus::create(config), PresenceDirectory::create(config),
+              defaultSink());
+        app().getLoop()->runEvery(flushInterval_, [this]() {
+            flush();
+        });
+    }
+
+    void MessageRouter::start(int64_t nodeId, const Json::Value& config, std::shared_ptr<MessageBus> bus,
+                              std::shared_ptr<PresenceDirectory> presence, LocalSink sink) {
+        if (started_.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        nodeId_ = nodeId;
+        if (config.isObject()) {
+            batchSize_ = std::max<size_t>(1, config.get("batch_size", static_cast<Json::UInt64>(batchSize_)).asUInt64());
+            flushInterval_ = std::chrono::milliseconds(
+                std::max<Json::Int64>(1, config.get("flush_interval_ms", static_cast<Json::Int64>(flushInterval_.count())).asInt64()));
+        }
+        bus_ = std::move(bus);
+        presence_ = std::move(presence);
+        sink_ = std::move(sink);
+
+        presence_->clearNode(nodeId_);
+        bus_->subscribe(channelFor(nodeId_), [this](const std::string& payload) {
+            onPayload(payload);
+        });
+        bus_->subscribe(channelFor(kBroadcast), [this](const std::string& payload) {
+            onPayload(payload);
+        });
+
+        started_.store(true, std::memory_order_release);
+        LOG_INFO << "Message router started: node_id=" << nodeId_ << " batch_size=" << batchSize_
+                 << " flush_interval_ms=" << flushInterval_.count();
+    }
+
+    void MessageRouter::onUserOnline(int64_t userId) {
+        if (started_.load(std::memory_order_acquire)) {
+            presence_->setOnline(userId, nodeId_);
+        }
+    }
+
+    void MessageRouter::onUserOffline(int64_t userId) {
+        if (started_.load(std::memory_order_acquire)) {
+            presence_->setOffline(userId, nodeId_);
+        }
+    }
+
+    void MessageRouter::routeDirect(int64_t receiverId, int64_t messageId, int64_t senderId,
+                                    std::string_view content, int64_t timestamp) {
+        sink_.direct(receiverId, messageId, senderId, content, timestamp);
+        if (!started_.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        presenceLookups_.fetch_add(1, std::memory_order_relaxed);
+        auto publishedAt = nowMicros();
+        presence_->lookup(receiverId,
+            [this, receiverId, messageId, senderId, publishedAt, timestamp,
+             content = std::string(content)](std::vector<int64_t>&& nodes) {
+                for (auto node : nodes) {
+                    if (node == nodeId_) {
+                        continue;
+                    }
+                    enqueue(node, [&](std::string& out) {
+                        out.push_back(static_cast<char>(kDirect));
+                        BinaryProtocol::appendVarint(out, static_cast<uint64_t>(receiverId));
+                        BinaryProtocol::appendVarint(out, static_cast<uint64_t>(messageId));
+                        BinaryProtocol::appendVarint(out, static_cast<uint64_t>(senderId));
+                        BinaryProtocol::appendVarint(out, publishedAt);
+                        BinaryProtocol::appendVarint(out, static_cast<uint64_t>(timestamp));
+                        BinaryProtocol::appendBytes(out, content);
+                    });
+                }
+            });
+    }
+
+    void MessageRouter::routeRoom(int64_t roomId, int64_t messageId, int64_t senderId, std::string_view content,
+                                  int64_t timestamp, const WebSocketConnection* origin) {
+        sink_.room(roomId, messageId, senderId, content, timestamp, origin);
+        if (!started_.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        auto publishedAt = nowMicros();
+        enqueue(kBroadcast, [&](std::string& out) {
+            out.push_back(static_cast<char>(kRoom));
+            BinaryProtocol::appendVarint(out, static_cast<uint64_t>(roomId));
+            BinaryProtocol::appendVarint(out, static_cast<uint64_t>(messageId));
+            BinaryProtocol::appendVarint(out, static_cast<uint64_t>(senderId));
+            BinaryProtocol::appendVarint(out, publishedAt);
+            BinaryProtocol::appendVarint(out, static_cast<uint64_t>(timestamp));
+            BinaryProtocol::appendBytes(out, content);
+        });
+    }
+
+    void MessageRouter::routeMembership(int64_t roomId, int64_t userId, bool joined) {
+        sink_.membership(roomId, userId, joined);
+        if (!started_.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        enqueue(kBroadcast, [&](std::string& out) {
+            out.push_back(static_cast<char>(joined ? kJoin : kLeave));
+            BinaryProtocol::appendVarint(out, static_cast<uint64_t>(roomId));
+            BinaryProtocol::appendVarint(out, static_cast<uint64_t>(userId));
+        });
+    }
+
+    template <typename Append>
+    void MessageRouter::enqueue(int64_t nodeId, Append&& append) {
+        std::string full;
+        size_t count = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& batch = outgoing_[nodeId];
+            if (batch.payload.empty()) {
+                // 批次头：发送节点 id，广播时接收方据此跳过自己发出的批次
+                BinaryProtocol::appendVarint(batch.payload, static_cast<uint64_t>(nodeId_));
+            }
+            append(batch.payload);
+            if (++batch.count < batchSize_) {
+                return;
+            }
+            full.swap(batch.payload);
+            count = batch.count;
+            batch.count = 0;
+        }
+        publish(nodeId, std::move(full), count);
+    }
+
+    void MessageRouter::flush() {
+        std::vector<std::pair<int64_t, Outgoing>> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& entry : outgoing_) {
+                if (entry.second.count == 0) {
+                    continue;
+                }
+                pending.emplace_back(entry.first, std::move(entry.second));
+                entry.second = Outgoing();
+            }
+        }
+        for (auto& entry : pending) {
+            publish(entry.first, std::move(entry.second.payload), entry.second.count);
+        }
+    }
+
+    void MessageRouter::publish(int64_t nodeId, std::string&& payload, size_t count) {
+        batchesPublished_.fetch_add(1, std::memory_order_relaxed);
+        deliveriesPublished_.fetch_add(count, std::memory_order_relaxed);
+        bus_->publish(channelFor(nodeId), std::move(payload));
+    }
+
+    void MessageRouter::onPayload(const std::string& payload) {
+        BinaryProtocol::Reader in(payload);
+        uint64_t origin;
+        if (!in.varint(origin)) {
+            LOG_ERROR << "Malformed cluster batch";
+            return;
+        }
+        if (static_cast<int64_t>(origin) == nodeId_) {
+            return;
+        }
+
+        while (!in.done()) {
+            uint8_t kind;
+            int64_t target, a, b, timestamp = 0;
+            uint64_t publishedAt = 0;
+            std::string_view content;
+            bool ok = in.byte(kind);
+            if (ok && (kind == kDirect || kind == kRoom)) {
+                ok = in.id(target) && in.id(a) && in.id(b) && in.varint(publishedAt) &&
+                     in.id(timestamp) && in.bytes(content);
+            } else if (ok && (kind == kJoin || kind == kLeave)) {
+                ok = in.id(target) && in.id(a);
+            } else {
+                ok = false;
+            }
+            if (!ok) {
+                LOG_ERROR << "Malformed cluster batch from node " << origin;
+                return;
+            }
+
+            // 其他节点写入的消息不经过本节点的历史缓存，对应会话的缓存条目作废
+            switch (kind) {
+            case kDirect:
+                MessageCache::instance().invalidate(makeConversationId(b, target));
+                sink_.direct(target, a, b, content, timestamp);
+                break;
+            case kRoom:
+                MessageCache::instance().invalidate(makeRoomConversationId(target));
+                sink_.room(target, a, b, content, timestamp, nullptr);
+                break;
+            default:
+                sink_.membership(target, a, kind == kJoin);
+                continue;
+            }
+
+            deliveriesReceived_.fetch_add(1, std::memory_order_relaxed);
+            auto now = nowMicros();
+            auto micros = now > publishedAt ? now - publishedAt : 0;
+            lastLatencyMicros_.store(micros, std::memory_order_relaxed);
+            totalLatencyMicros_.fetch_add(micros, std::memory_order_relaxed);
+            updateMax(maxLatencyMicros_, micros);
+        }
+    }
+
+    MessageRouter::Stats MessageRouter::stats() const {
+        return Stats{
+            batchesPublished_.load(std::memory_order_relaxed),
+            deliveriesPublished_.load(std::memory_order_relaxed),
+            deliveriesReceived_.load(std::memory_order_relaxed),
+            presenceLookups_.load(std::memory_order_relaxed),
+            lastLatencyMicros_.load(std::memory_order_relaxed),
+            maxLatencyMicros_.load(std::memory_order_relaxed),
+            totalLatencyMicros_.load(std::memory_order_relaxed),
+        };
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "MessageBus.h"
+#include "PresenceDirectory.h"
+#include <drogon/WebSocketConnection.h>
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace im_server
+{
+    // 多节点消息路由。先投递到本节点的连接，再通过在线目录找到接收方所在的其他节点，
+    // 把投递追加到发往该节点的批次里，凑满 batch_size 条或每隔 flush_interval_ms
+    // 在 im:node:{node id} 频道上整批发布。群聊消息和成员变化发往 im:broadcast，由所有节点处理。
+    //
+    // 配置（custom_config.cluster，另见 MessageBus）：
+    //   "batch_size"        : 单个批次最多携带的投递数，默认 64
+    //   "flush_interval_ms" : 批次最长等待时间，默认 2
+    class MessageRouter
+    {
+    public:
+        struct Stats
+        {
+            uint64_t batchesPublished;
+            uint64_t deliveriesPublished;
+            uint64_t deliveriesReceived;
+            uint64_t presenceLookups;
+            // 跨节点投递延迟：发送节点入批到接收节点写入本地连接，依赖节点间时钟同步
+            uint64_t lastLatencyMicros;
+            uint64_t maxLatencyMicros;
+            uint64_t totalLatencyMicros;
+        };
+
+        // 投递到本节点连接的动作。默认写入 SessionRegistry / FanoutService；
+        // 单机多节点测试可以为每个实例传入自己的实现
+        struct LocalSink
+        {
+            std::function<void(int64_t receiverId, int64_t messageId, int64_t senderId,
+                               std::string_view content, int64_t timestamp)>
+                direct;
+            std::function<void(int64_t roomId, int64_t messageId, int64_t senderId, std::string_view content,
+                               int64_t timestamp, const drogon::WebSocketConnection *origin)>
+                room;
+            std::function<void(int64_t roomId, int64_t userId, bool joined)> membership;
+        };
+
+        static MessageRouter &instance();
+
+        // 同一进程里可以构造多个实例模拟多个节点，它们通过 loopback 总线和在线目录互相投递
+        MessageRouter();
+
+        // 生产路径：从 custom_config.cluster 读取配置，node id 取 IdGenerator::nodeId()
+        void start();
+        void start(int64_t nodeId, const Json::Value &config, std::shared_ptr<MessageBus> bus,
+                   std::shared_ptr<PresenceDirectory> presence, LocalSink sink);
+
+        void onUserOnline(int64_t userId);
+        void onUserOffline(int64_t userId);
+
+        void routeDirect(int64_t receiverId, int64_t messageId, int64_t senderId, std::string_view content,
+                         int64_t timestamp);
+        // origin 为发送方连接，不回推给它自己
+        void routeRoom(int64_t roomId, int64_t messageId, int64_t senderId, std::string_view content,
+                       int64_t timestamp, const drogon::WebSocketConnection *origin);
+        void routeMembership(int64_t roomId, int64_t userId, bool joined);
+
+        // 立即发布所有未满的批次（定时器也会调用）
+        void flush();
+
+        Stats stats() const;
+
+    private:
+        static constexpr int64_t kBroadcast = -1;
+
+        enum Kind : uint8_t
+        {
+            kDirect = 1,
+            kRoom = 2,
+            kJoin = 3,
+            kLeave = 4
+        };
+
+        struct Outgoing
+        {
+            std::string payload;
+            size_t count = 0;
+        };
+
+        static LocalSink defaultSink();
+        static std::string channelFor(int64_t nodeId);
+
+        template <typename Append>
+        void enqueue(int64_t nodeId, Append &&append);
+        void publish(int64_t nodeId, std::string &&payload, size_t count);
+        void onPayload(const std::string &payload);
+
+        int64_t nodeId_ = 0;
+        size_t batchSize_ = 64;
+        std::chrono::milliseconds flushInterval_{2};
+        std::shared_ptr<MessageBus> bus_;
+        std::shared_ptr<PresenceDirectory> presence_;
+        LocalSink sink_;
+        std::atomic<bool> started_{false};
+
+        std::mutex mutex_;
+        std::unordered_map<int64_t, Outgoing> outgoing_;
+
+        std::atomic<uint64_t> batchesPublished_{0};
+        std::atomic<uint64_t> deliveriesPublished_{0};
+        std::atomic<uint64_t> deliveriesReceived_{0};
+        std::atomic<uint64_t> presenceLookups_{0};
+        std::atomic<uint64_t> lastLatencyMicros_{0};
+        std::atomic<uint64_t> maxLatencyMicros_{0};
+        std::atomic<uint64_t> totalLatencyMicros_{0};
+    };
+}
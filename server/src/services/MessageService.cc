@@ -1,130 +1,100 @@
 #include "MessageService.h"
+#include "MessageCache.h"
+#include "MessagePersister.h"
+#include "Storage.h"
 #include <string>
 #include <vector>
-#include <algorithm>  // for std::reverse
-
-using namespace drogon::orm;
 
 namespace im_server {
 
-    bool MessageService::saveMessage(int64_t senderId, int64_t receiverId, 
-                                    const std::string& content, const std::string& messageType) {
-        try {
-            std::string timestamp = TimeUtil::getCurrentTimestamp();
+    MessageService& MessageService::instance() {
+        static MessageService service;
+        return service;
+    }
 
-            auto result = dbClient->execSqlSync(
-                "INSERT INTO messages (sender_id, receiver_id, content, message_type, timestamp) VALUES ($1, $2, $3, $4, $5)",
-                senderId, receiverId, content, messageType, timestamp
-            );
+    bool MessageService::saveMessage(int64_t messageId, int64_t senderId, int64_t receiverId,
+                                     std::string content, MessageType messageType,
+                                     int64_t timestamp, BoolCallback&& callback) {
+        Message message(messageId, senderId, receiverId, std::move(content), messageType, timestamp);
 
-            return true;
-        } catch (const std::exception& e) {
-            LOG_ERROR << "Error saving message: " << e.what();
-            return false;
-        }
+        // 交给 write-behind 阶段批量落库，回调时机由 durability 配置决定；落库成功后才进缓存
+        return MessagePersister::instance().enqueue(std::move(message), std::move(callback));
     }
 
-    std::vector<Message> MessageService::getMessages(int64_t userId, int64_t otherUserId, int limit) {
-        std::vector<Message> messages;
-        
-        try {
-            // Get messages between these two users
-            auto result = dbClient->execSqlSync(
-                R"(SELECT id, sender_id, receiver_id, content, message_type, timestamp, is_read 
-                   FROM messages 
-                   WHERE (sender_id = $1 AND receiver_id = $2) OR (sender_id = $2 AND receiver_id = $1) 
-                   ORDER BY timestamp DESC LIMIT $3)",
-                userId, otherUserId, limit
-            );
+    bool MessageService::saveRoomMessage(int64_t messageId, int64_t senderId, int64_t roomId,
+                                         std::string content, MessageType messageType,
+                                         int64_t timestamp, BoolCallback&& callback) {
+        Message message(messageId, senderId, 0, std::move(content), messageType, timestamp);
+        message.room_id = roomId;
 
-            for (const auto& row : result) {
-                Message msg(
-                    row["id"].as<int64_t>(),
-                    row["sender_id"].as<int64_t>(),
-                    row["receiver_id"].as<int64_t>(),
-                    row["content"].as<std::string>(),
-                    row["message_type"].as<std::string>(),
-                    row["timestamp"].as<std::string>(),
-                    row["is_read"].as<bool>()
-                );
-                messages.push_back(msg);
-            }
-
-            // Reverse to get chronological order (oldest first)
-            std::reverse(messages.begin(), messages.end());
-            
-        } catch (const std::exception& e) {
-            LOG_ERROR << "Error getting messages: " << e.what();
-        }
+        return MessagePersister::instance().enqueue(std::move(message), std::move(callback));
+    }
 
-        return messages;
+    void MessageService::getMessages(int64_t userId, int64_t otherUserId, int64_t beforeId, int64_t afterId,
+                                     int limit, MessagesCallback&& callback) {
+        getConversationMessages(makeConversationId(userId, otherUserId), beforeId, afterId, limit,
+                                std::move(callback));
     }
 
-    bool MessageService::updateMessageAsRead(const std::string& messageId, int64_t userId) {
-        try {
-            auto result = dbClient->execSqlSync(
-                "UPDATE messages SET is_read = true WHERE id = $1 AND receiver_id = $2",
-                std::stoll(messageId), userId
-            );
+    void MessageService::getRoomMessages(int64_t roomId, int64_t beforeId, int64_t afterId, int limit,
+                                         MessagesCallback&& callback) {
+        getConversationMessages(makeRoomConversationId(roomId), beforeId, afterId, limit,
+                                std::move(callback));
+    }
 
-            return result.affectedRows() > 0;
-        } catch (const std::exception& e) {
-            LOG_ERROR << "Error updating message as read: " << e.what();
-            return false;
+    void MessageService::getConversationMessages(uint64_t conversationId, int64_t beforeId, int64_t afterId,
+                                                 int limit, MessagesCallback&& callback) {
+        if (auto cached = MessageCache::instance().lookup(conversationId, beforeId, afterId, limit)) {
+            callback(std::move(*cached));
+            return;
         }
+
+        bool latestPage = beforeId <= 0 && afterId <= 0;
+        uint64_t generation = latestPage ? MessageCache::instance().generation(conversationId) : 0;
+        Storage::instance().getConversationMessages(
+            conversationId, beforeId, afterId, limit,
+            [callback = std::move(callback), latestPage, conversationId, limit, generation](
+                std::vector<Message>&& messages) {
+                if (latestPage) {
+                    // 不足一页说明会话没有更早的消息，整个会话都可以由缓存回答
+                    MessageCache::instance().seedLatest(conversationId, messages,
+                                                        static_cast<int>(messages.size()) < limit, generation);
+                }
+                callback(std::move(messages));
+            });
     }
 
-    Message MessageService::getMessageById(const std::string& messageId) {
-        try {
-            auto result = dbClient->execSqlSync(
-                "SELECT id, sender_id, receiver_id, content, message_type, timestamp, is_read FROM messages WHERE id = $1",
-                std::stoll(messageId)
-            );
+    void MessageService::updateMessageAsRead(int64_t messageId, int64_t userId, int64_t senderId,
+                                             BoolCallback&& callback) {
+        MessageCache::instance().markRead(makeConversationId(userId, senderId), messageId, userId);
+        Storage::instance().markRead(messageId, userId, std::move(callback));
+    }
 
-            if (result.size() > 0) {
-                const auto& row = result[0];
-                return Message(
-                    row["id"].as<int64_t>(),
-                    row["sender_id"].as<int64_t>(),
-                    row["receiver_id"].as<int64_t>(),
-                    row["content"].as<std::string>(),
-                    row["message_type"].as<std::string>(),
-                    row["timestamp"].as<std::string>(),
-                    row["is_read"].as<bool>()
-                );
-            }
-        } catch (const std::exception& e) {
-            LOG_ERROR << "Error getting message by ID: " << e.what();
-        }
+    void MessageService::getMessagesForReceiver(int64_t receiverId, int64_t afterId, int limit,
+                                                MessagesCallback&& callback) {
+        Storage::instance().getMessagesForReceiver(receiverId, afterId, limit, std::move(callback));
+    }
 
-        return Message(); // Return empty message if not found
+    void MessageService::markConversationRead(int64_t userId, int64_t senderId, int64_t upToId,
+                                              BoolCallback&& callback) {
+        uint64_t conversationId = makeConversationId(userId, senderId);
+        MessageCache::instance().markReadUpTo(conversationId, upToId, userId);
+        Storage::instance().markConversationRead(conversationId, userId, upToId, std::move(callback));
     }
 
-    std::vector<Message> MessageService::getUnreadMessages(int64_t userId) {
-        std::vector<Message> messages;
-        
+    void MessageService::getMessageById(const std::string& messageId, MessageCallback&& callback) {
+        int64_t id;
         try {
-            auto result = dbClient->execSqlSync(
-                "SELECT id, sender_id, receiver_id, content, message_type, timestamp, is_read FROM messages WHERE receiver_id = $1 AND is_read = false ORDER BY timestamp ASC",
-                userId
-            );
-
-            for (const auto& row : result) {
-                Message msg(
-                    row["id"].as<int64_t>(),
-                    row["sender_id"].as<int64_t>(),
-                    row["receiver_id"].as<int64_t>(),
-                    row["content"].as<std::string>(),
-                    row["message_type"].as<std::string>(),
-                    row["timestamp"].as<std::string>(),
-                    row["is_read"].as<bool>()
-                );
-                messages.push_back(msg);
-            }
+            id = std::stoll(messageId);
         } catch (const std::exception& e) {
-            LOG_ERROR << "Error getting unread messages: " << e.what();
+            LOG_ERROR << "Invalid message id: " << messageId;
+            callback(Message());
+            return;
         }
+        Storage::instance().getMessageById(id, std::move(callback));
+    }
 
-        return messages;
+    void MessageService::getUnreadMessages(int64_t userId, MessagesCallback&& callback) {
+        Storage::instance().getUnreadMessages(userId, std::move(callback));
     }
-}
\ No newline at end of file
+}
@@ -2,25 +2,54 @@
 
 #include "../models/Message.h"
 #include "../utils/TimeUtil.h"
+#include <functional>
 #include <string>
 #include <vector>
-#include <drogon/orm/DbClient.h>
-
-using namespace drogon::orm;
 
 namespace im_server
 {
+    // 所有方法都是异步的：读写交给 Storage 后端执行，结果在后端的线程上回调，
+    // 调用方（IO 线程）不会被数据库往返阻塞。
     class MessageService
     {
     public:
-        bool saveMessage(int64_t senderId, int64_t receiverId,
-                         const std::string &content, const std::string &messageType);
-        std::vector<Message> getMessages(int64_t userId, int64_t otherUserId, int limit = 50);
-        bool updateMessageAsRead(const std::string &messageId, int64_t userId);
-        Message getMessageById(const std::string &messageId);
-        std::vector<Message> getUnreadMessages(int64_t userId);
+        // 进程内唯一实例，底层存储见 Storage
+        static MessageService &instance();
+
+        using BoolCallback = std::function<void(bool)>;
+        using MessagesCallback = std::function<void(std::vector<Message> &&)>;
+        using MessageCallback = std::function<void(Message &&)>;
+
+        // messageId、timestamp 由调用方预先生成，转发和落库使用同一份。
+        // 返回 false 表示写入队列已满，消息没有被接受，callback 不会被调用
+        bool saveMessage(int64_t messageId, int64_t senderId, int64_t receiverId,
+                         std::string content, MessageType messageType,
+                         int64_t timestamp, BoolCallback &&callback);
+        // 群聊消息只写一行（receiver_id 为 NULL），成员按 room_members 展开
+        bool saveRoomMessage(int64_t messageId, int64_t senderId, int64_t roomId,
+                             std::string content, MessageType messageType,
+                             int64_t timestamp, BoolCallback &&callback);
+        // 按 (conversation_id, id) 做 keyset 分页，结果按 id 升序：
+        // beforeId > 0 取比它更早的 limit 条，afterId > 0 取比它更新的 limit 条，都为 0 取最新的 limit 条
+        void getMessages(int64_t userId, int64_t otherUserId, int64_t beforeId, int64_t afterId,
+                         int limit, MessagesCallback &&callback);
+        // 群聊历史，分页语义同 getMessages；调用方负责校验成员身份
+        void getRoomMessages(int64_t roomId, int64_t beforeId, int64_t afterId, int limit,
+                             MessagesCallback &&callback);
+        // senderId 用于定位缓存中的会话
+        void updateMessageAsRead(int64_t messageId, int64_t userId, int64_t senderId,
+                                 BoolCallback &&callback);
+        // receiverId 收到的、id > afterId 的消息，按 id 升序（上线同步用）
+        void getMessagesForReceiver(int64_t receiverId, int64_t afterId, int limit, MessagesCallback &&callback);
+        // 批量已读：把 senderId 发给 userId 的、id <= upToId 的消息一次性标记为已读
+        void markConversationRead(int64_t userId, int64_t senderId, int64_t upToId, BoolCallback &&callback);
+        void getMessageById(const std::string &messageId, MessageCallback &&callback);
+        void getUnreadMessages(int64_t userId, MessagesCallback &&callback);
 
     private:
-        DbClientPtr dbClient = DbClient::newMysqlClient("host=localhost port=3306 user=root password=password dbname=im_db", 4);
+        MessageService() = default;
+
+        void getConversationMessages(uint64_t conversationId, int64_t beforeId, int64_t afterId, int limit,
+                                     MessagesCallback &&callback);
     };
-}
\ No newline at end of file
+}
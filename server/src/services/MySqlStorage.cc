@@ -0,0 +1,593 @@
+#include "MySqlStorage.h"
+#include "../utils/DbUtil.h"
+#include "../utils/Metrics.h"
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+using namespace drogon::orm;
+
+namespace im_server {
+
+    namespace {
+        const std::string kMessageColumns =
+            "SELECT id, sender_id, receiver_id, room_id, content, message_type, timestamp, is_read FROM messages ";
+
+        Message rowToMessage(const Row& row) {
+            Message message(
+                row["id"].as<int64_t>(),
+                row["sender_id"].as<int64_t>(),
+                row["receiver_id"].isNull() ? 0 : row["receiver_id"].as<int64_t>(),
+                row["content"].as<std::string>(),
+                parseMessageType(row["message_type"].as<std::string>()),
+                row["timestamp"].as<int64_t>(),
+                row["is_read"].as<bool>()
+            );
+            message.room_id = row["room_id"].isNull() ? 0 : row["room_id"].as<int64_t>();
+            return message;
+        }
+
+        // 唯一索引冲突："Duplicate entry '<值>' for key 'username'"（MySQL 8 为 'users.username'）。
+        // 值本身可能包含任意字符，所以只看最后一个 "for key '" 之后的索引名
+        Storage::Status duplicateKeyStatus(std::string_view error) {
+            if (error.find("Duplicate entry") == std::string_view::npos) {
+                return Storage::Status::Error;
+            }
+            auto pos = error.rfind("for key '");
+            if (pos == std::string_view::npos) {
+                return Storage::Status::Error;
+            }
+            auto key = error.substr(pos + 9);
+            key = key.substr(0, key.find('\''));
+            if (auto dot = key.rfind('.'); dot != std::string_view::npos) {
+                key.remove_prefix(dot + 1);
+            }
+            if (key == "username") {
+                return Storage::Status::UsernameTaken;
+            }
+            if (key == "email") {
+                return Storage::Status::EmailTaken;
+            }
+            return Storage::Status::Error;
+        }
+
+        std::vector<Message> rowsToMessages(const Result& result) {
+            std::vector<Message> messages;
+            messages.reserve(result.size());
+            for (const auto& row : result) {
+                messages.push_back(rowToMessage(row));
+            }
+            return messages;
+        }
+    }
+
+    void MySqlStorage::insertMessages(const std::vector<Message>& rows, BoolCallback&& callback) {
+        auto cb = std::make_shared<BoolCallback>(std::move(callback));
+        size_t count = rows.size();
+
+        // 一条多行 INSERT 本身就是一个原子事务，整批要么全部落库要么全部失败
+        std::string sql = "INSERT INTO messages (id, sender_id, receiver_id, room_id, conversation_id, content, message_type, timestamp) VALUES ";
+        sql.reserve(sql.size() + count * 18);
+        for (size_t i = 0; i < count; ++i) {
+            sql += (i == 0) ? "(?,?,?,?,?,?,?,?)" : ",(?,?,?,?,?,?,?,?)";
+        }
+        // 超时的批次可能其实已经提交，重试时已存在的行保持不变
+        sql += " ON DUPLICATE KEY UPDATE id = id";
+
+        auto binder = *DbUtil::getClient() << std::move(sql);
+        for (const auto& message : rows) {
+            // 单聊的 room_id、群聊的 receiver_id 写 NULL
+            bool room = message.room_id != 0;
+            binder << message.id << message.sender_id
+                   << (room ? std::nullopt : std::optional<int64_t>(message.receiver_id))
+                   << (room ? std::optional<int64_t>(message.room_id) : std::nullopt)
+                   << message.conversationId()
+                   << message.content << std::string(messageTypeName(message.message_type)) << message.timestamp;
+        }
+        binder >> [cb](const Result&) {
+                      (*cb)(true);
+                  }
+               >> [cb, count](const DrogonDbException& e) {
+                      LOG_ERROR << "Error saving " << count << " messages: " << e.base().what();
+                      (*cb)(false);
+                  };
+    }
+
+    void MySqlStorage::getConversationMessages(uint64_t conversationId, int64_t beforeId, int64_t afterId,
+                                               int limit, MessagesCallback&& callback) {
+        auto cb = std::make_shared<MessagesCallback>(std::move(callback));
+
+        // 向后翻页按 id 升序直接取；向前翻页和取最新一页按 id 降序取，再反转成时间顺序
+        bool ascending = afterId > 0;
+        static auto& latency = DbUtil::queryLatency("getMessages");
+        auto started = Metrics::now();
+        auto onResult = [cb, ascending, started](const Result& result) {
+            latency.observeSince(started);
+            auto messages = rowsToMessages(result);
+            if (!ascending) {
+                // Reverse to get chronological order (oldest first)
+                std::reverse(messages.begin(), messages.end());
+            }
+            (*cb)(std::move(messages));
+        };
+        auto onError = [cb, started](const DrogonDbException& e) {
+            latency.observeSince(started);
+            LOG_ERROR << "Error getting messages: " << e.base().what();
+            (*cb)({});
+        };
+
+        if (ascending) {
+            DbUtil::getClient()->execSqlAsync(
+                kMessageColumns + "WHERE conversation_id = ? AND id > ? ORDER BY id ASC LIMIT ?",
+                onResult, onError, conversationId, afterId, limit);
+        } else if (beforeId > 0) {
+            DbUtil::getClient()->execSqlAsync(
+                kMessageColumns + "WHERE conversation_id = ? AND id < ? ORDER BY id DESC LIMIT ?",
+                onResult, onError, conversationId, beforeId, limit);
+        } else {
+            DbUtil::getClient()->execSqlAsync(
+                kMessageColumns + "WHERE conversation_id = ? ORDER BY id DESC LIMIT ?",
+                onResult, onError, conversationId, limit);
+        }
+    }
+
+    void MySqlStorage::getMessagesForReceiver(int64_t receiverId, int64_t afterId, int limit,
+                                              MessagesCallback&& callback) {
+        auto cb = std::make_shared<MessagesCallback>(std::move(callback));
+        static auto& latency = DbUtil::queryLatency("getMessagesForReceiver");
+        auto started = Metrics::now();
+        DbUtil::getClient()->execSqlAsync(
+            kMessageColumns + "WHERE receiver_id = ? AND id > ? ORDER BY id ASC LIMIT ?",
+            [cb, started](const Result& result) {
+                latency.observeSince(started);
+                (*cb)(rowsToMessages(result));
+            },
+            [cb, started](const DrogonDbException& e) {
+                latency.observeSince(started);
+                LOG_ERROR << "Error getting messages for receiver: " << e.base().what();
+                (*cb)({});
+            },
+            receiverId, afterId, limit
+        );
+    }
+
+    void MySqlStorage::getUnreadMessages(int64_t receiverId, MessagesCallback&& callback) {
+        auto cb = std::make_shared<MessagesCallback>(std::move(callback));
+        static auto& latency = DbUtil::queryLatency("getUnreadMessages");
+        auto started = Metrics::now();
+        DbUtil::getClient()->execSqlAsync(
+            kMessageColumns + "WHERE receiver_id = ? AND is_read = false ORDER BY timestamp ASC",
+            [cb, started](const Result& result) {
+                latency.observeSince(started);
+                (*cb)(rowsToMessages(result));
+            },
+            [cb, started](const DrogonDbException& e) {
+                latency.observeSince(started);
+                LOG_ERROR << "Error getting unread messages: " << e.base().what();
+                (*cb)({});
+            },
+            receiverId
+        );
+    }
+
+    void MySqlStorage::getMessageById(int64_t messageId, MessageCallback&& callback) {
+        auto cb = std::make_shared<MessageCallback>(std::move(callback));
+        static auto& latency = DbUtil::queryLatency("getMessageById");
+        auto started = Metrics::now();
+        DbUtil::getClient()->execSqlAsync(
+            kMessageColumns + "WHERE id = ?",
+            [cb, started](const Result& result) {
+                latency.observeSince(started);
+                if (result.size() > 0) {
+                    (*cb)(rowToMessage(result[0]));
+                } else {
+                    (*cb)(Message()); // Return empty message if not found
+                }
+            },
+            [cb, started](const DrogonDbException& e) {
+                latency.observeSince(started);
+                LOG_ERROR << "Error getting message by ID: " << e.base().what();
+                (*cb)(Message());
+            },
+            messageId
+        );
+    }
+
+    void MySqlStorage::markRead(int64_t messageId, int64_t receiverId, BoolCallback&& callback) {
+        auto cb = std::make_shared<BoolCallback>(std::move(callback));
+        static auto& latency = DbUtil::queryLatency("updateMessageAsRead");
+        auto started = Metrics::now();
+        DbUtil::getClient()->execSqlAsync(
+            "UPDATE messages SET is_read = true WHERE id = ? AND receiver_id = ?",
+            [cb, started](const Result& result) {
+                latency.observeSince(started);
+                (*cb)(result.affectedRows() > 0);
+            },
+            [cb, started](const DrogonDbException& e) {
+                latency.observeSince(started);
+                LOG_ERROR << "Error updating message as read: " << e.base().what();
+                (*cb)(false);
+            },
+            messageId, receiverId
+        );
+    }
+
+    void MySqlStorage::markConversationRead(uint64_t conversationId, int64_t receiverId, int64_t upToId,
+                                            BoolCallback&& callback) {
+        auto cb = std::make_shared<BoolCallback>(std::move(callback));
+        static auto& latency = DbUtil::queryLatency("markConversationRead");
+        auto started = Metrics::now();
+        DbUtil::getClient()->execSqlAsync(
+            "UPDATE messages SET is_read = true WHERE conversation_id = ? AND receiver_id = ? AND id <= ? AND is_read = false",
+            [cb, started](const Result&) {
+                latency.observeSince(started);
+                (*cb)(true);
+            },
+            [cb, started](const DrogonDbException& e) {
+                latency.observeSince(started);
+                LOG_ERROR << "Error marking conversation as read: " << e.base().what();
+                (*cb)(false);
+            },
+            conversationId, receiverId, upToId
+        );
+    }
+
+    void MySqlStorage::createUser(const std::string& username, const std::string& email,
+                                  const std::string& passwordHash, const std::string& createdAt,
+                                  CreateUserCallback&& callback) {
+        auto cb = std::make_shared<CreateUserCallback>(std::move(callback));
+
+        // 不先查重：username / email 上的唯一索引负责检测冲突，一次往返完成注册。
+        // MySQL 不支持 RETURNING，新 id 取自 insertId()
+        DbUtil::getClient()->execSqlAsync(
+            "INSERT INTO users (username, email, password_hash, created_at, updated_at) VALUES (?, ?, ?, ?, ?)",
+            [cb](const Result& result) {
+                auto userId = static_cast<int64_t>(result.insertId());
+                (*cb)(userId > 0 ? Status::Ok : Status::Error, userId);
+            },
+            [cb](const DrogonDbException& e) {
+                auto conflict = duplicateKeyStatus(e.base().what());
+                if (conflict != Status::Error) {
+                    (*cb)(conflict, 0);
+                    return;
+                }
+                LOG_ERROR << "Error registering user: " << e.base().what();
+                (*cb)(Status::Error, 0);
+            },
+            username, email, passwordHash, createdAt, createdAt
+        );
+    }
+
+    void MySqlStorage::findUserByName(const std::string& username, UserCallback&& callback) {
+        auto cb = std::make_shared<UserCallback>(std::move(callback));
+        static auto& latency = DbUtil::queryLatency("loginUser");
+        auto started = Metrics::now();
+        DbUtil::getClient()->execSqlAsync(
+            "SELECT id, username, email, password_hash FROM users WHERE username = ? AND is_active = true",
+            [cb, started](const Result& result) {
+                latency.observeSince(started);
+                if (result.size() == 0) {
+                    (*cb)(Status::NotFound, User());
+                    return;
+                }
+                User user;
+                user.id = result[0]["id"].as<int64_t>();
+                user.username = result[0]["username"].as<std::string>();
+                user.email = result[0]["email"].as<std::string>();
+                user.password_hash = result[0]["password_hash"].as<std::string>();
+                (*cb)(Status::Ok, std::move(user));
+            },
+            [cb, started](const DrogonDbException& e) {
+                latency.observeSince(started);
+                LOG_ERROR << "Error logging in user: " << e.base().what();
+                (*cb)(Status::Error, User());
+            },
+            username
+        );
+    }
+
+    void MySqlStorage::findUserById(int64_t userId, UserCallback&& callback) {
+        auto cb = std::make_shared<UserCallback>(std::move(callback));
+        DbUtil::getClient()->execSqlAsync(
+            "SELECT id, username, email FROM users WHERE id = ? AND is_active = true",
+            [cb](const Result& result) {
+                if (result.size() == 0) {
+                    (*cb)(Status::NotFound, User());
+                    return;
+                }
+                User user;
+                user.id = result[0]["id"].as<int64_t>();
+                user.username = result[0]["username"].as<std::string>();
+                user.email = result[0]["email"].as<std::string>();
+                (*cb)(Status::Ok, std::move(user));
+            },
+            [cb](const DrogonDbException& e) {
+                LOG_ERROR << "Error finding user by id: " << e.base().what();
+                (*cb)(Status::Error, User());
+            },
+            userId
+        );
+    }
+
+    void MySqlStorage::updatePasswordHash(int64_t userId, const std::string& passwordHash,
+                                          BoolCallback&& callback) {
+        auto cb = std::make_shared<BoolCallback>(std::move(callback));
+        DbUtil::getClient()->execSqlAsync(
+            "UPDATE users SET password_hash = ? WHERE id = ?",
+            [cb](const Result& result) {
+                (*cb)(result.affectedRows() > 0);
+            },
+            [cb, userId](const DrogonDbException& e) {
+                LOG_ERROR << "Error updating password hash of user " << userId << ": " << e.base().what();
+                (*cb)(false);
+            },
+            passwordHash, userId
+        );
+    }
+
+    void MySqlStorage::setUserActive(int64_t userId, bool active, BoolCallback&& callback) {
+        auto cb = std::make_shared<BoolCallback>(std::move(callback));
+        DbUtil::getClient()->execSqlAsync(
+            "UPDATE users SET is_active = ? WHERE id = ?",
+            [cb, userId](const Result& result) {
+                if (result.affectedRows() > 0) {
+                    (*cb)(true);
+                    return;
+                }
+                // MySQL 只统计值真正改变的行：已经是目标状态时也返回 0，再查一次用户是否存在
+                DbUtil::getClient()->execSqlAsync(
+                    "SELECT 1 FROM users WHERE id = ?",
+                    [cb](const Result& rows) {
+                        (*cb)(!rows.empty());
+                    },
+                    [cb, userId](const DrogonDbException& e) {
+                        LOG_ERROR << "Error checking user " << userId << ": " << e.base().what();
+                        (*cb)(false);
+                    },
+                    userId
+                );
+            },
+            [cb, userId](const DrogonDbException& e) {
+                LOG_ERROR << "Error updating is_active of user " << userId << ": " << e.base().what();
+                (*cb)(false);
+            },
+            active, userId
+        );
+    }
+
+    void MySqlStorage::createRoom(int64_t roomId, const std::string& name, int64_t ownerId, bool isPublic,
+                                  BoolCallback&& callback) {
+        auto cb = std::make_shared<BoolCallback>(std::move(callback));
+
+        // 两条 INSERT 放在一个事务里，避免留下没有成员的房间。
+        // 事务在最后一个引用释放时提交，提交结果由 commit 回调给出；语句出错时自动回滚，不会再回调 commit
+        DbUtil::getClient()->newTransactionAsync(
+            [cb, roomId, name, ownerId, isPublic](const std::shared_ptr<Transaction>& trans) {
+                if (!trans) {
+                    LOG_ERROR << "Error starting transaction for room " << roomId;
+                    (*cb)(false);
+                    return;
+                }
+                trans->setCommitCallback([cb](bool committed) {
+                    (*cb)(committed);
+                });
+                trans->execSqlAsync(
+                    "INSERT INTO rooms (id, name, owner_id, is_public) VALUES (?, ?, ?, ?)",
+                    [cb, trans, roomId, ownerId](const Result&) {
+                        trans->execSqlAsync(
+                            "INSERT INTO room_members (room_id, user_id) VALUES (?, ?)",
+                            [](const Result&) {},
+                            [cb](const DrogonDbException& e) {
+                                LOG_ERROR << "Error adding room owner: " << e.base().what();
+                                (*cb)(false);
+                            },
+                            roomId, ownerId
+                        );
+                    },
+                    [cb](const DrogonDbException& e) {
+                        LOG_ERROR << "Error creating room: " << e.base().what();
+                        (*cb)(false);
+                    },
+                    roomId, name, ownerId, isPublic
+                );
+            });
+    }
+
+    void MySqlStorage::getRoom(int64_t roomId, RoomCallback&& callback) {
+        auto cb = std::make_shared<RoomCallback>(std::move(callback));
+        DbUtil::getClient()->execSqlAsync(
+            "SELECT owner_id, is_public FROM rooms WHERE id = ?",
+            [cb](const Result& result) {
+                if (result.empty()) {
+                    (*cb)(Status::NotFound, RoomInfo());
+                    return;
+                }
+                RoomInfo room;
+                room.ownerId = result[0]["owner_id"].as<int64_t>();
+                room.isPublic = result[0]["is_public"].as<bool>();
+                (*cb)(Status::Ok, std::move(room));
+            },
+            [cb](const DrogonDbException& e) {
+                LOG_ERROR << "Error loading room: " << e.base().what();
+                (*cb)(Status::Error, RoomInfo());
+            },
+            roomId
+        );
+    }
+
+    void MySqlStorage::joinRoom(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        auto cb = std::make_shared<BoolCallback>(std::move(callback));
+        // 房间不存在时外键约束报错
+        DbUtil::getClient()->execSqlAsync(
+            "INSERT INTO room_members (room_id, user_id) VALUES (?, ?) ON DUPLICATE KEY UPDATE room_id = room_id",
+            [cb](const Result&) {
+                (*cb)(true);
+            },
+            [cb](const DrogonDbException& e) {
+                LOG_ERROR << "Error joining room: " << e.base().what();
+                (*cb)(false);
+            },
+            roomId, userId
+        );
+    }
+
+    void MySqlStorage::leaveRoom(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        auto cb = std::make_shared<BoolCallback>(std::move(callback));
+        DbUtil::getClient()->execSqlAsync(
+            "DELETE FROM room_members WHERE room_id = ? AND user_id = ?",
+            [cb](const Result& result) {
+                (*cb)(result.affectedRows() > 0);
+            },
+            [cb](const DrogonDbException& e) {
+                LOG_ERROR << "Error leaving room: " << e.base().what();
+                (*cb)(false);
+            },
+            roomId, userId
+        );
+    }
+
+    void MySqlStorage::isMember(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        auto cb = std::make_shared<BoolCallback>(std::move(callback));
+        DbUtil::getClient()->execSqlAsync(
+            "SELECT 1 FROM room_members WHERE room_id = ? AND user_id = ?",
+            [cb](const Result& result) {
+                (*cb)(result.size() > 0);
+            },
+            [cb](const DrogonDbException& e) {
+                LOG_ERROR << "Error checking room membership: " << e.base().what();
+                (*cb)(false);
+            },
+            roomId, userId
+        );
+    }
+
+    void MySqlStorage::getUserRooms(int64_t userId, IdsCallback&& callback) {
+        auto cb = std::make_shared<IdsCallback>(std::move(callback));
+        DbUtil::getClient()->execSqlAsync(
+            "SELECT room_id FROM room_members WHERE user_id = ?",
+            [cb](const Result& result) {
+                std::vector<int64_t> rooms;
+                rooms.reserve(result.size());
+                for (const auto& row : result) {
+                    rooms.push_back(row["room_id"].as<int64_t>());
+                }
+                (*cb)(std::move(rooms));
+            },
+            [cb](const DrogonDbException& e) {
+                LOG_ERROR << "Error loading user rooms: " << e.base().what();
+                (*cb)({});
+            },
+            userId
+        );
+    }
+
+    void MySqlStorage::filterContacts(int64_t userId, std::vector<int64_t>&& candidates, IdsCallback&& callback) {
+        if (candidates.empty()) {
+            callback({});
+            return;
+        }
+        auto cb = std::make_shared<IdsCallback>(std::move(callback));
+        auto pending = std::make_shared<std::vector<int64_t>>(std::move(candidates));
+
+        // 先查同房间的成员（走 idx_user 和主键），剩下的再按单聊会话 id 查 messages
+        std::string sql = "SELECT DISTINCT m.user_id FROM room_members s JOIN room_members m ON m.room_id = s.room_id "
+                          "WHERE s.user_id = ? AND m.user_id IN (";
+        for (size_t i = 0; i < pending->size(); ++i) {
+            sql += i == 0 ? "?" : ",?";
+        }
+        sql += ")";
+
+        auto binder = *DbUtil::getClient() << std::move(sql);
+        binder << userId;
+        for (auto id : *pending) {
+            binder << id;
+        }
+        binder >> [cb, pending, userId](const Result& result) {
+                      std::vector<int64_t> contacts;
+                      contacts.reserve(result.size());
+                      for (const auto& row : result) {
+                          contacts.push_back(row["user_id"].as<int64_t>());
+                      }
+                      std::sort(contacts.begin(), contacts.end());
+                      std::vector<int64_t> rest;
+                      std::set_difference(pending->begin(), pending->end(), contacts.begin(), contacts.end(),
+                                          std::back_inserter(rest));
+                      if (rest.empty()) {
+                          (*cb)(std::move(contacts));
+                          return;
+                      }
+
+                      std::string sql = "SELECT DISTINCT conversation_id FROM messages WHERE conversation_id IN (";
+                      for (size_t i = 0; i < rest.size(); ++i) {
+                          sql += i == 0 ? "?" : ",?";
+                      }
+                      sql += ")";
+                      auto binder = *DbUtil::getClient() << std::move(sql);
+                      for (auto id : rest) {
+                          binder << makeConversationId(userId, id);
+                      }
+                      binder >> [cb, contacts = std::move(contacts), rest, userId](const Result& result) mutable {
+                                    std::vector<uint64_t> conversations;
+                                    conversations.reserve(result.size());
+                                    for (const auto& row : result) {
+                                        conversations.push_back(row["conversation_id"].as<uint64_t>());
+                                    }
+                                    std::sort(conversations.begin(), conversations.end());
+                                    for (auto id : rest) {
+                                        if (std::binary_search(conversations.begin(), conversations.end(),
+                                                               makeConversationId(userId, id))) {
+                                            contacts.push_back(id);
+                                        }
+                                    }
+                                    std::sort(contacts.begin(), contacts.end());
+                                    (*cb)(std::move(contacts));
+                                }
+                             >> [cb](const DrogonDbException& e) {
+                                    LOG_ERROR << "Error loading conversation partners: " << e.base().what();
+                                    (*cb)({});
+                                };
+                  }
+               >> [cb](const DrogonDbException& e) {
+                      LOG_ERROR << "Error loading room peers: " << e.base().what();
+                      (*cb)({});
+                  };
+    }
+
+    void MySqlStorage::loadCursor(int64_t userId, CursorCallback&& callback) {
+        auto cb = std::make_shared<CursorCallback>(std::move(callback));
+        DbUtil::getClient()->execSqlAsync(
+            "SELECT last_delivered_id FROM delivery_cursors WHERE user_id = ?",
+            [cb](const Result& result) {
+                (*cb)(true, result.size() > 0 ? result[0]["last_delivered_id"].as<int64_t>() : 0);
+            },
+            [cb](const DrogonDbException& e) {
+                LOG_ERROR << "Error loading delivery cursor: " << e.base().what();
+                (*cb)(false, 0);
+            },
+            userId
+        );
+    }
+
+    void MySqlStorage::saveCursors(std::vector<std::pair<int64_t, int64_t>>&& cursors, BoolCallback&& callback) {
+        auto cb = std::make_shared<BoolCallback>(std::move(callback));
+        std::string sql = "INSERT INTO delivery_cursors (user_id, last_delivered_id) VALUES ";
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            sql += i == 0 ? "(?,?)" : ",(?,?)";
+        }
+        sql += " ON DUPLICATE KEY UPDATE last_delivered_id = GREATEST(last_delivered_id, VALUES(last_delivered_id))";
+
+        auto binder = *DbUtil::getClient() << std::move(sql);
+        for (const auto& cursor : cursors) {
+            binder << cursor.first << cursor.second;
+        }
+        binder >> [cb](const Result&) {
+                      (*cb)(true);
+                  }
+               >> [cb](const DrogonDbException& e) {
+                      LOG_ERROR << "Error saving delivery cursors: " << e.base().what();
+                      (*cb)(false);
+                  };
+    }
+}
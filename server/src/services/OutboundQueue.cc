@@ -0,0 +1,202 @@
+#include "OutboundQueue.h"
+#include "SessionRegistry.h"
+#include "../utils/BinaryProtocol.h"
+#include "../utils/FrameEncoder.h"
+#include <algorithm>
+#include <vector>
+
+using namespace drogon;
+
+namespace im_server {
+
+    namespace {
+        void updateMax(std::atomic<uint64_t>& target, uint64_t value) {
+            auto current = target.load(std::memory_order_relaxed);
+            while (value > current &&
+                   !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    OutboundQueue& OutboundQueue::instance() {
+        static OutboundQueue queue;
+        return queue;
+    }
+
+    void OutboundQueue::configure(size_t lowWatermark, size_t highWatermark, size_t maxBytes) {
+        highWatermark_ = std::max<size_t>(1, highWatermark);
+        lowWatermark_ = std::min(lowWatermark, highWatermark_);
+        maxBytes_ = std::max(maxBytes, highWatermark_);
+    }
+
+    void OutboundQueue::sendReliable(const WebSocketConnectionPtr& conn, UserSession& session, int64_t ackId,
+                                     std::string_view frame, WebSocketMessageType type) {
+        auto& state = session.outbound;
+        int64_t resumeAfter = 0;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (state.evicted) {
+                droppedEvents_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (state.ackWindow) {
+                // 客户端已经 ack 过更大的 id 时，这一帧不会再被单独确认，不计入窗口
+                if (ackId <= 0 || ackId <= state.lastAckedId) {
+                    conn->send(frame.data(), frame.size(), type);
+                    return;
+                }
+                state.inflight.emplace_back(ackId, frame.size());
+            }
+
+            if (charge(state, frame.size())) {
+                resumeAfter = state.lastAckedId;
+            } else {
+                // 在锁内发送，保证同一连接上的帧顺序与窗口记录一致
+                conn->send(frame.data(), frame.size(), type);
+                return;
+            }
+        }
+        evict(conn, session, resumeAfter);
+    }
+
+    void OutboundQueue::sendCoalescible(const WebSocketConnectionPtr& conn, UserSession& session, uint64_t key,
+                                        std::string_view frame, WebSocketMessageType type) {
+        auto& state = session.outbound;
+        int64_t resumeAfter = 0;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (state.evicted) {
+                droppedEvents_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (!state.behind) {
+                if (state.ackWindow || !charge(state, frame.size())) {
+                    conn->send(frame.data(), frame.size(), type);
+                    return;
+                }
+                resumeAfter = state.lastAckedId;
+            } else {
+                auto it = state.coalesced.find(key);
+                if (it != state.coalesced.end()) {
+                    it->second.first.assign(frame.data(), frame.size());
+                    it->second.second = type;
+                    coalescedEvents_.fetch_add(1, std::memory_order_relaxed);
+                } else if (state.coalesced.size() < kMaxCoalesced) {
+                    state.coalesced.emplace(key, std::make_pair(std::string(frame), type));
+                } else {
+                    droppedEvents_.fetch_add(1, std::memory_order_relaxed);
+                }
+                return;
+            }
+        }
+        evict(conn, session, resumeAfter);
+    }
+
+    void OutboundQueue::onAck(const WebSocketConnectionPtr& conn, UserSession& session, int64_t lastId) {
+        auto& state = session.outbound;
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (lastId <= state.lastAckedId) {
+            return;
+        }
+        state.lastAckedId = lastId;
+
+        // 不同发送方的消息可能略微乱序入窗，按 id 而不是按位置扣除
+        size_t released = 0;
+        auto end = std::remove_if(state.inflight.begin(), state.inflight.end(),
+            [lastId, &released](const std::pair<int64_t, size_t>& entry) {
+                if (entry.first > lastId) {
+                    return false;
+                }
+                released += entry.second;
+                return true;
+            });
+        state.inflight.erase(end, state.inflight.end());
+        discharge(conn, state, released);
+    }
+
+    void OutboundQueue::onClientFrame(const WebSocketConnectionPtr& conn, UserSession& session) {
+        auto& state = session.outbound;
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (state.ackWindow || state.unackedBytes == 0) {
+            return;
+        }
+        discharge(conn, state, state.unackedBytes);
+    }
+
+    bool OutboundQueue::charge(OutboundState& state, size_t bytes) {
+        state.unackedBytes += bytes;
+        unackedBytes_.fetch_add(bytes, std::memory_order_relaxed);
+        updateMax(peakConnectionBytes_, state.unackedBytes);
+
+        if (state.unackedBytes > maxBytes_) {
+            state.evicted = true;
+            return true;
+        }
+        if (!state.behind && state.unackedBytes > highWatermark_) {
+            state.behind = true;
+            slowConsumers_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return false;
+    }
+
+    void OutboundQueue::discharge(const WebSocketConnectionPtr& conn, OutboundState& state, size_t bytes) {
+        state.unackedBytes -= bytes;
+        unackedBytes_.fetch_sub(bytes, std::memory_order_relaxed);
+
+        if (state.behind && state.unackedBytes <= lowWatermark_) {
+            state.behind = false;
+            slowConsumers_.fetch_sub(1, std::memory_order_relaxed);
+            if (state.evicted) {
+                return;
+            }
+            // 没有 ack=1 的连接上补发的事件同样计入窗口，暂存最多 kMaxCoalesced 条，不会越过 max_bytes 太多
+            for (auto& entry : state.coalesced) {
+                if (!state.ackWindow) {
+                    state.unackedBytes += entry.second.first.size();
+                    unackedBytes_.fetch_add(entry.second.first.size(), std::memory_order_relaxed);
+                }
+                conn->send(entry.second.first.data(), entry.second.first.size(), entry.second.second);
+            }
+            state.coalesced.clear();
+        }
+    }
+
+    void OutboundQueue::release(UserSession& session) {
+        auto& state = session.outbound;
+        std::lock_guard<std::mutex> lock(state.mutex);
+        unackedBytes_.fetch_sub(state.unackedBytes, std::memory_order_relaxed);
+        state.unackedBytes = 0;
+        state.inflight.clear();
+        state.coalesced.clear();
+        if (state.behind) {
+            state.behind = false;
+            slowConsumers_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        state.evicted = true;
+    }
+
+    void OutboundQueue::evict(const WebSocketConnectionPtr& conn, UserSession& session, int64_t resumeAfter) {
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+        LOG_WARN << "Evicting slow consumer: user " << session.userId << " resume_after=" << resumeAfter;
+
+        if (session.protocol == WireProtocol::Binary) {
+            auto frame = BinaryProtocol::encodeEvicted(resumeAfter);
+            conn->send(frame.data(), frame.size(), WebSocketMessageType::Binary);
+        } else {
+            auto frame = FrameEncoder::encodeEvicted(resumeAfter);
+            conn->send(frame.data(), frame.size());
+        }
+        conn->shutdown(CloseCode::kViolation, "slow consumer");
+    }
+
+    OutboundQueue::Stats OutboundQueue::stats() const {
+        return Stats{
+            unackedBytes_.load(std::memory_order_relaxed),
+            peakConnectionBytes_.load(std::memory_order_relaxed),
+            slowConsumers_.load(std::memory_order_relaxed),
+            evictions_.load(std::memory_order_relaxed),
+            coalescedEvents_.load(std::memory_order_relaxed),
+            droppedEvents_.load(std::memory_order_relaxed),
+        };
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <drogon/WebSocketConnection.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace im_server
+{
+    struct UserSession;
+
+    // 每个连接的下行窗口，作为 UserSession 的成员，由 OutboundQueue 加锁访问
+    struct OutboundState
+    {
+        std::mutex mutex;
+        // 已发送、客户端尚未 ack 的可靠帧：(ack id, 字节数)
+        std::deque<std::pair<int64_t, size_t>> inflight;
+        size_t unackedBytes = 0;
+        int64_t lastAckedId = 0;
+        // 握手时带 ack=1 的客户端承诺 ack 实时消息，窗口按 ack 扣除；
+        // 其余连接的窗口是上一个上行帧之后发出的全部字节，收到任意上行帧时清零
+        bool ackWindow = false;
+        bool behind = false;  // 超过高水位后置位，回落到低水位以下才清除
+        bool evicted = false;
+        // 落后期间暂存的可合并事件：key -> 最新一帧
+        std::unordered_map<uint64_t, std::pair<std::string, drogon::WebSocketMessageType>> coalesced;
+    };
+
+    // 下行背压。Drogon 不暴露连接的 TCP 输出缓冲区，这里用应用层 ack 做字节窗口：
+    // 带 id 的可靠帧（消息、同步批次）发出后计入窗口，客户端 ack last_id 时扣除。
+    //   - 窗口超过高水位：连接被视为慢消费者，typing / presence 等可合并事件按 key 只保留最新一条暂存，
+    //     回落到低水位以下时再补发；
+    //   - 窗口超过 max_bytes：发送 evicted 帧（带 resume_after 游标）后关闭连接，
+    //     客户端重连后离线同步从送达游标继续，服务端为单个连接占用的内存因此有上限。
+    // 不 ack 实时消息的连接（握手时没有 ack=1）无法逐帧确认，改为统计上一个上行帧（消息、ack、ping/pong 等）
+    // 之后发出的所有帧，包括可合并帧；收到上行帧即视为客户端仍在读取，窗口清零。
+    // 只收不发的旧客户端因此在连续收到 max_bytes 之后会被驱逐，需要定期发送 ping 或 ack 保持窗口。
+    //
+    // 配置（custom_config.outbound）：
+    //   "low_watermark_bytes"  : 默认 256KB
+    //   "high_watermark_bytes" : 默认 1MB
+    //   "max_bytes"            : 默认 4MB
+    class OutboundQueue
+    {
+    public:
+        struct Stats
+        {
+            uint64_t unackedBytes;     // 所有连接未确认字节之和
+            uint64_t peakConnectionBytes; // 单个连接出现过的最大未确认字节数
+            uint64_t slowConsumers;    // 当前处于高水位以上的连接数
+            uint64_t evictions;        // 因超过 max_bytes 被关闭的连接数
+            uint64_t coalescedEvents;  // 落后期间被新事件覆盖的可合并事件
+            uint64_t droppedEvents;    // 暂存已满或连接已驱逐时丢弃的帧
+        };
+
+        static OutboundQueue &instance();
+
+        void configure(size_t lowWatermark, size_t highWatermark, size_t maxBytes);
+
+        // 可靠帧：ackId 为客户端 ack 时用来确认它的 id（消息 id 或同步批次最后一条的 id）。
+        // ack=1 的连接上 ackId 为 0 的帧不计入窗口
+        void sendReliable(const drogon::WebSocketConnectionPtr &conn, UserSession &session, int64_t ackId,
+                          std::string_view frame, drogon::WebSocketMessageType type);
+        // 可合并帧：连接落后时同一 key 只保留最新一条；只在没有 ack=1 的连接上计入窗口
+        void sendCoalescible(const drogon::WebSocketConnectionPtr &conn, UserSession &session, uint64_t key,
+                             std::string_view frame, drogon::WebSocketMessageType type);
+        // 客户端 ack 了 lastId 及之前的消息
+        void onAck(const drogon::WebSocketConnectionPtr &conn, UserSession &session, int64_t lastId);
+        // 连接收到任意上行帧时调用，清空没有 ack=1 的连接的窗口
+        void onClientFrame(const drogon::WebSocketConnectionPtr &conn, UserSession &session);
+        // 连接关闭时调用，把该连接的未确认字节从全局统计中扣除
+        void release(UserSession &session);
+
+        Stats stats() const;
+
+    private:
+        static constexpr size_t kMaxCoalesced = 256;
+
+        OutboundQueue() = default;
+
+        // 计入窗口，返回是否超过 max_bytes 需要驱逐；调用方持有 state.mutex
+        bool charge(OutboundState &state, size_t bytes);
+        // 从窗口扣除，回落到低水位以下时补发暂存的可合并事件；调用方持有 state.mutex
+        void discharge(const drogon::WebSocketConnectionPtr &conn, OutboundState &state, size_t bytes);
+        void evict(const drogon::WebSocketConnectionPtr &conn, UserSession &session, int64_t resumeAfter);
+
+        size_t lowWatermark_ = 256 * 1024;
+        size_t highWatermark_ = 1024 * 1024;
+        size_t maxBytes_ = 4 * 1024 * 1024;
+
+        std::atomic<uint64_t> unackedBytes_{0};
+        std::atomic<uint64_t> peakConnectionBytes_{0};
+        std::atomic<uint64_t> slowConsumers_{0};
+        std::atomic<uint64_t> evictions_{0};
+        std::atomic<uint64_t> coalescedEvents_{0};
+        std::atomic<uint64_t> droppedEvents_{0};
+    };
+}
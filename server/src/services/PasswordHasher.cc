@@ -0,0 +1,202 @@
+#include "PasswordHasher.h"
+#include <drogon/HttpAppFramework.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <algorithm>
+#include <cstdio>
+
+using namespace drogon;
+
+namespace im_server {
+
+    namespace {
+        constexpr size_t kSaltBytes = 16;
+        constexpr size_t kHashBytes = 32;
+        // 迁移前 UserService 写入的占位格式
+        constexpr const char* kLegacyPrefix = "hashed_";
+
+        std::string encodeBase64(const unsigned char* data, size_t size) {
+            std::string out(4 * ((size + 2) / 3), '\0');
+            int written = EVP_EncodeBlock(reinterpret_cast<unsigned char*>(&out[0]), data, static_cast<int>(size));
+            out.resize(static_cast<size_t>(std::max(written, 0)));
+            return out;
+        }
+
+        // EVP_DecodeBlock 按 3 字节一组输出，需要按末尾的 '=' 去掉补齐的字节
+        bool decodeBase64(const std::string& in, std::string& out) {
+            if (in.empty() || in.size() % 4 != 0) {
+                return false;
+            }
+            out.assign(in.size() / 4 * 3, '\0');
+            int written = EVP_DecodeBlock(reinterpret_cast<unsigned char*>(&out[0]),
+                                          reinterpret_cast<const unsigned char*>(in.data()), static_cast<int>(in.size()));
+            if (written < 0) {
+                return false;
+            }
+            size_t padding = (in[in.size() - 1] == '=') + (in[in.size() - 2] == '=');
+            out.resize(static_cast<size_t>(written) - padding);
+            return true;
+        }
+    }
+
+    PasswordHasher& PasswordHasher::instance() {
+        static PasswordHasher hasher;
+        return hasher;
+    }
+
+    PasswordHasher::~PasswordHasher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void PasswordHasher::start() {
+        const auto& config = app().getCustomConfig()["auth"]["password"];
+        size_t workers = std::max(1u, std::thread::hardware_concurrency() / 2);
+        if (config.isObject()) {
+            workers = std::max<size_t>(1, config.get("workers", static_cast<Json::UInt64>(workers)).asUInt64());
+            maxQueue_ = std::max<size_t>(1, config.get("max_queue", static_cast<Json::UInt64>(maxQueue_)).asUInt64());
+            params_.logN = std::min(std::max(config.get("log_n", params_.logN).asInt(), 10), 22);
+            params_.r = std::max<uint64_t>(1, config.get("r", static_cast<Json::UInt64>(params_.r)).asUInt64());
+            params_.p = std::max<uint64_t>(1, config.get("p", static_cast<Json::UInt64>(params_.p)).asUInt64());
+        }
+
+        dummyHash_ = hashNow("dummy");
+        for (size_t i = 0; i < workers; ++i) {
+            workers_.emplace_back([this]() { run(); });
+        }
+        LOG_INFO << "Password hasher started: workers=" << workers << " max_queue=" << maxQueue_
+                 << " scrypt ln=" << params_.logN << " r=" << params_.r << " p=" << params_.p;
+    }
+
+    bool PasswordHasher::hash(std::string password, HashCallback&& callback) {
+        return submit([this, password = std::move(password), callback = std::move(callback)]() {
+            auto hash = hashNow(password);
+            callback(!hash.empty(), std::move(hash));
+        });
+    }
+
+    bool PasswordHasher::verify(std::string password, std::string stored, VerifyCallback&& callback) {
+        return submit([this, password = std::move(password), stored = std::move(stored),
+                       callback = std::move(callback)]() {
+            bool needsRehash = false;
+            bool match = verifyNow(password, stored, needsRehash);
+            callback(match, match && needsRehash);
+        });
+    }
+
+    bool PasswordHasher::verifyDummy(std::string password, VerifyCallback&& callback) {
+        return submit([this, password = std::move(password), callback = std::move(callback)]() {
+            bool needsRehash = false;
+            verifyNow(password, dummyHash_, needsRehash);
+            callback(false, false);
+        });
+    }
+
+    bool PasswordHasher::submit(std::function<void()>&& task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (workers_.empty() || queue_.size() >= maxQueue_) {
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            queue_.push_back(std::move(task));
+            queueDepth_.store(queue_.size(), std::memory_order_relaxed);
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    void PasswordHasher::run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+                if (stopping_) {
+                    return;
+                }
+                task = std::move(queue_.front());
+                queue_.pop_front();
+                queueDepth_.store(queue_.size(), std::memory_order_relaxed);
+            }
+            task();
+            hashed_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool PasswordHasher::derive(const std::string& password, const std::string& salt, const Params& params,
+                                unsigned char* out, size_t length) {
+        uint64_t n = 1ULL << params.logN;
+        // scrypt 需要约 128 * r * N * p 字节，OpenSSL 默认上限只有 32MB
+        uint64_t maxMemory = 128 * params.r * (n + params.p) + (1ULL << 20);
+        return EVP_PBE_scrypt(password.data(), password.size(),
+                              reinterpret_cast<const unsigned char*>(salt.data()), salt.size(),
+                              n, params.r, params.p, maxMemory, out, length) == 1;
+    }
+
+    std::string PasswordHasher::hashNow(const std::string& password) const {
+        unsigned char salt[kSaltBytes];
+        unsigned char key[kHashBytes];
+        if (RAND_bytes(salt, sizeof(salt)) != 1 ||
+            !derive(password, std::string(reinterpret_cast<char*>(salt), sizeof(salt)), params_, key, sizeof(key))) {
+            LOG_ERROR << "scrypt failed";
+            return {};
+        }
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "$scrypt$ln=%d,r=%llu,p=%llu$", params_.logN,
+                 static_cast<unsigned long long>(params_.r), static_cast<unsigned long long>(params_.p));
+        return prefix + encodeBase64(salt, sizeof(salt)) + "$" + encodeBase64(key, sizeof(key));
+    }
+
+    bool PasswordHasher::verifyNow(const std::string& password, const std::string& stored, bool& needsRehash) const {
+        if (stored.compare(0, 7, kLegacyPrefix) == 0) {
+            needsRehash = true;
+            std::string expected = kLegacyPrefix + password;
+            return expected.size() == stored.size() && CRYPTO_memcmp(expected.data(), stored.data(), stored.size()) == 0;
+        }
+
+        Params params;
+        unsigned long long r = 0, p = 0;
+        int consumed = 0;
+        if (sscanf(stored.c_str(), "$scrypt$ln=%d,r=%llu,p=%llu$%n", &params.logN, &r, &p, &consumed) != 3 ||
+            consumed == 0 || params.logN < 1 || params.logN > 22 || r == 0 || p == 0) {
+            LOG_ERROR << "Unrecognized password hash format";
+            return false;
+        }
+        params.r = r;
+        params.p = p;
+
+        auto separator = stored.find('$', static_cast<size_t>(consumed));
+        std::string salt, expected;
+        if (separator == std::string::npos ||
+            !decodeBase64(stored.substr(static_cast<size_t>(consumed), separator - consumed), salt) ||
+            !decodeBase64(stored.substr(separator + 1), expected) || expected.empty()) {
+            LOG_ERROR << "Corrupt password hash";
+            return false;
+        }
+
+        std::string key(expected.size(), '\0');
+        if (!derive(password, salt, params, reinterpret_cast<unsigned char*>(&key[0]), key.size())) {
+            LOG_ERROR << "scrypt failed";
+            return false;
+        }
+        needsRehash = params.logN != params_.logN || params.r != params_.r || params.p != params_.p;
+        return CRYPTO_memcmp(key.data(), expected.data(), key.size()) == 0;
+    }
+
+    PasswordHasher::Stats PasswordHasher::stats() const {
+        return Stats{
+            queueDepth_.load(std::memory_order_relaxed),
+            hashed_.load(std::memory_order_relaxed),
+            rejected_.load(std::memory_order_relaxed),
+            rehashed_.load(std::memory_order_relaxed),
+        };
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace im_server
+{
+    // 口令哈希：scrypt（OpenSSL EVP_PBE_scrypt），在独立的 CPU 线程池上执行，
+    // 避免几十毫秒的 KDF 计算卡住 Drogon IO 线程上的所有 WebSocket。
+    // 等待队列有上限，满了 hash / verify 直接返回 false，调用方回 503，登录风暴时快速失败而不是排队超时。
+    // 回调在线程池的线程上执行，需要访问数据库的调用方应先投递回自己的 IO 线程。
+    //
+    // 存储格式：$scrypt$ln=15,r=8,p=1$<salt base64>$<hash base64>
+    // 参数与当前配置不同、或是旧的 "hashed_" 占位格式时，verify 报告 needsRehash，由登录流程重新哈希回写。
+    //
+    // 配置（custom_config.auth.password）：
+    //   "workers"   : 线程数，默认 CPU 核数的一半（至少 1）
+    //   "max_queue" : 等待中的任务上限，默认 64
+    //   "log_n"     : scrypt N = 2^log_n，默认 15
+    //   "r" / "p"   : scrypt 块大小 / 并行度，默认 8 / 1
+    class PasswordHasher
+    {
+    public:
+        struct Stats
+        {
+            uint64_t queueDepth; // 等待中的任务
+            uint64_t hashed;     // 累计完成的 hash / verify
+            uint64_t rejected;   // 队列满被拒绝的请求
+            uint64_t rehashed;   // 登录时按新参数重新哈希
+        };
+
+        using HashCallback = std::function<void(bool ok, std::string &&hash)>;
+        using VerifyCallback = std::function<void(bool match, bool needsRehash)>;
+
+        static PasswordHasher &instance();
+
+        // 启动时调用一次
+        void start();
+
+        bool hash(std::string password, HashCallback &&callback);
+        bool verify(std::string password, std::string stored, VerifyCallback &&callback);
+        // 用户不存在时调用：按当前参数做一次同样代价的校验，结果总是不匹配，
+        // 使响应时间不泄露用户名是否存在
+        bool verifyDummy(std::string password, VerifyCallback &&callback);
+
+        void recordRehash() { rehashed_.fetch_add(1, std::memory_order_relaxed); }
+        Stats stats() const;
+
+    private:
+        struct Params
+        {
+            int logN = 15;
+            uint64_t r = 8;
+            uint64_t p = 1;
+        };
+
+        PasswordHasher() = default;
+        ~PasswordHasher();
+
+        bool submit(std::function<void()> &&task);
+        void run();
+
+        std::string hashNow(const std::string &password) const;
+        bool verifyNow(const std::string &password, const std::string &stored, bool &needsRehash) const;
+        static bool derive(const std::string &password, const std::string &salt, const Params &params,
+                           unsigned char *out, size_t length);
+
+        Params params_;
+        size_t maxQueue_ = 64;
+        std::string dummyHash_; // start 时按当前参数生成
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<std::function<void()>> queue_;
+        std::vector<std::thread> workers_;
+        bool stopping_ = false;
+
+        std::atomic<uint64_t> queueDepth_{0};
+        std::atomic<uint64_t> hashed_{0};
+        std::atomic<uint64_t> rejected_{0};
+        std::atomic<uint64_t> rehashed_{0};
+    };
+}
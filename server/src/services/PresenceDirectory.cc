@@ -0,0 +1,149 @@
+#include "PresenceDirectory.h"
+#include <drogon/HttpAppFramework.h>
+#include <drogon/nosql/RedisClient.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace drogon;
+
+namespace im_server {
+
+    namespace {
+        class LoopbackPresence : public PresenceDirectory {
+        public:
+            void setOnline(int64_t userId, int64_t nodeId) override {
+                std::lock_guard<std::mutex> lock(state().mutex);
+                auto& nodes = state().users[userId];
+                if (std::find(nodes.begin(), nodes.end(), nodeId) == nodes.end()) {
+                    nodes.push_back(nodeId);
+                }
+            }
+
+            void setOffline(int64_t userId, int64_t nodeId) override {
+                std::lock_guard<std::mutex> lock(state().mutex);
+                auto it = state().users.find(userId);
+                if (it == state().users.end()) {
+                    return;
+                }
+                auto& nodes = it->second;
+                nodes.erase(std::remove(nodes.begin(), nodes.end(), nodeId), nodes.end());
+                if (nodes.empty()) {
+                    state().users.erase(it);
+                }
+            }
+
+            void lookup(int64_t userId, NodesCallback&& callback) override {
+                std::vector<int64_t> nodes;
+                {
+                    std::lock_guard<std::mutex> lock(state().mutex);
+                    auto it = state().users.find(userId);
+                    if (it != state().users.end()) {
+                        nodes = it->second;
+                    }
+                }
+                callback(std::move(nodes));
+            }
+
+            void clearNode(int64_t nodeId) override {
+                std::lock_guard<std::mutex> lock(state().mutex);
+                for (auto it = state().users.begin(); it != state().users.end();) {
+                    auto& nodes = it->second;
+                    nodes.erase(std::remove(nodes.begin(), nodes.end(), nodeId), nodes.end());
+                    it = nodes.empty() ? state().users.erase(it) : std::next(it);
+                }
+            }
+
+        private:
+            // 与 LoopbackBus 一样整个进程共享
+            struct State {
+                std::mutex mutex;
+                std::unordered_map<int64_t, std::vector<int64_t>> users;
+            };
+
+            static State& state() {
+                static State instance;
+                return instance;
+            }
+        };
+
+        // im:presence:{user id} 为该用户所在节点的集合；
+        // im:node:{node id}:users 记录节点登记过的用户，节点重启时据此清理
+        class RedisPresence : public PresenceDirectory {
+        public:
+            explicit RedisPresence(nosql::RedisClientPtr client) : client_(std::move(client)) {}
+
+            void setOnline(int64_t userId, int64_t nodeId) override {
+                exec("SADD %s %lld", userKey(userId).c_str(), static_cast<long long>(nodeId));
+                exec("SADD %s %lld", nodeKey(nodeId).c_str(), static_cast<long long>(userId));
+            }
+
+            void setOffline(int64_t userId, int64_t nodeId) override {
+                exec("SREM %s %lld", userKey(userId).c_str(), static_cast<long long>(nodeId));
+                exec("SREM %s %lld", nodeKey(nodeId).c_str(), static_cast<long long>(userId));
+            }
+
+            void lookup(int64_t userId, NodesCallback&& callback) override {
+                auto cb = std::make_shared<NodesCallback>(std::move(callback));
+                client_->execCommandAsync(
+                    [cb](const nosql::RedisResult& result) {
+                        std::vector<int64_t> nodes;
+                        for (const auto& item : result.asArray()) {
+                            try {
+                                nodes.push_back(std::stoll(item.asString()));
+                            } catch (const std::exception&) {
+                            }
+                        }
+                        (*cb)(std::move(nodes));
+                    },
+                    [cb](const nosql::RedisException& e) {
+                        LOG_ERROR << "Error looking up presence: " << e.what();
+                        (*cb)({});
+                    },
+                    "SMEMBERS %s", userKey(userId).c_str());
+            }
+
+            void clearNode(int64_t nodeId) override {
+                client_->execCommandAsync(
+                    [this, nodeId](const nosql::RedisResult& result) {
+                        for (const auto& item : result.asArray()) {
+                            exec("SREM im:presence:%s %lld", item.asString().c_str(), static_cast<long long>(nodeId));
+                        }
+                        exec("DEL %s", nodeKey(nodeId).c_str());
+                    },
+                    [](const nosql::RedisException& e) {
+                        LOG_ERROR << "Error clearing node presence: " << e.what();
+                    },
+                    "SMEMBERS %s", nodeKey(nodeId).c_str());
+            }
+
+        private:
+            static std::string userKey(int64_t userId) { return "im:presence:" + std::to_string(userId); }
+            static std::string nodeKey(int64_t nodeId) { return "im:node:" + std::to_string(nodeId) + ":users"; }
+
+            // 不关心结果的写命令，参数按 hiredis 格式串传入
+            template <typename... Args>
+            void exec(const char* format, Args... args) {
+                client_->execCommandAsync(
+                    [](const nosql::RedisResult&) {},
+                    [format](const nosql::RedisException& e) {
+                        LOG_ERROR << "Redis command failed (" << format << "): " << e.what();
+                    },
+                    format, args...);
+            }
+
+            nosql::RedisClientPtr client_;
+        };
+    }
+
+    std::shared_ptr<PresenceDirectory> PresenceDirectory::create(const Json::Value& config) {
+        if (config.get("bus", "loopback").asString() == "redis") {
+            auto client = app().getRedisClient(config.get("redis_client", "default").asString());
+            if (client) {
+                return std::make_shared<RedisPresence>(std::move(client));
+            }
+        }
+        return std::make_shared<LoopbackPresence>();
+    }
+}
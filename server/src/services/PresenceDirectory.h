@@ -0,0 +1,29 @@
+#pragma once
+
+#include <json/json.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace im_server
+{
+    // 在线目录：user id -> 该用户有连接的节点集合（同一用户可以在多个节点上有设备）。
+    // 后端与 MessageBus 相同，由 custom_config.cluster.bus 选择。
+    class PresenceDirectory
+    {
+    public:
+        using NodesCallback = std::function<void(std::vector<int64_t> &&)>;
+
+        virtual ~PresenceDirectory() = default;
+
+        // 用户在本节点的第一个连接建立 / 最后一个连接关闭时调用
+        virtual void setOnline(int64_t userId, int64_t nodeId) = 0;
+        virtual void setOffline(int64_t userId, int64_t nodeId) = 0;
+        virtual void lookup(int64_t userId, NodesCallback &&callback) = 0;
+        // 节点启动时清掉上次运行（可能异常退出）留下的记录
+        virtual void clearNode(int64_t nodeId) = 0;
+
+        static std::shared_ptr<PresenceDirectory> create(const Json::Value &config);
+    };
+}
@@ -0,0 +1,320 @@
+#include "PresenceService.h"
+#include "OutboundQueue.h"
+#include "SessionRegistry.h"
+#include "Storage.h"
+#include "../utils/BinaryProtocol.h"
+#include "../utils/FrameEncoder.h"
+#include <drogon/HttpAppFramework.h>
+#include <algorithm>
+
+using namespace drogon;
+
+namespace im_server {
+
+    namespace {
+        // OutboundQueue 合并 key：同一用户的 presence 与 typing 分开合并
+        uint64_t presenceKey(int64_t userId) {
+            return static_cast<uint64_t>(userId) << 1;
+        }
+
+        uint64_t typingKey(int64_t userId) {
+            return (static_cast<uint64_t>(userId) << 1) | 1;
+        }
+
+        void insertSorted(std::vector<int64_t>& ids, int64_t id) {
+            auto it = std::lower_bound(ids.begin(), ids.end(), id);
+            if (it == ids.end() || *it != id) {
+                ids.insert(it, id);
+            }
+        }
+
+        void eraseSorted(std::vector<int64_t>& ids, int64_t id) {
+            auto it = std::lower_bound(ids.begin(), ids.end(), id);
+            if (it != ids.end() && *it == id) {
+                ids.erase(it);
+            }
+        }
+    }
+
+    PresenceService& PresenceService::instance() {
+        static PresenceService service;
+        return service;
+    }
+
+    void PresenceService::start() {
+        if (started_.exchange(true)) {
+            return;
+        }
+
+        const auto& config = app().getCustomConfig()["presence"];
+        window_ = std::chrono::milliseconds(std::max<Json::Int64>(1, config.get("window_ms", 200).asInt64()));
+        maxSubscriptions_ = config.get("max_subscriptions", 1000).asUInt64();
+
+        app().getLoop()->runEvery(window_, [this]() {
+            flush();
+        });
+        LOG_INFO << "Presence service started: window_ms=" << window_.count()
+                 << " max_subscriptions=" << maxSubscriptions_;
+    }
+
+    void PresenceService::eraseIfIdle(Shard& shard, std::unordered_map<int64_t, UserEntry>::iterator it) {
+        auto& entry = it->second;
+        if (entry.devices == 0 && !entry.announced && !entry.dirty &&
+            entry.watchers.empty() && entry.watching.empty()) {
+            shard.users.erase(it);
+        }
+    }
+
+    void PresenceService::connect(int64_t userId) {
+        auto& shard = shardOf(userId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto& entry = shard.users[userId];
+        if (++entry.devices != 1) {
+            return;
+        }
+        onlineUsers_.fetch_add(1, std::memory_order_relaxed);
+        stateChanges_.fetch_add(1, std::memory_order_relaxed);
+        if (!entry.dirty) {
+            entry.dirty = true;
+            shard.dirty.push_back(userId);
+        }
+    }
+
+    void PresenceService::disconnect(int64_t userId) {
+        std::vector<int64_t> watching;
+        {
+            auto& shard = shardOf(userId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.users.find(userId);
+            if (it == shard.users.end() || it->second.devices == 0) {
+                return;
+            }
+            auto& entry = it->second;
+            if (--entry.devices != 0) {
+                return;
+            }
+            onlineUsers_.fetch_sub(1, std::memory_order_relaxed);
+            stateChanges_.fetch_add(1, std::memory_order_relaxed);
+            if (!entry.dirty) {
+                entry.dirty = true;
+                shard.dirty.push_back(userId);
+            }
+            watching.swap(entry.watching);
+        }
+
+        // 本节点已没有该用户的连接，订阅随之失效
+        subscriptions_.fetch_sub(watching.size(), std::memory_order_relaxed);
+        for (auto target : watching) {
+            auto& shard = shardOf(target);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.users.find(target);
+            if (it != shard.users.end()) {
+                eraseSorted(it->second.watchers, userId);
+                eraseIfIdle(shard, it);
+            }
+        }
+    }
+
+    void PresenceService::subscribe(int64_t subscriberId, std::vector<int64_t>&& targets) {
+        std::sort(targets.begin(), targets.end());
+        targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+        targets.erase(std::remove(targets.begin(), targets.end(), subscriberId), targets.end());
+        if (targets.size() > maxSubscriptions_) {
+            targets.resize(maxSubscriptions_);
+        }
+
+        uint64_t sequence = subscribeSequence_.fetch_add(1, std::memory_order_relaxed) + 1;
+        {
+            auto& shard = shardOf(subscriberId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.users.find(subscriberId);
+            if (it == shard.users.end() || it->second.devices == 0) {
+                return;
+            }
+            it->second.subscription = sequence;
+        }
+
+        Storage::instance().filterContacts(
+            subscriberId, std::move(targets), [this, subscriberId, sequence](std::vector<int64_t>&& allowed) {
+                applySubscription(subscriberId, sequence, std::move(allowed));
+            });
+    }
+
+    void PresenceService::applySubscription(int64_t subscriberId, uint64_t sequence, std::vector<int64_t>&& targets) {
+        std::vector<int64_t> previous;
+        {
+            auto& shard = shardOf(subscriberId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.users.find(subscriberId);
+            // 用户已经没有连接（订阅命令与断开竞争），或查询期间有更新的订阅请求时不再登记
+            if (it == shard.users.end() || it->second.devices == 0 || it->second.subscription != sequence) {
+                return;
+            }
+            previous = std::move(it->second.watching);
+            it->second.watching = targets;
+        }
+
+        std::vector<int64_t> removed, added;
+        std::set_difference(previous.begin(), previous.end(), targets.begin(), targets.end(),
+                            std::back_inserter(removed));
+        std::set_difference(targets.begin(), targets.end(), previous.begin(), previous.end(),
+                            std::back_inserter(added));
+        subscriptions_.fetch_add(added.size(), std::memory_order_relaxed);
+        subscriptions_.fetch_sub(removed.size(), std::memory_order_relaxed);
+
+        // 每次只持有一个分片的锁
+        for (auto target : removed) {
+            auto& shard = shardOf(target);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.users.find(target);
+            if (it != shard.users.end()) {
+                eraseSorted(it->second.watchers, subscriberId);
+                eraseIfIdle(shard, it);
+            }
+        }
+
+        std::vector<int64_t> online;
+        for (auto target : added) {
+            auto& shard = shardOf(target);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto& entry = shard.users[target];
+            insertSorted(entry.watchers, subscriberId);
+            if (entry.announced) {
+                online.push_back(target);
+            }
+        }
+
+        const std::vector<int64_t> self{subscriberId};
+        for (auto target : online) {
+            notifyPresence(target, true, self);
+        }
+    }
+
+    void PresenceService::typing(int64_t fromId, int64_t toId) {
+        if (fromId == toId) {
+            return;
+        }
+        auto& shard = shardOf(fromId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.typing.emplace_back(fromId, toId);
+    }
+
+    bool PresenceService::isOnline(int64_t userId) {
+        auto& shard = shardOf(userId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.users.find(userId);
+        return it != shard.users.end() && it->second.devices > 0;
+    }
+
+    void PresenceService::flush() {
+        struct Change {
+            int64_t userId;
+            bool online;
+            std::vector<int64_t> watchers;
+        };
+        std::vector<Change> changes;
+        std::vector<std::pair<int64_t, int64_t>> typing;
+
+        for (auto& shard : shards_) {
+            std::vector<int64_t> dirty;
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                dirty.swap(shard.dirty);
+                if (!shard.typing.empty()) {
+                    typing.insert(typing.end(), shard.typing.begin(), shard.typing.end());
+                    shard.typing.clear();
+                }
+                for (auto userId : dirty) {
+                    auto it = shard.users.find(userId);
+                    if (it == shard.users.end()) {
+                        continue;
+                    }
+                    auto& entry = it->second;
+                    entry.dirty = false;
+                    bool online = entry.devices > 0;
+                    if (online == entry.announced) {
+                        suppressed_.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        entry.announced = online;
+                        if (!entry.watchers.empty()) {
+                            changes.push_back(Change{userId, online, entry.watchers});
+                        }
+                    }
+                    eraseIfIdle(shard, it);
+                }
+            }
+        }
+
+        // 通知在锁外进行
+        for (const auto& change : changes) {
+            notifyPresence(change.userId, change.online, change.watchers);
+        }
+
+        std::sort(typing.begin(), typing.end());
+        typing.erase(std::unique(typing.begin(), typing.end()), typing.end());
+        for (const auto& entry : typing) {
+            notifyTyping(entry.first, entry.second);
+        }
+    }
+
+    void PresenceService::notifyPresence(int64_t userId, bool online, const std::vector<int64_t>& watchers) {
+        std::string_view jsonFrame, binaryFrame;
+        auto& outbound = OutboundQueue::instance();
+        auto key = presenceKey(userId);
+        for (auto watcher : watchers) {
+            SessionRegistry::instance().forEachConnection(watcher, [&](const WebSocketConnectionPtr& conn) {
+                auto session = SessionRegistry::sessionOf(conn);
+                if (!session) {
+                    return;
+                }
+                if (session->protocol == WireProtocol::Binary) {
+                    if (binaryFrame.empty()) {
+                        binaryFrame = BinaryProtocol::encodePresence(userId, online);
+                    }
+                    outbound.sendCoalescible(conn, *session, key, binaryFrame, WebSocketMessageType::Binary);
+                } else {
+                    if (jsonFrame.empty()) {
+                        jsonFrame = FrameEncoder::encodePresence(userId, online);
+                    }
+                    outbound.sendCoalescible(conn, *session, key, jsonFrame, WebSocketMessageType::Text);
+                }
+                presenceEvents_.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+    }
+
+    void PresenceService::notifyTyping(int64_t fromId, int64_t toId) {
+        std::string_view jsonFrame, binaryFrame;
+        auto& outbound = OutboundQueue::instance();
+        auto key = typingKey(fromId);
+        SessionRegistry::instance().forEachConnection(toId, [&](const WebSocketConnectionPtr& conn) {
+            auto session = SessionRegistry::sessionOf(conn);
+            if (!session) {
+                return;
+            }
+            if (session->protocol == WireProtocol::Binary) {
+                if (binaryFrame.empty()) {
+                    binaryFrame = BinaryProtocol::encodeTyping(fromId);
+                }
+                outbound.sendCoalescible(conn, *session, key, binaryFrame, WebSocketMessageType::Binary);
+            } else {
+                if (jsonFrame.empty()) {
+                    jsonFrame = FrameEncoder::encodeTyping(fromId);
+                }
+                outbound.sendCoalescible(conn, *session, key, jsonFrame, WebSocketMessageType::Text);
+            }
+            typingEvents_.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    PresenceService::Stats PresenceService::stats() const {
+        return Stats{
+            onlineUsers_.load(std::memory_order_relaxed),
+            subscriptions_.load(std::memory_order_relaxed),
+            stateChanges_.load(std::memory_order_relaxed),
+            suppressed_.load(std::memory_order_relaxed),
+            presenceEvents_.load(std::memory_order_relaxed),
+            typingEvents_.load(std::memory_order_relaxed),
+        };
+    }
+}
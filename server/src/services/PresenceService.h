@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace im_server
+{
+    // 在线状态与输入状态。一个用户可以有多台设备同时在线，设备数从 0 变 1 / 从 1 变 0 才算状态变化。
+    // 变化先记为 dirty，每隔 window_ms 统一结算一次：窗口内断线又重连（或反之）的用户最终状态没变，
+    // 不产生事件；变了的每个订阅者只收到一条 presence。typing 同理，同一对 (from, to) 每个窗口最多转发一次。
+    // 下行经 OutboundQueue::sendCoalescible 发送，慢消费者只保留每个用户的最新状态。
+    //
+    // 订阅关系用排序的 id 数组保存（被订阅者的 watchers、订阅者的 watching），按用户 id 分片加锁。
+    // 订阅列表按用户整体替换，最后一次 presence_subscribe 为准；用户在本节点最后一个连接断开时清除。
+    // 只能订阅与自己同在某个房间或有过单聊消息的用户（Storage::filterContacts），其余目标被忽略。
+    //
+    // 在线状态只在本节点内维护和推送：订阅者只能看到与自己连在同一节点上的用户，
+    // 多节点部署时其他节点上的用户显示为离线，typing 也只转发给本节点上的连接。
+    //
+    // 配置（custom_config.presence）：
+    //   "window_ms"         : 合并窗口，默认 200
+    //   "max_subscriptions" : 每个用户最多订阅的人数，默认 1000
+    class PresenceService
+    {
+    public:
+        struct Stats
+        {
+            uint64_t onlineUsers;     // 本节点至少有一个连接的用户
+            uint64_t subscriptions;   // 订阅关系总数
+            uint64_t stateChanges;    // 设备数 0 <-> 1 的原始变化次数
+            uint64_t suppressed;      // 窗口内来回变化、最终未变而被合并掉的次数
+            uint64_t presenceEvents;  // 发给订阅者的 presence 事件数
+            uint64_t typingEvents;    // 合并后转发的 typing 事件数
+        };
+
+        static PresenceService &instance();
+
+        // 在 IO 线程启动后调用，读取配置并启动合并定时器
+        void start();
+
+        // 每个连接建立 / 关闭时各调用一次
+        void connect(int64_t userId);
+        void disconnect(int64_t userId);
+
+        // 用 targets 中允许订阅的用户替换 subscriberId 的订阅列表，并立即推送其中在线用户的状态。
+        // 需要查询存储，订阅异步生效；多次订阅只有最后一次生效
+        void subscribe(int64_t subscriberId, std::vector<int64_t> &&targets);
+        void typing(int64_t fromId, int64_t toId);
+
+        bool isOnline(int64_t userId);
+
+        // 结算当前窗口（定时器调用）
+        void flush();
+
+        Stats stats() const;
+
+    private:
+        static constexpr size_t kShards = 16;
+
+        struct UserEntry
+        {
+            uint32_t devices = 0;
+            bool announced = false; // 最近一次通知订阅者的状态
+            bool dirty = false;
+            uint64_t subscription = 0;     // 最近一次订阅请求的序号，查询存储期间又有新请求时丢弃旧结果
+            std::vector<int64_t> watchers; // 订阅了该用户的人，有序
+            std::vector<int64_t> watching; // 该用户订阅的人，有序
+        };
+
+        struct Shard
+        {
+            std::mutex mutex;
+            std::unordered_map<int64_t, UserEntry> users;
+            std::vector<int64_t> dirty;
+            std::vector<std::pair<int64_t, int64_t>> typing; // (from, to)，flush 时排序去重
+        };
+
+        PresenceService() = default;
+
+        Shard &shardOf(int64_t userId) { return shards_[static_cast<uint64_t>(userId) % kShards]; }
+        // 调用方持有分片锁；没有设备、没有订阅关系的条目直接删除
+        static void eraseIfIdle(Shard &shard, std::unordered_map<int64_t, UserEntry>::iterator it);
+
+        void applySubscription(int64_t subscriberId, uint64_t sequence, std::vector<int64_t> &&targets);
+
+        void notifyPresence(int64_t userId, bool online, const std::vector<int64_t> &watchers);
+        void notifyTyping(int64_t fromId, int64_t toId);
+
+        std::chrono::milliseconds window_{200};
+        size_t maxSubscriptions_ = 1000;
+        std::atomic<bool> started_{false};
+        std::atomic<uint64_t> subscribeSequence_{0};
+        std::array<Shard, kShards> shards_;
+
+        std::atomic<uint64_t> onlineUsers_{0};
+        std::atomic<uint64_t> subscriptions_{0};
+        std::atomic<uint64_t> stateChanges_{0};
+        std::atomic<uint64_t> suppressed_{0};
+        std::atomic<uint64_t> presenceEvents_{0};
+        std::atomic<uint64_t> typingEvents_{0};
+    };
+}
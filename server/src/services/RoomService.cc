@@ -0,0 +1,91 @@
+#include "RoomService.h"
+#include "MessageRouter.h"
+#include "Storage.h"
+#include "../utils/IdGenerator.h"
+
+namespace im_server {
+
+    RoomService& RoomService::instance() {
+        static RoomService service;
+        return service;
+    }
+
+    void RoomService::createRoom(int64_t ownerId, const std::string& name, bool isPublic, IdCallback&& callback) {
+        int64_t roomId = IdGenerator::nextId();
+        Storage::instance().createRoom(
+            roomId, name, ownerId, isPublic,
+            [callback = std::move(callback), roomId, ownerId](bool ok) {
+                if (!ok) {
+                    callback(0);
+                    return;
+                }
+                MessageRouter::instance().routeMembership(roomId, ownerId, true);
+                callback(roomId);
+            });
+    }
+
+    void RoomService::joinRoom(int64_t roomId, int64_t userId, StatusCallback&& callback) {
+        Storage::instance().getRoom(
+            roomId,
+            [callback = std::move(callback), roomId, userId](Storage::Status status, Storage::RoomInfo&& room) mutable {
+                if (status != Storage::Status::Ok) {
+                    callback(status == Storage::Status::NotFound ? Status::NotFound : Status::Error);
+                    return;
+                }
+                if (room.isPublic || room.ownerId == userId) {
+                    addToRoom(roomId, userId, std::move(callback));
+                    return;
+                }
+                // 非公开房间：已经是成员时同样视为成功
+                Storage::instance().isMember(roomId, userId, [callback = std::move(callback)](bool member) {
+                    callback(member ? Status::Ok : Status::Forbidden);
+                });
+            });
+    }
+
+    void RoomService::addMember(int64_t roomId, int64_t requesterId, int64_t userId, StatusCallback&& callback) {
+        Storage::instance().getRoom(
+            roomId,
+            [callback = std::move(callback), roomId, requesterId, userId](Storage::Status status,
+                                                                          Storage::RoomInfo&& room) mutable {
+                if (status != Storage::Status::Ok) {
+                    callback(status == Storage::Status::NotFound ? Status::NotFound : Status::Error);
+                    return;
+                }
+                if (room.ownerId != requesterId) {
+                    callback(Status::Forbidden);
+                    return;
+                }
+                addToRoom(roomId, userId, std::move(callback));
+            });
+    }
+
+    void RoomService::addToRoom(int64_t roomId, int64_t userId, StatusCallback&& callback) {
+        // 房间已确认存在，失败多半是用户不存在（外键约束）
+        Storage::instance().joinRoom(
+            roomId, userId,
+            [callback = std::move(callback), roomId, userId](bool ok) {
+                if (ok) {
+                    MessageRouter::instance().routeMembership(roomId, userId, true);
+                }
+                callback(ok ? Status::Ok : Status::NotFound);
+            });
+    }
+
+    void RoomService::leaveRoom(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        Storage::instance().leaveRoom(
+            roomId, userId,
+            [callback = std::move(callback), roomId, userId](bool removed) {
+                MessageRouter::instance().routeMembership(roomId, userId, false);
+                callback(removed);
+            });
+    }
+
+    void RoomService::isMember(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        Storage::instance().isMember(roomId, userId, std::move(callback));
+    }
+
+    void RoomService::getUserRooms(int64_t userId, IdsCallback&& callback) {
+        Storage::instance().getUserRooms(userId, std::move(callback));
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace im_server
+{
+    // 群聊房间与成员关系（rooms / room_members 表），全部异步执行。
+    // 成员变化成功后通知 FanoutService 更新在线连接的房间索引。
+    // 加入策略：公开房间（is_public）任何人可以加入；非公开房间只能由创建者通过 addMember 添加成员。
+    class RoomService
+    {
+    public:
+        static RoomService &instance();
+
+        enum class Status
+        {
+            Ok,
+            NotFound,  // 房间不存在（addMember 时也可能是被添加的用户不存在）
+            Forbidden, // 非公开房间 / 不是创建者
+            Error
+        };
+
+        using BoolCallback = std::function<void(bool)>;
+        using StatusCallback = std::function<void(Status)>;
+        using IdCallback = std::function<void(int64_t)>;
+        using IdsCallback = std::function<void(std::vector<int64_t> &&)>;
+
+        // 创建房间并把创建者加入成员，失败时回调 0
+        void createRoom(int64_t ownerId, const std::string &name, bool isPublic, IdCallback &&callback);
+        // 已是成员视为成功；非公开房间返回 Forbidden
+        void joinRoom(int64_t roomId, int64_t userId, StatusCallback &&callback);
+        // 创建者把 userId 加入房间（邀请），公开房间同样适用
+        void addMember(int64_t roomId, int64_t requesterId, int64_t userId, StatusCallback &&callback);
+        void leaveRoom(int64_t roomId, int64_t userId, BoolCallback &&callback);
+        void isMember(int64_t roomId, int64_t userId, BoolCallback &&callback);
+        void getUserRooms(int64_t userId, IdsCallback &&callback);
+
+    private:
+        RoomService() = default;
+
+        static void addToRoom(int64_t roomId, int64_t userId, StatusCallback &&callback);
+    };
+}
@@ -0,0 +1,76 @@
+#include "SessionRegistry.h"
+
+using namespace drogon;
+
+namespace im_server {
+
+    SessionRegistry& SessionRegistry::instance() {
+        static SessionRegistry registry;
+        return registry;
+    }
+
+    bool SessionRegistry::add(const WebSocketConnectionPtr& conn, const UserSessionPtr& session) {
+        conn->setContext(session);
+
+        auto& shard = shardFor(session->userId);
+        bool first;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto& conns = shard.users[session->userId];
+            first = conns.empty();
+            conns.push_back(conn);
+        }
+        connectionCount_.fetch_add(1, std::memory_order_relaxed);
+        return first;
+    }
+
+    bool SessionRegistry::remove(const WebSocketConnectionPtr& conn) {
+        auto session = sessionOf(conn);
+        if (!session) {
+            return false;
+        }
+
+        auto& shard = shardFor(session->userId);
+        bool removed = false;
+        bool last = false;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.users.find(session->userId);
+            if (it != shard.users.end()) {
+                auto& conns = it->second;
+                for (size_t i = 0; i < conns.size(); ++i) {
+                    if (conns[i] == conn) {
+                        // 设备顺序无关紧要，swap 到末尾再 pop，O(1) 删除
+                        conns[i] = std::move(conns.back());
+                        conns.pop_back();
+                        removed = true;
+                        break;
+                    }
+                }
+                if (conns.empty()) {
+                    shard.users.erase(it);
+                    last = removed;
+                }
+            }
+        }
+        if (removed) {
+            connectionCount_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        conn->clearContext();
+        return last;
+    }
+
+    std::vector<WebSocketConnectionPtr> SessionRegistry::getConnections(int64_t userId) const {
+        std::vector<WebSocketConnectionPtr> result;
+        forEachConnection(userId, [&result](const WebSocketConnectionPtr& conn) {
+            result.push_back(conn);
+        });
+        return result;
+    }
+
+    bool SessionRegistry::isOnline(int64_t userId) const {
+        const auto& shard = shardFor(userId);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.users.find(userId) != shard.users.end();
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "OutboundQueue.h"
+#include <drogon/WebSocketConnection.h>
+#include <trantor/net/EventLoop.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace im_server
+{
+    // 连接建立时协商的线路格式，决定下行帧的编码方式
+    enum class WireProtocol
+    {
+        Json,
+        Binary
+    };
+
+    // 单个 WebSocket 连接上的会话信息，通过 setContext 挂在连接上，
+    // 从连接反查会话不需要任何锁
+    struct UserSession
+    {
+        int64_t userId = 0;
+        std::string userIdStr;
+        WireProtocol protocol = WireProtocol::Json;
+        // 下行背压窗口，见 OutboundQueue
+        OutboundState outbound;
+        // 连接所属的 IO 线程；以下字段只在该线程上读写
+        trantor::EventLoop *loop = nullptr;
+        std::unordered_set<int64_t> rooms;
+    };
+
+    using UserSessionPtr = std::shared_ptr<UserSession>;
+
+    // 在线会话注册表：按 user id 哈希分片，每个分片一把读写锁。
+    // 查找 / 转发只拿对应分片的读锁，复杂度 O(该用户的设备数)，
+    // 不同用户之间的投递互不阻塞。
+    class SessionRegistry
+    {
+    public:
+        static SessionRegistry &instance();
+
+        // 返回 true 表示这是该用户在本节点的第一个连接
+        bool add(const drogon::WebSocketConnectionPtr &conn, const UserSessionPtr &session);
+        // 返回 true 表示该用户在本节点已没有连接
+        bool remove(const drogon::WebSocketConnectionPtr &conn);
+
+        // 对某个用户的每个在线连接调用 f，持有分片读锁期间执行，f 不应阻塞
+        template <typename F>
+        void forEachConnection(int64_t userId, F &&f) const
+        {
+            const auto &shard = shardFor(userId);
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.users.find(userId);
+            if (it == shard.users.end())
+                return;
+            for (const auto &conn : it->second)
+                f(conn);
+        }
+
+        std::vector<drogon::WebSocketConnectionPtr> getConnections(int64_t userId) const;
+        bool isOnline(int64_t userId) const;
+        size_t connectionCount() const { return connectionCount_.load(std::memory_order_relaxed); }
+
+        static UserSessionPtr sessionOf(const drogon::WebSocketConnectionPtr &conn)
+        {
+            return conn->getContext<UserSession>();
+        }
+
+    private:
+        static constexpr size_t kShardCount = 64;
+
+        struct alignas(64) Shard
+        {
+            mutable std::shared_mutex mutex;
+            std::unordered_map<int64_t, std::vector<drogon::WebSocketConnectionPtr>> users;
+        };
+
+        Shard &shardFor(int64_t userId) { return shards_[static_cast<uint64_t>(userId) % kShardCount]; }
+        const Shard &shardFor(int64_t userId) const { return shards_[static_cast<uint64_t>(userId) % kShardCount]; }
+
+        std::array<Shard, kShardCount> shards_;
+        std::atomic<size_t> connectionCount_{0};
+    };
+}
@@ -0,0 +1,308 @@
+#include "SessionStore.h"
+#include "Storage.h"
+#include <drogon/HttpAppFramework.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <algorithm>
+#include <charconv>
+#include <memory>
+#include <vector>
+
+using namespace drogon;
+
+namespace im_server {
+
+    namespace {
+        constexpr size_t kTokenBytes = 32;
+        constexpr double kSweepIntervalSeconds = 3600;
+
+        // base64url，不带补齐的 '='
+        std::string encodeBase64Url(const unsigned char* data, size_t size) {
+            std::string out(4 * ((size + 2) / 3), '\0');
+            int written = EVP_EncodeBlock(reinterpret_cast<unsigned char*>(&out[0]), data, static_cast<int>(size));
+            out.resize(static_cast<size_t>(std::max(written, 0)));
+            while (!out.empty() && out.back() == '=') {
+                out.pop_back();
+            }
+            std::replace(out.begin(), out.end(), '+', '-');
+            std::replace(out.begin(), out.end(), '/', '_');
+            return out;
+        }
+    }
+
+    SessionStore& SessionStore::instance() {
+        static SessionStore store;
+        return store;
+    }
+
+    template <typename... Args>
+    void SessionStore::exec(const char* format, Args... args) {
+        redis_->execCommandAsync(
+            [](const nosql::RedisResult&) {},
+            [format](const nosql::RedisException& e) {
+                LOG_ERROR << "Redis command failed (" << format << "): " << e.what();
+            },
+            format, args...);
+    }
+
+    void SessionStore::start() {
+        const auto& config = app().getCustomConfig()["auth"]["sessions"];
+        if (config.isObject()) {
+            accessTtl_ = std::chrono::seconds(std::max<int64_t>(60, config.get("access_ttl_sec", 900).asInt64()));
+            refreshTtl_ = std::chrono::seconds(
+                std::max<int64_t>(1, config.get("refresh_ttl_days", 30).asInt64()) * 24 * 3600);
+            maxPerUser_ = std::max<size_t>(1, config.get("max_per_user", 10).asUInt64());
+        }
+
+        // 会话只在本节点内存中时，其他节点不认本节点签发的令牌，也收不到本节点的吊销
+        const auto& cluster = app().getCustomConfig()["cluster"];
+        bool clustered = cluster.get("bus", "loopback").asString() == "redis";
+        auto clientName = config.isObject() ? config.get("redis_client", "").asString() : std::string();
+        if (clientName.empty() && clustered) {
+            clientName = cluster.get("redis_client", "default").asString();
+            LOG_WARN << "auth.sessions.redis_client is not set in a multi-node deployment, using cluster redis client '"
+                     << clientName << "'";
+        }
+        if (!clientName.empty()) {
+            redis_ = app().getRedisClient(clientName);
+            if (!redis_) {
+                LOG_ERROR << "Redis client '" << clientName << "' not found, sessions are kept in memory only";
+            }
+        }
+        if (!redis_ && clustered) {
+            LOG_ERROR << "Sessions are not shared between nodes: refresh tokens only work on the node that issued them"
+                      << " and deactivated users keep their sessions on other nodes";
+        }
+
+        app().getLoop()->runEvery(kSweepIntervalSeconds, [this]() {
+            sweep();
+        });
+        LOG_INFO << "Session store started: access_ttl_sec=" << accessTtl_.count()
+                 << " refresh_ttl_sec=" << refreshTtl_.count() << " max_per_user=" << maxPerUser_
+                 << (redis_ ? " (mirrored to redis)" : "");
+    }
+
+    std::string SessionStore::issue(int64_t userId) {
+        unsigned char random[kTokenBytes];
+        if (RAND_bytes(random, sizeof(random)) != 1) {
+            LOG_ERROR << "RAND_bytes failed";
+            return {};
+        }
+        auto token = std::to_string(userId) + "." + encodeBase64Url(random, sizeof(random));
+        auto hash = digest(token);
+
+        std::vector<std::string> evicted;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sessions_[hash] = Session{userId, std::chrono::system_clock::now() + refreshTtl_};
+            auto& owned = userSessions_[userId];
+            owned.push_back(hash);
+            while (owned.size() > maxPerUser_) {
+                sessions_.erase(owned.front());
+                evicted.push_back(std::move(owned.front()));
+                owned.pop_front();
+            }
+        }
+        issued_.fetch_add(1, std::memory_order_relaxed);
+
+        if (redis_) {
+            auto ttl = static_cast<long long>(refreshTtl_.count());
+            exec("SET %s %lld EX %lld", sessionKey(hash).c_str(), static_cast<long long>(userId), ttl);
+            exec("SADD %s %s", userKey(userId).c_str(), hash.c_str());
+            exec("EXPIRE %s %lld", userKey(userId).c_str(), ttl);
+            for (const auto& old : evicted) {
+                eraseRemote(old, userId);
+            }
+        }
+        return token;
+    }
+
+    void SessionStore::refresh(const std::string& refreshToken, RefreshCallback&& callback) {
+        int64_t userId = parseUserId(refreshToken);
+        if (userId <= 0) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            callback(RefreshStatus::Invalid, 0, {});
+            return;
+        }
+
+        // 先确认用户仍是启用状态再消耗令牌，查询失败时令牌保持有效
+        auto cb = std::make_shared<RefreshCallback>(std::move(callback));
+        Storage::instance().findUserById(userId, [this, refreshToken, userId, cb](Storage::Status status, User&&) {
+            if (status == Storage::Status::Error) {
+                (*cb)(RefreshStatus::Unavailable, 0, {});
+                return;
+            }
+            if (status != Storage::Status::Ok) {
+                revoke(refreshToken);
+                misses_.fetch_add(1, std::memory_order_relaxed);
+                (*cb)(RefreshStatus::Invalid, 0, {});
+                return;
+            }
+            consume(refreshToken, userId, std::move(*cb));
+        });
+    }
+
+    void SessionStore::consume(const std::string& refreshToken, int64_t userId, RefreshCallback&& callback) {
+        auto hash = digest(refreshToken);
+        bool local = eraseLocal(hash);
+
+        auto finish = [this, userId](RefreshCallback& cb, bool valid, bool localHit) {
+            if (!valid) {
+                misses_.fetch_add(1, std::memory_order_relaxed);
+                cb(RefreshStatus::Invalid, 0, {});
+                return;
+            }
+            (localHit ? localHits_ : remoteHits_).fetch_add(1, std::memory_order_relaxed);
+            auto next = issue(userId);
+            if (next.empty()) {
+                cb(RefreshStatus::Unavailable, 0, {});
+                return;
+            }
+            cb(RefreshStatus::Ok, userId, std::move(next));
+        };
+
+        if (!redis_) {
+            finish(callback, local, true);
+            return;
+        }
+
+        // DEL 返回 1 说明令牌仍有效，且只有一个请求能删掉它，并发刷新同一个令牌时只有一个成功
+        auto cb = std::make_shared<RefreshCallback>(std::move(callback));
+        redis_->execCommandAsync(
+            [this, cb, finish, hash, userId, local](const nosql::RedisResult& result) {
+                exec("SREM %s %s", userKey(userId).c_str(), hash.c_str());
+                finish(*cb, result.asInteger() > 0, local);
+            },
+            [cb, finish, local](const nosql::RedisException& e) {
+                LOG_ERROR << "Error consuming refresh token in redis, falling back to local sessions: " << e.what();
+                finish(*cb, local, true);
+            },
+            "DEL %s", sessionKey(hash).c_str());
+    }
+
+    void SessionStore::revoke(const std::string& refreshToken) {
+        int64_t userId = parseUserId(refreshToken);
+        if (userId <= 0) {
+            return;
+        }
+        auto hash = digest(refreshToken);
+        eraseLocal(hash);
+        if (redis_) {
+            eraseRemote(hash, userId);
+        }
+    }
+
+    void SessionStore::revokeUser(int64_t userId) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = userSessions_.find(userId);
+            if (it != userSessions_.end()) {
+                for (const auto& hash : it->second) {
+                    sessions_.erase(hash);
+                }
+                userSessions_.erase(it);
+            }
+        }
+        if (!redis_) {
+            return;
+        }
+        auto key = userKey(userId);
+        redis_->execCommandAsync(
+            [this, key](const nosql::RedisResult& result) {
+                for (const auto& item : result.asArray()) {
+                    exec("DEL %s", sessionKey(item.asString()).c_str());
+                }
+                exec("DEL %s", key.c_str());
+            },
+            [userId](const nosql::RedisException& e) {
+                LOG_ERROR << "Error revoking sessions of user " << userId << ": " << e.what();
+            },
+            "SMEMBERS %s", key.c_str());
+    }
+
+    int64_t SessionStore::parseUserId(const std::string& refreshToken) {
+        auto dot = refreshToken.find('.');
+        if (dot == std::string::npos || dot + 1 >= refreshToken.size()) {
+            return 0;
+        }
+        int64_t userId = 0;
+        auto result = std::from_chars(refreshToken.data(), refreshToken.data() + dot, userId);
+        if (result.ec != std::errc() || result.ptr != refreshToken.data() + dot) {
+            return 0;
+        }
+        return userId;
+    }
+
+    std::string SessionStore::digest(const std::string& refreshToken) {
+        static constexpr char kHex[] = "0123456789abcdef";
+        unsigned char hash[SHA256_DIGEST_LENGTH];
+        SHA256(reinterpret_cast<const unsigned char*>(refreshToken.data()), refreshToken.size(), hash);
+        std::string out(sizeof(hash) * 2, '\0');
+        for (size_t i = 0; i < sizeof(hash); ++i) {
+            out[i * 2] = kHex[hash[i] >> 4];
+            out[i * 2 + 1] = kHex[hash[i] & 0xF];
+        }
+        return out;
+    }
+
+    bool SessionStore::eraseLocal(const std::string& hash) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sessions_.find(hash);
+        if (it == sessions_.end()) {
+            return false;
+        }
+        bool valid = it->second.expiresAt > std::chrono::system_clock::now();
+        auto owned = userSessions_.find(it->second.userId);
+        if (owned != userSessions_.end()) {
+            auto& hashes = owned->second;
+            hashes.erase(std::remove(hashes.begin(), hashes.end(), hash), hashes.end());
+            if (hashes.empty()) {
+                userSessions_.erase(owned);
+            }
+        }
+        sessions_.erase(it);
+        return valid;
+    }
+
+    void SessionStore::eraseRemote(const std::string& hash, int64_t userId) {
+        exec("DEL %s", sessionKey(hash).c_str());
+        exec("SREM %s %s", userKey(userId).c_str(), hash.c_str());
+    }
+
+    // Redis 中的会话由 EX 过期，这里只清理内存
+    void SessionStore::sweep() {
+        auto now = std::chrono::system_clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto owned = userSessions_.begin(); owned != userSessions_.end();) {
+            auto& hashes = owned->second;
+            for (auto hash = hashes.begin(); hash != hashes.end();) {
+                auto it = sessions_.find(*hash);
+                if (it != sessions_.end() && it->second.expiresAt > now) {
+                    ++hash;
+                    continue;
+                }
+                if (it != sessions_.end()) {
+                    sessions_.erase(it);
+                }
+                hash = hashes.erase(hash);
+            }
+            owned = hashes.empty() ? userSessions_.erase(owned) : std::next(owned);
+        }
+    }
+
+    SessionStore::Stats SessionStore::stats() const {
+        size_t sessions;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sessions = sessions_.size();
+        }
+        return Stats{
+            sessions,
+            issued_.load(std::memory_order_relaxed),
+            localHits_.load(std::memory_order_relaxed),
+            remoteHits_.load(std::memory_order_relaxed),
+            misses_.load(std::memory_order_relaxed),
+        };
+    }
+}
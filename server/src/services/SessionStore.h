@@ -0,0 +1,112 @@
+#pragma once
+
+#include <drogon/nosql/RedisClient.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace im_server
+{
+    // 登录会话。登录时签发短期的 access token（JWT，默认 15 分钟）和长期的 refresh token；
+    // access token 过期后客户端用 refresh token 换一对新的（/api/auth/refresh），不需要口令，
+    // 但每次都按 id 确认用户仍是启用状态（停用在其他节点执行时本节点不会收到吊销）。
+    // refresh token 只能使用一次，每次刷新都作废旧的、签发新的。
+    //
+    // refresh token 形如 "<user id>.<32 字节随机数 base64url>"，服务端只保存它的 SHA-256。
+    // 会话保存在本进程内存中；配置了 redis_client 时同时写入 Redis：
+    //   im:session:{sha256}    值为 user id，EX 为剩余有效期
+    //   im:user_sessions:{id}  该用户的会话摘要集合，按用户吊销时使用
+    // 此时以 Redis 为准：刷新时按 DEL 的返回值判断令牌是否仍有效，其他节点签发的令牌也能刷新，
+    // 在任一节点作废的令牌其他节点也不再接受；Redis 出错时退回本地记录。
+    // 多节点部署（cluster.bus 为 "redis"）必须共享会话，未配置 redis_client 时使用 cluster.redis_client。
+    //
+    // 配置（custom_config.auth.sessions）：
+    //   "access_ttl_sec"   : access token 有效期，默认 900
+    //   "refresh_ttl_days" : refresh token 有效期，默认 30
+    //   "max_per_user"     : 每个用户在本节点保留的会话数，超出时作废最早的，默认 10
+    //   "redis_client"     : redis_clients 中的客户端名，留空（默认）时单节点只保存在内存中
+    class SessionStore
+    {
+    public:
+        struct Stats
+        {
+            uint64_t sessions;     // 本节点内存中的会话
+            uint64_t issued;       // 累计签发的 refresh token
+            uint64_t localHits;    // 刷新时命中本节点内存
+            uint64_t remoteHits;   // 本节点没有、在 Redis 中找到（其他节点签发或本节点重启前签发）
+            uint64_t misses;       // 无效、过期、已使用或用户已停用的 refresh token
+        };
+
+        enum class RefreshStatus
+        {
+            Ok,
+            Invalid,    // 无效、过期、已使用，或用户已停用
+            Unavailable // 查询用户失败，refresh token 没有被消耗，可以重试
+        };
+
+        using RefreshCallback = std::function<void(RefreshStatus, int64_t userId, std::string &&refreshToken)>;
+
+        static SessionStore &instance();
+
+        // 启动时调用一次
+        void start();
+
+        std::chrono::seconds accessTtl() const { return accessTtl_; }
+
+        // 为登录成功的用户签发 refresh token
+        std::string issue(int64_t userId);
+        // 作废 refreshToken 并签发新的；回调可能在数据库或 Redis 客户端的线程上执行
+        void refresh(const std::string &refreshToken, RefreshCallback &&callback);
+        // 退出登录
+        void revoke(const std::string &refreshToken);
+        // 作废用户的全部会话（停用用户时）
+        void revokeUser(int64_t userId);
+
+        Stats stats() const;
+
+    private:
+        struct Session
+        {
+            int64_t userId;
+            std::chrono::system_clock::time_point expiresAt;
+        };
+
+        SessionStore() = default;
+
+        static int64_t parseUserId(const std::string &refreshToken);
+        static std::string digest(const std::string &refreshToken);
+        static std::string sessionKey(const std::string &digest) { return "im:session:" + digest; }
+        static std::string userKey(int64_t userId) { return "im:user_sessions:" + std::to_string(userId); }
+
+        // 用户确认是启用状态之后消耗令牌并签发新的
+        void consume(const std::string &refreshToken, int64_t userId, RefreshCallback &&callback);
+        // 从内存中移除，返回该会话此前是否存在且未过期
+        bool eraseLocal(const std::string &digest);
+        void eraseRemote(const std::string &digest, int64_t userId);
+        void sweep();
+
+        // 不关心结果的写命令，参数按 hiredis 格式串传入
+        template <typename... Args>
+        void exec(const char *format, Args... args);
+
+        std::chrono::seconds accessTtl_{900};
+        std::chrono::seconds refreshTtl_{30 * 24 * 3600};
+        size_t maxPerUser_ = 10;
+        drogon::nosql::RedisClientPtr redis_;
+
+        mutable std::mutex mutex_;
+        std::unordered_map<std::string, Session> sessions_;
+        // 每个用户的会话摘要，按签发顺序
+        std::unordered_map<int64_t, std::deque<std::string>> userSessions_;
+
+        std::atomic<uint64_t> issued_{0};
+        std::atomic<uint64_t> localHits_{0};
+        std::atomic<uint64_t> remoteHits_{0};
+        std::atomic<uint64_t> misses_{0};
+    };
+}
@@ -0,0 +1,45 @@
+#include "Storage.h"
+#include "EmbeddedStorage.h"
+#include "MessageArchive.h"
+#include "MySqlStorage.h"
+#include "TieredStorage.h"
+#include <drogon/HttpAppFramework.h>
+
+using namespace drogon;
+
+namespace im_server {
+
+    Storage& Storage::instance() {
+        static std::unique_ptr<Storage> storage = create(app().getCustomConfig()["storage"]);
+        return *storage;
+    }
+
+    std::unique_ptr<Storage> Storage::create(const Json::Value& config) {
+        std::string backend = config.isObject() ? config.get("backend", "mysql").asString() : "mysql";
+        if (backend == "embedded") {
+            EmbeddedStorage::Options options;
+            options.dataDir = config.get("data_dir", options.dataDir).asString();
+            options.segmentBytes = config.get("segment_mb", static_cast<Json::UInt64>(options.segmentBytes >> 20)).asUInt64() << 20;
+            options.fsync = config.get("fsync", options.fsync).asBool();
+            auto storage = std::make_unique<EmbeddedStorage>(options);
+            LOG_INFO << "Storage backend: embedded, data_dir=" << options.dataDir;
+            return storage;
+        }
+        if (backend != "mysql") {
+            LOG_WARN << "Unknown storage backend '" << backend << "', falling back to mysql";
+        }
+        const auto& archive = config.isObject() ? config["archive"] : Json::Value::nullSingleton();
+        if (archive.isObject() && archive.get("enabled", false).asBool()) {
+            std::string dir = archive.get("dir", "./archive").asString();
+            // 不执行迁移的实例只读打开共享的归档目录
+            bool readOnly = !archive.get("migrate", true).asBool();
+            if (MessageArchive::instance().open(dir, readOnly)) {
+                LOG_INFO << "Storage backend: mysql, archive_dir=" << dir << (readOnly ? " (read-only)" : "");
+                return std::make_unique<TieredStorage>(std::make_unique<MySqlStorage>());
+            }
+            LOG_ERROR << "Failed to open message archive at " << dir << ", archived messages will not be readable";
+        }
+        LOG_INFO << "Storage backend: mysql";
+        return std::make_unique<MySqlStorage>();
+    }
+}
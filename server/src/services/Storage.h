@@ -0,0 +1,101 @@
+#pragma once
+
+#include "../models/Message.h"
+#include "../models/User.h"
+#include <json/json.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace im_server
+{
+    // Service 层之下的存储接口。所有方法都是异步的，结果在存储后端自己的线程上回调
+    // （MySQL 为 DbClient 的线程，embedded 为引擎的单个工作线程），调用方不会被阻塞。
+    //
+    // 配置（custom_config.storage）：
+    //   "backend"    : "mysql"（默认，使用 db_clients，见 DbUtil）或 "embedded"
+    //   "data_dir"   : embedded 引擎的日志目录，默认 "./data"
+    //   "segment_mb" : embedded 引擎单个日志段大小，默认 64
+    //   "fsync"      : embedded 引擎每次写入后是否同步刷盘（msync MS_SYNC），默认 false
+    class Storage
+    {
+    public:
+        enum class Status
+        {
+            Ok,
+            NotFound,
+            UsernameTaken,
+            EmailTaken,
+            Error
+        };
+
+        using BoolCallback = std::function<void(bool)>;
+        using MessagesCallback = std::function<void(std::vector<Message> &&)>;
+        using MessageCallback = std::function<void(Message &&)>;
+        using UserCallback = std::function<void(Status, User &&)>;
+        using CreateUserCallback = std::function<void(Status, int64_t userId)>;
+        using IdsCallback = std::function<void(std::vector<int64_t> &&)>;
+        using CursorCallback = std::function<void(bool ok, int64_t cursor)>;
+
+        struct RoomInfo
+        {
+            int64_t ownerId = 0;
+            bool isPublic = false;
+        };
+        using RoomCallback = std::function<void(Status, RoomInfo &&)>;
+
+        virtual ~Storage() = default;
+
+        // 按 custom_config.storage 选择的后端，首次调用时创建（embedded 在此回放日志）
+        static Storage &instance();
+        static std::unique_ptr<Storage> create(const Json::Value &config);
+
+        // 消息。insertMessages 整批原子写入，已存在的 id 跳过（失败重试时整批重写）；
+        // 分页语义同 MessageService::getMessages，结果按 id 升序
+        virtual void insertMessages(const std::vector<Message> &rows, BoolCallback &&callback) = 0;
+        virtual void getConversationMessages(uint64_t conversationId, int64_t beforeId, int64_t afterId, int limit,
+                                             MessagesCallback &&callback) = 0;
+        virtual void getMessagesForReceiver(int64_t receiverId, int64_t afterId, int limit,
+                                            MessagesCallback &&callback) = 0;
+        virtual void getUnreadMessages(int64_t receiverId, MessagesCallback &&callback) = 0;
+        // 不存在时回调 id 为 0 的 Message
+        virtual void getMessageById(int64_t messageId, MessageCallback &&callback) = 0;
+        // 消息存在且接收方是 receiverId 时回调 true
+        virtual void markRead(int64_t messageId, int64_t receiverId, BoolCallback &&callback) = 0;
+        virtual void markConversationRead(uint64_t conversationId, int64_t receiverId, int64_t upToId,
+                                          BoolCallback &&callback) = 0;
+
+        // 用户。用户名或邮箱已被占用时回调 UsernameTaken / EmailTaken
+        virtual void createUser(const std::string &username, const std::string &email,
+                                const std::string &passwordHash, const std::string &createdAt,
+                                CreateUserCallback &&callback) = 0;
+        // 只查找 is_active 的用户，找不到回调 NotFound
+        virtual void findUserByName(const std::string &username, UserCallback &&callback) = 0;
+        // 同上，按 id 查找；不返回口令哈希
+        virtual void findUserById(int64_t userId, UserCallback &&callback) = 0;
+        // 登录时按新的 KDF 参数重新哈希后回写；用户不存在时回调 false
+        virtual void updatePasswordHash(int64_t userId, const std::string &passwordHash,
+                                        BoolCallback &&callback) = 0;
+        // 启用 / 停用用户；用户不存在时回调 false
+        virtual void setUserActive(int64_t userId, bool active, BoolCallback &&callback) = 0;
+
+        // 群聊房间与成员。createRoom 同时把创建者加入成员，两者一起成功或失败；
+        // joinRoom 在房间不存在时回调 false，已是成员视为成功，是否允许加入由 RoomService 判断；
+        // leaveRoom 只有确实移除了成员才回调 true
+        virtual void createRoom(int64_t roomId, const std::string &name, int64_t ownerId, bool isPublic,
+                                BoolCallback &&callback) = 0;
+        virtual void getRoom(int64_t roomId, RoomCallback &&callback) = 0;
+        virtual void joinRoom(int64_t roomId, int64_t userId, BoolCallback &&callback) = 0;
+        virtual void leaveRoom(int64_t roomId, int64_t userId, BoolCallback &&callback) = 0;
+        virtual void isMember(int64_t roomId, int64_t userId, BoolCallback &&callback) = 0;
+        virtual void getUserRooms(int64_t userId, IdsCallback &&callback) = 0;
+        // candidates（升序、不重复）中与 userId 同在某个房间或有过单聊消息的用户，按升序回调；出错时回调空列表
+        virtual void filterContacts(int64_t userId, std::vector<int64_t> &&candidates, IdsCallback &&callback) = 0;
+
+        // 上线同步的 last-delivered 游标，没有记录时为 0；saveCursors 只会让游标前移
+        virtual void loadCursor(int64_t userId, CursorCallback &&callback) = 0;
+        virtual void saveCursors(std::vector<std::pair<int64_t, int64_t>> &&cursors, BoolCallback &&callback) = 0;
+    };
+}
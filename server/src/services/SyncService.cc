@@ -0,0 +1,309 @@
+#include "SyncService.h"
+#include "MessagePersister.h"
+#include "MessageService.h"
+#include "OutboundQueue.h"
+#include "SessionRegistry.h"
+#include "Storage.h"
+#include "../utils/BinaryProtocol.h"
+#include "../utils/FrameEncoder.h"
+#include <drogon/HttpAppFramework.h>
+#include <algorithm>
+
+using namespace drogon;
+
+namespace im_server {
+
+    namespace {
+        // 单次 saveCursors 最多携带的游标数（MySQL 后端为一条多行 upsert）
+        constexpr size_t kCursorsPerStatement = 500;
+    }
+
+    SyncService& SyncService::instance() {
+        static SyncService service;
+        return service;
+    }
+
+    void SyncService::start() {
+        const auto& config = app().getCustomConfig()["sync"];
+        if (config.isObject()) {
+            maxConcurrentJobs_ = std::max<size_t>(1, config.get("max_concurrent_jobs", 32).asUInt64());
+            batchSize_ = std::max<size_t>(1, config.get("batch_size", 100).asUInt64());
+            ackTimeoutSeconds_ = config.get("ack_timeout_sec", 30.0).asDouble();
+            cursorFlushSeconds_ = config.get("cursor_flush_interval_ms", 1000).asDouble() / 1000.0;
+        }
+
+        app().getLoop()->runEvery(cursorFlushSeconds_, [this]() {
+            flushCursors();
+        });
+    }
+
+    void SyncService::startSync(const WebSocketConnectionPtr& conn, int64_t userId) {
+        auto job = std::make_shared<Job>();
+        job->conn = conn;
+        job->key = conn.get();
+        job->userId = userId;
+
+        bool runNow = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_[job->key] = job;
+            caughtUp_.erase(job->key);
+            if (running_ < maxConcurrentJobs_) {
+                ++running_;
+                job->holdsSlot = true;
+                runNow = true;
+            } else {
+                pending_.push_back(job);
+            }
+        }
+
+        if (runNow) {
+            launch(job);
+        }
+    }
+
+    void SyncService::launch(const JobPtr& job) {
+        Storage::instance().loadCursor(job->userId, [this, job](bool ok, int64_t cursor) {
+            if (!ok) {
+                finish(job);
+                return;
+            }
+            {
+                // 内存里可能有尚未刷盘的更新游标
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = dirtyCursors_.find(job->userId);
+                if (it != dirtyCursors_.end()) {
+                    cursor = std::max(cursor, it->second);
+                }
+                job->cursor = cursor;
+            }
+            fetchBatch(job);
+        });
+    }
+
+    void SyncService::fetchBatch(const JobPtr& job) {
+        if (job->finished || job->conn.expired()) {
+            finish(job);
+            return;
+        }
+
+        int limit = static_cast<int>(batchSize_);
+        MessageService::instance().getMessagesForReceiver(job->userId, job->cursor, limit,
+            [this, job, limit](std::vector<Message>&& messages) {
+                auto conn = job->conn.lock();
+                if (!conn || job->finished) {
+                    finish(job);
+                    return;
+                }
+
+                bool hasMore = static_cast<int>(messages.size()) == limit;
+                auto session = SessionRegistry::sessionOf(conn);
+                if (!session) {
+                    finish(job);
+                    return;
+                }
+                // 批次按最后一条的 id 计入下行窗口，客户端 ack 后扣除；空批次不计入。
+                // 先登记等待的 id 再发送，ack 不会早于登记到达
+                int64_t ackId = messages.empty() ? 0 : messages.back().id;
+                JobPtr next;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    job->awaitingId = ackId;
+                    job->lastBatch = !hasMore;
+                    if (!hasMore) {
+                        // 最后一批无需等待 ack 即可释放并发名额
+                        next = releaseSlotLocked(job);
+                        if (ackId == 0 && !job->finished) {
+                            caughtUp_.insert(job->key);
+                        }
+                    }
+                }
+                if (next) {
+                    launch(next);
+                }
+
+                if (session->protocol == WireProtocol::Binary) {
+                    auto frame = BinaryProtocol::encodeSyncBatch(messages, hasMore);
+                    OutboundQueue::instance().sendReliable(conn, *session, ackId, frame, WebSocketMessageType::Binary);
+                } else {
+                    auto frame = FrameEncoder::encodeSyncBatch(messages, hasMore);
+                    OutboundQueue::instance().sendReliable(conn, *session, ackId, frame, WebSocketMessageType::Text);
+                }
+
+                if (ackId == 0) {
+                    finish(job);
+                    return;
+                }
+                armAckTimeout(job, ackId);
+            });
+    }
+
+    void SyncService::armAckTimeout(const JobPtr& job, int64_t awaitingId) {
+        std::weak_ptr<Job> weakJob = job;
+        auto timer = app().getLoop()->runAfter(ackTimeoutSeconds_, [this, weakJob, awaitingId]() {
+            auto job = weakJob.lock();
+            if (!job) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (job->finished || job->awaitingId != awaitingId) {
+                    return;
+                }
+            }
+            LOG_WARN << "Sync ack timeout for user " << job->userId;
+            finish(job);
+        });
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (job->awaitingId == awaitingId) {
+            job->timer = timer;
+        }
+    }
+
+    void SyncService::onAck(const WebSocketConnectionPtr& conn, int64_t userId, int64_t lastId) {
+        int64_t unpersisted = MessagePersister::instance().oldestPendingId();
+        JobPtr resume;
+        JobPtr completed;
+        trantor::TimerId timer = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            int64_t delivered = 0;
+            auto it = jobs_.find(conn.get());
+            if (it != jobs_.end()) {
+                // 同步进行中：只有对当前批次的 ack 能证明积压消息已送达
+                auto& job = it->second;
+                if (job->awaitingId != 0 && lastId >= job->awaitingId) {
+                    delivered = job->awaitingId;
+                    job->cursor = job->awaitingId;
+                    job->awaitingId = 0;
+                    timer = job->timer;
+                    job->timer = 0;
+                    if (job->lastBatch) {
+                        caughtUp_.insert(job->key);
+                        completed = job;
+                    } else {
+                        resume = job;
+                    }
+                }
+            } else if (caughtUp_.count(conn.get()) > 0) {
+                delivered = lastId;
+            }
+
+            if (unpersisted > 0) {
+                delivered = std::min(delivered, unpersisted - 1);
+            }
+            if (delivered > 0) {
+                auto& cursor = dirtyCursors_[userId];
+                cursor = std::max(cursor, delivered);
+            }
+        }
+
+        if (timer != 0) {
+            app().getLoop()->invalidateTimer(timer);
+        }
+        if (resume) {
+            fetchBatch(resume);
+        }
+        if (completed) {
+            finish(completed);
+        }
+    }
+
+    void SyncService::onDisconnect(const WebSocketConnectionPtr& conn) {
+        JobPtr job;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            caughtUp_.erase(conn.get());
+            auto it = jobs_.find(conn.get());
+            if (it == jobs_.end()) {
+                return;
+            }
+            job = it->second;
+        }
+        finish(job);
+    }
+
+    void SyncService::finish(const JobPtr& job) {
+        JobPtr next;
+        trantor::TimerId timer = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (job->finished) {
+                return;
+            }
+            job->finished = true;
+            timer = job->timer;
+            job->timer = 0;
+
+            auto it = jobs_.find(job->key);
+            if (it != jobs_.end() && it->second == job) {
+                jobs_.erase(it);
+            }
+
+            // 排队中的任务被取消时不占并发名额
+            auto queued = std::find(pending_.begin(), pending_.end(), job);
+            if (queued != pending_.end()) {
+                pending_.erase(queued);
+                return;
+            }
+            next = releaseSlotLocked(job);
+        }
+
+        if (timer != 0) {
+            app().getLoop()->invalidateTimer(timer);
+        }
+        if (next) {
+            launch(next);
+        }
+    }
+
+    SyncService::JobPtr SyncService::releaseSlotLocked(const JobPtr& job) {
+        if (!job->holdsSlot) {
+            return nullptr;
+        }
+        job->holdsSlot = false;
+        --running_;
+        while (!pending_.empty()) {
+            auto candidate = std::move(pending_.front());
+            pending_.pop_front();
+            if (!candidate->finished) {
+                candidate->holdsSlot = true;
+                ++running_;
+                return candidate;
+            }
+        }
+        return nullptr;
+    }
+
+    void SyncService::flushCursors() {
+        std::unordered_map<int64_t, int64_t> cursors;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (dirtyCursors_.empty()) {
+                return;
+            }
+            cursors.swap(dirtyCursors_);
+        }
+
+        auto it = cursors.begin();
+        while (it != cursors.end()) {
+            std::vector<std::pair<int64_t, int64_t>> rows;
+            for (; it != cursors.end() && rows.size() < kCursorsPerStatement; ++it) {
+                rows.emplace_back(it->first, it->second);
+            }
+            auto batch = rows;
+            Storage::instance().saveCursors(std::move(rows), [this, batch](bool ok) {
+                if (ok) {
+                    return;
+                }
+                // 写失败时放回内存，下次定时刷盘重试
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (const auto& row : batch) {
+                    auto& cursor = dirtyCursors_[row.first];
+                    cursor = std::max(cursor, row.second);
+                }
+            });
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <drogon/WebSocketConnection.h>
+#include <trantor/net/EventLoop.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace im_server
+{
+    // 上线同步：连接建立后按用户的 last-delivered 游标把离线期间收到的消息分批推给客户端。
+    //   - 每批 batch_size 条，客户端用 {"type":"ack","last_id":...} 确认后才查询下一批（背压）
+    //   - 同时进行的同步任务不超过 max_concurrent_jobs 个，其余排队，部署后的重连风暴不会压垮数据库
+    //   - ack 同样用于实时消息；游标只在内存中前移，每 cursor_flush_interval_ms 用一条多行 upsert 批量落库
+    //
+    // 游标只按能证明已送达的 ack 前移：同步进行中只认对当前批次的 ack（前移到该批最后一条），
+    // 期间实时消息的 ack 不移动游标，否则会越过尚未推送的积压消息；
+    // 最后一批被 ack 之后该连接才算追上，此后的 ack 直接前移到 last_id。
+    // 消息先转发后落库，游标同时限制在本节点尚未落库的最小消息 id 之前（MessagePersister::oldestPendingId），
+    // 这些消息落库后下次上线仍会补发。其他节点写入队列中的消息本节点看不到：
+    // 若其他节点在 flush_interval_ms 内没有落库、而本连接已经 ack 了更新的消息，这条消息不会被补发
+    // （客户端可按 id 用 /api/messages 的 after_id 补齐）。
+    //
+    // 配置（custom_config.sync）：
+    //   "max_concurrent_jobs"       : 默认 32
+    //   "batch_size"                : 默认 100
+    //   "ack_timeout_sec"           : 等待客户端 ack 的超时，超时放弃本次同步，默认 30
+    //   "cursor_flush_interval_ms"  : 默认 1000
+    class SyncService
+    {
+    public:
+        static SyncService &instance();
+
+        // 在 IO 线程启动后调用，读取配置并启动游标刷盘定时器
+        void start();
+
+        void startSync(const drogon::WebSocketConnectionPtr &conn, int64_t userId);
+        void onAck(const drogon::WebSocketConnectionPtr &conn, int64_t userId, int64_t lastId);
+        void onDisconnect(const drogon::WebSocketConnectionPtr &conn);
+
+    private:
+        struct Job
+        {
+            std::weak_ptr<drogon::WebSocketConnection> conn;
+            const drogon::WebSocketConnection *key = nullptr;
+            int64_t userId = 0;
+            int64_t cursor = 0;
+            std::atomic<bool> finished{false};
+            // 以下字段在 mutex_ 保护下读写
+            int64_t awaitingId = 0; // 已推送、等待 ack 的最后一条消息 id
+            bool lastBatch = false; // awaitingId 属于最后一批，ack 后该连接追上
+            bool holdsSlot = false; // 占用一个并发名额；最后一批发出后即释放，不等 ack
+            trantor::TimerId timer = 0;
+        };
+        using JobPtr = std::shared_ptr<Job>;
+
+        SyncService() = default;
+
+        void launch(const JobPtr &job);
+        void fetchBatch(const JobPtr &job);
+        void armAckTimeout(const JobPtr &job, int64_t awaitingId);
+        void finish(const JobPtr &job);
+        // 调用方持有 mutex_；释放 job 的并发名额，返回需要启动的排队任务
+        JobPtr releaseSlotLocked(const JobPtr &job);
+        void flushCursors();
+
+        size_t maxConcurrentJobs_ = 32;
+        size_t batchSize_ = 100;
+        double ackTimeoutSeconds_ = 30.0;
+        double cursorFlushSeconds_ = 1.0;
+
+        std::mutex mutex_;
+        std::deque<JobPtr> pending_;
+        std::unordered_map<const drogon::WebSocketConnection *, JobPtr> jobs_;
+        size_t running_ = 0;
+        // 已追上的连接：其 ack 可以直接前移游标
+        std::unordered_set<const drogon::WebSocketConnection *> caughtUp_;
+        // 尚未落库的游标：user id -> 最大已确认消息 id
+        std::unordered_map<int64_t, int64_t> dirtyCursors_;
+    };
+}
@@ -0,0 +1,170 @@
+#include "TieredStorage.h"
+#include "MessageArchive.h"
+#include <algorithm>
+
+namespace im_server {
+
+    namespace {
+        std::vector<Message> merge(std::vector<Message>&& hot, std::vector<Message>&& cold) {
+            std::vector<Message> merged;
+            merged.reserve(hot.size() + cold.size());
+            std::merge(std::make_move_iterator(cold.begin()), std::make_move_iterator(cold.end()),
+                       std::make_move_iterator(hot.begin()), std::make_move_iterator(hot.end()),
+                       std::back_inserter(merged),
+                       [](const Message& a, const Message& b) { return a.id < b.id; });
+            // 迁移过程中同一条消息可能同时在热库和归档里
+            merged.erase(std::unique(merged.begin(), merged.end(),
+                                     [](const Message& a, const Message& b) { return a.id == b.id; }),
+                         merged.end());
+            return merged;
+        }
+    }
+
+    TieredStorage::TieredStorage(std::unique_ptr<Storage> hot) : hot_(std::move(hot)) {}
+
+    void TieredStorage::insertMessages(const std::vector<Message>& rows, BoolCallback&& callback) {
+        hot_->insertMessages(rows, std::move(callback));
+    }
+
+    void TieredStorage::getConversationMessages(uint64_t conversationId, int64_t beforeId, int64_t afterId,
+                                                int limit, MessagesCallback&& callback) {
+        if (afterId > 0) {
+            hot_->getConversationMessages(
+                conversationId, 0, afterId, limit,
+                [callback = std::move(callback), conversationId, afterId, limit](std::vector<Message>&& hot) {
+                    auto& archive = MessageArchive::instance();
+                    // 热库取满一页时，只有归档里有比这一页最后一条更早的消息才需要合并
+                    int64_t upTo = static_cast<int>(hot.size()) >= limit ? hot.back().id : 0;
+                    if (!archive.mayHaveBetween(conversationId, afterId, upTo)) {
+                        callback(std::move(hot));
+                        return;
+                    }
+                    auto merged = merge(std::move(hot), archive.readAfter(conversationId, afterId, limit));
+                    if (static_cast<int>(merged.size()) > limit) {
+                        merged.resize(static_cast<size_t>(limit));
+                    }
+                    callback(std::move(merged));
+                });
+            return;
+        }
+
+        hot_->getConversationMessages(
+            conversationId, beforeId, 0, limit,
+            [callback = std::move(callback), conversationId, beforeId, limit](std::vector<Message>&& hot) {
+                auto& archive = MessageArchive::instance();
+                // 热库取满一页时，只有归档里有比这一页第一条更新的消息才需要合并
+                int64_t newerThan = static_cast<int>(hot.size()) >= limit ? hot.front().id : 0;
+                if (!archive.mayHaveBetween(conversationId, newerThan, beforeId)) {
+                    callback(std::move(hot));
+                    return;
+                }
+                auto merged = merge(std::move(hot), archive.readBefore(conversationId, beforeId, limit));
+                if (static_cast<int>(merged.size()) > limit) {
+                    merged.erase(merged.begin(), merged.end() - limit);
+                }
+                callback(std::move(merged));
+            });
+    }
+
+    void TieredStorage::getMessagesForReceiver(int64_t receiverId, int64_t afterId, int limit,
+                                               MessagesCallback&& callback) {
+        hot_->getMessagesForReceiver(receiverId, afterId, limit, std::move(callback));
+    }
+
+    void TieredStorage::getUnreadMessages(int64_t receiverId, MessagesCallback&& callback) {
+        hot_->getUnreadMessages(receiverId, std::move(callback));
+    }
+
+    void TieredStorage::getMessageById(int64_t messageId, MessageCallback&& callback) {
+        hot_->getMessageById(messageId, [callback = std::move(callback), messageId](Message&& message) {
+            if (message.id == 0) {
+                callback(MessageArchive::instance().find(messageId));
+                return;
+            }
+            callback(std::move(message));
+        });
+    }
+
+    void TieredStorage::markRead(int64_t messageId, int64_t receiverId, BoolCallback&& callback) {
+        hot_->markRead(messageId, receiverId, std::move(callback));
+    }
+
+    void TieredStorage::markConversationRead(uint64_t conversationId, int64_t receiverId, int64_t upToId,
+                                             BoolCallback&& callback) {
+        hot_->markConversationRead(conversationId, receiverId, upToId, std::move(callback));
+    }
+
+    void TieredStorage::createUser(const std::string& username, const std::string& email,
+                                   const std::string& passwordHash, const std::string& createdAt,
+                                   CreateUserCallback&& callback) {
+        hot_->createUser(username, email, passwordHash, createdAt, std::move(callback));
+    }
+
+    void TieredStorage::findUserByName(const std::string& username, UserCallback&& callback) {
+        hot_->findUserByName(username, std::move(callback));
+    }
+
+    void TieredStorage::findUserById(int64_t userId, UserCallback&& callback) {
+        hot_->findUserById(userId, std::move(callback));
+    }
+
+    void TieredStorage::updatePasswordHash(int64_t userId, const std::string& passwordHash,
+                                           BoolCallback&& callback) {
+        hot_->updatePasswordHash(userId, passwordHash, std::move(callback));
+    }
+
+    void TieredStorage::setUserActive(int64_t userId, bool active, BoolCallback&& callback) {
+        hot_->setUserActive(userId, active, std::move(callback));
+    }
+
+    void TieredStorage::createRoom(int64_t roomId, const std::string& name, int64_t ownerId, bool isPublic,
+                                   BoolCallback&& callback) {
+        hot_->createRoom(roomId, name, ownerId, isPublic, std::move(callback));
+    }
+
+    void TieredStorage::getRoom(int64_t roomId, RoomCallback&& callback) {
+        hot_->getRoom(roomId, std::move(callback));
+    }
+
+    void TieredStorage::joinRoom(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        hot_->joinRoom(roomId, userId, std::move(callback));
+    }
+
+    void TieredStorage::leaveRoom(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        hot_->leaveRoom(roomId, userId, std::move(callback));
+    }
+
+    void TieredStorage::isMember(int64_t roomId, int64_t userId, BoolCallback&& callback) {
+        hot_->isMember(roomId, userId, std::move(callback));
+    }
+
+    void TieredStorage::getUserRooms(int64_t userId, IdsCallback&& callback) {
+        hot_->getUserRooms(userId, std::move(callback));
+    }
+
+    void TieredStorage::filterContacts(int64_t userId, std::vector<int64_t>&& candidates, IdsCallback&& callback) {
+        // 单聊消息可能已全部迁入归档，热库查不到的再看归档的块索引
+        auto all = candidates;
+        hot_->filterContacts(userId, std::move(candidates),
+                             [callback = std::move(callback), all = std::move(all), userId](std::vector<int64_t>&& hot) {
+                                 auto& archive = MessageArchive::instance();
+                                 std::vector<int64_t> contacts;
+                                 contacts.reserve(all.size());
+                                 for (auto id : all) {
+                                     if (std::binary_search(hot.begin(), hot.end(), id) ||
+                                         archive.mayHaveBetween(makeConversationId(userId, id), 0, 0)) {
+                                         contacts.push_back(id);
+                                     }
+                                 }
+                                 callback(std::move(contacts));
+                             });
+    }
+
+    void TieredStorage::loadCursor(int64_t userId, CursorCallback&& callback) {
+        hot_->loadCursor(userId, std::move(callback));
+    }
+
+    void TieredStorage::saveCursors(std::vector<std::pair<int64_t, int64_t>>&& cursors, BoolCallback&& callback) {
+        hot_->saveCursors(std::move(cursors), std::move(callback));
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Storage.h"
+#include <memory>
+
+namespace im_server
+{
+    // MySQL 热数据 + 归档冷数据（见 MessageArchive / MessageArchiver）。
+    // 会话分页先查热库，只有内存中的块索引表明归档里可能有这一页需要的消息时才读归档并合并，
+    // 活跃会话的最新一页不会碰归档。其余操作直接交给热库：归档只收已读消息和群聊消息，
+    // 未读、已读标记和上线同步都只涉及热库。
+    class TieredStorage : public Storage
+    {
+    public:
+        explicit TieredStorage(std::unique_ptr<Storage> hot);
+
+        void insertMessages(const std::vector<Message> &rows, BoolCallback &&callback) override;
+        void getConversationMessages(uint64_t conversationId, int64_t beforeId, int64_t afterId, int limit,
+                                     MessagesCallback &&callback) override;
+        void getMessagesForReceiver(int64_t receiverId, int64_t afterId, int limit,
+                                    MessagesCallback &&callback) override;
+        void getUnreadMessages(int64_t receiverId, MessagesCallback &&callback) override;
+        void getMessageById(int64_t messageId, MessageCallback &&callback) override;
+        void markRead(int64_t messageId, int64_t receiverId, BoolCallback &&callback) override;
+        void markConversationRead(uint64_t conversationId, int64_t receiverId, int64_t upToId,
+                                  BoolCallback &&callback) override;
+
+        void createUser(const std::string &username, const std::string &email, const std::string &passwordHash,
+                        const std::string &createdAt, CreateUserCallback &&callback) override;
+        void findUserByName(const std::string &username, UserCallback &&callback) override;
+        void findUserById(int64_t userId, UserCallback &&callback) override;
+        void updatePasswordHash(int64_t userId, const std::string &passwordHash, BoolCallback &&callback) override;
+        void setUserActive(int64_t userId, bool active, BoolCallback &&callback) override;
+
+        void createRoom(int64_t roomId, const std::string &name, int64_t ownerId, bool isPublic,
+                        BoolCallback &&callback) override;
+        void getRoom(int64_t roomId, RoomCallback &&callback) override;
+        void joinRoom(int64_t roomId, int64_t userId, BoolCallback &&callback) override;
+        void leaveRoom(int64_t roomId, int64_t userId, BoolCallback &&callback) override;
+        void isMember(int64_t roomId, int64_t userId, BoolCallback &&callback) override;
+        void getUserRooms(int64_t userId, IdsCallback &&callback) override;
+        void filterContacts(int64_t userId, std::vector<int64_t> &&candidates, IdsCallback &&callback) override;
+
+        void loadCursor(int64_t userId, CursorCallback &&callback) override;
+        void saveCursors(std::vector<std::pair<int64_t, int64_t>> &&cursors, BoolCallback &&callback) override;
+
+    private:
+        std::unique_ptr<Storage> hot_;
+    };
+}
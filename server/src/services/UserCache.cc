@@ -0,0 +1,81 @@
+#include "UserCache.h"
+#include <algorithm>
+
+namespace im_server {
+
+    UserCache& UserCache::instance() {
+        static UserCache cache;
+        return cache;
+    }
+
+    void UserCache::configure(size_t maxEntries, std::chrono::seconds ttl) {
+        maxEntries_ = std::max<size_t>(1, maxEntries);
+        ttl_ = ttl;
+    }
+
+    bool UserCache::findByName(const std::string& username, User& user) {
+        if (ttl_.count() <= 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto name = byName_.find(username);
+        if (name != byName_.end()) {
+            auto it = users_.find(name->second);
+            if (it->second.expiresAt > std::chrono::steady_clock::now()) {
+                user = it->second.user;
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            eraseLocked(it);
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void UserCache::insert(const User& user, uint64_t generation) {
+        if (ttl_.count() <= 0 || !user.is_active) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (invalidations_.load(std::memory_order_relaxed) != generation) {
+            return;
+        }
+        auto existing = users_.find(user.id);
+        if (existing != users_.end()) {
+            eraseLocked(existing);
+        } else if (users_.size() >= maxEntries_) {
+            eraseLocked(users_.begin());
+        }
+        users_.emplace(user.id, Entry{user, std::chrono::steady_clock::now() + ttl_});
+        byName_[user.username] = user.id;
+    }
+
+    void UserCache::invalidate(int64_t userId) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 在锁内递增，与 insert 的检查互斥
+        invalidations_.fetch_add(1, std::memory_order_release);
+        auto it = users_.find(userId);
+        if (it != users_.end()) {
+            eraseLocked(it);
+        }
+    }
+
+    void UserCache::eraseLocked(std::unordered_map<int64_t, Entry>::iterator it) {
+        byName_.erase(it->second.user.username);
+        users_.erase(it);
+    }
+
+    UserCache::Stats UserCache::stats() const {
+        size_t entries;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries = users_.size();
+        }
+        return Stats{
+            entries,
+            hits_.load(std::memory_order_relaxed),
+            misses_.load(std::memory_order_relaxed),
+            invalidations_.load(std::memory_order_relaxed),
+        };
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../models/User.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace im_server
+{
+    // 登录用的用户记录缓存（含口令哈希），按 id 保存，另有用户名到 id 的索引。
+    // 命中时 loginUser 只剩口令校验，不再查询 users 表；只缓存 is_active 的用户。
+    // 停用用户（UserService::setUserActive）和回写口令哈希时按 id 显式失效；
+    // 其他节点上的修改不会通知本节点，条目最多存活 ttl_sec 秒。
+    //
+    // 配置（custom_config.auth.user_cache）：
+    //   "max_entries" : 条目上限，满了随机淘汰一条，默认 100000
+    //   "ttl_sec"     : 条目有效期，默认 300，0 关闭缓存
+    class UserCache
+    {
+    public:
+        struct Stats
+        {
+            uint64_t entries;
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t invalidations;
+        };
+
+        static UserCache &instance();
+
+        void configure(size_t maxEntries, std::chrono::seconds ttl);
+
+        bool findByName(const std::string &username, User &user);
+
+        // 查询存储前取 generation()，插入时带回：期间发生过失效则放弃插入，
+        // 避免失效之前读到的旧记录在失效之后被放回缓存
+        uint64_t generation() const { return invalidations_.load(std::memory_order_acquire); }
+        void insert(const User &user, uint64_t generation);
+
+        void invalidate(int64_t userId);
+
+        Stats stats() const;
+
+    private:
+        struct Entry
+        {
+            User user;
+            std::chrono::steady_clock::time_point expiresAt;
+        };
+
+        UserCache() = default;
+
+        // 调用方持有 mutex_
+        void eraseLocked(std::unordered_map<int64_t, Entry>::iterator it);
+
+        size_t maxEntries_ = 100000;
+        std::chrono::seconds ttl_{300};
+
+        mutable std::mutex mutex_;
+        std::unordered_map<int64_t, Entry> users_;
+        std::unordered_map<std::string, int64_t> byName_;
+
+        std::atomic<uint64_t> hits_{0};
+        std::atomic<uint64_t> misses_{0};
+        std::atomic<uint64_t> invalidations_{0};
+    };
+}
@@ -1,120 +1,195 @@
 #include "UserService.h"
+#include "PasswordHasher.h"
+#include "SessionStore.h"
+#include "Storage.h"
+#include "UserCache.h"
+#include "../utils/DbUtil.h"
+#include "../utils/EmailUtil.h"
+#include <drogon/HttpAppFramework.h>
+#include <trantor/net/EventLoop.h>
 #include <string>
-#include <tuple>
-#include <regex>
-
-using namespace drogon::orm;
 
 namespace im_server {
 
-    std::pair<bool, std::string> UserService::registerUser(const std::string& username, 
-                                                          const std::string& password, 
-                                                          const std::string& email) {
+    namespace {
+        // PasswordHasher 的回调在线程池上执行；之后的 Storage 调用（use_fast_client 的连接只能在所属 IO 线程上使用）
+        // 和请求回调都投递回发起请求的线程
+        trantor::EventLoop* callerLoop() {
+            auto* loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+            return loop ? loop : drogon::app().getLoop();
+        }
+    }
+
+    UserService& UserService::instance() {
+        static UserService service;
+        return service;
+    }
+
+    void UserService::registerUser(const std::string& username, 
+                                   const std::string& password, 
+                                   const std::string& email,
+                                   AuthCallback&& callback) {
         // Validate input
         if (username.empty() || password.empty() || email.empty()) {
-            return {false, "Username, password, and email are required"};
+            callback({AuthStatus::Failed, "Username, password, and email are required"});
+            return;
         }
 
         if (!validateEmail(email)) {
-            return {false, "Invalid email format"};
+            callback({AuthStatus::Failed, "Invalid email format"});
+            return;
         }
 
         if (username.length() < 3 || username.length() > 30) {
-            return {false, "Username must be between 3 and 30 characters"};
+            callback({AuthStatus::Failed, "Username must be between 3 and 30 characters"});
+            return;
         }
 
         if (password.length() < 6) {
-            return {false, "Password must be at least 6 characters"};
+            callback({AuthStatus::Failed, "Password must be at least 6 characters"});
+            return;
         }
 
-        try {
-            // Check if username or email already exists
-            auto result = dbClient->execSqlSync(
-                "SELECT id FROM users WHERE username = $1 OR email = $2", 
-                username, email
-            );
-
-            if (result.size() > 0) {
-                // Check if it's a username conflict or email conflict
-                auto existingUser = dbClient->execSqlSync(
-                    "SELECT id FROM users WHERE username = $1", username
-                );
-                
-                if (existingUser.size() > 0) {
-                    return {false, "Username already exists"};
-                } else {
-                    return {false, "Email already exists"};
+        // 注册要先哈希口令再插入，耗时按整个流程统计
+        static auto& latency = DbUtil::queryLatency("registerUser");
+        auto cb = std::make_shared<AuthCallback>(
+            [callback = std::move(callback), started = Metrics::now()](AuthResult&& result) {
+                latency.observeSince(started);
+                callback(std::move(result));
+            });
+
+        auto* loop = callerLoop();
+        bool queued = PasswordHasher::instance().hash(password,
+            [cb, username, email, loop](bool ok, std::string&& hashedPassword) {
+                if (!ok) {
+                    loop->queueInLoop([cb]() {
+                        (*cb)({AuthStatus::Failed, "Internal error"});
+                    });
+                    return;
                 }
-            }
-
-            // Hash the password
-            std::string hashedPassword = hashPassword(password);
-            std::string createdAt = TimeUtil::getCurrentTimestamp();
-            std::string updatedAt = createdAt;
-
-            // Insert the new user
-            auto insertResult = dbClient->execSqlSync(
-                "INSERT INTO users (username, email, password_hash, created_at, updated_at) VALUES ($1, $2, $3, $4, $5) RETURNING id",
-                username, email, hashedPassword, createdAt, updatedAt
-            );
-
-            if (insertResult.size() > 0) {
-                auto userId = insertResult[0]["id"].as<int64_t>();
-                return {true, std::to_string(userId)};
-            } else {
-                return {false, "Failed to register user"};
-            }
-        } catch (const std::exception& e) {
-            LOG_ERROR << "Error registering user: " << e.what();
-            return {false, "Database error: " + std::string(e.what())};
+                loop->queueInLoop([cb, username, email, hashedPassword = std::move(hashedPassword)]() {
+                    Storage::instance().createUser(
+                        username, email, hashedPassword, TimeUtil::getCurrentTimestamp(),
+                        [cb](Storage::Status status, int64_t userId) {
+                            switch (status) {
+                            case Storage::Status::Ok:
+                                (*cb)({AuthStatus::Ok, std::to_string(userId)});
+                                break;
+                            case Storage::Status::UsernameTaken:
+                                (*cb)({AuthStatus::Failed, "Username already exists"});
+                                break;
+                            case Storage::Status::EmailTaken:
+                                (*cb)({AuthStatus::Failed, "Email already exists"});
+                                break;
+                            default:
+                                (*cb)({AuthStatus::Failed, "Database error"});
+                                break;
+                            }
+                        });
+                });
+            });
+        if (!queued) {
+            (*cb)({AuthStatus::Busy, "Server busy, please retry"});
         }
     }
 
-    std::pair<bool, std::string> UserService::loginUser(const std::string& username, 
-                                                       const std::string& password) {
+    void UserService::loginUser(const std::string& username, 
+                                const std::string& password,
+                                AuthCallback&& callback) {
         if (username.empty() || password.empty()) {
-            return {false, "Username and password are required"};
+            callback({AuthStatus::Failed, "Username and password are required"});
+            return;
         }
 
-        try {
-            // Find user by username
-            auto result = dbClient->execSqlSync(
-                "SELECT id, password_hash FROM users WHERE username = $1 AND is_active = true", 
-                username
-            );
-
-            if (result.size() == 0) {
-                return {false, "Invalid username or password"};
+        auto cb = std::make_shared<AuthCallback>(std::move(callback));
+        auto* loop = callerLoop();
+        auto verify = [cb, password, loop](User&& user) {
+            int64_t userId = user.id;
+            bool queued = PasswordHasher::instance().verify(password, std::move(user.password_hash),
+                [cb, userId, password, loop](bool match, bool needsRehash) {
+                    loop->queueInLoop([cb, userId, password, match, needsRehash]() {
+                        if (!match) {
+                            (*cb)({AuthStatus::Failed, "Invalid username or password"});
+                            return;
+                        }
+                        (*cb)({AuthStatus::Ok, std::to_string(userId)});
+                        if (needsRehash) {
+                            rehashPassword(userId, password);
+                        }
+                    });
+                });
+            if (!queued) {
+                (*cb)({AuthStatus::Busy, "Server busy, please retry"});
             }
+        };
 
-            auto userId = result[0]["id"].as<int64_t>();
-            auto storedHash = result[0]["password_hash"].as<std::string>();
-
-            // Verify password
-            if (verifyPassword(password, storedHash)) {
-                return {true, std::to_string(userId)};
-            } else {
-                return {false, "Invalid username or password"};
-            }
-        } catch (const std::exception& e) {
-            LOG_ERROR << "Error logging in user: " << e.what();
-            return {false, "Database error: " + std::string(e.what())};
+        auto& cache = UserCache::instance();
+        User cached;
+        if (cache.findByName(username, cached)) {
+            verify(std::move(cached));
+            return;
         }
+
+        // Find user by username
+        uint64_t generation = cache.generation();
+        Storage::instance().findUserByName(
+            username,
+            [cb, verify, password, loop, generation](Storage::Status status, User&& user) {
+                if (status == Storage::Status::Error) {
+                    (*cb)({AuthStatus::Failed, "Database error"});
+                    return;
+                }
+                if (status != Storage::Status::Ok) {
+                    // 用户不存在时同样花一次 scrypt 的时间，避免按响应时间枚举用户名
+                    bool queued = PasswordHasher::instance().verifyDummy(password, [cb, loop](bool, bool) {
+                        loop->queueInLoop([cb]() {
+                            (*cb)({AuthStatus::Failed, "Invalid username or password"});
+                        });
+                    });
+                    if (!queued) {
+                        (*cb)({AuthStatus::Busy, "Server busy, please retry"});
+                    }
+                    return;
+                }
+                UserCache::instance().insert(user, generation);
+                verify(std::move(user));
+            });
     }
 
-    bool UserService::validateEmail(const std::string& email) {
-        const std::regex pattern(R"(^[a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,}$)");
-        return std::regex_match(email, pattern);
+    void UserService::setUserActive(int64_t userId, bool active, std::function<void(bool)>&& callback) {
+        Storage::instance().setUserActive(userId, active,
+            [userId, active, callback = std::move(callback)](bool ok) {
+                if (ok) {
+                    UserCache::instance().invalidate(userId);
+                    if (!active) {
+                        SessionStore::instance().revokeUser(userId);
+                    }
+                }
+                callback(ok);
+            });
     }
 
-    std::string UserService::hashPassword(const std::string& password) {
-        // In a real application, you would use a secure hashing algorithm like bcrypt
-        // For this example, we'll use a simple hash (not suitable for production)
-        return "hashed_" + password; // Placeholder for actual hashing
+    void UserService::rehashPassword(int64_t userId, const std::string& password) {
+        // 线程池排满时放弃，下次登录再换
+        auto* loop = callerLoop();
+        PasswordHasher::instance().hash(password, [userId, loop](bool ok, std::string&& hash) {
+            if (!ok) {
+                return;
+            }
+            loop->queueInLoop([userId, hash = std::move(hash)]() {
+                Storage::instance().updatePasswordHash(userId, hash, [userId](bool updated) {
+                    if (updated) {
+                        UserCache::instance().invalidate(userId);
+                        PasswordHasher::instance().recordRehash();
+                    } else {
+                        LOG_WARN << "Failed to store rehashed password of user " << userId;
+                    }
+                });
+            });
+        });
     }
 
-    bool UserService::verifyPassword(const std::string& password, const std::string& hash) {
-        // In a real application, you would use a secure password verification function
-        return hashPassword(password) == hash;
+    bool UserService::validateEmail(const std::string& email) {
+        return EmailUtil::isValid(email);
     }
-}
\ No newline at end of file
+}
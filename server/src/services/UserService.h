@@ -2,28 +2,53 @@
 
 #include "../models/User.h"
 #include "../utils/TimeUtil.h"
+#include <functional>
 #include <string>
-#include <tuple>
-#include <regex>
-#include <drogon/orm/DbClient.h>
-
-using namespace drogon::orm;
 
 namespace im_server
 {
+    // registerUser / loginUser 异步执行，口令哈希和校验在 PasswordHasher 的线程池上完成，
+    // 完成后回到调用线程的事件循环再访问数据库和执行回调。
+    // 回调中 Ok 时 value 为 user id，其余为错误信息；Busy 表示哈希线程池排满，调用方应返回 503。
+    // loginUser 先查 UserCache，未命中才查询 users 表；用户不存在时也做一次同等代价的校验
     class UserService
     {
     public:
-        std::pair<bool, std::string> registerUser(const std::string &username,
-                                                  const std::string &password,
-                                                  const std::string &email);
-        std::pair<bool, std::string> loginUser(const std::string &username,
-                                               const std::string &password);
+        enum class AuthStatus
+        {
+            Ok,
+            Failed,
+            Busy
+        };
+
+        struct AuthResult
+        {
+            AuthStatus status;
+            std::string value;
+        };
+
+        // 进程内唯一实例，底层存储见 Storage
+        static UserService &instance();
+
+        using AuthCallback = std::function<void(AuthResult &&)>;
+
+        void registerUser(const std::string &username,
+                          const std::string &password,
+                          const std::string &email,
+                          AuthCallback &&callback);
+        void loginUser(const std::string &username,
+                       const std::string &password,
+                       AuthCallback &&callback);
         bool validateEmail(const std::string &email);
-        std::string hashPassword(const std::string &password);
-        bool verifyPassword(const std::string &password, const std::string &hash);
+
+        // 修改 is_active。成功后使本节点 UserCache 中的记录失效；停用时同时作废该用户的全部 refresh token，
+        // 已签发的 access token 在过期（SessionStore::accessTtl）前仍然有效
+        void setUserActive(int64_t userId, bool active, std::function<void(bool)> &&callback);
 
     private:
-        DbClientPtr dbClient = DbClient::newMysqlClient("host=localhost port=3306 user=root password=password dbname=im_db", 4);
+        UserService() = default;
+
+        // 口令校验通过但哈希参数已过时，按当前参数重新哈希并回写
+        static void rehashPassword(int64_t userId, const std::string &password);
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include "CommandParser.h"
+#include "TimeUtil.h"
+#include "../models/Message.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace im_server
+{
+    // /ws/chat 的二进制帧格式（WebSocket binary frame），连接时通过 ?proto=bin
+    // 或 Sec-WebSocket-Protocol: im.bin.v1 协商。
+    // 帧首字节是类型，之后依次是字段：id 为 LEB128 无符号 varint，字符串为 varint 长度 + 原始字节。
+    //
+    //   上行  0x01 message       to, client_msg_id, content
+    //         0x02 read_receipt  from, up_to_id, message_id（0 表示没有）
+    //         0x03 ack           last_id
+    //         0x04 room_message  room_id, client_msg_id, content
+    //         0x05 presence_subscribe  count, count × user_id
+    //         0x06 typing        to
+    //   下行  0x80 connected
+    //         0x81 message       id, from, timestamp, content
+    //         0x82 message_ack   id, success(1 字节), client_msg_id
+    //         0x83 sync_batch    has_more(1 字节), count, count × (id, from, message_type, timestamp, content)
+    //         0x84 room_message  id, room_id, from, timestamp, content
+    //         0x85 evicted       resume_after
+    //         0x86 presence      user, online(1 字节)
+    //         0x87 typing        from
+    //
+    // 编码结果与 FrameEncoder 一样写在每个线程复用的缓冲区里，返回的 string_view
+    // 在同一线程下一次二进制编码前有效。
+    class BinaryProtocol
+    {
+    public:
+        static constexpr const char *kSubprotocol = "im.bin.v1";
+
+        enum Opcode : uint8_t
+        {
+            kMessage = 0x01,
+            kReadReceipt = 0x02,
+            kAck = 0x03,
+            kRoomMessage = 0x04,
+            kPresenceSubscribe = 0x05,
+            kTyping = 0x06,
+            kConnected = 0x80,
+            kMessageOut = 0x81,
+            kMessageAck = 0x82,
+            kSyncBatch = 0x83,
+            kRoomMessageOut = 0x84,
+            kEvicted = 0x85,
+            kPresence = 0x86,
+            kTypingOut = 0x87
+        };
+
+        static CommandParser::Status decode(std::string_view frame, ChatCommand &command)
+        {
+            Reader in(frame);
+            uint8_t opcode;
+            if (!in.byte(opcode))
+                return CommandParser::Status::Malformed;
+
+            bool ok;
+            switch (opcode)
+            {
+            case kMessage:
+                command.type = CommandType::Message;
+                ok = in.id(command.to) && in.bytes(command.clientMsgId) && in.bytes(command.content);
+                break;
+            case kRoomMessage:
+                command.type = CommandType::Message;
+                ok = in.id(command.roomId) && in.bytes(command.clientMsgId) && in.bytes(command.content);
+                break;
+            case kReadReceipt:
+                command.type = CommandType::ReadReceipt;
+                ok = in.id(command.from) && in.id(command.upToId) && in.id(command.messageId);
+                break;
+            case kAck:
+                command.type = CommandType::Ack;
+                ok = in.id(command.lastId);
+                break;
+            case kTyping:
+                command.type = CommandType::Typing;
+                ok = in.id(command.to);
+                break;
+            case kPresenceSubscribe:
+            {
+                command.type = CommandType::PresenceSubscribe;
+                uint64_t count;
+                // 每个 id 至少 1 字节，先按剩余长度校验 count 再分配
+                ok = in.varint(count) && count <= in.remaining();
+                if (ok)
+                    command.users.reserve(count);
+                for (uint64_t i = 0; ok && i < count; ++i)
+                {
+                    int64_t id;
+                    ok = in.id(id);
+                    if (ok)
+                        command.users.push_back(id);
+                }
+                break;
+            }
+            default:
+                return CommandParser::Status::UnknownType;
+            }
+            return ok && in.done() ? CommandParser::Status::Ok : CommandParser::Status::Malformed;
+        }
+
+        static std::string_view encodeConnected()
+        {
+            auto &out = buffer();
+            out.push_back(static_cast<char>(kConnected));
+            return out;
+        }
+
+        static std::string_view encodeMessage(int64_t id, int64_t from, std::string_view content,
+                                              int64_t timestamp)
+        {
+            auto &out = buffer();
+            out.push_back(static_cast<char>(kMessageOut));
+            appendVarint(out, static_cast<uint64_t>(id));
+            appendVarint(out, static_cast<uint64_t>(from));
+            appendTimestamp(out, timestamp);
+            appendBytes(out, content);
+            return out;
+        }
+
+        static std::string_view encodeRoomMessage(int64_t id, int64_t roomId, int64_t from,
+                                                  std::string_view content, int64_t timestamp)
+        {
+            auto &out = buffer();
+            out.push_back(static_cast<char>(kRoomMessageOut));
+            appendVarint(out, static_cast<uint64_t>(id));
+            appendVarint(out, static_cast<uint64_t>(roomId));
+            appendVarint(out, static_cast<uint64_t>(from));
+            appendTimestamp(out, timestamp);
+            appendBytes(out, content);
+            return out;
+        }
+
+        static std::string_view encodeMessageAck(int64_t id, std::string_view clientMsgId, bool success)
+        {
+            auto &out = buffer();
+            out.push_back(static_cast<char>(kMessageAck));
+            appendVarint(out, static_cast<uint64_t>(id));
+            out.push_back(success ? 1 : 0);
+            appendBytes(out, clientMsgId);
+            return out;
+        }
+
+        // success 字节为 2 表示 busy，id 为 0
+        static std::string_view encodeMessageBusy(std::string_view clientMsgId)
+        {
+            auto &out = buffer();
+            out.push_back(static_cast<char>(kMessageAck));
+            appendVarint(out, 0);
+            out.push_back(2);
+            appendBytes(out, clientMsgId);
+            return out;
+        }
+
+        // 同 FrameEncoder::encodeEvicted，不复用线程缓冲区
+        static std::string encodeEvicted(int64_t resumeAfter)
+        {
+            std::string out;
+            out.push_back(static_cast<char>(kEvicted));
+            appendVarint(out, static_cast<uint64_t>(resumeAfter));
+            return out;
+        }
+
+        static std::string_view encodePresence(int64_t userId, bool online)
+        {
+            auto &out = buffer();
+            out.push_back(static_cast<char>(kPresence));
+            appendVarint(out, static_cast<uint64_t>(userId));
+            out.push_back(online ? 1 : 0);
+            return out;
+        }
+
+        static std::string_view encodeTyping(int64_t from)
+        {
+            auto &out = buffer();
+            out.push_back(static_cast<char>(kTypingOut));
+            appendVarint(out, static_cast<uint64_t>(from));
+            return out;
+        }
+
+        static std::string_view encodeSyncBatch(const std::vector<Message> &messages, bool hasMore)
+        {
+            auto &out = buffer();
+            out.push_back(static_cast<char>(kSyncBatch));
+            out.push_back(hasMore ? 1 : 0);
+            appendVarint(out, messages.size());
+            for (const auto &msg : messages)
+            {
+                appendVarint(out, static_cast<uint64_t>(msg.id));
+                appendVarint(out, static_cast<uint64_t>(msg.sender_id));
+                appendBytes(out, messageTypeName(msg.message_type));
+                appendTimestamp(out, msg.timestamp);
+                appendBytes(out, msg.content);
+            }
+            return out;
+        }
+
+        // 线路上仍是 "YYYY-MM-DD HH:MM:SS.mmm" 字符串，与 JSON 帧一致
+        static void appendTimestamp(std::string &out, int64_t epochMillis)
+        {
+            out.push_back(static_cast<char>(TimeUtil::kTimestampLength));
+            auto offset = out.size();
+            out.resize(offset + TimeUtil::kTimestampLength);
+            TimeUtil::formatMillis(epochMillis, &out[offset]);
+        }
+
+        static void appendVarint(std::string &out, uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+        static void appendBytes(std::string &out, std::string_view value)
+        {
+            appendVarint(out, value.size());
+            out.append(value.data(), value.size());
+        }
+
+        // 按上面的字段编码顺序读取，越界或 varint 过长时返回 false
+        class Reader
+        {
+        public:
+            explicit Reader(std::string_view data)
+                : p_(reinterpret_cast<const uint8_t *>(data.data())), end_(p_ + data.size()) {}
+
+            bool byte(uint8_t &out)
+            {
+                if (p_ == end_)
+                    return false;
+                out = *p_++;
+                return true;
+            }
+
+            bool varint(uint64_t &out)
+            {
+                out = 0;
+                for (int shift = 0; shift < 64 && p_ != end_; shift += 7)
+                {
+                    uint8_t b = *p_++;
+                    out |= static_cast<uint64_t>(b & 0x7F) << shift;
+                    if (!(b & 0x80))
+                        return true;
+                }
+                return false;
+            }
+
+            // id 是正的 int64，超出范围的视为格式错误
+            bool id(int64_t &out)
+            {
+                uint64_t value;
+                if (!varint(value) || value > static_cast<uint64_t>(INT64_MAX))
+                    return false;
+                out = static_cast<int64_t>(value);
+                return true;
+            }
+
+            bool bytes(std::string_view &out)
+            {
+                uint64_t size;
+                if (!varint(size) || size > static_cast<uint64_t>(end_ - p_))
+                    return false;
+                out = std::string_view(reinterpret_cast<const char *>(p_), size);
+                p_ += size;
+                return true;
+            }
+
+            bool done() const { return p_ == end_; }
+            size_t remaining() const { return static_cast<size_t>(end_ - p_); }
+
+        private:
+            const uint8_t *p_;
+            const uint8_t *end_;
+        };
+
+    private:
+        static constexpr size_t kInitialCapacity = 4096;
+
+        static std::string &buffer()
+        {
+            thread_local std::string out = [] {
+                std::string s;
+                s.reserve(kInitialCapacity);
+                return s;
+            }();
+            out.clear();
+            return out;
+        }
+    };
+}
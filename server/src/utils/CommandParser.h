@@ -0,0 +1,521 @@
+#pragma once
+
+#include <json/json.h>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace im_server
+{
+    enum class CommandType
+    {
+        Unknown,
+        Message,
+        ReadReceipt,
+        Ack,
+        PresenceSubscribe,
+        Typing
+    };
+
+    // 上行 WebSocket 命令中用到的字段，与线路格式（JSON / 二进制）无关。
+    // id 为 0 表示没有该字段；字符串是指向帧缓冲区的 string_view
+    struct ChatCommand
+    {
+        CommandType type = CommandType::Unknown;
+        int64_t to = 0;
+        int64_t roomId = 0; // 群聊消息用 room_id 代替 to
+        int64_t messageId = 0;
+        int64_t from = 0;
+        int64_t upToId = 0;
+        int64_t lastId = 0;
+        std::string_view content;
+        std::string_view clientMsgId;
+        std::vector<int64_t> users; // presence_subscribe 的订阅列表
+
+        // 回退到 jsoncpp 解析时字符串字段存放在这里
+        std::array<std::string, 2> owned;
+    };
+
+    // 按需解析上行 JSON 命令：只扫描一遍帧，提取已知字段，不构建 JSON DOM。
+    // 扫描成功后字符串在原缓冲区内就地反转义，结果直接指向 std::string &&message 的内存。
+    // 遇到嵌套对象 / 数组或 \u 转义时回退到线程内复用的 Json::CharReader。
+    class CommandParser
+    {
+    public:
+        enum class Status
+        {
+            Ok,
+            Malformed,
+            UnknownType
+        };
+
+        static Status parse(std::string &frame, ChatCommand &command)
+        {
+            FastParser parser(frame.data(), frame.data() + frame.size(), command);
+            switch (parser.run())
+            {
+            case FastResult::Ok:
+                return command.type == CommandType::Unknown ? Status::UnknownType : Status::Ok;
+            case FastResult::UnknownType:
+                return Status::UnknownType;
+            case FastResult::Malformed:
+                return Status::Malformed;
+            case FastResult::NeedFallback:
+                break;
+            }
+            command = ChatCommand();
+            return parseWithJsoncpp(frame, command);
+        }
+
+        static bool toInt64(std::string_view value, int64_t &out)
+        {
+            if (value.empty())
+                return false;
+            auto result = std::from_chars(value.data(), value.data() + value.size(), out);
+            return result.ec == std::errc() && result.ptr == value.data() + value.size();
+        }
+
+    private:
+        enum class FastResult
+        {
+            Ok,
+            Malformed,
+            UnknownType,
+            NeedFallback
+        };
+
+        static CommandType typeFromName(std::string_view name)
+        {
+            if (name == "message")
+                return CommandType::Message;
+            if (name == "read_receipt")
+                return CommandType::ReadReceipt;
+            if (name == "ack")
+                return CommandType::Ack;
+            if (name == "typing")
+                return CommandType::Typing;
+            if (name == "presence_subscribe")
+                return CommandType::PresenceSubscribe;
+            return CommandType::Unknown;
+        }
+
+        enum class Field
+        {
+            None,
+            Content,
+            ClientMsgId,
+            To,
+            RoomId,
+            MessageId,
+            From,
+            UpToId,
+            LastId,
+            Users
+        };
+
+        static Field fieldFromKey(std::string_view key)
+        {
+            switch (key.size())
+            {
+            case 2:
+                if (key == "to")
+                    return Field::To;
+                break;
+            case 4:
+                if (key == "from")
+                    return Field::From;
+                break;
+            case 5:
+                if (key == "users")
+                    return Field::Users;
+                break;
+            case 7:
+                if (key == "content")
+                    return Field::Content;
+                if (key == "last_id")
+                    return Field::LastId;
+                if (key == "room_id")
+                    return Field::RoomId;
+                break;
+            case 8:
+                if (key == "up_to_id")
+                    return Field::UpToId;
+                break;
+            case 10:
+                if (key == "message_id")
+                    return Field::MessageId;
+                break;
+            case 13:
+                if (key == "client_msg_id")
+                    return Field::ClientMsgId;
+                break;
+            }
+            return Field::None;
+        }
+
+        static std::string_view *stringSlot(ChatCommand &command, Field field)
+        {
+            return field == Field::Content ? &command.content : &command.clientMsgId;
+        }
+
+        static int64_t *idSlot(ChatCommand &command, Field field)
+        {
+            switch (field)
+            {
+            case Field::To:
+                return &command.to;
+            case Field::RoomId:
+                return &command.roomId;
+            case Field::MessageId:
+                return &command.messageId;
+            case Field::From:
+                return &command.from;
+            case Field::UpToId:
+                return &command.upToId;
+            default:
+                return &command.lastId;
+            }
+        }
+
+        // id 可以是 JSON 数字或数字字符串，空值 / null 视为没有
+        static bool assignId(ChatCommand &command, Field field, std::string_view value)
+        {
+            int64_t *slot = idSlot(command, field);
+            if (value.empty())
+            {
+                *slot = 0;
+                return true;
+            }
+            return toInt64(value, *slot);
+        }
+
+        class FastParser
+        {
+        public:
+            FastParser(char *begin, char *end, ChatCommand &command)
+                : p_(begin), end_(end), command_(command) {}
+
+            FastResult run()
+            {
+                skipSpace();
+                if (p_ == end_ || *p_ != '{')
+                    return FastResult::Malformed;
+                ++p_;
+
+                skipSpace();
+                if (p_ != end_ && *p_ == '}')
+                    return finish();
+
+                while (true)
+                {
+                    skipSpace();
+                    std::string_view key;
+                    bool escaped;
+                    auto result = parseString(key, escaped);
+                    if (result != FastResult::Ok)
+                        return result;
+                    // 字段名里的转义交给 jsoncpp
+                    if (escaped)
+                        return FastResult::NeedFallback;
+
+                    skipSpace();
+                    if (p_ == end_ || *p_ != ':')
+                        return FastResult::Malformed;
+                    ++p_;
+                    skipSpace();
+
+                    std::string_view value;
+                    result = parseValue(value, escaped);
+                    if (result != FastResult::Ok)
+                        return result;
+
+                    if (key == "type")
+                    {
+                        // 已知类型名都不含需要转义的字符，带转义的一定是未知类型
+                        command_.type = typeFromName(escaped ? std::string_view() : value);
+                        // 未知类型立即拒绝，不再扫描剩余字段
+                        if (command_.type == CommandType::Unknown)
+                            return FastResult::UnknownType;
+                    }
+                    else
+                    {
+                        auto field = fieldFromKey(key);
+                        if (field == Field::Content || field == Field::ClientMsgId)
+                        {
+                            *stringSlot(command_, field) = value;
+                            auto bit = 1u << static_cast<unsigned>(field);
+                            escapedFields_ = escaped ? (escapedFields_ | bit) : (escapedFields_ & ~bit);
+                        }
+                        else if (field == Field::Users)
+                        {
+                            // 数组会回退到 jsoncpp，走到这里说明不是数组
+                            if (!value.empty())
+                                return FastResult::Malformed;
+                        }
+                        else if (field != Field::None)
+                        {
+                            // 数字不需要转义
+                            if (escaped || !assignId(command_, field, value))
+                                return FastResult::Malformed;
+                        }
+                    }
+
+                    skipSpace();
+                    if (p_ == end_)
+                        return FastResult::Malformed;
+                    if (*p_ == ',')
+                    {
+                        ++p_;
+                        continue;
+                    }
+                    if (*p_ == '}')
+                        return finish();
+                    return FastResult::Malformed;
+                }
+            }
+
+        private:
+            FastResult finish()
+            {
+                ++p_;
+                skipSpace();
+                if (p_ != end_)
+                    return FastResult::Malformed;
+
+                for (auto field : {Field::Content, Field::ClientMsgId})
+                {
+                    if (escapedFields_ & (1u << static_cast<unsigned>(field)))
+                    {
+                        auto *slot = stringSlot(command_, field);
+                        *slot = unescape(*slot);
+                    }
+                }
+                return FastResult::Ok;
+            }
+
+            void skipSpace()
+            {
+                while (p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+                    ++p_;
+            }
+
+            // 找到下一个 '"' 或 '\\'，SSE2 下每次比较 16 字节
+            char *findQuoteOrEscape(char *p)
+            {
+#if defined(__SSE2__)
+                const __m128i quote = _mm_set1_epi8('"');
+                const __m128i backslash = _mm_set1_epi8('\\');
+                while (end_ - p >= 16)
+                {
+                    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                              _mm_cmpeq_epi8(chunk, backslash)));
+                    if (mask != 0)
+                        return p + __builtin_ctz(static_cast<unsigned>(mask));
+                    p += 16;
+                }
+#endif
+                while (p != end_ && *p != '"' && *p != '\\')
+                    ++p;
+                return p;
+            }
+
+            // 扫描字符串，out 指向引号内的原始内容；只校验转义，不改写缓冲区，
+            // 这样回退到 jsoncpp 时帧仍然是原样
+            FastResult parseString(std::string_view &out, bool &escaped)
+            {
+                if (p_ == end_ || *p_ != '"')
+                    return FastResult::Malformed;
+                char *start = ++p_;
+                escaped = false;
+
+                while (true)
+                {
+                    p_ = findQuoteOrEscape(p_);
+                    if (p_ == end_)
+                        return FastResult::Malformed;
+                    if (*p_ == '"')
+                    {
+                        out = std::string_view(start, p_ - start);
+                        ++p_;
+                        return FastResult::Ok;
+                    }
+
+                    if (end_ - p_ < 2)
+                        return FastResult::Malformed;
+                    switch (p_[1])
+                    {
+                    case '"':
+                    case '\\':
+                    case '/':
+                    case 'b':
+                    case 'f':
+                    case 'n':
+                    case 'r':
+                    case 't':
+                        break;
+                    case 'u':
+                        return FastResult::NeedFallback;
+                    default:
+                        return FastResult::Malformed;
+                    }
+                    escaped = true;
+                    p_ += 2;
+                }
+            }
+
+            // 整帧扫描成功后再就地反转义，结果只会变短
+            static std::string_view unescape(std::string_view raw)
+            {
+                char *begin = const_cast<char *>(raw.data());
+                char *write = begin;
+                for (size_t i = 0; i < raw.size(); ++i)
+                {
+                    char c = raw[i];
+                    if (c == '\\')
+                    {
+                        switch (raw[++i])
+                        {
+                        case 'b':
+                            c = '\b';
+                            break;
+                        case 'f':
+                            c = '\f';
+                            break;
+                        case 'n':
+                            c = '\n';
+                            break;
+                        case 'r':
+                            c = '\r';
+                            break;
+                        case 't':
+                            c = '\t';
+                            break;
+                        default:
+                            c = raw[i];
+                        }
+                    }
+                    *write++ = c;
+                }
+                return std::string_view(begin, write - begin);
+            }
+
+            FastResult parseValue(std::string_view &out, bool &escaped)
+            {
+                escaped = false;
+                if (p_ == end_)
+                    return FastResult::Malformed;
+
+                switch (*p_)
+                {
+                case '"':
+                    return parseString(out, escaped);
+                case '{':
+                case '[':
+                    return FastResult::NeedFallback;
+                case 't':
+                    return parseLiteral("true", out);
+                case 'f':
+                    return parseLiteral("false", out);
+                case 'n':
+                    // null 视为缺省
+                    {
+                        auto result = parseLiteral("null", out);
+                        out = std::string_view();
+                        return result;
+                    }
+                default:
+                {
+                    char *start = p_;
+                    while (p_ != end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '-' || *p_ == '+' ||
+                                          *p_ == '.' || *p_ == 'e' || *p_ == 'E'))
+                        ++p_;
+                    if (p_ == start)
+                        return FastResult::Malformed;
+                    out = std::string_view(start, p_ - start);
+                    return FastResult::Ok;
+                }
+                }
+            }
+
+            FastResult parseLiteral(std::string_view literal, std::string_view &out)
+            {
+                if (static_cast<size_t>(end_ - p_) < literal.size() ||
+                    std::memcmp(p_, literal.data(), literal.size()) != 0)
+                    return FastResult::Malformed;
+                out = std::string_view(p_, literal.size());
+                p_ += literal.size();
+                return FastResult::Ok;
+            }
+
+            char *p_;
+            char *end_;
+            ChatCommand &command_;
+            unsigned escapedFields_ = 0;
+        };
+
+        static Status parseWithJsoncpp(const std::string &frame, ChatCommand &command)
+        {
+            thread_local std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+
+            Json::Value json;
+            std::string errors;
+            if (!reader->parse(frame.data(), frame.data() + frame.size(), &json, &errors) || !json.isObject())
+                return Status::Malformed;
+
+            // asString() 遇到对象 / 数组会抛异常；非字符串的 type 与快速路径一样按未知类型处理
+            const auto &type = json["type"];
+            command.type = type.isString() ? typeFromName(type.asString()) : CommandType::Unknown;
+            if (command.type == CommandType::Unknown)
+                return Status::UnknownType;
+
+            try
+            {
+                for (const auto &key : json.getMemberNames())
+                {
+                    auto field = fieldFromKey(key);
+                    const auto &value = json[key];
+                    if (field == Field::None || value.isNull())
+                        continue;
+                    if (field == Field::Users)
+                    {
+                        if (!value.isArray())
+                            return Status::Malformed;
+                        command.users.reserve(value.size());
+                        for (const auto &item : value)
+                        {
+                            int64_t id;
+                            if (!toInt64(item.asString(), id) || id <= 0)
+                                return Status::Malformed;
+                            command.users.push_back(id);
+                        }
+                    }
+                    else if (field == Field::Content || field == Field::ClientMsgId)
+                    {
+                        auto &owned = command.owned[field == Field::Content ? 0 : 1];
+                        owned = value.asString();
+                        *stringSlot(command, field) = owned;
+                    }
+                    else if (!assignId(command, field, value.asString()))
+                    {
+                        return Status::Malformed;
+                    }
+                }
+            }
+            catch (const std::exception &)
+            {
+                // 已知字段的值是对象或数组
+                return Status::Malformed;
+            }
+            return Status::Ok;
+        }
+    };
+}
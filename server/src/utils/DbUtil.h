@@ -0,0 +1,54 @@
+#pragma once
+
+#include <drogon/HttpAppFramework.h>
+#include <drogon/orm/DbClient.h>
+#include "Metrics.h"
+#include <string>
+
+namespace im_server
+{
+    // 所有 Service 共用 config.json 里 db_clients 声明的连接池，不再各自建池。
+    // 通过 custom_config.database 选择：
+    //   "client_name"     : db_clients 中的 name，默认 "default"
+    //   "use_fast_client" : 对应的 db_clients 项设置了 "is_fast": true 时置 true，
+    //                       此时每个 IO 线程各有 connection_number 条连接，只能在 IO 线程上取用
+    class DbUtil
+    {
+    public:
+        static drogon::orm::DbClientPtr getClient()
+        {
+            static const Settings settings = loadSettings();
+            if (settings.useFastClient)
+            {
+                return drogon::app().getFastDbClient(settings.clientName);
+            }
+            return drogon::app().getDbClient(settings.clientName);
+        }
+
+        // 按调用方法区分的查询耗时 im_db_query_seconds{method="..."}，调用处缓存在函数内 static 变量中
+        static Metrics::Histogram &queryLatency(const char *method)
+        {
+            return Metrics::instance().histogram("im_db_query_seconds", "Database query latency by service method",
+                                                 std::string("method=\"") + method + "\"");
+        }
+
+    private:
+        struct Settings
+        {
+            std::string clientName = "default";
+            bool useFastClient = false;
+        };
+
+        static Settings loadSettings()
+        {
+            Settings settings;
+            const auto &database = drogon::app().getCustomConfig()["database"];
+            if (database.isObject())
+            {
+                settings.clientName = database.get("client_name", settings.clientName).asString();
+                settings.useFastClient = database.get("use_fast_client", settings.useFastClient).asBool();
+            }
+            return settings;
+        }
+    };
+}
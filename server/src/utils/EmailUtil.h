@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace im_server
+{
+    // 注册时的邮箱格式检查，与原来的 ^[a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,}$ 等价：
+    // 本地部分和域名各自只含允许的字符，域名最后一个 '.' 之后是至少两个字母。
+    // 不用 std::regex，每个字符查一次编译期生成的表。
+    class EmailUtil
+    {
+    public:
+        static constexpr size_t kMaxLength = 254;
+
+        static bool isValid(std::string_view email)
+        {
+            if (email.size() > kMaxLength)
+                return false;
+            const auto &table = chars();
+            auto at = email.find('@');
+            if (at == 0 || at == std::string_view::npos)
+                return false;
+            for (size_t i = 0; i < at; ++i)
+            {
+                if (!(table[static_cast<unsigned char>(email[i])] & kLocalChar))
+                    return false;
+            }
+            auto dot = email.rfind('.');
+            if (dot == std::string_view::npos || dot <= at + 1 || email.size() - dot - 1 < 2)
+                return false;
+            for (size_t i = at + 1; i < email.size(); ++i)
+            {
+                auto flags = table[static_cast<unsigned char>(email[i])];
+                if (!(flags & (i > dot ? kAlpha : kDomainChar)))
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        static constexpr uint8_t kAlpha = 1;
+        static constexpr uint8_t kLocalChar = 2;
+        static constexpr uint8_t kDomainChar = 4;
+
+        // 每个字节可以出现在邮箱哪一部分
+        static constexpr std::array<uint8_t, 256> makeChars()
+        {
+            std::array<uint8_t, 256> table{};
+            for (int c = 0; c < 256; ++c)
+            {
+                bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+                bool alnum = alpha || (c >= '0' && c <= '9');
+                uint8_t flags = 0;
+                if (alpha)
+                    flags |= kAlpha;
+                if (alnum || c == '.' || c == '_' || c == '%' || c == '+' || c == '-')
+                    flags |= kLocalChar;
+                if (alnum || c == '.' || c == '-')
+                    flags |= kDomainChar;
+                table[c] = flags;
+            }
+            return table;
+        }
+
+        static const std::array<uint8_t, 256> &chars()
+        {
+            static constexpr std::array<uint8_t, 256> table = makeChars();
+            return table;
+        }
+    };
+}
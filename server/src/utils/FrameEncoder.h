@@ -0,0 +1,272 @@
+#pragma once
+
+#include "TimeUtil.h"
+#include "../models/Message.h"
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace im_server
+{
+    // 固定结构的下行帧直接拼接成 JSON 文本，不经过 Json::Value / StreamWriterBuilder。
+    // 结果写在每个线程复用的缓冲区里，返回的 string_view 在同一线程下一次编码前有效；
+    // 一条消息只编码一次，再原样发给接收方的所有设备（WebSocketConnection::send 会拷贝数据）。
+    class FrameEncoder
+    {
+    public:
+        // {"type":"message","id":"..","from":"..","content":"..","timestamp":".."}
+        static std::string_view encodeMessage(int64_t id, int64_t from, std::string_view content,
+                                              int64_t timestamp)
+        {
+            auto &out = buffer();
+            out.append(kMessagePrefix);
+            appendMessageFields(out, id, from, content, timestamp);
+            out.push_back('}');
+            return out;
+        }
+
+        // {"type":"message","id":"..","room_id":"..","from":"..","content":"..","timestamp":".."}
+        static std::string_view encodeRoomMessage(int64_t id, int64_t roomId, int64_t from,
+                                                  std::string_view content, int64_t timestamp)
+        {
+            auto &out = buffer();
+            out.append(kMessagePrefix);
+            appendInt(out, id);
+            out.append(R"(","room_id":")");
+            appendInt(out, roomId);
+            out.append(R"(","from":")");
+            appendInt(out, from);
+            out.append(R"(","content":")");
+            appendEscaped(out, content);
+            out.append(R"(","timestamp":")");
+            appendTimestamp(out, timestamp);
+            out.append(R"("})");
+            return out;
+        }
+
+        // {"type":"message_ack","id":"..","client_msg_id":"..","success":true}
+        static std::string_view encodeMessageAck(int64_t id, std::string_view clientMsgId, bool success)
+        {
+            auto &out = buffer();
+            out.append(R"({"type":"message_ack","id":")");
+            appendInt(out, id);
+            out.append(R"(","client_msg_id":")");
+            appendEscaped(out, clientMsgId);
+            out.append(success ? R"(","success":true})" : R"(","success":false})");
+            return out;
+        }
+
+        // {"type":"message_ack","id":"0","client_msg_id":"..","success":false,"error":"busy"}
+        // 服务端写入队列已满，消息没有被接受也没有转发，客户端稍后重发
+        static std::string_view encodeMessageBusy(std::string_view clientMsgId)
+        {
+            auto &out = buffer();
+            out.append(R"({"type":"message_ack","id":"0","client_msg_id":")");
+            appendEscaped(out, clientMsgId);
+            out.append(R"(","success":false,"error":"busy"})");
+            return out;
+        }
+
+        // {"type":"presence","user":"..","status":"online"|"offline"}
+        static std::string_view encodePresence(int64_t userId, bool online)
+        {
+            auto &out = buffer();
+            out.append(R"({"type":"presence","user":")");
+            appendInt(out, userId);
+            out.append(online ? R"(","status":"online"})" : R"(","status":"offline"})");
+            return out;
+        }
+
+        // {"type":"typing","from":".."}
+        static std::string_view encodeTyping(int64_t from)
+        {
+            auto &out = buffer();
+            out.append(R"({"type":"typing","from":")");
+            appendInt(out, from);
+            out.append(R"("})");
+            return out;
+        }
+
+        // {"type":"evicted","resume_after":".."}
+        // 在投递循环中途触发，调用方可能还持有指向 buffer() 的帧，这里不复用线程缓冲区
+        static std::string encodeEvicted(int64_t resumeAfter)
+        {
+            std::string out;
+            out.append(R"({"type":"evicted","resume_after":")");
+            appendInt(out, resumeAfter);
+            out.append(R"("})");
+            return out;
+        }
+
+        // {"type":"sync_batch","has_more":..,"messages":[{"id":..,"from":..,"content":..,"message_type":..,"timestamp":..},...]}
+        static std::string_view encodeSyncBatch(const std::vector<Message> &messages, bool hasMore)
+        {
+            auto &out = buffer();
+            out.append(hasMore ? R"({"type":"sync_batch","has_more":true,"messages":[)"
+                               : R"({"type":"sync_batch","has_more":false,"messages":[)");
+            for (size_t i = 0; i < messages.size(); ++i)
+            {
+                const auto &msg = messages[i];
+                out.append(i == 0 ? R"({"id":")" : R"(,{"id":")");
+                appendInt(out, msg.id);
+                out.append(R"(","from":")");
+                appendInt(out, msg.sender_id);
+                out.append(R"(","content":")");
+                appendEscaped(out, msg.content);
+                out.append(R"(","message_type":")");
+                out.append(messageTypeName(msg.message_type));
+                out.append(R"(","timestamp":")");
+                appendTimestamp(out, msg.timestamp);
+                out.append(R"("})");
+            }
+            out.append("]}");
+            return out;
+        }
+
+        // GET /api/messages 的响应体：
+        // {"success":true,"messages":[{"id":"..","from_user":"..","to_user":"..","is_read":..,"content":"..",
+        //  "message_type":"..","timestamp":".."},...],"has_more":..,"before_id":"..","after_id":".."}
+        // 群聊消息用 "room_id" 代替 "to_user" / "is_read"。
+        // 结果交给 HttpResponse 持有，所以不使用线程复用的缓冲区，而是按估算长度一次分配后移交
+        static std::string encodeHistory(const std::vector<Message> &messages, bool hasMore)
+        {
+            size_t estimate = 96;
+            for (const auto &msg : messages)
+                estimate += msg.content.size() + 160;
+
+            std::string out;
+            out.reserve(estimate);
+            out.append(R"({"success":true,"messages":[)");
+            for (size_t i = 0; i < messages.size(); ++i)
+            {
+                const auto &msg = messages[i];
+                out.append(i == 0 ? R"({"id":")" : R"(,{"id":")");
+                appendInt(out, msg.id);
+                out.append(R"(","from_user":")");
+                appendInt(out, msg.sender_id);
+                if (msg.room_id != 0)
+                {
+                    out.append(R"(","room_id":")");
+                    appendInt(out, msg.room_id);
+                    out.append(R"(",)");
+                }
+                else
+                {
+                    out.append(R"(","to_user":")");
+                    appendInt(out, msg.receiver_id);
+                    out.append(msg.is_read ? R"(","is_read":true,)" : R"(","is_read":false,)");
+                }
+                out.append(R"("content":")");
+                appendEscaped(out, msg.content);
+                out.append(R"(","message_type":")");
+                out.append(messageTypeName(msg.message_type));
+                out.append(R"(","timestamp":")");
+                appendTimestamp(out, msg.timestamp);
+                out.append(R"("})");
+            }
+            out.append(hasMore ? R"(],"has_more":true)" : R"(],"has_more":false)");
+            // 游标：继续向前翻页用最早一条的 id，拉取新消息用最新一条的 id
+            if (!messages.empty())
+            {
+                out.append(R"(,"before_id":")");
+                appendInt(out, messages.front().id);
+                out.append(R"(","after_id":")");
+                appendInt(out, messages.back().id);
+                out.push_back('"');
+            }
+            out.push_back('}');
+            return out;
+        }
+
+        // 按 JSON 字符串规则转义，UTF-8 多字节字符原样保留
+        static void appendEscaped(std::string &out, std::string_view value)
+        {
+            size_t start = 0;
+            for (size_t i = 0; i < value.size(); ++i)
+            {
+                auto c = static_cast<unsigned char>(value[i]);
+                if (c >= 0x20 && c != '"' && c != '\\')
+                    continue;
+
+                out.append(value.data() + start, i - start);
+                start = i + 1;
+                switch (c)
+                {
+                case '"':
+                    out.append("\\\"");
+                    break;
+                case '\\':
+                    out.append("\\\\");
+                    break;
+                case '\n':
+                    out.append("\\n");
+                    break;
+                case '\r':
+                    out.append("\\r");
+                    break;
+                case '\t':
+                    out.append("\\t");
+                    break;
+                case '\b':
+                    out.append("\\b");
+                    break;
+                case '\f':
+                    out.append("\\f");
+                    break;
+                default:
+                {
+                    static constexpr char kHex[] = "0123456789abcdef";
+                    char escaped[] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+                    out.append(escaped, sizeof(escaped));
+                }
+                }
+            }
+            out.append(value.data() + start, value.size() - start);
+        }
+
+        // Unix 毫秒 -> "YYYY-MM-DD HH:MM:SS.mmm"，不含引号
+        static void appendTimestamp(std::string &out, int64_t epochMillis)
+        {
+            char text[TimeUtil::kTimestampLength];
+            TimeUtil::formatMillis(epochMillis, text);
+            out.append(text, sizeof(text));
+        }
+
+        static void appendInt(std::string &out, int64_t value)
+        {
+            char digits[24];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            out.append(digits, result.ptr - digits);
+        }
+
+    private:
+        static constexpr std::string_view kMessagePrefix = R"({"type":"message","id":")";
+        static constexpr size_t kInitialCapacity = 4096;
+
+        static void appendMessageFields(std::string &out, int64_t id, int64_t from,
+                                        std::string_view content, int64_t timestamp)
+        {
+            appendInt(out, id);
+            out.append(R"(","from":")");
+            appendInt(out, from);
+            out.append(R"(","content":")");
+            appendEscaped(out, content);
+            out.append(R"(","timestamp":")");
+            appendTimestamp(out, timestamp);
+            out.push_back('"');
+        }
+
+        // clear() 保留容量，稳定运行后编码不再分配内存
+        static std::string &buffer()
+        {
+            thread_local std::string out = [] {
+                std::string s;
+                s.reserve(kInitialCapacity);
+                return s;
+            }();
+            out.clear();
+            return out;
+        }
+    };
+}
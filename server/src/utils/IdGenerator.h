@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace im_server
+{
+    // Snowflake 风格的 64 位消息 id，进程内生成，不依赖数据库自增：
+    //   | 1 位符号(0) | 41 位毫秒时间戳 | 6 位节点 | 6 位线程槽 | 10 位序号 |
+    // 每个线程独占一个线程槽并维护自己的 (毫秒, 序号)，生成时无锁、无共享写。
+    // 同一线程内 id 严格递增，不同线程 / 节点之间按时间大致有序。
+    class IdGenerator
+    {
+    public:
+        static constexpr int kSequenceBits = 10;
+        static constexpr int kSlotBits = 6;
+        static constexpr int kNodeBits = 6;
+        static constexpr int64_t kMaxNodeId = (1 << kNodeBits) - 1;
+        // 2024-01-01 00:00:00 UTC
+        static constexpr int64_t kEpochMillis = 1704067200000LL;
+
+        // 启动时根据配置设置节点号（0 ~ 63），多实例部署时每个实例必须不同
+        static void setNodeId(int64_t nodeId)
+        {
+            nodeId_.store(nodeId & kMaxNodeId, std::memory_order_relaxed);
+        }
+
+        static int64_t nodeId()
+        {
+            return nodeId_.load(std::memory_order_relaxed);
+        }
+
+        static int64_t nextId()
+        {
+            thread_local State state = acquireSlot();
+            if (state.slot == kSharedSlot)
+            {
+                // 线程槽用完后的线程共享最后一个槽，加锁生成
+                static std::mutex mutex;
+                static State shared{kSharedSlot, 0, 0};
+                std::lock_guard<std::mutex> lock(mutex);
+                return generate(shared);
+            }
+            return generate(state);
+        }
+
+        // 从 id 中取出生成时的 Unix 毫秒时间戳
+        static int64_t timestampOf(int64_t id)
+        {
+            return (id >> (kSequenceBits + kSlotBits + kNodeBits)) + kEpochMillis;
+        }
+
+        // 该 Unix 毫秒时间戳之后生成的 id 都不小于返回值，用于按时间划分 id 区间
+        static int64_t firstIdAt(int64_t unixMillis)
+        {
+            return std::max<int64_t>(0, unixMillis - kEpochMillis) << (kSequenceBits + kSlotBits + kNodeBits);
+        }
+
+    private:
+        static constexpr int64_t kMaxSequence = (1 << kSequenceBits) - 1;
+        static constexpr int64_t kSharedSlot = (1 << kSlotBits) - 1;
+
+        struct State
+        {
+            int64_t slot;
+            int64_t lastMillis;
+            int64_t sequence;
+        };
+
+        static State acquireSlot()
+        {
+            static std::atomic<int64_t> nextSlot{0};
+            int64_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed);
+            return State{slot < kSharedSlot ? slot : kSharedSlot, 0, 0};
+        }
+
+        static int64_t currentMillis()
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count() -
+                   kEpochMillis;
+        }
+
+        static int64_t generate(State &state)
+        {
+            int64_t now = currentMillis();
+            if (now <= state.lastMillis)
+            {
+                // 同一毫秒内（或系统时钟回拨）沿用上次的毫秒，只递增序号
+                now = state.lastMillis;
+                if (++state.sequence > kMaxSequence)
+                {
+                    // 本毫秒序号耗尽，借用下一毫秒
+                    ++now;
+                    state.sequence = 0;
+                }
+            }
+            else
+            {
+                state.sequence = 0;
+            }
+            state.lastMillis = now;
+
+            return (now << (kSequenceBits + kSlotBits + kNodeBits)) |
+                   (nodeId() << (kSequenceBits + kSlotBits)) |
+                   (state.slot << kSequenceBits) |
+                   state.sequence;
+        }
+
+        static inline std::atomic<int64_t> nodeId_{0};
+    };
+}
@@ -2,71 +2,171 @@
 
 #include <string>
 #include <jwt-cpp/jwt.h>
+#include <drogon/HttpRequest.h>
+#include "Metrics.h"
+#include <array>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 namespace im_server
 {
     class JwtUtil
     {
     public:
-        static std::string generateToken(const std::string &userId);
+        // 有效期由 SessionStore::accessTtl() 决定，过期后用 refresh token 换新的
+        static std::string generateToken(const std::string &userId, std::chrono::seconds ttl);
         static std::string verifyToken(const std::string &token);
         static std::string decodeToken(const std::string &token);
+        // 从 ?token= 参数或 Authorization: Bearer 头中取 token
+        static std::string extractToken(const drogon::HttpRequestPtr &req);
 
     private:
         static const std::string SECRET_KEY;
+        static const std::string ISSUER;
+
+        // 已验证 token 的缓存：token -> (user id, 过期时间)。
+        // 命中时跳过 base64 解码、JSON 解析和 HMAC；按 token 原文比较，不存在摘要碰撞问题。
+        // 分片加锁，每个分片容量固定，满了随机淘汰一条。
+        class VerifiedCache
+        {
+        public:
+            bool find(const std::string &token, std::string &userId)
+            {
+                auto &shard = shardFor(token);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                auto it = shard.entries.find(token);
+                if (it == shard.entries.end())
+                    return false;
+                if (it->second.expiresAt <= std::chrono::system_clock::now())
+                {
+                    shard.entries.erase(it);
+                    return false;
+                }
+                userId = it->second.userId;
+                return true;
+            }
+
+            void insert(const std::string &token, const std::string &userId,
+                        std::chrono::system_clock::time_point expiresAt)
+            {
+                auto &shard = shardFor(token);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                if (shard.entries.size() >= kShardCapacity)
+                    shard.entries.erase(shard.entries.begin());
+                shard.entries[token] = Entry{userId, expiresAt};
+            }
+
+        private:
+            static constexpr size_t kShardCount = 16;
+            static constexpr size_t kShardCapacity = 4096;
+
+            struct Entry
+            {
+                std::string userId;
+                std::chrono::system_clock::time_point expiresAt;
+            };
+
+            struct alignas(64) Shard
+            {
+                std::mutex mutex;
+                std::unordered_map<std::string, Entry> entries;
+            };
+
+            Shard &shardFor(const std::string &token)
+            {
+                return shards_[std::hash<std::string>()(token) % kShardCount];
+            }
+
+            std::array<Shard, kShardCount> shards_;
+        };
+
+        static VerifiedCache &verifiedCache()
+        {
+            static VerifiedCache cache;
+            return cache;
+        }
+
+        // result: cache_hit / valid / invalid
+        static Metrics::Counter &verifications(const char *result)
+        {
+            return Metrics::instance().counter("im_jwt_verifications_total", "JWT verifications by result",
+                                               std::string("result=\"") + result + "\"");
+        }
     };
 
     // In a real application, this secret should be stored securely (e.g., environment variable)
-    const std::string JwtUtil::SECRET_KEY = "your-super-secret-key-change-in-production";
+    inline const std::string JwtUtil::SECRET_KEY = "your-super-secret-key-change-in-production";
+    inline const std::string JwtUtil::ISSUER = "im_server";
 
-    std::string JwtUtil::generateToken(const std::string &userId)
+    inline std::string JwtUtil::generateToken(const std::string &userId, std::chrono::seconds ttl)
     {
+        auto now = std::chrono::system_clock::now();
         auto token = jwt::create()
                          .set_type("JWT")
-                         .set_issued_at(std::chrono::system_clock::now())
-                         .set_expires_at(std::chrono::system_clock::now() + std::chrono::seconds{3600 * 24}) // 24 hours
+                         .set_issuer(ISSUER)
+                         .set_issued_at(now)
+                         .set_expires_at(now + ttl)
                          .set_payload_claim("user_id", jwt::claim(userId))
                          .sign(jwt::algorithm::hs256{SECRET_KEY});
 
         return token;
     }
 
-    std::string JwtUtil::verifyToken(const std::string &token)
+    inline std::string JwtUtil::verifyToken(const std::string &token)
     {
+        std::string userId;
+        static auto &cacheHits = verifications("cache_hit");
+        static auto &valid = verifications("valid");
+        static auto &invalid = verifications("invalid");
+
+        if (verifiedCache().find(token, userId))
+        {
+            cacheHits.inc();
+            return userId;
+        }
+
         try
         {
             auto decoded = jwt::decode(token);
 
-            // Verify signature
-            auto verifier = jwt::verify()
-                                .allow_algorithm(jwt::algorithm::hs256{SECRET_KEY})
-                                .with_issuer("im_server");
+            // Verify signature: the verifier (and its hs256 key) is built once and shared by all threads
+            static const auto verifier = jwt::verify()
+                                             .allow_algorithm(jwt::algorithm::hs256{SECRET_KEY})
+                                             .with_issuer(ISSUER);
 
             verifier.verify(decoded);
 
-            // Check if token is expired
-            if (decoded.has_expires_at() && decoded.get_expires_at() < std::chrono::system_clock::now())
+            // 没有过期时间的 token 不接受，否则无法从缓存中淘汰
+            if (!decoded.has_expires_at() || decoded.get_expires_at() < std::chrono::system_clock::now())
             {
+                invalid.inc();
                 return "";
             }
 
             // Get user_id from payload
             if (decoded.has_payload_claim("user_id"))
             {
-                return decoded.get_payload_claim("user_id").as_string();
+                userId = decoded.get_payload_claim("user_id").as_string();
+                verifiedCache().insert(token, userId, decoded.get_expires_at());
+                valid.inc();
+                return userId;
             }
 
+            invalid.inc();
             return "";
         }
         catch (const std::exception &e)
         {
             LOG_ERROR << "JWT verification failed: " << e.what();
+            invalid.inc();
             return "";
         }
     }
 
-    std::string JwtUtil::decodeToken(const std::string &token)
+    inline std::string JwtUtil::decodeToken(const std::string &token)
     {
         try
         {
@@ -85,4 +185,18 @@ namespace im_server
             return "";
         }
     }
-}
\ No newline at end of file
+
+    inline std::string JwtUtil::extractToken(const drogon::HttpRequestPtr &req)
+    {
+        std::string token = req->getParameter("token");
+        if (token.empty())
+        {
+            const auto &authHeader = req->getHeader("Authorization");
+            if (authHeader.compare(0, 7, "Bearer ") == 0)
+            {
+                token = authHeader.substr(7);
+            }
+        }
+        return token;
+    }
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace im_server
+{
+    // 进程内指标。热路径上只写当前线程自己的槽位（独占一条 cache line，普通 load + store，没有原子读改写），
+    // 读取时再把所有线程的槽位相加，输出 Prometheus 文本格式（见 MetricsController 的 /metrics）。
+    //
+    //   Counter   : 单调递增计数
+    //   Histogram : HDR 风格的对数-线性桶，每个 2 的幂区间再分 8 个子桶，相对误差约 12.5%，
+    //               记录单位为微秒，输出时换算成秒
+    //   callback  : 读取时调用的函数，用来导出各 Service 已有的 stats()
+    //
+    // 指标对象在注册表里永久存在，返回的引用可以缓存在函数内 static 变量中。
+    class Metrics
+    {
+    public:
+        static constexpr size_t kMaxThreads = 64;
+
+        enum class Type
+        {
+            Counter,
+            Gauge,
+            Histogram
+        };
+
+        // 每个线程第一次写指标时分到一个槽位；超出 kMaxThreads 的线程共用最后一个槽位（改用原子加）
+        static size_t threadSlot()
+        {
+            static std::atomic<size_t> next{0};
+            thread_local size_t slot = std::min(next.fetch_add(1, std::memory_order_relaxed), kMaxThreads - 1);
+            return slot;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        static Clock::time_point now() { return Clock::now(); }
+
+        class Counter
+        {
+        public:
+            void inc(uint64_t n = 1)
+            {
+                auto slot = threadSlot();
+                auto &cell = cells_[slot].value;
+                if (slot == kMaxThreads - 1)
+                    cell.fetch_add(n, std::memory_order_relaxed);
+                else
+                    cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+            }
+
+            uint64_t value() const
+            {
+                uint64_t sum = 0;
+                for (const auto &cell : cells_)
+                    sum += cell.value.load(std::memory_order_relaxed);
+                return sum;
+            }
+
+        private:
+            struct alignas(64) Cell
+            {
+                std::atomic<uint64_t> value{0};
+            };
+            std::array<Cell, kMaxThreads> cells_;
+        };
+
+        class Histogram
+        {
+        public:
+            static constexpr unsigned kSubBits = 3;
+            static constexpr unsigned kSubBuckets = 1u << kSubBits;
+            // 0 ~ 2^36 微秒（约 19 小时），更大的值落入最后一个桶
+            static constexpr unsigned kMaxExponent = 36;
+            static constexpr size_t kBuckets = (kMaxExponent - kSubBits + 2) * kSubBuckets;
+
+            void observe(uint64_t micros)
+            {
+                auto slot = threadSlot();
+                auto *shard = shards_[slot].load(std::memory_order_acquire);
+                if (!shard)
+                    shard = allocate(slot);
+                auto &bucket = shard->buckets[bucketOf(micros)];
+                if (slot == kMaxThreads - 1)
+                {
+                    bucket.fetch_add(1, std::memory_order_relaxed);
+                    shard->sum.fetch_add(micros, std::memory_order_relaxed);
+                }
+                else
+                {
+                    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    shard->sum.store(shard->sum.load(std::memory_order_relaxed) + micros, std::memory_order_relaxed);
+                }
+            }
+
+            void observeSince(Clock::time_point start)
+            {
+                observe(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count()));
+            }
+
+            // 桶下标：小于 2^kSubBits 的值一一对应，之后每个 2 的幂区间 kSubBuckets 个桶
+            static size_t bucketOf(uint64_t value)
+            {
+                if (value < kSubBuckets)
+                    return static_cast<size_t>(value);
+                unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+                if (exponent > kMaxExponent)
+                    return kBuckets - 1;
+                auto sub = static_cast<size_t>((value >> (exponent - kSubBits)) & (kSubBuckets - 1));
+                return (exponent - kSubBits + 1) * kSubBuckets + sub;
+            }
+
+            // 桶内的最大值（含）
+            static uint64_t upperBound(size_t bucket)
+            {
+                if (bucket < kSubBuckets)
+                    return bucket;
+                unsigned exponent = static_cast<unsigned>(bucket / kSubBuckets) + kSubBits - 1;
+                uint64_t sub = bucket % kSubBuckets;
+                return ((kSubBuckets + sub + 1) << (exponent - kSubBits)) - 1;
+            }
+
+            struct Snapshot
+            {
+                std::array<uint64_t, kBuckets> buckets{};
+                uint64_t count = 0;
+                uint64_t sum = 0;
+            };
+
+            Snapshot snapshot() const
+            {
+                Snapshot out;
+                for (const auto &slot : shards_)
+                {
+                    const auto *shard = slot.load(std::memory_order_acquire);
+                    if (!shard)
+                        continue;
+                    for (size_t i = 0; i < kBuckets; ++i)
+                    {
+                        auto n = shard->buckets[i].load(std::memory_order_relaxed);
+                        out.buckets[i] += n;
+                        out.count += n;
+                    }
+                    out.sum += shard->sum.load(std::memory_order_relaxed);
+                }
+                return out;
+            }
+
+            ~Histogram()
+            {
+                for (auto &slot : shards_)
+                    delete slot.load(std::memory_order_relaxed);
+            }
+
+        private:
+            struct alignas(64) Shard
+            {
+                std::array<std::atomic<uint64_t>, kBuckets> buckets{};
+                std::atomic<uint64_t> sum{0};
+            };
+
+            Shard *allocate(size_t slot)
+            {
+                auto *fresh = new Shard();
+                Shard *expected = nullptr;
+                // 共享槽位可能被多个线程同时初始化
+                if (!shards_[slot].compare_exchange_strong(expected, fresh, std::memory_order_acq_rel))
+                {
+                    delete fresh;
+                    return expected;
+                }
+                return fresh;
+            }
+
+            std::array<std::atomic<Shard *>, kMaxThreads> shards_{};
+        };
+
+        static Metrics &instance()
+        {
+            static Metrics metrics;
+            return metrics;
+        }
+
+        // labels 形如 method="getMessages"，同名不同 labels 的指标共用 HELP / TYPE 行
+        Counter &counter(const std::string &name, const std::string &help, const std::string &labels = "")
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &entry = add(name, help, labels, Type::Counter);
+            if (!entry.counter)
+                entry.counter = std::make_unique<Counter>();
+            return *entry.counter;
+        }
+
+        Histogram &histogram(const std::string &name, const std::string &help, const std::string &labels = "")
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &entry = add(name, help, labels, Type::Histogram);
+            if (!entry.histogram)
+                entry.histogram = std::make_unique<Histogram>();
+            return *entry.histogram;
+        }
+
+        void callback(const std::string &name, const std::string &help, Type type, std::function<double()> read,
+                      const std::string &labels = "")
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            add(name, help, labels, type).read = std::move(read);
+        }
+
+        // Prometheus text exposition format 0.0.4
+        std::string render() const
+        {
+            std::string out;
+            out.reserve(16 * 1024);
+            std::lock_guard<std::mutex> lock(mutex_);
+            const std::string *lastName = nullptr;
+            for (const auto &entry : entries_)
+            {
+                if (!lastName || *lastName != entry->name)
+                {
+                    out.append("# HELP ").append(entry->name).append(" ").append(entry->help).append("\n");
+                    out.append("# TYPE ").append(entry->name).append(" ").append(typeName(entry->type)).append("\n");
+                    lastName = &entry->name;
+                }
+
+                if (entry->read)
+                    appendSample(out, entry->name, entry->labels, entry->read());
+                else if (entry->counter)
+                    appendSample(out, entry->name, entry->labels, static_cast<double>(entry->counter->value()));
+                else if (entry->histogram)
+                    appendHistogram(out, *entry);
+            }
+            return out;
+        }
+
+    private:
+        struct Entry
+        {
+            std::string name;
+            std::string help;
+            std::string labels;
+            Type type;
+            std::unique_ptr<Counter> counter;
+            std::unique_ptr<Histogram> histogram;
+            std::function<double()> read;
+        };
+
+        Metrics() = default;
+
+        // 调用方持有 mutex_；同名指标插在一起，保证输出时 HELP / TYPE 只出现一次
+        Entry &add(const std::string &name, const std::string &help, const std::string &labels, Type type)
+        {
+            auto insertAt = entries_.end();
+            for (auto it = entries_.begin(); it != entries_.end(); ++it)
+            {
+                if ((*it)->name != name)
+                    continue;
+                if ((*it)->labels == labels)
+                    return **it;
+                insertAt = it + 1;
+            }
+            auto entry = std::make_unique<Entry>();
+            entry->name = name;
+            entry->help = help;
+            entry->labels = labels;
+            entry->type = type;
+            return **entries_.insert(insertAt, std::move(entry));
+        }
+
+        static const char *typeName(Type type)
+        {
+            switch (type)
+            {
+            case Type::Counter:
+                return "counter";
+            case Type::Gauge:
+                return "gauge";
+            default:
+                return "histogram";
+            }
+        }
+
+        static void appendNumber(std::string &out, double value)
+        {
+            char buf[32];
+            int n = std::snprintf(buf, sizeof(buf), "%.17g", value);
+            out.append(buf, n);
+        }
+
+        static void appendSample(std::string &out, const std::string &name, const std::string &labels, double value,
+                                 const char *suffix = "", const std::string &extraLabel = "")
+        {
+            out.append(name).append(suffix);
+            if (!labels.empty() || !extraLabel.empty())
+            {
+                out.push_back('{');
+                out.append(labels);
+                if (!labels.empty() && !extraLabel.empty())
+                    out.push_back(',');
+                out.append(extraLabel);
+                out.push_back('}');
+            }
+            out.push_back(' ');
+            appendNumber(out, value);
+            out.push_back('\n');
+        }
+
+        // 内部桶太细，输出时合并到固定的秒级边界；桶边界不对齐带来的误差在 12.5% 以内
+        static void appendHistogram(std::string &out, const Entry &entry)
+        {
+            static constexpr uint64_t kBoundsMicros[] = {
+                50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+                100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+
+            auto snapshot = entry.histogram->snapshot();
+            uint64_t cumulative = 0;
+            size_t bucket = 0;
+            for (auto bound : kBoundsMicros)
+            {
+                while (bucket < Histogram::kBuckets && Histogram::upperBound(bucket) <= bound)
+                    cumulative += snapshot.buckets[bucket++];
+                char le[32];
+                std::snprintf(le, sizeof(le), "le=\"%g\"", static_cast<double>(bound) / 1e6);
+                appendSample(out, entry.name, entry.labels, static_cast<double>(cumulative), "_bucket", le);
+            }
+            appendSample(out, entry.name, entry.labels, static_cast<double>(snapshot.count), "_bucket", "le=\"+Inf\"");
+            appendSample(out, entry.name, entry.labels, static_cast<double>(snapshot.sum) / 1e6, "_sum");
+            appendSample(out, entry.name, entry.labels, static_cast<double>(snapshot.count), "_count");
+        }
+
+        mutable std::mutex mutex_;
+        std::vector<std::unique_ptr<Entry>> entries_;
+    };
+}
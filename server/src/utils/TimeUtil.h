@@ -1,69 +1,218 @@
 #pragma once
 
-#include <string>
 #include <chrono>
-#include <iomanip>
-#include <sstream>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
 
 namespace im_server
 {
+    // 时间的规范形式是 Unix 毫秒（int64），Message、messages 表和存储引擎都只保存这个整数；
+    // "YYYY-MM-DD HH:MM:SS.mmm"（本地时区）只在下发给客户端时生成。
+    //
+    // 格式化不经过 stringstream / localtime：年月日由整数运算推出，数字按两位一组查表写入。
+    // 每个线程缓存上一次格式化的结果，同一分钟内只改写秒和毫秒 5 个字符；
+    // 时区偏移按 15 分钟一段缓存（各时区的夏令时切换都落在 15 分钟边界上），
+    // 每个线程每段最多调用一次 localtime_r。
     class TimeUtil
     {
     public:
-        static std::string getCurrentTimestamp();
-        static std::string formatTimestamp(std::time_t time);
-        static std::time_t getCurrentTime();
-        static std::string timeToString(std::time_t time);
-        static std::time_t stringToTime(const std::string &str);
-    };
+        // "2024-01-01 12:00:00.000" 的长度
+        static constexpr size_t kTimestampLength = 23;
 
-    std::string TimeUtil::getCurrentTimestamp()
-    {
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                      now.time_since_epoch()) %
-                  1000;
+        static int64_t nowMillis()
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        }
 
-        std::stringstream ss;
-        ss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
-        ss << '.' << std::setfill('0') << std::setw(3) << ms.count();
+        // 写入恰好 kTimestampLength 个字符，不追加 '\0'
+        static void formatMillis(int64_t epochMillis, char *out)
+        {
+            thread_local Cache cache;
+            int64_t seconds = floorDiv(epochMillis, 1000);
+            int64_t millis = epochMillis - seconds * 1000;
+            int64_t minute = floorDiv(seconds, 60);
+            if (minute != cache.minute)
+            {
+                cache.minute = minute;
+                formatMinute(minute * 60 + localOffset(seconds), cache.text);
+            }
+            const char *pairs = kDigitPairs;
+            int64_t second = seconds - minute * 60;
+            cache.text[17] = pairs[second * 2];
+            cache.text[18] = pairs[second * 2 + 1];
+            cache.text[20] = static_cast<char>('0' + millis / 100);
+            cache.text[21] = pairs[(millis % 100) * 2];
+            cache.text[22] = pairs[(millis % 100) * 2 + 1];
+            std::char_traits<char>::copy(out, cache.text, kTimestampLength);
+        }
 
-        return ss.str();
-    }
+        static std::string formatMillis(int64_t epochMillis)
+        {
+            std::string out(kTimestampLength, '\0');
+            formatMillis(epochMillis, &out[0]);
+            return out;
+        }
 
-    std::string TimeUtil::formatTimestamp(std::time_t time)
-    {
-        std::stringstream ss;
-        ss << std::put_time(std::localtime(&time), "%Y-%m-%d %H:%M:%S");
-        return ss.str();
-    }
+        // 解析 "YYYY-MM-DD HH:MM:SS[.mmm]"（本地时区，日期和时间之间也可以是 'T'），格式不对返回 -1
+        static int64_t parseMillis(std::string_view text)
+        {
+            if (text.size() != 19 && text.size() != kTimestampLength)
+                return -1;
+            int year, month, day, hour, minute, second, millis = 0;
+            bool ok = readDigits(text, 0, 4, year) && text[4] == '-' && readDigits(text, 5, 2, month) &&
+                      text[7] == '-' && readDigits(text, 8, 2, day) && (text[10] == ' ' || text[10] == 'T') &&
+                      readDigits(text, 11, 2, hour) && text[13] == ':' && readDigits(text, 14, 2, minute) &&
+                      text[16] == ':' && readDigits(text, 17, 2, second) &&
+                      (text.size() == 19 || (text[19] == '.' && readDigits(text, 20, 3, millis)));
+            if (!ok || month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month) || hour > 23 ||
+                minute > 59 || second > 60)
+                return -1;
 
-    std::time_t TimeUtil::getCurrentTime()
-    {
-        return std::time(nullptr);
-    }
+            int64_t local = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+            // 先按本地时间粗估 UTC，再用该时刻的偏移修正
+            int64_t utc = local - localOffset(local);
+            utc = local - localOffset(utc);
+            return utc * 1000 + millis;
+        }
 
-    std::string TimeUtil::timeToString(std::time_t time)
-    {
-        return std::to_string(time);
-    }
+        static std::string getCurrentTimestamp()
+        {
+            return formatMillis(nowMillis());
+        }
 
-    std::time_t TimeUtil::stringToTime(const std::string &str)
-    {
-        // Parsing a string like "2022-01-01 12:00:00" to time_t
-        // This is a simplified version - a more robust implementation would be needed for production
-        struct std::tm tm = {};
-        int year, month, day, hour, minute, second;
-        sscanf(str.c_str(), "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second);
-
-        tm.tm_year = year - 1900;
-        tm.tm_mon = month - 1;
-        tm.tm_mday = day;
-        tm.tm_hour = hour;
-        tm.tm_min = minute;
-        tm.tm_sec = second;
-
-        return std::mktime(&tm);
-    }
-}
\ No newline at end of file
+        // "YYYY-MM-DD HH:MM:SS"
+        static std::string formatTimestamp(std::time_t time)
+        {
+            char text[kTimestampLength];
+            formatMillis(static_cast<int64_t>(time) * 1000, text);
+            return std::string(text, 19);
+        }
+
+        static std::time_t getCurrentTime()
+        {
+            return std::time(nullptr);
+        }
+
+        static std::string timeToString(std::time_t time)
+        {
+            return std::to_string(time);
+        }
+
+        static std::time_t stringToTime(const std::string &str)
+        {
+            int64_t millis = parseMillis(str);
+            return millis < 0 ? static_cast<std::time_t>(-1) : static_cast<std::time_t>(millis / 1000);
+        }
+
+    private:
+        struct Cache
+        {
+            int64_t minute = INT64_MIN;
+            char text[kTimestampLength] = {};
+        };
+
+        // "00" "01" ... "99"，按两位一组查表写入数字
+        static constexpr char kDigitPairs[] =
+            "0001020304050607080910111213141516171819"
+            "2021222324252627282930313233343536373839"
+            "4041424344454647484950515253545556575859"
+            "6061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        static constexpr int kDaysInMonth[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        static constexpr int64_t kOffsetBucketSeconds = 15 * 60;
+
+        static constexpr int64_t floorDiv(int64_t a, int64_t b)
+        {
+            return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+        }
+
+        static constexpr bool isLeap(int year)
+        {
+            return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+        }
+
+        static constexpr int daysInMonth(int year, int month)
+        {
+            return month == 2 && isLeap(year) ? 29 : kDaysInMonth[month - 1];
+        }
+
+        // 公历日期与 1970-01-01 之间的天数互转（Howard Hinnant 的 days_from_civil / civil_from_days）
+        static constexpr int64_t daysFromCivil(int64_t y, unsigned m, unsigned d)
+        {
+            y -= m <= 2;
+            int64_t era = floorDiv(y, 400);
+            auto yoe = static_cast<unsigned>(y - era * 400);
+            unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+            unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+            return era * 146097 + static_cast<int64_t>(doe) - 719468;
+        }
+
+        static void formatMinute(int64_t localSeconds, char *out)
+        {
+            int64_t days = floorDiv(localSeconds, 86400);
+            auto secondOfDay = static_cast<unsigned>(localSeconds - days * 86400);
+
+            int64_t z = days + 719468;
+            int64_t era = floorDiv(z, 146097);
+            auto doe = static_cast<unsigned>(z - era * 146097);
+            unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+            unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+            unsigned mp = (5 * doy + 2) / 153;
+            unsigned day = doy - (153 * mp + 2) / 5 + 1;
+            unsigned month = mp < 10 ? mp + 3 : mp - 9;
+            int64_t year = static_cast<int64_t>(yoe) + era * 400 + (month <= 2);
+
+            const char *pairs = kDigitPairs;
+            auto put = [pairs](char *at, unsigned value) {
+                at[0] = pairs[value * 2];
+                at[1] = pairs[value * 2 + 1];
+            };
+            auto y = static_cast<unsigned>(year < 0 ? 0 : year > 9999 ? 9999 : year);
+            put(out, y / 100);
+            put(out + 2, y % 100);
+            out[4] = '-';
+            put(out + 5, month);
+            out[7] = '-';
+            put(out + 8, day);
+            out[10] = ' ';
+            put(out + 11, secondOfDay / 3600);
+            out[13] = ':';
+            put(out + 14, secondOfDay / 60 % 60);
+            out[16] = ':';
+            out[19] = '.';
+        }
+
+        // 该 UTC 时刻本地时间相对 UTC 的秒数
+        static int64_t localOffset(int64_t utcSeconds)
+        {
+            thread_local int64_t bucket = INT64_MIN;
+            thread_local int64_t offset = 0;
+            int64_t current = floorDiv(utcSeconds, kOffsetBucketSeconds);
+            if (current != bucket)
+            {
+                auto time = static_cast<std::time_t>(current * kOffsetBucketSeconds);
+                std::tm tm{};
+                offset = localtime_r(&time, &tm) ? tm.tm_gmtoff : 0;
+                bucket = current;
+            }
+            return offset;
+        }
+
+        static bool readDigits(std::string_view text, size_t pos, size_t count, int &value)
+        {
+            value = 0;
+            for (size_t i = pos; i < pos + count; ++i)
+            {
+                auto digit = static_cast<unsigned>(text[i] - '0');
+                if (digit > 9)
+                    return false;
+                value = value * 10 + static_cast<int>(digit);
+            }
+            return true;
+        }
+    };
+}
@@ -0,0 +1,134 @@
+#include <drogon/drogon_test.h>
+#include "utils/CommandParser.h"
+#include <string>
+
+using namespace im_server;
+
+namespace {
+    CommandParser::Status parse(std::string frame, ChatCommand& command) {
+        static thread_local std::string buffer;
+        buffer = std::move(frame);
+        return CommandParser::parse(buffer, command);
+    }
+
+    // 在帧尾追加一个带 \u 转义的无关字段，强制走 jsoncpp 回退路径
+    std::string withFallback(const std::string& frame) {
+        return frame.substr(0, frame.rfind('}')) + R"(,"pad":"\u0041"})";
+    }
+}
+
+DROGON_TEST(CommandParserFastPath) {
+    ChatCommand command;
+    std::string frame = R"({"type":"message","to":"42","content":"hi \"there\"\n","client_msg_id":"c1"})";
+    REQUIRE(CommandParser::parse(frame, command) == CommandParser::Status::Ok);
+    CHECK(command.type == CommandType::Message);
+    CHECK(command.to == 42);
+    CHECK(command.content == "hi \"there\"\n");
+    CHECK(command.clientMsgId == "c1");
+
+    // id 可以是数字或数字字符串
+    ChatCommand ack;
+    REQUIRE(parse(R"({ "type" : "ack", "last_id" : 123456789012345678 })", ack) == CommandParser::Status::Ok);
+    CHECK(ack.type == CommandType::Ack);
+    CHECK(ack.lastId == 123456789012345678);
+}
+
+DROGON_TEST(CommandParserFallbackMatchesFastPath) {
+    const std::string frames[] = {
+        R"({"type":"message","to":"42","content":"a\tb","client_msg_id":"x"})",
+        R"({"type":"message","room_id":7,"content":"hello"})",
+        R"({"type":"read_receipt","from":"3","message_id":"99"})",
+        R"({"type":"read_receipt","from":3,"up_to_id":100})",
+        R"({"type":"ack","last_id":"5"})",
+        R"({"type":"typing","to":9})",
+        R"({"type":"message","to":null,"room_id":"8","content":"x"})",
+    };
+    for (const auto& frame : frames) {
+        ChatCommand fast, fallback;
+        auto fastStatus = parse(frame, fast);
+        auto fallbackStatus = parse(withFallback(frame), fallback);
+        CHECK(fastStatus == CommandParser::Status::Ok);
+        CHECK(fallbackStatus == fastStatus);
+        CHECK(fallback.type == fast.type);
+        CHECK(fallback.to == fast.to);
+        CHECK(fallback.roomId == fast.roomId);
+        CHECK(fallback.messageId == fast.messageId);
+        CHECK(fallback.from == fast.from);
+        CHECK(fallback.upToId == fast.upToId);
+        CHECK(fallback.lastId == fast.lastId);
+        CHECK(std::string(fallback.content) == std::string(fast.content));
+        CHECK(std::string(fallback.clientMsgId) == std::string(fast.clientMsgId));
+    }
+}
+
+DROGON_TEST(CommandParserUnicodeEscape) {
+    ChatCommand command;
+    REQUIRE(parse(R"({"type":"message","to":1,"content":"\u4f60\u597d"})", command) == CommandParser::Status::Ok);
+    CHECK(command.content == "\xe4\xbd\xa0\xe5\xa5\xbd");
+}
+
+DROGON_TEST(CommandParserPresenceUsers) {
+    ChatCommand command;
+    REQUIRE(parse(R"({"type":"presence_subscribe","users":["1",2,"3"]})", command) == CommandParser::Status::Ok);
+    REQUIRE(command.users.size() == 3);
+    CHECK(command.users[0] == 1);
+    CHECK(command.users[2] == 3);
+
+    ChatCommand bad;
+    CHECK(parse(R"({"type":"presence_subscribe","users":"1"})", bad) == CommandParser::Status::Malformed);
+    CHECK(parse(R"({"type":"presence_subscribe","users":[0]})", bad) == CommandParser::Status::Malformed);
+    CHECK(parse(R"({"type":"presence_subscribe","users":[{"id":1}]})", bad) == CommandParser::Status::Malformed);
+}
+
+// 非字符串的 type / content / to 必须返回错误状态，而不是让 jsoncpp 的异常抛出去
+DROGON_TEST(CommandParserNonStringValues) {
+    const std::string unknownType[] = {
+        R"({"type":{"a":1}})",
+        R"({"type":[1]})",
+        R"({"type":123})",
+        R"({"type":null,"to":1})",
+        R"({"to":1,"content":"x"})",
+        R"({"type":{"a":1},"pad":"\u0041"})",
+        R"({"type":true,"pad":"\u0041"})",
+    };
+    for (const auto& frame : unknownType) {
+        ChatCommand command;
+        CommandParser::Status status = CommandParser::Status::Ok;
+        CHECK_NOTHROW(status = parse(frame, command));
+        CHECK(status == CommandParser::Status::UnknownType);
+    }
+
+    const std::string malformed[] = {
+        R"({"type":"message","to":1,"content":{"a":1}})",
+        R"({"type":"message","to":1,"content":["x"]})",
+        R"({"type":"message","to":{"id":1},"content":"x"})",
+        R"({"type":"message","to":[1],"content":"x"})",
+        R"({"type":"message","to":"abc","content":"x"})",
+        R"({"type":"message","to":1,"client_msg_id":{"a":1},"content":"x"})",
+        R"({"type":"ack","last_id":[1]})",
+    };
+    for (const auto& frame : malformed) {
+        ChatCommand command;
+        CommandParser::Status status = CommandParser::Status::Ok;
+        CHECK_NOTHROW(status = parse(frame, command));
+        CHECK(status == CommandParser::Status::Malformed);
+    }
+}
+
+DROGON_TEST(CommandParserMalformedFrames) {
+    const std::string frames[] = {
+        "",
+        "[]",
+        R"({"type":"message")",
+        R"({"type":"message",})",
+        R"({"type":"message","content":"unterminated})",
+        R"({"type":"message","content":"bad \q escape"})",
+        R"({"type":"message"} trailing)",
+    };
+    for (const auto& frame : frames) {
+        ChatCommand command;
+        CommandParser::Status status = CommandParser::Status::Ok;
+        CHECK_NOTHROW(status = parse(frame, command));
+        CHECK(status == CommandParser::Status::Malformed);
+    }
+}
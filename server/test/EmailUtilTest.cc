@@ -0,0 +1,76 @@
+#include <drogon/drogon_test.h>
+#include "utils/EmailUtil.h"
+#include <random>
+#include <regex>
+#include <string>
+
+using namespace im_server;
+
+namespace {
+    // 改成查表之前使用的正则
+    bool matchesRegex(const std::string& email) {
+        static const std::regex pattern(R"(^[a-zA-Z0-9._%+-]+@[a-zA-Z0-9.-]+\.[a-zA-Z]{2,}$)");
+        return std::regex_match(email, pattern);
+    }
+}
+
+DROGON_TEST(EmailUtilCases) {
+    CHECK(EmailUtil::isValid("alice@example.com"));
+    CHECK(EmailUtil::isValid("a.b_c%d+e-f@mail.example.co"));
+    CHECK(EmailUtil::isValid("x@y.zz"));
+    CHECK(EmailUtil::isValid("x@sub-domain.example.museum"));
+    CHECK(EmailUtil::isValid("x@a..b.cc"));
+
+    CHECK(!EmailUtil::isValid(""));
+    CHECK(!EmailUtil::isValid("@example.com"));
+    CHECK(!EmailUtil::isValid("alice"));
+    CHECK(!EmailUtil::isValid("alice@"));
+    CHECK(!EmailUtil::isValid("alice@example"));
+    CHECK(!EmailUtil::isValid("alice@.com"));
+    CHECK(!EmailUtil::isValid("alice@example.c"));
+    CHECK(!EmailUtil::isValid("alice@example.c0m"));
+    CHECK(!EmailUtil::isValid("alice@exa_mple.com"));
+    CHECK(!EmailUtil::isValid("alice@@example.com"));
+    CHECK(!EmailUtil::isValid("ali ce@example.com"));
+    CHECK(!EmailUtil::isValid("alice@example.com."));
+    CHECK(!EmailUtil::isValid(std::string("alice\0@example.com", 19)));
+    CHECK(!EmailUtil::isValid("\xe5\xbc\xa0@example.com"));
+
+    // 长度上限
+    std::string longest = std::string(EmailUtil::kMaxLength - 12, 'a') + "@example.com";
+    CHECK(EmailUtil::isValid(longest));
+    CHECK(!EmailUtil::isValid("a" + longest));
+}
+
+DROGON_TEST(EmailUtilMatchesRegex) {
+    // 按 本地部分@域名.后缀 的形状拼出候选，每段都可能为空或混入不允许的字符，再随机改掉一个字符
+    static const std::string local = "aZ09._%+-";
+    static const std::string domain = "aZ09.-_";
+    static const std::string suffix = "aZz0";
+    static const std::string any = "aZ09._%+-@. !#\xff";
+    std::mt19937 rng(12345);
+    auto randomPart = [&rng](const std::string& chars, size_t maxLength) {
+        std::string part(std::uniform_int_distribution<size_t>(0, maxLength)(rng), '\0');
+        for (auto& c : part) {
+            c = chars[std::uniform_int_distribution<size_t>(0, chars.size() - 1)(rng)];
+        }
+        return part;
+    };
+
+    int mismatches = 0;
+    int valid = 0;
+    for (int i = 0; i < 100000; ++i) {
+        auto email = randomPart(local, 4) + "@" + randomPart(domain, 4) + "." + randomPart(suffix, 3);
+        if (rng() % 2 == 0) {
+            email[rng() % email.size()] = any[rng() % any.size()];
+        }
+        bool expected = matchesRegex(email);
+        if (EmailUtil::isValid(email) != expected) {
+            ++mismatches;
+        }
+        valid += expected;
+    }
+    CHECK(mismatches == 0);
+    // 样本里要有足够多的合法地址，否则比较没有意义
+    CHECK(valid > 1000);
+}
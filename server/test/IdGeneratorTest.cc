@@ -0,0 +1,71 @@
+#include <drogon/drogon_test.h>
+#include "utils/IdGenerator.h"
+#include "utils/TimeUtil.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace im_server;
+
+namespace {
+    constexpr int kNodeShift = IdGenerator::kSequenceBits + IdGenerator::kSlotBits;
+}
+
+DROGON_TEST(IdGeneratorMonotonicPerThread) {
+    IdGenerator::setNodeId(5);
+    auto before = TimeUtil::nowMillis();
+    // 远超每毫秒 1024 个序号，必然触发借用下一毫秒
+    std::vector<int64_t> ids(20000);
+    for (auto& id : ids) {
+        id = IdGenerator::nextId();
+    }
+    auto after = TimeUtil::nowMillis();
+
+    for (size_t i = 1; i < ids.size(); ++i) {
+        CHECK(ids[i] > ids[i - 1]);
+    }
+    for (auto id : {ids.front(), ids.back()}) {
+        CHECK(id > 0);
+        CHECK(((id >> kNodeShift) & IdGenerator::kMaxNodeId) == 5);
+    }
+    CHECK(IdGenerator::timestampOf(ids.front()) >= before);
+    // 借用的毫秒最多领先 20000 / 1024 毫秒
+    CHECK(IdGenerator::timestampOf(ids.back()) <= after + 20);
+
+    // 按时间划分 id 区间
+    CHECK(IdGenerator::firstIdAt(before) <= ids.front());
+    CHECK(IdGenerator::firstIdAt(after + 21) > ids.back());
+    CHECK(IdGenerator::timestampOf(IdGenerator::firstIdAt(before)) == before);
+    CHECK(IdGenerator::firstIdAt(IdGenerator::kEpochMillis - 1000) == 0);
+
+    IdGenerator::setNodeId(IdGenerator::kMaxNodeId + 2);
+    CHECK(IdGenerator::nodeId() == 1);
+    IdGenerator::setNodeId(0);
+}
+
+DROGON_TEST(IdGeneratorUniqueAcrossThreads) {
+    // 线程数超过线程槽（63 个独占槽），后来的线程共享最后一个槽
+    constexpr int kThreads = 80;
+    constexpr int kPerThread = 2000;
+    std::vector<std::vector<int64_t>> perThread(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&ids = perThread[t]]() {
+            ids.reserve(kPerThread);
+            for (int i = 0; i < kPerThread; ++i) {
+                ids.push_back(IdGenerator::nextId());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<int64_t> all;
+    for (const auto& ids : perThread) {
+        CHECK(std::is_sorted(ids.begin(), ids.end()));
+        all.insert(all.end(), ids.begin(), ids.end());
+    }
+    std::sort(all.begin(), all.end());
+    CHECK(std::adjacent_find(all.begin(), all.end()) == all.end());
+}
@@ -0,0 +1,107 @@
+#include <drogon/drogon_test.h>
+#include "services/MessageArchive.h"
+#include "utils/IdGenerator.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace im_server;
+
+namespace {
+    // MessageArchive 是单例，整个测试进程共用一个临时目录
+    MessageArchive& openArchive() {
+        static bool opened = [] {
+            char dir[] = "/tmp/im_archive_test_XXXXXX";
+            return ::mkdtemp(dir) != nullptr && MessageArchive::instance().open(dir);
+        }();
+        (void)opened;
+        return MessageArchive::instance();
+    }
+
+    Message directMessage(int64_t id, int64_t sender, int64_t receiver, const std::string& content) {
+        return Message(id, sender, receiver, content, MessageType::Text, IdGenerator::timestampOf(id), true);
+    }
+}
+
+DROGON_TEST(MessageArchiveRoundTrip) {
+    auto& archive = openArchive();
+    REQUIRE(archive.isOpen());
+
+    // 超过一个块（256 条）的单聊消息，双方交替发送，乱序写入
+    uint64_t conversation = makeConversationId(7, 9);
+    int64_t base = IdGenerator::firstIdAt(1735689600000LL);
+    std::vector<Message> messages;
+    for (int i = 0; i < 300; ++i) {
+        int64_t id = base + i * 3;
+        messages.push_back(i % 2 ? directMessage(id, 9, 7, "m" + std::to_string(i))
+                                 : directMessage(id, 7, 9, "m" + std::to_string(i)));
+    }
+    messages[10].timestamp += 5;
+    messages[11].message_type = MessageType::Image;
+    messages[12].is_read = false;
+    std::vector<Message> shuffled(messages.rbegin(), messages.rend());
+    REQUIRE(archive.append(conversation, std::move(shuffled)));
+    REQUIRE(archive.sync());
+
+    auto latest = archive.readBefore(conversation, 0, 20);
+    REQUIRE(latest.size() == 20);
+    CHECK(latest.front().id == messages[280].id);
+    CHECK(latest.back().id == messages[299].id);
+    CHECK(latest.back().content == "m299");
+    CHECK(latest.back().sender_id == 9);
+    CHECK(latest.back().receiver_id == 7);
+
+    auto page = archive.readAfter(conversation, messages[5].id, 10);
+    REQUIRE(page.size() == 10);
+    CHECK(page.front().id == messages[6].id);
+    CHECK(page[4].timestamp == messages[10].timestamp);
+    CHECK(page[5].message_type == MessageType::Image);
+    CHECK(!page[6].is_read);
+    CHECK(page[7].is_read);
+
+    // 跨块分页
+    auto older = archive.readBefore(conversation, messages[260].id, 10);
+    REQUIRE(older.size() == 10);
+    CHECK(older.front().id == messages[250].id);
+    CHECK(older.back().id == messages[259].id);
+
+    auto found = archive.find(messages[123].id);
+    CHECK(found.id == messages[123].id);
+    CHECK(found.content == "m123");
+    CHECK(archive.find(messages[123].id + 1).id == 0);
+
+    CHECK(archive.mayHaveBetween(conversation, 0, 0));
+    CHECK(!archive.mayHaveBetween(conversation, messages[299].id, 0));
+    CHECK(!archive.mayHaveBetween(makeConversationId(7, 10), 0, 0));
+}
+
+DROGON_TEST(MessageArchiveRoomAndDuplicates) {
+    auto& archive = openArchive();
+    REQUIRE(archive.isOpen());
+
+    uint64_t conversation = makeRoomConversationId(42);
+    int64_t base = IdGenerator::firstIdAt(1735776000000LL);
+    std::vector<Message> messages;
+    for (int i = 0; i < 5; ++i) {
+        Message message(base + i, 100 + i, 0, "r" + std::to_string(i), MessageType::Text,
+                        IdGenerator::timestampOf(base + i), false);
+        message.room_id = 42;
+        messages.push_back(std::move(message));
+    }
+    // 迁移中途崩溃后同一批消息会被再归档一次
+    auto copy = messages;
+    REQUIRE(archive.append(conversation, std::move(copy)));
+    copy = messages;
+    REQUIRE(archive.append(conversation, std::move(copy)));
+
+    auto all = archive.readAfter(conversation, 0, 50);
+    REQUIRE(all.size() == 5);
+    for (size_t i = 0; i < all.size(); ++i) {
+        CHECK(all[i].id == messages[i].id);
+        CHECK(all[i].room_id == 42);
+        CHECK(all[i].receiver_id == 0);
+        CHECK(all[i].sender_id == messages[i].sender_id);
+        CHECK(all[i].content == messages[i].content);
+    }
+    CHECK(archive.readBefore(conversation, messages[2].id, 50).size() == 2);
+}
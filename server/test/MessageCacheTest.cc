@@ -0,0 +1,114 @@
+#include <drogon/drogon_test.h>
+#include "services/MessageCache.h"
+#include <string>
+#include <vector>
+
+using namespace im_server;
+
+namespace {
+    constexpr int64_t kAlice = 1;
+    constexpr int64_t kBob = 2;
+
+    Message makeMessage(int64_t id) {
+        return Message(id, kAlice, kBob, "m" + std::to_string(id), MessageType::Text, id);
+    }
+
+    // 库中 [first, last] 的消息，模拟数据库返回的最新一页
+    std::vector<Message> page(int64_t first, int64_t last) {
+        std::vector<Message> messages;
+        for (int64_t id = first; id <= last; ++id) {
+            messages.push_back(makeMessage(id));
+        }
+        return messages;
+    }
+
+    std::vector<int64_t> idsOf(const std::vector<Message>& messages) {
+        std::vector<int64_t> ids;
+        for (const auto& message : messages) {
+            ids.push_back(message.id);
+        }
+        return ids;
+    }
+}
+
+DROGON_TEST(MessageCacheSeedLatest) {
+    auto& cache = MessageCache::instance();
+    cache.configure(1024 * 1024, 200, std::chrono::milliseconds(0));
+    const auto conversation = makeConversationId(kAlice, kBob);
+    cache.invalidate(conversation);
+
+    // 读库、合并之间没有写入：最新一页进入缓存，后续分页直接命中
+    auto generation = cache.generation(conversation);
+    cache.seedLatest(conversation, page(10, 19), false, generation);
+    cache.append(makeMessage(20));
+    auto latest = cache.lookup(conversation, 0, 0, 5);
+    REQUIRE(latest.has_value());
+    CHECK(idsOf(*latest) == std::vector<int64_t>({16, 17, 18, 19, 20}));
+    auto older = cache.lookup(conversation, 15, 0, 5);
+    REQUIRE(older.has_value());
+    CHECK(idsOf(*older) == std::vector<int64_t>({10, 11, 12, 13, 14}));
+    // 早于 floorId 的部分无法回答
+    CHECK(!cache.lookup(conversation, 11, 0, 5).has_value());
+    cache.invalidate(conversation);
+}
+
+DROGON_TEST(MessageCacheSeedAfterConcurrentAppend) {
+    auto& cache = MessageCache::instance();
+    cache.configure(1024 * 1024, 200, std::chrono::milliseconds(0));
+    const auto conversation = makeConversationId(kAlice, kBob);
+    cache.invalidate(conversation);
+
+    // 1. 读最新一页之前取 generation，库中此时只有 [10, 19]
+    auto generation = cache.generation(conversation);
+    auto fromDb = page(10, 19);
+
+    // 2. 读库之后两条消息先后提交：id 较大的 30 先提交、以它建立条目（floorId = 30），
+    //    id 较小的 25 后提交，低于 floorId 被丢弃
+    cache.append(makeMessage(30));
+    cache.append(makeMessage(25));
+
+    // 3. 读库回调到达。按这一页把 floorId 降到 10 会声称 [10, +inf) 完整，但 25 不在其中
+    cache.seedLatest(conversation, fromDb, false, generation);
+
+    auto latest = cache.lookup(conversation, 0, 0, 3);
+    CHECK(!latest.has_value() || idsOf(*latest) == std::vector<int64_t>({19, 25, 30}));
+    auto after = cache.lookup(conversation, 0, 19, 10);
+    CHECK(!after.has_value() || idsOf(*after) == std::vector<int64_t>({25, 30}));
+    // 缓存仍能回答它确实完整的部分
+    auto newest = cache.lookup(conversation, 0, 0, 1);
+    REQUIRE(newest.has_value());
+    CHECK(idsOf(*newest) == std::vector<int64_t>({30}));
+
+    // 重新读库（此时库中已有 25 和 30）后可以正常合并
+    generation = cache.generation(conversation);
+    auto reread = page(10, 19);
+    reread.push_back(makeMessage(25));
+    reread.push_back(makeMessage(30));
+    cache.seedLatest(conversation, reread, false, generation);
+    latest = cache.lookup(conversation, 0, 0, 3);
+    REQUIRE(latest.has_value());
+    CHECK(idsOf(*latest) == std::vector<int64_t>({19, 25, 30}));
+    cache.invalidate(conversation);
+}
+
+DROGON_TEST(MessageCacheSeedAfterInvalidate) {
+    auto& cache = MessageCache::instance();
+    cache.configure(1024 * 1024, 200, std::chrono::milliseconds(0));
+    const auto conversation = makeConversationId(kAlice, kBob);
+    cache.invalidate(conversation);
+
+    // 读库之后其他节点写入了 20 并通过集群总线使条目失效，这一页已经过时，不能建立条目
+    auto generation = cache.generation(conversation);
+    auto fromDb = page(10, 19);
+    cache.invalidate(conversation);
+    cache.seedLatest(conversation, fromDb, true, generation);
+    CHECK(!cache.lookup(conversation, 0, 0, 5).has_value());
+
+    // 不足一页（complete）时整个会话都由缓存回答
+    generation = cache.generation(conversation);
+    cache.seedLatest(conversation, page(1, 3), true, generation);
+    auto all = cache.lookup(conversation, 0, 0, 10);
+    REQUIRE(all.has_value());
+    CHECK(idsOf(*all) == std::vector<int64_t>({1, 2, 3}));
+    cache.invalidate(conversation);
+}
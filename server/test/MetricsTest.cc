@@ -0,0 +1,92 @@
+#include <drogon/drogon_test.h>
+#include "utils/Metrics.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace im_server;
+
+namespace {
+    using Histogram = Metrics::Histogram;
+
+    // render() 输出中某一行（不含换行）是否存在
+    bool hasLine(const std::string& text, const std::string& line) {
+        return text.find(line + "\n") != std::string::npos;
+    }
+}
+
+DROGON_TEST(MetricsHistogramBuckets) {
+    // 小值一一对应
+    for (uint64_t value = 0; value < Histogram::kSubBuckets; ++value) {
+        CHECK(Histogram::bucketOf(value) == value);
+        CHECK(Histogram::upperBound(value) == value);
+    }
+
+    // 桶连续覆盖：每个值落在 (上一个桶的上界, 本桶上界] 内，且上界相对误差不超过 1 / kSubBuckets
+    uint64_t checked = 0;
+    for (uint64_t value = 1; value < (1ULL << Histogram::kMaxExponent); value = value * 17 / 16 + 1) {
+        auto bucket = Histogram::bucketOf(value);
+        REQUIRE(bucket < Histogram::kBuckets);
+        CHECK(Histogram::upperBound(bucket) >= value);
+        CHECK(bucket == 0 || Histogram::upperBound(bucket - 1) < value);
+        CHECK(Histogram::upperBound(bucket) - value <= value / Histogram::kSubBuckets);
+        ++checked;
+    }
+    CHECK(checked > 100);
+
+    // 每个桶的上界落回本桶，下一个值进入下一个桶
+    for (size_t bucket = 0; bucket + 1 < Histogram::kBuckets; ++bucket) {
+        auto bound = Histogram::upperBound(bucket);
+        CHECK(Histogram::bucketOf(bound) == bucket);
+        CHECK(Histogram::bucketOf(bound + 1) == bucket + 1);
+    }
+
+    // 超出范围的值落入最后一个桶
+    CHECK(Histogram::bucketOf(1ULL << (Histogram::kMaxExponent + 1)) == Histogram::kBuckets - 1);
+    CHECK(Histogram::bucketOf(UINT64_MAX) == Histogram::kBuckets - 1);
+}
+
+DROGON_TEST(MetricsHistogramRender) {
+    auto& histogram = Metrics::instance().histogram("test_latency_seconds", "Test latency", "op=\"a\"");
+    for (uint64_t micros : {10, 40, 90, 900, 3000, 20000000}) {
+        histogram.observe(micros);
+    }
+    auto snapshot = histogram.snapshot();
+    CHECK(snapshot.count == 6);
+    CHECK(snapshot.sum == 20004040);
+
+    auto text = Metrics::instance().render();
+    CHECK(hasLine(text, "# TYPE test_latency_seconds histogram"));
+    CHECK(hasLine(text, "test_latency_seconds_bucket{op=\"a\",le=\"5e-05\"} 2"));
+    CHECK(hasLine(text, "test_latency_seconds_bucket{op=\"a\",le=\"0.0001\"} 3"));
+    CHECK(hasLine(text, "test_latency_seconds_bucket{op=\"a\",le=\"0.001\"} 4"));
+    CHECK(hasLine(text, "test_latency_seconds_bucket{op=\"a\",le=\"0.005\"} 5"));
+    CHECK(hasLine(text, "test_latency_seconds_bucket{op=\"a\",le=\"10\"} 5"));
+    CHECK(hasLine(text, "test_latency_seconds_bucket{op=\"a\",le=\"+Inf\"} 6"));
+    CHECK(hasLine(text, "test_latency_seconds_sum{op=\"a\"} 20.00404"));
+    CHECK(hasLine(text, "test_latency_seconds_count{op=\"a\"} 6"));
+}
+
+DROGON_TEST(MetricsCounterAcrossThreads) {
+    // 线程数超过 kMaxThreads，后来的线程共用最后一个槽位
+    auto& counter = Metrics::instance().counter("test_events_total", "Test events");
+    auto& histogram = Metrics::instance().histogram("test_threads_seconds", "Test histogram");
+    constexpr int kThreads = static_cast<int>(Metrics::kMaxThreads) + 16;
+    constexpr int kPerThread = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&counter, &histogram]() {
+            for (int i = 0; i < kPerThread; ++i) {
+                counter.inc();
+                histogram.observe(100);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(counter.value() == static_cast<uint64_t>(kThreads) * kPerThread);
+    CHECK(histogram.snapshot().count == static_cast<uint64_t>(kThreads) * kPerThread);
+    CHECK(&Metrics::instance().counter("test_events_total", "Test events") == &counter);
+    CHECK(hasLine(Metrics::instance().render(), "test_events_total " + std::to_string(kThreads * kPerThread)));
+}
@@ -0,0 +1,64 @@
+#include <drogon/drogon_test.h>
+#include "utils/TimeUtil.h"
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+using namespace im_server;
+
+namespace {
+    // 偏移缓存按线程保存，测试统一在 UTC 下运行，且在第一次格式化之前设置
+    void useUtc() {
+        ::setenv("TZ", "UTC", 1);
+        ::tzset();
+    }
+}
+
+DROGON_TEST(TimeUtilFormat) {
+    useUtc();
+    CHECK(TimeUtil::formatMillis(0) == "1970-01-01 00:00:00.000");
+    CHECK(TimeUtil::formatMillis(1704067200000LL) == "2024-01-01 00:00:00.000");
+    CHECK(TimeUtil::formatMillis(1709164800123LL) == "2024-02-29 00:00:00.123");
+    CHECK(TimeUtil::formatMillis(951782400000LL) == "2000-02-29 00:00:00.000");
+    CHECK(TimeUtil::formatMillis(-1) == "1969-12-31 23:59:59.999");
+
+    // 同一分钟内只改写秒和毫秒，跨分钟、跨日要重新生成
+    CHECK(TimeUtil::formatMillis(1704067259999LL) == "2024-01-01 00:00:59.999");
+    CHECK(TimeUtil::formatMillis(1704067260000LL) == "2024-01-01 00:01:00.000");
+    CHECK(TimeUtil::formatMillis(1704153599007LL) == "2024-01-01 23:59:59.007");
+    CHECK(TimeUtil::formatMillis(1704153600050LL) == "2024-01-02 00:00:00.050");
+
+    CHECK(TimeUtil::formatTimestamp(static_cast<std::time_t>(1704067200)) == "2024-01-01 00:00:00");
+}
+
+DROGON_TEST(TimeUtilParse) {
+    useUtc();
+    CHECK(TimeUtil::parseMillis("2024-01-01 00:00:00") == 1704067200000LL);
+    CHECK(TimeUtil::parseMillis("2024-01-01T00:00:00.250") == 1704067200250LL);
+    CHECK(TimeUtil::parseMillis("1969-12-31 23:59:58.500") == -1500);
+    CHECK(TimeUtil::stringToTime("2024-02-29 12:30:15") == static_cast<std::time_t>(1709209815));
+
+    // 格式错误或字段越界
+    CHECK(TimeUtil::parseMillis("") == -1);
+    CHECK(TimeUtil::parseMillis("2024-01-01") == -1);
+    CHECK(TimeUtil::parseMillis("2024-01-01 00:00:00.5") == -1);
+    CHECK(TimeUtil::parseMillis("2024/01/01 00:00:00") == -1);
+    CHECK(TimeUtil::parseMillis("2023-02-29 00:00:00") == -1);
+    CHECK(TimeUtil::parseMillis("2024-13-01 00:00:00") == -1);
+    CHECK(TimeUtil::parseMillis("2024-01-01 24:00:00") == -1);
+    CHECK(TimeUtil::parseMillis("2024-01-01 00:60:00") == -1);
+    CHECK(TimeUtil::parseMillis("2024-01-0a 00:00:00") == -1);
+    CHECK(TimeUtil::stringToTime("not a time") == static_cast<std::time_t>(-1));
+}
+
+DROGON_TEST(TimeUtilRoundTrip) {
+    useUtc();
+    // 步长不整除分钟和天，覆盖缓存命中和失效两种路径
+    for (int64_t millis = 946684800000LL; millis < 4102444800000LL; millis += 7919LL * 3600 * 1000 + 12345) {
+        auto text = TimeUtil::formatMillis(millis);
+        CHECK(text.size() == TimeUtil::kTimestampLength);
+        CHECK(TimeUtil::parseMillis(text) == millis);
+    }
+    auto now = TimeUtil::nowMillis();
+    CHECK(TimeUtil::parseMillis(TimeUtil::formatMillis(now)) == now);
+}
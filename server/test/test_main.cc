@@ -0,0 +1,7 @@
+#define DROGON_TEST_MAIN
+#include <drogon/drogon_test.h>
+
+// 单元测试只覆盖不依赖事件循环和数据库的模块，不需要启动 app()
+int main(int argc, char** argv) {
+    return drogon::test::run(argc, argv);
+}